@@ -0,0 +1,79 @@
+#version 450 core
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNormal;
+layout(location = 2) in vec2 inTexCoord;
+layout(location = 3) in uvec4 inJoints;
+layout(location = 4) in vec4 inWeights;
+
+struct BakedClip
+{
+	uint firstFrame;
+	uint frameCount;
+	float framesPerSecond;
+	float duration;
+};
+
+struct CrowdInstance
+{
+	mat4 model;
+	uint clipId;
+	float timeOffset;
+	uint padding0;
+	uint padding1;
+};
+
+// rows of half precision RGBA texels, three per bone
+layout(std430, set = 0, binding = 0) readonly buffer BakedBones { uvec2 texels[]; } bakedBones;
+layout(std430, set = 0, binding = 1) readonly buffer BakedClips { BakedClip clips[]; } bakedClips;
+layout(std430, set = 0, binding = 2) readonly buffer CrowdInstances { CrowdInstance instances[]; } crowd;
+
+layout(push_constant) uniform CrowdConstants
+{
+	mat4 viewProjection;
+	float time;
+	uint boneCount;
+} constants;
+
+layout(location = 0) out vec3 fragPos;
+
+vec4 fetchRow(uint frame, uint bone, uint row)
+{
+	uvec2 texel = bakedBones.texels[(frame * constants.boneCount + bone) * 3 + row];
+	return vec4(unpackHalf2x16(texel.x), unpackHalf2x16(texel.y));
+}
+
+mat4 fetchBone(uint frame, uint bone)
+{
+	vec4 row0 = fetchRow(frame, bone, 0);
+	vec4 row1 = fetchRow(frame, bone, 1);
+	vec4 row2 = fetchRow(frame, bone, 2);
+	return transpose(mat4(row0, row1, row2, vec4(0.0, 0.0, 0.0, 1.0)));
+}
+
+void main()
+{
+	CrowdInstance instance = crowd.instances[gl_InstanceIndex];
+	BakedClip clip = bakedClips.clips[instance.clipId];
+
+	// wrap over the duration, the last baked frame may cover only part of a frame interval
+	float seconds = (0.0 < clip.duration) ? mod(constants.time + instance.timeOffset, clip.duration) : 0.0;
+	float frameTime = seconds * clip.framesPerSecond;
+	uint frame = min(uint(frameTime), clip.frameCount - 1);
+	uint nextFrame = (frame + 1) % clip.frameCount;
+	// the last frame blends back to the first over what is left of the clip
+	float frameEnd = min(float(frame + 1), clip.duration * clip.framesPerSecond);
+	float blend = clamp((frameTime - float(frame)) / max(frameEnd - float(frame), 1e-6), 0.0, 1.0);
+
+	mat4 skin = mat4(0.0);
+	for (int i = 0; i < 4; i++)
+	{
+		mat4 current = fetchBone(clip.firstFrame + frame, inJoints[i]);
+		mat4 next = fetchBone(clip.firstFrame + nextFrame, inJoints[i]);
+		skin += inWeights[i] * mix(current, next, blend);
+	}
+
+	vec4 worldPos = instance.model * skin * vec4(inPosition, 1.0);
+	gl_Position = constants.viewProjection * worldPos;
+	fragPos = worldPos.xyz;
+}
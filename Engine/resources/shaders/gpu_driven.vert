@@ -0,0 +1,32 @@
+#version 450 core
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNormal;
+
+struct Instance
+{
+	mat4 model;
+	vec4 boundingSphere;
+	uint meshIndex;
+	uint materialIndex;
+	uint bucket;
+	uint padding;
+};
+
+// firstInstance of each culled draw is the index of the instance
+layout(std430, set = 0, binding = 0) readonly buffer Instances { Instance instances[]; };
+
+layout(push_constant) uniform DrawConstants
+{
+	mat4 viewProjection;
+} constants;
+
+layout(location = 0) out vec3 fragPos;
+
+void main()
+{
+	Instance instance = instances[gl_InstanceIndex];
+	vec4 worldPos = instance.model * vec4(inPosition, 1.0);
+	gl_Position = constants.viewProjection * worldPos;
+	fragPos = worldPos.xyz;
+}
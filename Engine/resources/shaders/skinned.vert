@@ -0,0 +1,41 @@
+#version 450 core
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNormal;
+layout(location = 2) in vec2 inTexCoord;
+layout(location = 3) in uvec4 inJoints;
+layout(location = 4) in vec4 inWeights;
+
+// skinning matrices of all skinned instances of the frame, three rows per bone
+layout(std430, set = 0, binding = 0) readonly buffer BonePalette { vec4 rows[]; } palette;
+
+layout(set = 1, binding = 0) uniform CameraData
+{
+	mat4 viewProjection;
+} camera;
+
+layout(push_constant) uniform SkinnedConstants
+{
+	mat4 model;
+	uint paletteOffset;
+} constants;
+
+layout(location = 0) out vec3 fragPos;
+
+mat4 fetchBone(uint bone)
+{
+	uint first = (constants.paletteOffset + bone) * 3;
+	return transpose(mat4(palette.rows[first], palette.rows[first + 1], palette.rows[first + 2], vec4(0.0, 0.0, 0.0, 1.0)));
+}
+
+void main()
+{
+	mat4 skin = inWeights.x * fetchBone(inJoints.x)
+		+ inWeights.y * fetchBone(inJoints.y)
+		+ inWeights.z * fetchBone(inJoints.z)
+		+ inWeights.w * fetchBone(inJoints.w);
+
+	vec4 worldPos = constants.model * skin * vec4(inPosition, 1.0);
+	gl_Position = camera.viewProjection * worldPos;
+	fragPos = worldPos.xyz;
+}
@@ -100,10 +100,11 @@ AssetLoader::~AssetLoader()
  * @brief Function for loading
  * @param scene
  * @param nameToIndex
+ * @param boneCount is the number of bones in the skeleton. Every animation node gets a pose for each of them.
  * @param animationsToFill
  * @return
  */
-size_t loadAnimations(const aiScene* scene, std::map<std::string, uint32_t>& nameToIndex, std::vector<Animation>& animationsToFill)
+size_t loadAnimations(const aiScene* scene, std::map<std::string, uint32_t>& nameToIndex, size_t boneCount, std::vector<Animation>& animationsToFill)
 {
 	size_t loadedAnimations = 0;
 
@@ -121,7 +122,9 @@ size_t loadAnimations(const aiScene* scene, std::map<std::string, uint32_t>& nam
 		uint32_t maxKeys = std::max({ animation->mChannels[0]->mNumPositionKeys,
 									 animation->mChannels[0]->mNumRotationKeys,
 									 animation->mChannels[0]->mNumScalingKeys });
-		newAnimation.animationNodes.resize(maxKeys);
+		// every node holds a pose for each bone of the skeleton
+		const AnimationNode emptyNode{ 0.0, std::vector<Pose>(boneCount) };
+		newAnimation.animationNodes.resize(maxKeys, emptyNode);
 		newAnimation.totalTicks = animation->mDuration;
 		newAnimation.ticksPerSecond = (0 < animation->mTicksPerSecond) ? animation->mTicksPerSecond : 24;
 		newAnimation.duration = animation->mDuration / animation->mTicksPerSecond;
@@ -130,11 +133,12 @@ size_t loadAnimations(const aiScene* scene, std::map<std::string, uint32_t>& nam
 		{
 			aiNodeAnim* animationNode = animation->mChannels[j];
 			std::string boneName = std::string(animationNode->mNodeName.C_Str());
-			if (!nameToIndex.contains(boneName)) // discard control nodes, etc.
+			auto bone = nameToIndex.find(boneName);
+			if (bone == nameToIndex.end() || boneCount <= bone->second) // discard control nodes, etc.
 			{
 				continue;
 			}
-			uint32_t index = nameToIndex[boneName];
+			uint32_t index = bone->second;
 			uint32_t nSca = animationNode->mNumScalingKeys;
 			uint32_t nRot = animationNode->mNumRotationKeys;
 			uint32_t nPos = animationNode->mNumPositionKeys;
@@ -146,7 +150,7 @@ size_t loadAnimations(const aiScene* scene, std::map<std::string, uint32_t>& nam
 			{
 				std::cout << "Warning: " << boneName << " has more keys than the previous maximum. " << numKeys << " > " << maxKeys << std::endl;
 				maxKeys = numKeys;
-				newAnimation.animationNodes.resize(maxKeys);
+				newAnimation.animationNodes.resize(maxKeys, emptyNode);
 			}
 			uint32_t si = 0;
 			uint32_t ri = 0;
@@ -332,7 +336,7 @@ std::vector<GraphicsAsset> AssetLoader::loadModel(std::string path)
 
 
 			// load animations
-			loadAnimations(scene, nameToIndex, asset.animations);
+			loadAnimations(scene, nameToIndex, numBones, asset.animations);
 		} // end of if for bones
 
 
@@ -0,0 +1,91 @@
+#include "AttributeArray.hpp"
+#include "AttributeKernels.hpp"
+#include "CpuFeatures.hpp"
+
+#include <new>
+
+void* allocateAttributeStorage(size_t bytes)
+{
+	if (bytes == 0)
+		return nullptr;
+	void* memory = ::operator new(bytes, std::align_val_t(ATTRIBUTE_ARRAY_ALIGNMENT));
+	return memory;
+}
+
+void freeAttributeStorage(void* memory)
+{
+	if (memory != nullptr)
+		::operator delete(memory, std::align_val_t(ATTRIBUTE_ARRAY_ALIGNMENT));
+}
+
+void addScaledFloats(float* target, const float* source, float factor, size_t count)
+{
+	switch (getSimdLevel())
+	{
+	case SimdLevel::AVX2:
+		addScaledFloatsAvx2(target, source, factor, count);
+		break;
+#if defined(REHTI_SIMD_X86)
+	case SimdLevel::SSE2:
+		addScaledFloatsWith<Lane4>(target, source, factor, count);
+		break;
+#endif
+	default:
+		addScaledFloatsWith<Lane1>(target, source, factor, count);
+		break;
+	}
+}
+
+void addFloats(float* target, const float* source, size_t count)
+{
+	switch (getSimdLevel())
+	{
+	case SimdLevel::AVX2:
+		addFloatsAvx2(target, source, count);
+		break;
+#if defined(REHTI_SIMD_X86)
+	case SimdLevel::SSE2:
+		addFloatsWith<Lane4>(target, source, count);
+		break;
+#endif
+	default:
+		addFloatsWith<Lane1>(target, source, count);
+		break;
+	}
+}
+
+void scaleFloats(float* target, float factor, size_t count)
+{
+	switch (getSimdLevel())
+	{
+	case SimdLevel::AVX2:
+		scaleFloatsAvx2(target, factor, count);
+		break;
+#if defined(REHTI_SIMD_X86)
+	case SimdLevel::SSE2:
+		scaleFloatsWith<Lane4>(target, factor, count);
+		break;
+#endif
+	default:
+		scaleFloatsWith<Lane1>(target, factor, count);
+		break;
+	}
+}
+
+void lerpFloats(float* target, const float* first, const float* second, float factor, size_t count)
+{
+	switch (getSimdLevel())
+	{
+	case SimdLevel::AVX2:
+		lerpFloatsAvx2(target, first, second, factor, count);
+		break;
+#if defined(REHTI_SIMD_X86)
+	case SimdLevel::SSE2:
+		lerpFloatsWith<Lane4>(target, first, second, factor, count);
+		break;
+#endif
+	default:
+		lerpFloatsWith<Lane1>(target, first, second, factor, count);
+		break;
+	}
+}
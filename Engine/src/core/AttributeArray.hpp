@@ -0,0 +1,213 @@
+#pragma once
+
+#include "BasicAttributes.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+constexpr size_t ATTRIBUTE_ARRAY_ALIGNMENT = 32; // one AVX register
+constexpr size_t ATTRIBUTE_ARRAY_PADDING = ATTRIBUTE_ARRAY_ALIGNMENT / sizeof(float);
+
+void* allocateAttributeStorage(size_t bytes);
+void freeAttributeStorage(void* memory);
+
+// Whole span operations, using the widest instruction set the CPU supports.
+void addScaledFloats(float* target, const float* source, float factor, size_t count); ///< target += source * factor
+void addFloats(float* target, const float* source, size_t count);                     ///< target += source
+void scaleFloats(float* target, float factor, size_t count);                          ///< target *= factor
+void lerpFloats(float* target, const float* first, const float* second, float factor, size_t count); ///< target = mix(first, second, factor)
+
+/**
+ * @brief Structure of arrays container for attributes like Position, Velocity or Scale.
+ * Each float component of the attribute lives in its own aligned array, so whole array operations are single vectorized sweeps.
+ * Elements are unordered: removal moves the last element into the hole.
+ * @tparam Attribute is an AttributeBase type whose value consists of floats only.
+ */
+template <typename Attribute>
+class AttributeArray
+{
+public:
+	using ValueType = decltype(Attribute::value);
+	static constexpr size_t COMPONENTS = sizeof(ValueType) / sizeof(float);
+	static_assert(sizeof(ValueType) % sizeof(float) == 0, "AttributeArray supports float based attributes only");
+
+	AttributeArray() = default;
+	explicit AttributeArray(size_t count) { resize(count); }
+	~AttributeArray() { freeAttributeStorage(storage); }
+
+	AttributeArray(const AttributeArray& other) { *this = other; }
+	AttributeArray(AttributeArray&& other) noexcept { swap(other); }
+
+	AttributeArray& operator=(const AttributeArray& other)
+	{
+		if (this == &other)
+			return *this;
+		count = 0;
+		reserve(other.count);
+		for (size_t c = 0; c < COMPONENTS; c++)
+			std::memcpy(component(c), other.component(c), other.count * sizeof(float));
+		count = other.count;
+		return *this;
+	}
+	AttributeArray& operator=(AttributeArray&& other) noexcept
+	{
+		swap(other);
+		return *this;
+	}
+
+	size_t size() const { return count; }
+	size_t capacity() const { return stride; }
+	bool empty() const { return count == 0; }
+
+	void reserve(size_t newCapacity)
+	{
+		if (newCapacity <= stride)
+			return;
+		// every component array starts aligned
+		size_t newStride = (newCapacity + ATTRIBUTE_ARRAY_PADDING - 1) / ATTRIBUTE_ARRAY_PADDING * ATTRIBUTE_ARRAY_PADDING;
+		float* newStorage = static_cast<float*>(allocateAttributeStorage(newStride * COMPONENTS * sizeof(float)));
+		for (size_t c = 0; c < COMPONENTS; c++)
+		{
+			if (0 < count)
+				std::memcpy(newStorage + c * newStride, storage + c * stride, count * sizeof(float));
+		}
+		freeAttributeStorage(storage);
+		storage = newStorage;
+		stride = newStride;
+	}
+
+	/**
+	 * @brief Resizes the array. New elements are zero.
+	 */
+	void resize(size_t newCount)
+	{
+		if (stride < newCount)
+			reserve(std::max(newCount, stride * 2));
+		for (size_t c = 0; count < newCount && c < COMPONENTS; c++)
+			std::memset(component(c) + count, 0, (newCount - count) * sizeof(float));
+		count = newCount;
+	}
+
+	void clear() { count = 0; }
+
+	/**
+	 * @brief Appends an attribute.
+	 * @return index of the new element.
+	 */
+	size_t push_back(const Attribute& attribute)
+	{
+		if (count == stride)
+			reserve(std::max<size_t>(ATTRIBUTE_ARRAY_PADDING, stride * 2));
+		count++;
+		set(count - 1, attribute);
+		return count - 1;
+	}
+
+	/**
+	 * @brief Removes the element by moving the last element into its place.
+	 */
+	void swapRemove(size_t index)
+	{
+		count--;
+		if (index != count)
+			set(index, get(count));
+	}
+
+	Attribute get(size_t index) const
+	{
+		ValueType value;
+		float* components = reinterpret_cast<float*>(&value);
+		for (size_t c = 0; c < COMPONENTS; c++)
+			components[c] = storage[c * stride + index];
+		return Attribute(value);
+	}
+
+	void set(size_t index, const Attribute& attribute)
+	{
+		const float* components = reinterpret_cast<const float*>(&attribute.value);
+		for (size_t c = 0; c < COMPONENTS; c++)
+			storage[c * stride + index] = components[c];
+	}
+
+	/**
+	 * @brief Returns the aligned array of a single component, e.g. all x coordinates.
+	 */
+	float* component(size_t c) { return storage + c * stride; }
+	const float* component(size_t c) const { return storage + c * stride; }
+
+	/**
+	 * @brief this += other * factor, e.g. positions.addScaled(velocities, dt).
+	 */
+	template <typename Other>
+	AttributeArray& addScaled(const AttributeArray<Other>& other, float factor)
+	{
+		checkCompatible(other);
+		for (size_t c = 0; c < COMPONENTS; c++)
+			addScaledFloats(component(c), other.component(c), factor, count);
+		return *this;
+	}
+
+	/**
+	 * @brief this += other.
+	 */
+	template <typename Other>
+	AttributeArray& add(const AttributeArray<Other>& other)
+	{
+		checkCompatible(other);
+		for (size_t c = 0; c < COMPONENTS; c++)
+			addFloats(component(c), other.component(c), count);
+		return *this;
+	}
+
+	/**
+	 * @brief this *= factor.
+	 */
+	AttributeArray& scale(float factor)
+	{
+		for (size_t c = 0; c < COMPONENTS; c++)
+			scaleFloats(component(c), factor, count);
+		return *this;
+	}
+
+	/**
+	 * @brief Component wise linear interpolation of two arrays into this one. Quaternions are not renormalized.
+	 */
+	AttributeArray& lerp(const AttributeArray& first, const AttributeArray& second, float factor)
+	{
+		if (first.count != second.count)
+			throw std::runtime_error("AttributeArray::lerp: arrays differ in size");
+		resize(first.count);
+		for (size_t c = 0; c < COMPONENTS; c++)
+			lerpFloats(component(c), first.component(c), second.component(c), factor, count);
+		return *this;
+	}
+
+	void swap(AttributeArray& other) noexcept
+	{
+		std::swap(storage, other.storage);
+		std::swap(count, other.count);
+		std::swap(stride, other.stride);
+	}
+
+private:
+	template <typename Other>
+	void checkCompatible(const AttributeArray<Other>& other) const
+	{
+		static_assert(AttributeArray<Other>::COMPONENTS == COMPONENTS, "Attributes must have the same number of components");
+		if (other.size() != count)
+			throw std::runtime_error("AttributeArray: arrays differ in size");
+	}
+
+	float* storage = nullptr;
+	size_t count = 0;
+	size_t stride = 0; ///< capacity of each component array, a multiple of ATTRIBUTE_ARRAY_PADDING
+};
+
+using PositionArray = AttributeArray<Position>;
+using ScaleArray = AttributeArray<Scale>;
+using VelocityArray = AttributeArray<Velocity>;
+using AngularVelocityArray = AttributeArray<AngularVelocity>;
+using AccelerationArray = AttributeArray<Acceleration>;
@@ -0,0 +1,29 @@
+#include "AttributeKernels.hpp"
+
+// This file is compiled with AVX2 and FMA enabled. It is only called after CpuFeatures has confirmed support.
+
+#if defined(__AVX2__)
+using WideLane = Lane8;
+#else
+using WideLane = Lane1;
+#endif
+
+void addScaledFloatsAvx2(float* target, const float* source, float factor, size_t count)
+{
+	addScaledFloatsWith<WideLane>(target, source, factor, count);
+}
+
+void addFloatsAvx2(float* target, const float* source, size_t count)
+{
+	addFloatsWith<WideLane>(target, source, count);
+}
+
+void scaleFloatsAvx2(float* target, float factor, size_t count)
+{
+	scaleFloatsWith<WideLane>(target, factor, count);
+}
+
+void lerpFloatsAvx2(float* target, const float* first, const float* second, float factor, size_t count)
+{
+	lerpFloatsWith<WideLane>(target, first, second, factor, count);
+}
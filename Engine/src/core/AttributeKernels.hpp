@@ -0,0 +1,65 @@
+#pragma once
+
+#include "SimdLanes.hpp"
+
+#include <cstddef>
+
+/*
+* Float span kernels behind AttributeArray, shared by the scalar, SSE2 and AVX2 variants.
+* Include only from AttributeArray*.cpp.
+*/
+
+// Variants compiled with AVX2 in AttributeArrayAvx2.cpp.
+void addScaledFloatsAvx2(float* target, const float* source, float factor, size_t count);
+void addFloatsAvx2(float* target, const float* source, size_t count);
+void scaleFloatsAvx2(float* target, float factor, size_t count);
+void lerpFloatsAvx2(float* target, const float* first, const float* second, float factor, size_t count);
+
+namespace
+{
+	template <typename F>
+	inline void addScaledFloatsWith(float* target, const float* source, float factor, size_t count)
+	{
+		F wideFactor = F::broadcast(factor);
+		size_t i = 0;
+		for (; i + F::WIDTH <= count; i += F::WIDTH)
+			fmadd(F::load(source + i), wideFactor, F::load(target + i)).store(target + i);
+		for (; i < count; i++)
+			target[i] += source[i] * factor;
+	}
+
+	template <typename F>
+	inline void addFloatsWith(float* target, const float* source, size_t count)
+	{
+		size_t i = 0;
+		for (; i + F::WIDTH <= count; i += F::WIDTH)
+			(F::load(target + i) + F::load(source + i)).store(target + i);
+		for (; i < count; i++)
+			target[i] += source[i];
+	}
+
+	template <typename F>
+	inline void scaleFloatsWith(float* target, float factor, size_t count)
+	{
+		F wideFactor = F::broadcast(factor);
+		size_t i = 0;
+		for (; i + F::WIDTH <= count; i += F::WIDTH)
+			(F::load(target + i) * wideFactor).store(target + i);
+		for (; i < count; i++)
+			target[i] *= factor;
+	}
+
+	template <typename F>
+	inline void lerpFloatsWith(float* target, const float* first, const float* second, float factor, size_t count)
+	{
+		F wideFactor = F::broadcast(factor);
+		size_t i = 0;
+		for (; i + F::WIDTH <= count; i += F::WIDTH)
+		{
+			F a = F::load(first + i);
+			fmadd(F::load(second + i) - a, wideFactor, a).store(target + i);
+		}
+		for (; i < count; i++)
+			target[i] = first[i] + (second[i] - first[i]) * factor;
+	}
+} // namespace
@@ -1,14 +1,26 @@
 #include "BasicAttributes.hpp"
+#include "CpuFeatures.hpp"
+#include "PoseKernels.hpp"
 
-glm::mat4 Pose::getTransformationMatrix() const
+glm::mat4 AffineTransform::toMat4() const
+{
+	return glm::mat4(
+		rows[0].x, rows[1].x, rows[2].x, 0.f,
+		rows[0].y, rows[1].y, rows[2].y, 0.f,
+		rows[0].z, rows[1].z, rows[2].z, 0.f,
+		rows[0].w, rows[1].w, rows[2].w, 1.f);
+}
+
+AffineTransform Pose::getAffineTransform() const
 {
-	glm::mat4 transformation = glm::mat4(1.0f);
+	AffineTransform transform;
+	composeAffineLanes<Lane1>(this, &transform);
+	return transform;
+}
 
-	glm::mat4 scalingMat = glm::scale(glm::mat4(1.0f), scale.value);
-	glm::mat4 rotatMat = orientation.toMat4();
-	glm::mat4 translMat = glm::translate(glm::mat4(1.0f), position.value);
-	transformation = translMat * rotatMat * scalingMat;
-	return transformation;
+glm::mat4 Pose::getTransformationMatrix() const
+{
+	return getAffineTransform().toMat4();
 }
 
 Pose Pose::interpolate(Pose first, Pose second, float factor)
@@ -20,4 +32,41 @@ Pose Pose::interpolate(Pose first, Pose second, float factor)
 	interpolatedNode.scale = first.scale * inverseWeight + second.scale * normalizedTimeClamped;
 	interpolatedNode.orientation = glm::slerp(first.orientation.value, second.orientation.value, normalizedTimeClamped);
 	return interpolatedNode;
-}
\ No newline at end of file
+}
+
+void Pose::interpolatePoses(const Pose* first, const Pose* second, float factor, size_t count, Pose* posesToFill)
+{
+	float normalizedTimeClamped = glm::clamp(factor, 0.0f, 1.0f);
+	switch (getSimdLevel())
+	{
+	case SimdLevel::AVX2:
+		interpolatePosesAvx2(first, second, normalizedTimeClamped, count, posesToFill);
+		break;
+#if defined(REHTI_SIMD_X86)
+	case SimdLevel::SSE2:
+		interpolatePosesWith<Lane4>(first, second, normalizedTimeClamped, count, posesToFill);
+		break;
+#endif
+	default:
+		interpolatePosesWith<Lane1>(first, second, normalizedTimeClamped, count, posesToFill);
+		break;
+	}
+}
+
+void Pose::composeAffineTransforms(const Pose* poses, size_t count, AffineTransform* transformsToFill)
+{
+	switch (getSimdLevel())
+	{
+	case SimdLevel::AVX2:
+		composeAffineTransformsAvx2(poses, count, transformsToFill);
+		break;
+#if defined(REHTI_SIMD_X86)
+	case SimdLevel::SSE2:
+		composeAffineTransformsWith<Lane4>(poses, count, transformsToFill);
+		break;
+#endif
+	default:
+		composeAffineTransformsWith<Lane1>(poses, count, transformsToFill);
+		break;
+	}
+}
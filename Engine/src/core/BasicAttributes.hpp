@@ -56,12 +56,12 @@ struct AttributeBase
 		value = scalar;
 		return static_cast<Derived&>(*this);
 	}
-	Derived& operator+=(const ValueType& scalar) const {
-		this->value += scalar;
+	Derived& operator+=(const ValueType& scalar) {
+		value += scalar;
 		return static_cast<Derived&>(*this);
 	}
-	Derived& operator-=(const ValueType& scalar) const {
-		this->value -= scalar;
+	Derived& operator-=(const ValueType& scalar) {
+		value -= scalar;
 		return static_cast<Derived&>(*this);
 	}
 	Derived& operator*=(const ValueType& scalar) {
@@ -135,6 +135,16 @@ struct Scale : AttributeBase<Scale, glm::vec3>
 	using AttributeBase<Scale, glm::vec3>::AttributeBase;
 };
 
+/**
+ * @brief Affine transformation stored as the upper three rows of a 4x4 matrix. Translation is in the w components.
+ */
+struct AffineTransform
+{
+	glm::vec4 rows[3];
+
+	glm::mat4 toMat4() const;
+};
+
 struct Pose
 {
 	Position position;
@@ -143,6 +153,29 @@ struct Pose
 
 	static Pose interpolate(Pose first, Pose second, float factor);
 
+	/**
+	 * @brief Interpolates two arrays of poses with the same factor.
+	 * Orientations are blended with normalized lerp, falling back to slerp for pairs that are far apart.
+	 * Uses the widest instruction set the CPU supports.
+	 * @param first poses at factor 0.
+	 * @param second poses at factor 1.
+	 * @param factor is clamped to [0, 1].
+	 * @param count of poses in each array.
+	 * @param posesToFill receives the interpolated poses. May be the same array as first or second.
+	 */
+	static void interpolatePoses(const Pose* first, const Pose* second, float factor, size_t count, Pose* posesToFill);
+
+	/**
+	 * @brief Composes translation, rotation and scale of each pose straight into an affine transform.
+	 * Uses the widest instruction set the CPU supports.
+	 * @param poses to compose.
+	 * @param count of poses.
+	 * @param transformsToFill receives count transforms.
+	 */
+	static void composeAffineTransforms(const Pose* poses, size_t count, AffineTransform* transformsToFill);
+
+	AffineTransform getAffineTransform() const;
+
 	glm::mat4 getTransformationMatrix() const;
 };
 
@@ -0,0 +1,19 @@
+#include "PoseKernels.hpp"
+
+// This file is compiled with AVX2 and FMA enabled. It is only called after CpuFeatures has confirmed support.
+
+#if defined(__AVX2__)
+using WideLane = Lane8;
+#else
+using WideLane = Lane1;
+#endif
+
+void composeAffineTransformsAvx2(const Pose* poses, size_t count, AffineTransform* transformsToFill)
+{
+	composeAffineTransformsWith<WideLane>(poses, count, transformsToFill);
+}
+
+void interpolatePosesAvx2(const Pose* first, const Pose* second, float factor, size_t count, Pose* posesToFill)
+{
+	interpolatePosesWith<WideLane>(first, second, factor, count, posesToFill);
+}
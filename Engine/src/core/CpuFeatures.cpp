@@ -0,0 +1,68 @@
+#include "CpuFeatures.hpp"
+
+#include <atomic>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#define REHTI_X86_MSVC
+#elif defined(__x86_64__) || defined(__i386__)
+#define REHTI_X86_GNU
+#endif
+
+SimdLevel detectSimdLevel()
+{
+#if defined(REHTI_X86_MSVC)
+	int info[4];
+	__cpuid(info, 1);
+	bool fma = (info[2] & (1 << 12)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	bool sse2 = (info[3] & (1 << 26)) != 0;
+	bool ymmEnabled = osxsave && (_xgetbv(0) & 0x6) == 0x6; // OS saves the xmm and ymm registers
+	__cpuidex(info, 7, 0);
+	bool avx2 = (info[1] & (1 << 5)) != 0;
+	if (avx && avx2 && fma && ymmEnabled)
+		return SimdLevel::AVX2;
+	if (sse2)
+		return SimdLevel::SSE2;
+	return SimdLevel::SCALAR;
+#elif defined(REHTI_X86_GNU)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return SimdLevel::AVX2;
+	if (__builtin_cpu_supports("sse2"))
+		return SimdLevel::SSE2;
+	return SimdLevel::SCALAR;
+#else
+	return SimdLevel::SCALAR;
+#endif
+}
+
+static const SimdLevel detectedLevel = detectSimdLevel();
+static std::atomic<SimdLevel> levelLimit = SimdLevel::AVX2;
+
+SimdLevel getSimdLevel()
+{
+	SimdLevel limit = levelLimit.load(std::memory_order_relaxed);
+	return (limit < detectedLevel) ? limit : detectedLevel;
+}
+
+void limitSimdLevel(SimdLevel level)
+{
+	levelLimit.store(level, std::memory_order_relaxed);
+}
+
+const char* getSimdLevelName(SimdLevel level)
+{
+	switch (level)
+	{
+	case SimdLevel::SCALAR:
+		return "scalar";
+	case SimdLevel::SSE2:
+		return "SSE2";
+	case SimdLevel::AVX2:
+		return "AVX2";
+	}
+	return "unknown";
+}
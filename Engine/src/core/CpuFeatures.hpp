@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @brief Instruction set levels that have their own kernel variants.
+ */
+enum class SimdLevel : uint8_t
+{
+	SCALAR,
+	SSE2,
+	AVX2, // AVX2 together with FMA
+};
+
+/**
+ * @brief Returns the best instruction set level supported by both the CPU and the OS. Detected once.
+ */
+SimdLevel getSimdLevel();
+
+/**
+ * @brief Restricts kernels to the given level at most. Used by tests and benchmarks to compare variants.
+ * @param level is the highest level to use. Levels above the detected one are ignored.
+ */
+void limitSimdLevel(SimdLevel level);
+
+const char* getSimdLevelName(SimdLevel level);
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "SimdLanes.hpp"
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+/*
+* Frustum test kernels behind FrustumCulling, shared by the scalar, SSE2 and AVX2 variants.
+* Include only from FrustumCulling*.cpp.
+*/
+
+// Variants compiled with AVX2 in FrustumCullingAvx2.cpp. They cull [begin, end) of the component arrays.
+size_t cullSpheresAvx2(const glm::vec4* planes, const float* const* components, size_t begin, size_t end, uint32_t* visibleIndices);
+size_t cullBoxesAvx2(const glm::vec4* planes, const float* const* components, size_t begin, size_t end, uint32_t* visibleIndices);
+
+namespace
+{
+	/// Appends begin + i for every set bit i of the mask.
+	inline size_t appendVisible(uint32_t mask, size_t begin, uint32_t* visibleIndices, size_t visibleCount)
+	{
+		while (mask != 0)
+		{
+			visibleIndices[visibleCount++] = static_cast<uint32_t>(begin + std::countr_zero(mask));
+			mask &= mask - 1;
+		}
+		return visibleCount;
+	}
+
+	/// Components are center x, y, z and radius.
+	struct SphereTest
+	{
+		template <typename F>
+		static uint32_t outside(const glm::vec4* planes, const float* const* components, size_t i)
+		{
+			F x = F::load(components[0] + i);
+			F y = F::load(components[1] + i);
+			F z = F::load(components[2] + i);
+			F negativeRadius = F::broadcast(0.f) - F::load(components[3] + i);
+			uint32_t outsideMask = 0;
+			for (int p = 0; p < 6; p++)
+			{
+				F distance = fmadd(F::broadcast(planes[p].x), x, fmadd(F::broadcast(planes[p].y), y, fmadd(F::broadcast(planes[p].z), z, F::broadcast(planes[p].w))));
+				outsideMask |= lessThanMask(distance, negativeRadius);
+			}
+			return outsideMask;
+		}
+	};
+
+	/// Components are center x, y, z and extents x, y, z.
+	struct BoxTest
+	{
+		template <typename F>
+		static uint32_t outside(const glm::vec4* planes, const float* const* components, size_t i)
+		{
+			F x = F::load(components[0] + i);
+			F y = F::load(components[1] + i);
+			F z = F::load(components[2] + i);
+			F ex = F::load(components[3] + i);
+			F ey = F::load(components[4] + i);
+			F ez = F::load(components[5] + i);
+			uint32_t outsideMask = 0;
+			for (int p = 0; p < 6; p++)
+			{
+				F distance = fmadd(F::broadcast(planes[p].x), x, fmadd(F::broadcast(planes[p].y), y, fmadd(F::broadcast(planes[p].z), z, F::broadcast(planes[p].w))));
+				// projected half size of the box on the plane normal
+				F radius = fmadd(F::broadcast(fabsf(planes[p].x)), ex, fmadd(F::broadcast(fabsf(planes[p].y)), ey, F::broadcast(fabsf(planes[p].z)) * ez));
+				outsideMask |= lessThanMask(distance, F::broadcast(0.f) - radius);
+			}
+			return outsideMask;
+		}
+	};
+
+	/// Wide lanes for whole blocks, a scalar lane for the tail.
+	template <typename F, typename Test>
+	inline size_t cullWith(const glm::vec4* planes, const float* const* components, size_t begin, size_t end, uint32_t* visibleIndices)
+	{
+		constexpr uint32_t ALL_LANES = (1u << F::WIDTH) - 1;
+		size_t visibleCount = 0;
+		size_t i = begin;
+		for (; i + F::WIDTH <= end; i += F::WIDTH)
+			visibleCount = appendVisible(~Test::template outside<F>(planes, components, i) & ALL_LANES, i, visibleIndices, visibleCount);
+		for (; i < end; i++)
+			visibleCount = appendVisible(~Test::template outside<Lane1>(planes, components, i) & 1u, i, visibleIndices, visibleCount);
+		return visibleCount;
+	}
+} // namespace
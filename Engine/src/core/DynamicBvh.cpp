@@ -0,0 +1,553 @@
+#include "DynamicBvh.hpp"
+#include "JobSystem.hpp"
+
+#include <algorithm>
+#include <queue>
+#include <utility>
+
+constexpr int BVH_BIN_COUNT = 16;
+constexpr size_t BVH_BATCH_GRAIN = 64;
+
+namespace
+{
+	enum class FrustumOverlap
+	{
+		OUTSIDE,
+		INTERSECTS,
+		INSIDE
+	};
+
+	FrustumOverlap classifyBox(const Frustum& frustum, const Aabb& bounds)
+	{
+		glm::vec3 center = bounds.getCenter();
+		glm::vec3 extents = bounds.getExtents();
+		FrustumOverlap result = FrustumOverlap::INSIDE;
+		for (const glm::vec4& plane : frustum.planes)
+		{
+			float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+			float radius = glm::dot(glm::abs(glm::vec3(plane)), extents);
+			if (distance < -radius)
+				return FrustumOverlap::OUTSIDE;
+			if (distance < radius)
+				result = FrustumOverlap::INTERSECTS;
+		}
+		return result;
+	}
+} // namespace
+
+DynamicBvh::DynamicBvh(float margin, float rebuildRatio)
+	: root(BVH_NULL_NODE), freeList(BVH_NULL_NODE), leafCount(0), hasDirtyNodes(false), margin(margin), rebuildRatio(rebuildRatio),
+	internalArea(0.0), builtCost(0.f)
+{
+}
+
+int32_t DynamicBvh::insert(const Aabb& bounds, uint64_t userData)
+{
+	// insertion rebuilds the path to the root, which must not mix with stale nodes
+	refit();
+	int32_t proxy = allocateNode();
+	nodes[proxy].bounds = makeFatBounds(bounds, glm::vec3(0.f));
+	nodes[proxy].userData = userData;
+	leafBounds[proxy] = bounds;
+	insertLeaf(proxy);
+	leafCount++;
+	return proxy;
+}
+
+void DynamicBvh::remove(int32_t proxy)
+{
+	refit();
+	removeLeaf(proxy);
+	freeNode(proxy);
+	leafCount--;
+}
+
+bool DynamicBvh::move(int32_t proxy, const Aabb& bounds, const glm::vec3& displacement)
+{
+	leafBounds[proxy] = bounds;
+	if (nodes[proxy].bounds.contains(bounds))
+		return false;
+	nodes[proxy].bounds = makeFatBounds(bounds, displacement);
+	markDirty(proxy);
+	return true;
+}
+
+void DynamicBvh::refit()
+{
+	if (!hasDirtyNodes)
+		return;
+	// post order over the dirty nodes only: a node is fixed once none of its children is dirty
+	std::vector<int32_t> stack;
+	stack.push_back(root);
+	while (!stack.empty())
+	{
+		int32_t index = stack.back();
+		Node& node = nodes[index];
+		if (node.isLeaf())
+		{
+			node.dirty = false;
+			stack.pop_back();
+			continue;
+		}
+		bool childPending = false;
+		for (int32_t child : node.children)
+		{
+			if (nodes[child].dirty)
+			{
+				stack.push_back(child);
+				childPending = true;
+			}
+		}
+		if (childPending)
+			continue;
+		setInternalBounds(index, Aabb::merge(nodes[node.children[0]].bounds, nodes[node.children[1]].bounds));
+		node.dirty = false;
+		stack.pop_back();
+	}
+	hasDirtyNodes = false;
+}
+
+void DynamicBvh::rebuild()
+{
+	if (root == BVH_NULL_NODE)
+		return;
+	// keep the leaves, so that proxies survive, and recycle every internal node
+	std::vector<BuildEntry> leaves;
+	leaves.reserve(leafCount);
+	std::vector<int32_t> stack;
+	stack.push_back(root);
+	while (!stack.empty())
+	{
+		int32_t index = stack.back();
+		stack.pop_back();
+		if (nodes[index].isLeaf())
+		{
+			nodes[index].dirty = false;
+			leaves.push_back({ nodes[index].bounds, nodes[index].bounds.getCenter(), index });
+			continue;
+		}
+		stack.push_back(nodes[index].children[0]);
+		stack.push_back(nodes[index].children[1]);
+		freeNode(index);
+	}
+	internalArea = 0.0;
+	hasDirtyNodes = false;
+	root = buildRange(leaves.data(), leaves.size(), BVH_NULL_NODE);
+	builtCost = getCost();
+}
+
+void DynamicBvh::update()
+{
+	refit();
+	if (builtCost * rebuildRatio < getCost())
+		rebuild();
+}
+
+void DynamicBvh::queryOverlaps(const Aabb& bounds, std::vector<int32_t>& proxies) const
+{
+	if (root == BVH_NULL_NODE)
+		return;
+	std::vector<int32_t> stack;
+	stack.push_back(root);
+	while (!stack.empty())
+	{
+		const Node& node = nodes[stack.back()];
+		int32_t index = stack.back();
+		stack.pop_back();
+		if (!node.bounds.overlaps(bounds))
+			continue;
+		if (!node.isLeaf())
+		{
+			stack.push_back(node.children[0]);
+			stack.push_back(node.children[1]);
+		}
+		else if (leafBounds[index].overlaps(bounds))
+		{
+			proxies.push_back(index);
+		}
+	}
+}
+
+void DynamicBvh::querySphere(const glm::vec3& center, float radius, std::vector<int32_t>& proxies) const
+{
+	if (root == BVH_NULL_NODE)
+		return;
+	float radiusSquared = radius * radius;
+	std::vector<int32_t> stack;
+	stack.push_back(root);
+	while (!stack.empty())
+	{
+		const Node& node = nodes[stack.back()];
+		int32_t index = stack.back();
+		stack.pop_back();
+		if (radiusSquared < node.bounds.distanceSquared(center))
+			continue;
+		if (!node.isLeaf())
+		{
+			stack.push_back(node.children[0]);
+			stack.push_back(node.children[1]);
+		}
+		else if (leafBounds[index].distanceSquared(center) <= radiusSquared)
+		{
+			proxies.push_back(index);
+		}
+	}
+}
+
+void DynamicBvh::queryFrustum(const Frustum& frustum, std::vector<int32_t>& proxies) const
+{
+	if (root == BVH_NULL_NODE)
+		return;
+	// the second member tells whether the subtree is already known to be inside
+	std::vector<std::pair<int32_t, bool>> stack;
+	stack.emplace_back(root, false);
+	while (!stack.empty())
+	{
+		auto [index, inside] = stack.back();
+		stack.pop_back();
+		const Node& node = nodes[index];
+		if (!inside)
+		{
+			FrustumOverlap overlap = classifyBox(frustum, node.bounds);
+			if (overlap == FrustumOverlap::OUTSIDE)
+				continue;
+			inside = overlap == FrustumOverlap::INSIDE;
+		}
+		if (!node.isLeaf())
+		{
+			stack.emplace_back(node.children[0], inside);
+			stack.emplace_back(node.children[1], inside);
+		}
+		else if (inside || frustum.containsBox(leafBounds[index].getCenter(), leafBounds[index].getExtents()))
+		{
+			proxies.push_back(index);
+		}
+	}
+}
+
+void DynamicBvh::queryNearest(const glm::vec3& point, size_t k, std::vector<int32_t>& proxies, float maxDistance) const
+{
+	proxies.clear();
+	if (root == BVH_NULL_NODE || k == 0)
+		return;
+	// best first: node distances are lower bounds of the leaves below, so a leaf that comes out is the next nearest
+	using Entry = std::pair<float, int32_t>;
+	std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+	float maxDistanceSquared = maxDistance * maxDistance;
+	queue.emplace(nodes[root].bounds.distanceSquared(point), root);
+	while (!queue.empty() && proxies.size() < k)
+	{
+		auto [distanceSquared, index] = queue.top();
+		queue.pop();
+		if (maxDistanceSquared < distanceSquared)
+			break;
+		const Node& node = nodes[index];
+		if (node.isLeaf())
+		{
+			// leaves are queued twice: first with the fat box, then with the exact one
+			float exactDistance = leafBounds[index].distanceSquared(point);
+			if (exactDistance <= distanceSquared)
+				proxies.push_back(index);
+			else
+				queue.emplace(exactDistance, index);
+			continue;
+		}
+		for (int32_t child : node.children)
+			queue.emplace(nodes[child].bounds.distanceSquared(point), child);
+	}
+}
+
+void DynamicBvh::raycast(const Ray& ray, float maxDistance, const std::function<float(int32_t proxy, float maxDistance)>& callback) const
+{
+	if (root == BVH_NULL_NODE)
+		return;
+	glm::vec3 inverseDirection = 1.f / ray.direction;
+	std::vector<std::pair<int32_t, float>> stack;
+	float rootDistance = nodes[root].bounds.intersectRay(ray.origin, inverseDirection, maxDistance);
+	if (rootDistance != INFINITY)
+		stack.emplace_back(root, rootDistance);
+	while (!stack.empty())
+	{
+		auto [index, entryDistance] = stack.back();
+		stack.pop_back();
+		// a closer hit may have been found since the node was pushed
+		if (maxDistance < entryDistance)
+			continue;
+		const Node& node = nodes[index];
+		if (node.isLeaf())
+		{
+			if (leafBounds[index].intersectRay(ray.origin, inverseDirection, maxDistance) != INFINITY)
+				maxDistance = std::min(maxDistance, callback(index, maxDistance));
+			continue;
+		}
+		float distances[2];
+		for (int c = 0; c < 2; c++)
+			distances[c] = nodes[node.children[c]].bounds.intersectRay(ray.origin, inverseDirection, maxDistance);
+		// the nearer child goes on top
+		int nearChild = distances[1] < distances[0] ? 1 : 0;
+		for (int c : { 1 - nearChild, nearChild })
+		{
+			if (distances[c] != INFINITY)
+				stack.emplace_back(node.children[c], distances[c]);
+		}
+	}
+}
+
+void DynamicBvh::queryOverlapsBatch(const Aabb* boxes, size_t count, std::vector<int32_t>* results) const
+{
+	JobSystem::getInstance().parallelFor(count, BVH_BATCH_GRAIN, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			results[i].clear();
+			queryOverlaps(boxes[i], results[i]);
+		}
+	});
+}
+
+int32_t DynamicBvh::getHeight() const
+{
+	if (root == BVH_NULL_NODE)
+		return 0;
+	int32_t height = 0;
+	std::vector<std::pair<int32_t, int32_t>> stack;
+	stack.emplace_back(root, 1);
+	while (!stack.empty())
+	{
+		auto [index, depth] = stack.back();
+		stack.pop_back();
+		height = std::max(height, depth);
+		if (!nodes[index].isLeaf())
+		{
+			stack.emplace_back(nodes[index].children[0], depth + 1);
+			stack.emplace_back(nodes[index].children[1], depth + 1);
+		}
+	}
+	return height;
+}
+
+float DynamicBvh::getCost() const
+{
+	if (root == BVH_NULL_NODE || nodes[root].isLeaf())
+		return 0.f;
+	return static_cast<float>(internalArea / nodes[root].bounds.getSurfaceArea());
+}
+
+int32_t DynamicBvh::allocateNode()
+{
+	int32_t index = freeList;
+	if (index == BVH_NULL_NODE)
+	{
+		index = static_cast<int32_t>(nodes.size());
+		nodes.emplace_back();
+		leafBounds.emplace_back();
+	}
+	else
+	{
+		freeList = nodes[index].parent;
+	}
+	Node& node = nodes[index];
+	node.bounds = { glm::vec3(0.f), glm::vec3(0.f) };
+	node.parent = BVH_NULL_NODE;
+	node.children[0] = BVH_NULL_NODE;
+	node.children[1] = BVH_NULL_NODE;
+	node.userData = 0;
+	node.dirty = false;
+	return index;
+}
+
+void DynamicBvh::freeNode(int32_t node)
+{
+	nodes[node].parent = freeList;
+	freeList = node;
+}
+
+void DynamicBvh::insertLeaf(int32_t leaf)
+{
+	if (root == BVH_NULL_NODE)
+	{
+		root = leaf;
+		nodes[leaf].parent = BVH_NULL_NODE;
+		return;
+	}
+
+	// descend towards the cheapest sibling, counting the growth of the ancestors as well
+	Aabb leafBox = nodes[leaf].bounds;
+	int32_t index = root;
+	while (!nodes[index].isLeaf())
+	{
+		const Node& node = nodes[index];
+		float area = node.bounds.getSurfaceArea();
+		float combinedArea = Aabb::merge(node.bounds, leafBox).getSurfaceArea();
+		float cost = 2.f * combinedArea;
+		float inheritedCost = 2.f * (combinedArea - area);
+
+		float childCosts[2];
+		for (int c = 0; c < 2; c++)
+		{
+			const Node& child = nodes[node.children[c]];
+			float grownArea = Aabb::merge(child.bounds, leafBox).getSurfaceArea();
+			childCosts[c] = (child.isLeaf() ? grownArea : grownArea - child.bounds.getSurfaceArea()) + inheritedCost;
+		}
+		if (cost < childCosts[0] && cost < childCosts[1])
+			break;
+		index = childCosts[0] < childCosts[1] ? node.children[0] : node.children[1];
+	}
+
+	int32_t sibling = index;
+	int32_t oldParent = nodes[sibling].parent;
+	int32_t newParent = allocateNode();
+	nodes[newParent].parent = oldParent;
+	nodes[newParent].children[0] = sibling;
+	nodes[newParent].children[1] = leaf;
+	setInternalBounds(newParent, Aabb::merge(leafBox, nodes[sibling].bounds));
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+	if (oldParent == BVH_NULL_NODE)
+	{
+		root = newParent;
+	}
+	else
+	{
+		Node& parent = nodes[oldParent];
+		parent.children[parent.children[0] == sibling ? 0 : 1] = newParent;
+	}
+
+	for (index = oldParent; index != BVH_NULL_NODE; index = nodes[index].parent)
+	{
+		const Node& node = nodes[index];
+		setInternalBounds(index, Aabb::merge(nodes[node.children[0]].bounds, nodes[node.children[1]].bounds));
+	}
+}
+
+void DynamicBvh::removeLeaf(int32_t leaf)
+{
+	if (leaf == root)
+	{
+		root = BVH_NULL_NODE;
+		return;
+	}
+
+	// the sibling takes the place of the parent
+	int32_t parent = nodes[leaf].parent;
+	int32_t grandParent = nodes[parent].parent;
+	int32_t sibling = nodes[parent].children[0] == leaf ? nodes[parent].children[1] : nodes[parent].children[0];
+	internalArea -= nodes[parent].bounds.getSurfaceArea();
+	freeNode(parent);
+	nodes[sibling].parent = grandParent;
+	if (grandParent == BVH_NULL_NODE)
+	{
+		root = sibling;
+		return;
+	}
+	Node& node = nodes[grandParent];
+	node.children[node.children[0] == parent ? 0 : 1] = sibling;
+
+	for (int32_t index = grandParent; index != BVH_NULL_NODE; index = nodes[index].parent)
+	{
+		const Node& ancestor = nodes[index];
+		setInternalBounds(index, Aabb::merge(nodes[ancestor.children[0]].bounds, nodes[ancestor.children[1]].bounds));
+	}
+}
+
+void DynamicBvh::markDirty(int32_t node)
+{
+	while (node != BVH_NULL_NODE && !nodes[node].dirty)
+	{
+		nodes[node].dirty = true;
+		node = nodes[node].parent;
+	}
+	hasDirtyNodes = true;
+}
+
+Aabb DynamicBvh::makeFatBounds(const Aabb& bounds, const glm::vec3& displacement) const
+{
+	Aabb fat = { bounds.min - glm::vec3(margin), bounds.max + glm::vec3(margin) };
+	fat.min += glm::min(displacement, glm::vec3(0.f));
+	fat.max += glm::max(displacement, glm::vec3(0.f));
+	return fat;
+}
+
+int32_t DynamicBvh::buildRange(BuildEntry* entries, size_t count, int32_t parent)
+{
+	if (count == 1)
+	{
+		nodes[entries[0].leaf].parent = parent;
+		return entries[0].leaf;
+	}
+
+	Aabb centroidBounds = { entries[0].center, entries[0].center };
+	for (size_t i = 1; i < count; i++)
+		centroidBounds = { glm::min(centroidBounds.min, entries[i].center), glm::max(centroidBounds.max, entries[i].center) };
+
+	// binned SAH along the longest axis of the centroids
+	glm::vec3 centroidSize = centroidBounds.max - centroidBounds.min;
+	int axis = centroidSize.x < centroidSize.y ? (centroidSize.y < centroidSize.z ? 2 : 1) : (centroidSize.x < centroidSize.z ? 2 : 0);
+	size_t middle = count / 2;
+	if (2 < count && 0.f < centroidSize[axis])
+	{
+		float binScale = BVH_BIN_COUNT / centroidSize[axis];
+		float axisMin = centroidBounds.min[axis];
+		auto getBin = [&](const BuildEntry& entry) {
+			return std::min(static_cast<int>((entry.center[axis] - axisMin) * binScale), BVH_BIN_COUNT - 1);
+		};
+		Aabb binBounds[BVH_BIN_COUNT];
+		size_t binCounts[BVH_BIN_COUNT] = {};
+		for (size_t i = 0; i < count; i++)
+		{
+			int bin = getBin(entries[i]);
+			binBounds[bin] = binCounts[bin] == 0 ? entries[i].bounds : Aabb::merge(binBounds[bin], entries[i].bounds);
+			binCounts[bin]++;
+		}
+
+		// right to left sweep first, then evaluate each split on the way back
+		float rightAreas[BVH_BIN_COUNT];
+		size_t rightCounts[BVH_BIN_COUNT];
+		Aabb accumulated{};
+		size_t accumulatedCount = 0;
+		for (int bin = BVH_BIN_COUNT - 1; 0 < bin; bin--)
+		{
+			if (binCounts[bin] != 0)
+				accumulated = accumulatedCount == 0 ? binBounds[bin] : Aabb::merge(accumulated, binBounds[bin]);
+			accumulatedCount += binCounts[bin];
+			rightAreas[bin] = accumulatedCount == 0 ? 0.f : accumulated.getSurfaceArea();
+			rightCounts[bin] = accumulatedCount;
+		}
+		int bestBin = -1;
+		float bestCost = INFINITY;
+		accumulatedCount = 0;
+		for (int bin = 0; bin < BVH_BIN_COUNT - 1; bin++)
+		{
+			if (binCounts[bin] != 0)
+				accumulated = accumulatedCount == 0 ? binBounds[bin] : Aabb::merge(accumulated, binBounds[bin]);
+			accumulatedCount += binCounts[bin];
+			if (accumulatedCount == 0 || rightCounts[bin + 1] == 0)
+				continue;
+			float cost = accumulated.getSurfaceArea() * accumulatedCount + rightAreas[bin + 1] * rightCounts[bin + 1];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestBin = bin;
+			}
+		}
+		if (0 <= bestBin)
+		{
+			BuildEntry* split = std::partition(entries, entries + count, [&](const BuildEntry& entry) { return getBin(entry) <= bestBin; });
+			middle = static_cast<size_t>(split - entries);
+		}
+	}
+
+	int32_t index = allocateNode();
+	nodes[index].parent = parent;
+	int32_t first = buildRange(entries, middle, index);
+	int32_t second = buildRange(entries + middle, count - middle, index);
+	nodes[index].children[0] = first;
+	nodes[index].children[1] = second;
+	setInternalBounds(index, Aabb::merge(nodes[first].bounds, nodes[second].bounds));
+	return index;
+}
+
+void DynamicBvh::setInternalBounds(int32_t node, const Aabb& bounds)
+{
+	internalArea += static_cast<double>(bounds.getSurfaceArea()) - nodes[node].bounds.getSurfaceArea();
+	nodes[node].bounds = bounds;
+}
@@ -0,0 +1,226 @@
+#pragma once
+
+#include "FrustumCulling.hpp"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+constexpr int32_t BVH_NULL_NODE = -1;
+constexpr float DEFAULT_BVH_MARGIN = 0.1f;
+constexpr float DEFAULT_BVH_REBUILD_RATIO = 1.4f;
+
+/**
+ * @brief Axis aligned bounding box as minimum and maximum corners.
+ */
+struct Aabb
+{
+	glm::vec3 min;
+	glm::vec3 max;
+
+	glm::vec3 getCenter() const { return (min + max) * 0.5f; }
+	glm::vec3 getExtents() const { return (max - min) * 0.5f; }
+	float getSurfaceArea() const
+	{
+		glm::vec3 size = max - min;
+		return 2.f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+	bool contains(const Aabb& other) const
+	{
+		return min.x <= other.min.x && min.y <= other.min.y && min.z <= other.min.z
+			&& other.max.x <= max.x && other.max.y <= max.y && other.max.z <= max.z;
+	}
+	bool overlaps(const Aabb& other) const
+	{
+		return min.x <= other.max.x && min.y <= other.max.y && min.z <= other.max.z
+			&& other.min.x <= max.x && other.min.y <= max.y && other.min.z <= max.z;
+	}
+	/// Squared distance from the point to the box, zero inside.
+	float distanceSquared(const glm::vec3& point) const
+	{
+		glm::vec3 offset = glm::max(glm::max(min - point, point - max), glm::vec3(0.f));
+		return glm::dot(offset, offset);
+	}
+
+	/**
+	 * @brief Slab test of a ray against the box.
+	 * @param origin of the ray.
+	 * @param inverseDirection is one divided by each component of the ray direction.
+	 * @param maxDistance along the ray.
+	 * @return distance where the ray enters the box, zero if it starts inside, or INFINITY if it misses.
+	 */
+	float intersectRay(const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance) const
+	{
+		glm::vec3 toMin = (min - origin) * inverseDirection;
+		glm::vec3 toMax = (max - origin) * inverseDirection;
+		glm::vec3 entry = glm::min(toMin, toMax);
+		glm::vec3 exit = glm::max(toMin, toMax);
+		float enter = std::max(std::max(entry.x, entry.y), std::max(entry.z, 0.f));
+		float leave = std::min(std::min(exit.x, exit.y), std::min(exit.z, maxDistance));
+		return enter <= leave ? enter : INFINITY;
+	}
+
+	static Aabb merge(const Aabb& a, const Aabb& b) { return { glm::min(a.min, b.min), glm::max(a.max, b.max) }; }
+};
+
+/**
+ * @brief Ray with an origin and a direction. Distances along the ray are measured in lengths of the direction.
+ */
+struct Ray
+{
+	glm::vec3 origin;
+	glm::vec3 direction;
+
+	glm::vec3 getPoint(float distance) const { return origin + direction * distance; }
+};
+
+/**
+ * @brief Dynamic bounding volume hierarchy over axis aligned boxes, e.g. the bounds of the scene entities.
+ * Leaves store a fat box grown by a margin, so small movements do not touch the tree at all.
+ * Moves only mark the path to the root, and refit() fixes the marked nodes in one pass. update() also rebuilds
+ * the tree with binned SAH once refitting has degraded it too much.
+ * Queries test the exact boxes of the leaves and must run after refit() or update().
+ */
+class DynamicBvh
+{
+public:
+	/**
+	 * @param margin is added on every side of the leaf boxes.
+	 * @param rebuildRatio is how much the SAH cost may grow over the last build before update() rebuilds.
+	 */
+	explicit DynamicBvh(float margin = DEFAULT_BVH_MARGIN, float rebuildRatio = DEFAULT_BVH_REBUILD_RATIO);
+
+	/**
+	 * @brief Adds a box to the tree.
+	 * @param bounds of the object.
+	 * @param userData is returned by getUserData, e.g. an entity id.
+	 * @return proxy of the box. Stays valid until removed, also across rebuilds.
+	 */
+	int32_t insert(const Aabb& bounds, uint64_t userData);
+
+	/**
+	 * @brief Removes a box from the tree.
+	 * @param proxy returned by insert.
+	 */
+	void remove(int32_t proxy);
+
+	/**
+	 * @brief Moves a box. The tree is only touched if the box leaves its fat box.
+	 * @param proxy returned by insert.
+	 * @param bounds is the new box of the object.
+	 * @param displacement is the expected movement until the next move. The fat box is stretched in its direction.
+	 * @return true if the fat box had to change.
+	 */
+	bool move(int32_t proxy, const Aabb& bounds, const glm::vec3& displacement = glm::vec3(0.f));
+
+	/**
+	 * @brief Recomputes the boxes of the nodes above moved leaves.
+	 */
+	void refit();
+
+	/**
+	 * @brief Rebuilds every internal node top down with binned SAH. Proxies stay valid.
+	 */
+	void rebuild();
+
+	/**
+	 * @brief Refits, and rebuilds if the tree has degraded past the rebuild ratio. Call once per frame after the moves.
+	 */
+	void update();
+
+	/**
+	 * @brief Appends the proxies whose boxes overlap the given box.
+	 */
+	void queryOverlaps(const Aabb& bounds, std::vector<int32_t>& proxies) const;
+
+	/**
+	 * @brief Appends the proxies whose boxes touch the sphere.
+	 */
+	void querySphere(const glm::vec3& center, float radius, std::vector<int32_t>& proxies) const;
+
+	/**
+	 * @brief Appends the proxies whose boxes are inside or intersect the frustum.
+	 * Subtrees completely inside the frustum are appended without further tests.
+	 */
+	void queryFrustum(const Frustum& frustum, std::vector<int32_t>& proxies) const;
+
+	/**
+	 * @brief Finds the k proxies whose boxes are closest to the point, ordered by distance.
+	 * @param point to search from.
+	 * @param k is the maximum number of proxies to return.
+	 * @param proxies is cleared and receives the results.
+	 * @param maxDistance limits the search radius.
+	 */
+	void queryNearest(const glm::vec3& point, size_t k, std::vector<int32_t>& proxies, float maxDistance = INFINITY) const;
+
+	/**
+	 * @brief Visits the proxies whose boxes the ray hits, roughly from near to far.
+	 * @param ray to cast.
+	 * @param maxDistance along the ray.
+	 * @param callback is called with a proxy and the current maximum distance. It returns the new maximum distance,
+	 *		e.g. the distance of a hit on the object, which clips the rest of the traversal.
+	 */
+	void raycast(const Ray& ray, float maxDistance, const std::function<float(int32_t proxy, float maxDistance)>& callback) const;
+
+	/**
+	 * @brief Runs an overlap query per box on the job system.
+	 * @param boxes to query.
+	 * @param count of boxes.
+	 * @param results must hold count vectors. Each is cleared and receives the proxies of its box.
+	 */
+	void queryOverlapsBatch(const Aabb* boxes, size_t count, std::vector<int32_t>* results) const;
+
+	uint64_t getUserData(int32_t proxy) const { return nodes[proxy].userData; }
+	const Aabb& getBounds(int32_t proxy) const { return leafBounds[proxy]; }
+	const Aabb& getFatBounds(int32_t proxy) const { return nodes[proxy].bounds; }
+	size_t getProxyCount() const { return leafCount; }
+	int32_t getHeight() const;
+
+	/**
+	 * @brief Returns the SAH cost of the tree: the summed surface areas of the internal nodes relative to the root.
+	 */
+	float getCost() const;
+
+private:
+	struct Node
+	{
+		Aabb bounds;        ///< fat box for leaves
+		int32_t parent;     ///< next free node while the node is unused
+		int32_t children[2]; ///< BVH_NULL_NODE for leaves
+		uint64_t userData;
+		bool dirty;         ///< bounds are stale, or a leaf below has moved
+
+		bool isLeaf() const { return children[0] == BVH_NULL_NODE; }
+	};
+
+	/// Leaf copied out of the tree for a rebuild, so that the build sweeps contiguous memory.
+	struct BuildEntry
+	{
+		Aabb bounds;
+		glm::vec3 center;
+		int32_t leaf;
+	};
+
+	int32_t allocateNode();
+	void freeNode(int32_t node);
+	void insertLeaf(int32_t leaf);
+	void removeLeaf(int32_t leaf);
+	void markDirty(int32_t node);
+	Aabb makeFatBounds(const Aabb& bounds, const glm::vec3& displacement) const;
+	int32_t buildRange(BuildEntry* entries, size_t count, int32_t parent);
+	void setInternalBounds(int32_t node, const Aabb& bounds); ///< keeps internalArea up to date
+
+	// exact boxes are only needed at the leaves, so they stay out of the nodes every traversal step loads
+	std::vector<Node> nodes;
+	std::vector<Aabb> leafBounds; ///< exact box of each leaf, indexed like nodes
+	int32_t root;
+	int32_t freeList;
+	size_t leafCount;
+	bool hasDirtyNodes;
+	float margin;
+	float rebuildRatio;
+	double internalArea; ///< surface area summed over the internal nodes, double as it accumulates small deltas
+	float builtCost;    ///< getCost() after the last rebuild
+};
@@ -1,8 +1,16 @@
 #include "EntityManager.hpp"
+#include "JobSystem.hpp"
 
 EntityManager::EntityManager()
 {
 	this->drawablesQuery = world.query<IndexedDrawable>();
+	// release the transform data together with the entity
+	world.observer<Transform>()
+		.event(flecs::OnRemove)
+		.each([this](Transform& transform) {
+			if (transform.handle != INVALID_TRANSFORM)
+				transformSystem.destroyTransform(transform.handle);
+		});
 }
 
 EntityManager::~EntityManager()
@@ -14,3 +22,15 @@ void EntityManager::createEntity()
 	flecs::entity e = world.entity();
 	auto id = e.id();
 }
+
+flecs::entity EntityManager::createTransformEntity(const Pose& localPose, TransformHandle parent)
+{
+	flecs::entity entity = world.entity();
+	entity.set<Transform>({ transformSystem.createTransform(localPose, parent) });
+	return entity;
+}
+
+void EntityManager::updateTransforms()
+{
+	transformSystem.update(&JobSystem::getInstance());
+}
@@ -1,8 +1,11 @@
+#pragma once
+
 #include <flecs.h>
 #include <string>
 
 #include "BasicAttributes.hpp"
 #include "GraphicsTypes.hpp"
+#include "TransformSystem.hpp"
 
 class EntityManager
 {
@@ -13,9 +16,25 @@ public:
 
 	void createEntity();
 
+	/**
+	 * @brief Creates an entity with a Transform component.
+	 * @param localPose is the pose relative to the parent.
+	 * @param parent is the transform of the parent entity, or INVALID_TRANSFORM for a root.
+	 * @return the created entity.
+	 */
+	flecs::entity createTransformEntity(const Pose& localPose, TransformHandle parent = INVALID_TRANSFORM);
+
+	/**
+	 * @brief Recomputes the world matrices of transforms that moved since the previous call.
+	 */
+	void updateTransforms();
+
+	TransformSystem& getTransformSystem() { return transformSystem; }
+
 	// void createGraphicsEntity(std::string resourcePath);
 
 private:
+	TransformSystem transformSystem; // declared first, because the world releases transforms when it is destroyed
 	flecs::world world;
 	flecs::query<IndexedDrawable> drawablesQuery;
-};
\ No newline at end of file
+};
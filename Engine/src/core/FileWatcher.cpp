@@ -0,0 +1,129 @@
+#include "FileWatcher.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+FileWatcher::FileWatcher()
+	: watching(false), inotifyFd(-1), watchDescriptor(-1), scanInterval(0)
+{
+}
+
+FileWatcher::~FileWatcher()
+{
+	cleanup();
+}
+
+bool FileWatcher::initialize(const std::string& directory, std::chrono::milliseconds scanInterval)
+{
+	cleanup();
+	this->directory = directory;
+	this->scanInterval = scanInterval;
+	std::error_code error;
+	if (!std::filesystem::is_directory(this->directory, error))
+	{
+		std::cerr << "Cannot watch " << directory << ", it is not a directory" << std::endl;
+		return false;
+	}
+
+#if defined(__linux__)
+	inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (0 <= inotifyFd)
+	{
+		// editors either write in place or write a temporary file and move it over the original
+		watchDescriptor = inotify_add_watch(inotifyFd, this->directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+		if (watchDescriptor < 0)
+		{
+			close(inotifyFd);
+			inotifyFd = -1;
+		}
+	}
+#endif
+	if (inotifyFd < 0)
+	{
+		// remember the current state, only later changes are reported
+		scan();
+		lastScan = std::chrono::steady_clock::now();
+	}
+	watching = true;
+	return true;
+}
+
+void FileWatcher::cleanup()
+{
+#if defined(__linux__)
+	if (0 <= inotifyFd)
+	{
+		inotify_rm_watch(inotifyFd, watchDescriptor);
+		close(inotifyFd);
+	}
+#endif
+	inotifyFd = -1;
+	watchDescriptor = -1;
+	writeTimes.clear();
+	watching = false;
+}
+
+std::vector<std::string> FileWatcher::poll()
+{
+	std::vector<std::string> changed;
+	if (!watching)
+		return changed;
+
+#if defined(__linux__)
+	if (0 <= inotifyFd)
+	{
+		alignas(inotify_event) char buffer[4096];
+		while (true)
+		{
+			ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+			if (length <= 0)
+				break;
+			for (ssize_t offset = 0; offset < length;)
+			{
+				const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+				if (0 < event->len && (event->mask & IN_ISDIR) == 0)
+					changed.push_back((directory / event->name).string());
+				offset += sizeof(inotify_event) + event->len;
+			}
+		}
+		std::sort(changed.begin(), changed.end());
+		changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+		return changed;
+	}
+#endif
+
+	auto now = std::chrono::steady_clock::now();
+	if (now - lastScan < scanInterval)
+		return changed;
+	lastScan = now;
+	return scan();
+}
+
+std::vector<std::string> FileWatcher::scan()
+{
+	std::vector<std::string> changed;
+	std::error_code error;
+	for (const auto& entry : std::filesystem::directory_iterator(directory, error))
+	{
+		if (!entry.is_regular_file(error))
+			continue;
+		std::filesystem::file_time_type writeTime = entry.last_write_time(error);
+		if (error)
+			continue;
+		std::string path = entry.path().string();
+		auto found = writeTimes.find(path);
+		if (found == writeTimes.end() || found->second != writeTime)
+		{
+			changed.push_back(path);
+			writeTimes[path] = writeTime;
+		}
+	}
+	std::sort(changed.begin(), changed.end());
+	return changed;
+}
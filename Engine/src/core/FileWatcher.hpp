@@ -0,0 +1,56 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Reports files of a directory that were written or replaced, e.g. shaders saved in an editor.
+ * Uses inotify on Linux, where polling costs one non-blocking read. Elsewhere the directory is scanned for newer
+ * modification times, at most once per scan interval.
+ * Not thread safe, meant to be polled once per frame.
+ */
+class FileWatcher
+{
+
+public:
+	FileWatcher();
+	~FileWatcher();
+
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator=(const FileWatcher&) = delete;
+
+	/**
+	 * @brief Starts watching the files directly in the directory.
+	 * @param directory to watch.
+	 * @param scanInterval between scans where inotify is not available.
+	 * @return false if the directory cannot be watched.
+	 */
+	bool initialize(const std::string& directory, std::chrono::milliseconds scanInterval = std::chrono::milliseconds(250));
+
+	/**
+	 * @brief Stops watching.
+	 */
+	void cleanup();
+
+	/**
+	 * @brief Returns the files changed since the last poll without blocking. A file saved several times is reported once.
+	 * @return paths of the changed files.
+	 */
+	std::vector<std::string> poll();
+
+	bool isWatching() const { return watching; }
+
+private:
+	std::vector<std::string> scan();
+
+	std::filesystem::path directory;
+	bool watching;
+	int inotifyFd;  ///< -1 without inotify
+	int watchDescriptor;
+	std::chrono::milliseconds scanInterval;
+	std::chrono::steady_clock::time_point lastScan;
+	std::unordered_map<std::string, std::filesystem::file_time_type> writeTimes; ///< of the scanned files
+};
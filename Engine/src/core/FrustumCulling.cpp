@@ -0,0 +1,119 @@
+#include "FrustumCulling.hpp"
+#include "CullingKernels.hpp"
+#include "CpuFeatures.hpp"
+#include "JobSystem.hpp"
+
+#include <cstring>
+#include <vector>
+
+Frustum Frustum::fromViewProjection(const glm::mat4& viewProjection)
+{
+	// Gribb-Hartmann on the rows of the matrix, with Vulkan's 0..1 depth range
+	glm::vec4 row0(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+	glm::vec4 row1(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+	glm::vec4 row2(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+	glm::vec4 row3(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+
+	Frustum frustum;
+	frustum.planes[0] = row3 + row0; // left
+	frustum.planes[1] = row3 - row0; // right
+	frustum.planes[2] = row3 + row1; // bottom
+	frustum.planes[3] = row3 - row1; // top
+	frustum.planes[4] = row2;        // near
+	frustum.planes[5] = row3 - row2; // far
+	for (glm::vec4& plane : frustum.planes)
+	{
+		plane /= glm::length(glm::vec3(plane));
+	}
+	return frustum;
+}
+
+bool Frustum::containsSphere(const glm::vec3& center, float radius) const
+{
+	for (const glm::vec4& plane : planes)
+	{
+		if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+			return false;
+	}
+	return true;
+}
+
+bool Frustum::containsBox(const glm::vec3& center, const glm::vec3& extents) const
+{
+	for (const glm::vec4& plane : planes)
+	{
+		float radius = glm::dot(glm::abs(glm::vec3(plane)), extents);
+		if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+			return false;
+	}
+	return true;
+}
+
+namespace
+{
+	using CullRangeFunction = size_t (*)(const glm::vec4*, const float* const*, size_t, size_t, uint32_t*);
+
+	size_t cullSpheresRange(const glm::vec4* planes, const float* const* components, size_t begin, size_t end, uint32_t* visibleIndices)
+	{
+		switch (getSimdLevel())
+		{
+		case SimdLevel::AVX2:
+			return cullSpheresAvx2(planes, components, begin, end, visibleIndices);
+#if defined(REHTI_SIMD_X86)
+		case SimdLevel::SSE2:
+			return cullWith<Lane4, SphereTest>(planes, components, begin, end, visibleIndices);
+#endif
+		default:
+			return cullWith<Lane1, SphereTest>(planes, components, begin, end, visibleIndices);
+		}
+	}
+
+	size_t cullBoxesRange(const glm::vec4* planes, const float* const* components, size_t begin, size_t end, uint32_t* visibleIndices)
+	{
+		switch (getSimdLevel())
+		{
+		case SimdLevel::AVX2:
+			return cullBoxesAvx2(planes, components, begin, end, visibleIndices);
+#if defined(REHTI_SIMD_X86)
+		case SimdLevel::SSE2:
+			return cullWith<Lane4, BoxTest>(planes, components, begin, end, visibleIndices);
+#endif
+		default:
+			return cullWith<Lane1, BoxTest>(planes, components, begin, end, visibleIndices);
+		}
+	}
+
+	/**
+	 * @brief Culls the chunks in parallel. Each chunk compacts into its own part of the output, which is then closed up in order.
+	 */
+	size_t cullChunked(CullRangeFunction cullRange, const Frustum& frustum, const float* const* components, size_t count, uint32_t* visibleIndices)
+	{
+		if (count <= CULLING_CHUNK_SIZE)
+			return cullRange(frustum.planes, components, 0, count, visibleIndices);
+
+		std::vector<size_t> chunkCounts((count + CULLING_CHUNK_SIZE - 1) / CULLING_CHUNK_SIZE);
+		JobSystem::getInstance().parallelFor(count, CULLING_CHUNK_SIZE, [&](size_t begin, size_t end) {
+			chunkCounts[begin / CULLING_CHUNK_SIZE] = cullRange(frustum.planes, components, begin, end, visibleIndices + begin);
+		});
+
+		size_t visibleCount = chunkCounts[0];
+		for (size_t chunk = 1; chunk < chunkCounts.size(); chunk++)
+		{
+			std::memmove(visibleIndices + visibleCount, visibleIndices + chunk * CULLING_CHUNK_SIZE, chunkCounts[chunk] * sizeof(uint32_t));
+			visibleCount += chunkCounts[chunk];
+		}
+		return visibleCount;
+	}
+} // namespace
+
+size_t cullSpheres(const Frustum& frustum, const BoundingSphereArray& spheres, uint32_t* visibleIndices)
+{
+	const float* components[4] = { spheres.component(0), spheres.component(1), spheres.component(2), spheres.component(3) };
+	return cullChunked(cullSpheresRange, frustum, components, spheres.size(), visibleIndices);
+}
+
+size_t cullBoxes(const Frustum& frustum, const BoundingBoxArray& boxes, uint32_t* visibleIndices)
+{
+	const float* components[6] = { boxes.component(0), boxes.component(1), boxes.component(2), boxes.component(3), boxes.component(4), boxes.component(5) };
+	return cullChunked(cullBoxesRange, frustum, components, boxes.size(), visibleIndices);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "AttributeArray.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief View frustum as six planes facing inwards. A point p is inside a plane if dot(plane.xyz, p) + plane.w >= 0.
+ */
+struct Frustum
+{
+	glm::vec4 planes[6]; ///< left, right, bottom, top, near, far, normalized
+
+	/**
+	 * @brief Extracts the planes from a view projection matrix with Vulkan's 0..1 depth range, e.g. Camera::getWorldToScreenMatrix.
+	 * @param viewProjection matrix.
+	 * @return The frustum in the space the matrix transforms from.
+	 */
+	static Frustum fromViewProjection(const glm::mat4& viewProjection);
+
+	bool containsSphere(const glm::vec3& center, float radius) const;
+	bool containsBox(const glm::vec3& center, const glm::vec3& extents) const;
+};
+
+/**
+ * @brief Axis aligned box as center and half extents.
+ */
+struct BoxBounds
+{
+	glm::vec3 center;
+	glm::vec3 extents;
+};
+
+/**
+ * @brief Bounding sphere with the center in xyz and the radius in w.
+ */
+struct BoundingSphere : AttributeBase<BoundingSphere, glm::vec4>
+{
+	using AttributeBase<BoundingSphere, glm::vec4>::operator=;
+	using AttributeBase<BoundingSphere, glm::vec4>::AttributeBase;
+};
+
+struct BoundingBox : AttributeBase<BoundingBox, BoxBounds>
+{
+	using AttributeBase<BoundingBox, BoxBounds>::operator=;
+	using AttributeBase<BoundingBox, BoxBounds>::AttributeBase;
+};
+
+using BoundingSphereArray = AttributeArray<BoundingSphere>;
+using BoundingBoxArray = AttributeArray<BoundingBox>;
+
+constexpr size_t CULLING_CHUNK_SIZE = 16384; ///< volumes per job when culling in parallel
+
+/**
+ * @brief Tests every sphere against the frustum and writes the indices of the visible ones in ascending order.
+ * Uses the widest instruction set the CPU supports. Arrays larger than CULLING_CHUNK_SIZE are split over the job system.
+ * @param frustum to test against.
+ * @param spheres to test.
+ * @param visibleIndices must hold spheres.size() indices.
+ * @return number of visible spheres.
+ */
+size_t cullSpheres(const Frustum& frustum, const BoundingSphereArray& spheres, uint32_t* visibleIndices);
+
+/**
+ * @brief Tests every box against the frustum and writes the indices of the visible ones in ascending order.
+ * Boxes that straddle a plane count as visible.
+ * @param frustum to test against.
+ * @param boxes to test.
+ * @param visibleIndices must hold boxes.size() indices.
+ * @return number of visible boxes.
+ */
+size_t cullBoxes(const Frustum& frustum, const BoundingBoxArray& boxes, uint32_t* visibleIndices);
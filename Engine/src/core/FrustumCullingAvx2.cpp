@@ -0,0 +1,19 @@
+#include "CullingKernels.hpp"
+
+// This file is compiled with AVX2 and FMA enabled. It is only called after CpuFeatures has confirmed support.
+
+#if defined(__AVX2__)
+using WideLane = Lane8;
+#else
+using WideLane = Lane1;
+#endif
+
+size_t cullSpheresAvx2(const glm::vec4* planes, const float* const* components, size_t begin, size_t end, uint32_t* visibleIndices)
+{
+	return cullWith<WideLane, SphereTest>(planes, components, begin, end, visibleIndices);
+}
+
+size_t cullBoxesAvx2(const glm::vec4* planes, const float* const* components, size_t begin, size_t end, uint32_t* visibleIndices)
+{
+	return cullWith<WideLane, BoxTest>(planes, components, begin, end, visibleIndices);
+}
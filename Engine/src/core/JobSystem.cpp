@@ -0,0 +1,126 @@
+#include "JobSystem.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+JobSystem::JobSystem(uint32_t workerCount)
+{
+	workers.reserve(workerCount);
+	for (uint32_t i = 0; i < workerCount; i++)
+	{
+		workers.emplace_back(&JobSystem::workerLoop, this);
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		stopping = true;
+	}
+	queueCondition.notify_all();
+	for (std::thread& worker : workers)
+	{
+		worker.join();
+	}
+}
+
+JobSystem& JobSystem::getInstance()
+{
+	static JobSystem instance(std::max(1u, std::thread::hardware_concurrency()) - 1);
+	return instance;
+}
+
+void JobSystem::submit(std::function<void()> job)
+{
+	if (workers.empty())
+	{
+		job();
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		queue.push_back(std::move(job));
+	}
+	queueCondition.notify_one();
+}
+
+void JobSystem::parallelFor(size_t count, size_t grainSize, const std::function<void(size_t begin, size_t end)>& work)
+{
+	if (count == 0)
+		return;
+	grainSize = std::max<size_t>(grainSize, 1);
+	size_t chunkCount = (count + grainSize - 1) / grainSize;
+	if (chunkCount == 1 || workers.empty())
+	{
+		work(0, count);
+		return;
+	}
+
+	// Helpers may start after the loop is already done, so the shared state outlives this call.
+	struct LoopState
+	{
+		std::atomic<size_t> nextChunk = 0;
+		std::atomic<size_t> finishedChunks = 0;
+		std::mutex doneMutex;
+		std::condition_variable doneCondition;
+	};
+	std::shared_ptr<LoopState> state = std::make_shared<LoopState>();
+	const std::function<void(size_t, size_t)>* workPtr = &work;
+
+	auto runChunks = [state, workPtr, count, grainSize, chunkCount]() {
+		size_t chunk = state->nextChunk.fetch_add(1, std::memory_order_relaxed);
+		while (chunk < chunkCount)
+		{
+			size_t begin = chunk * grainSize;
+			(*workPtr)(begin, std::min(begin + grainSize, count));
+			if (state->finishedChunks.fetch_add(1, std::memory_order_acq_rel) + 1 == chunkCount)
+			{
+				std::lock_guard<std::mutex> lock(state->doneMutex);
+				state->doneCondition.notify_all();
+			}
+			chunk = state->nextChunk.fetch_add(1, std::memory_order_relaxed);
+		}
+	};
+
+	size_t helperCount = std::min<size_t>(workers.size(), chunkCount - 1);
+	for (size_t i = 0; i < helperCount; i++)
+	{
+		submit(runChunks);
+	}
+	runChunks();
+
+	std::unique_lock<std::mutex> lock(state->doneMutex);
+	state->doneCondition.wait(lock, [&state, chunkCount]() { return state->finishedChunks.load(std::memory_order_acquire) == chunkCount; });
+}
+
+void JobSystem::waitIdle()
+{
+	std::unique_lock<std::mutex> lock(queueMutex);
+	idleCondition.wait(lock, [this]() { return queue.empty() && runningJobs == 0; });
+}
+
+void JobSystem::workerLoop()
+{
+	while (true)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(queueMutex);
+			queueCondition.wait(lock, [this]() { return stopping || !queue.empty(); });
+			if (stopping && queue.empty())
+				return;
+			job = std::move(queue.front());
+			queue.pop_front();
+			runningJobs++;
+		}
+		job();
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			runningJobs--;
+			if (queue.empty() && runningJobs == 0)
+				idleCondition.notify_all();
+		}
+	}
+}
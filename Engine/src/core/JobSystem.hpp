@@ -0,0 +1,64 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Fixed pool of worker threads shared by the engine subsystems.
+ */
+class JobSystem
+{
+public:
+	/**
+	 * @brief Starts the workers.
+	 * @param workerCount is the number of threads besides the calling thread. Zero runs everything on the caller.
+	 */
+	explicit JobSystem(uint32_t workerCount);
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	/**
+	 * @brief Returns the engine wide job system with one worker per hardware thread, minus the calling thread.
+	 */
+	static JobSystem& getInstance();
+
+	/**
+	 * @brief Queues a job to run on some worker. Runs it right away if there are no workers.
+	 */
+	void submit(std::function<void()> job);
+
+	/**
+	 * @brief Splits [0, count) into chunks of grainSize and runs them on the workers and the calling thread.
+	 * Returns once every chunk has been processed.
+	 * @param count of items.
+	 * @param grainSize is the number of items in a chunk.
+	 * @param work is called with the [begin, end) range of each chunk.
+	 */
+	void parallelFor(size_t count, size_t grainSize, const std::function<void(size_t begin, size_t end)>& work);
+
+	/**
+	 * @brief Waits until the queue is empty and no job is running.
+	 */
+	void waitIdle();
+
+	uint32_t getWorkerCount() const { return static_cast<uint32_t>(workers.size()); }
+
+private:
+	void workerLoop();
+
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> queue;
+	std::mutex queueMutex;
+	std::condition_variable queueCondition;
+	std::condition_variable idleCondition;
+	uint32_t runningJobs = 0;
+	bool stopping = false;
+};
@@ -0,0 +1,264 @@
+#include "PickingService.hpp"
+#include "AssetLoader.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+	/**
+	 * @brief Box around the transformed box, from the transformed center and the absolute matrix applied to the extents.
+	 */
+	Aabb transformBounds(const glm::mat4& transform, const Aabb& bounds)
+	{
+		glm::vec3 center = glm::vec3(transform * glm::vec4(bounds.getCenter(), 1.f));
+		glm::vec3 extents = bounds.getExtents();
+		glm::vec3 transformedExtents(0.f);
+		for (int column = 0; column < 3; column++)
+			transformedExtents += glm::abs(glm::vec3(transform[column])) * extents[column];
+		return { center - transformedExtents, center + transformedExtents };
+	}
+
+	Ray transformRay(const glm::mat4& transform, const Ray& ray)
+	{
+		// the direction is not normalized, so distances stay comparable between spaces
+		return { glm::vec3(transform * glm::vec4(ray.origin, 1.f)), glm::vec3(transform * glm::vec4(ray.direction, 0.f)) };
+	}
+
+	bool intersectTriangle(const Ray& ray, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, float maxDistance, RayHit& hit)
+	{
+		glm::vec3 edge1 = b - a;
+		glm::vec3 edge2 = c - a;
+		glm::vec3 p = glm::cross(ray.direction, edge2);
+		float determinant = glm::dot(edge1, p);
+		if (std::abs(determinant) <= 1e-12f)
+			return false;
+		float inverseDeterminant = 1.f / determinant;
+		glm::vec3 s = ray.origin - a;
+		float u = glm::dot(s, p) * inverseDeterminant;
+		if (u < 0.f || 1.f < u)
+			return false;
+		glm::vec3 q = glm::cross(s, edge1);
+		float v = glm::dot(ray.direction, q) * inverseDeterminant;
+		if (v < 0.f || 1.f < u + v)
+			return false;
+		float distance = glm::dot(edge2, q) * inverseDeterminant;
+		if (distance <= 0.f || maxDistance <= distance)
+			return false;
+		hit.distance = distance;
+		hit.u = u;
+		hit.v = v;
+		return true;
+	}
+} // namespace
+
+uint32_t PickingService::registerMesh(const GraphicsAsset& asset)
+{
+	if (asset.vertices.empty() || asset.indices.size() % 3 != 0)
+		throw std::runtime_error("PickingService::registerMesh: the asset has no triangle list");
+
+	PickMesh mesh;
+	mesh.positions.reserve(asset.vertices.size());
+	for (const FullVertex& vertex : asset.vertices)
+		mesh.positions.push_back(vertex.position);
+	mesh.indices = asset.indices;
+	mesh.bounds = { mesh.positions[0], mesh.positions[0] };
+	for (const glm::vec3& position : mesh.positions)
+		mesh.bounds = { glm::min(mesh.bounds.min, position), glm::max(mesh.bounds.max, position) };
+
+	bool skinned = asset.skeleton.has_value() && (asset.attributes & FLAG_JOINTS) && (asset.attributes & FLAG_WEIGHTS);
+	if (skinned)
+	{
+		size_t boneCount = asset.skeleton->bones.size();
+		mesh.bones.resize(boneCount);
+		mesh.joints.reserve(asset.vertices.size());
+		mesh.weights.reserve(asset.vertices.size());
+		for (const FullVertex& vertex : asset.vertices)
+		{
+			mesh.joints.push_back(vertex.joints);
+			mesh.weights.push_back(vertex.weights);
+		}
+		// each triangle follows the dominant bones of its vertices
+		std::vector<bool> boneHasBounds(boneCount, false);
+		for (uint32_t triangle = 0; triangle < mesh.indices.size() / 3; triangle++)
+		{
+			uint32_t dominantBones[3];
+			for (int corner = 0; corner < 3; corner++)
+			{
+				const FullVertex& vertex = asset.vertices[mesh.indices[3 * triangle + corner]];
+				int strongest = 0;
+				for (int i = 1; i < 4; i++)
+				{
+					if (vertex.weights[strongest] < vertex.weights[i])
+						strongest = i;
+				}
+				dominantBones[corner] = std::min<uint32_t>(vertex.joints[strongest], static_cast<uint32_t>(boneCount - 1));
+			}
+			for (int corner = 0; corner < 3; corner++)
+			{
+				uint32_t bone = dominantBones[corner];
+				if (std::find(dominantBones, dominantBones + corner, bone) != dominantBones + corner)
+					continue;
+				BonePickBounds& bounds = mesh.bones[bone];
+				bounds.triangles.push_back(triangle);
+				for (int vertex = 0; vertex < 3; vertex++)
+				{
+					const glm::vec3& position = mesh.positions[mesh.indices[3 * triangle + vertex]];
+					bounds.bindBounds = boneHasBounds[bone] ? Aabb{ glm::min(bounds.bindBounds.min, position), glm::max(bounds.bindBounds.max, position) } : Aabb{ position, position };
+					boneHasBounds[bone] = true;
+				}
+			}
+		}
+	}
+
+	meshes.push_back(std::move(mesh));
+	return static_cast<uint32_t>(meshes.size() - 1);
+}
+
+int32_t PickingService::addInstance(uint32_t mesh, const glm::mat4& transform, uint64_t userData)
+{
+	int32_t index;
+	if (freeInstances.empty())
+	{
+		index = static_cast<int32_t>(instances.size());
+		instances.emplace_back();
+	}
+	else
+	{
+		index = freeInstances.back();
+		freeInstances.pop_back();
+	}
+	PickInstance& instance = instances[index];
+	instance.mesh = mesh;
+	instance.userData = userData;
+	instance.transform = transform;
+	instance.inverseTransform = glm::inverse(transform);
+	// skinned meshes start in bind pose
+	instance.boneTransforms.assign(meshes[mesh].bones.size(), glm::mat4(1.f));
+	instance.inverseBoneTransforms.assign(meshes[mesh].bones.size(), glm::mat4(1.f));
+	instance.proxy = sceneBvh.insert(getWorldBounds(instance), static_cast<uint64_t>(index));
+	return index;
+}
+
+void PickingService::setTransform(int32_t instance, const glm::mat4& transform)
+{
+	PickInstance& target = instances[instance];
+	target.transform = transform;
+	target.inverseTransform = glm::inverse(transform);
+	sceneBvh.move(target.proxy, getWorldBounds(target));
+}
+
+void PickingService::setBoneTransforms(int32_t instance, const glm::mat4* boneTransforms)
+{
+	PickInstance& target = instances[instance];
+	for (size_t bone = 0; bone < target.boneTransforms.size(); bone++)
+	{
+		target.boneTransforms[bone] = boneTransforms[bone];
+		target.inverseBoneTransforms[bone] = glm::inverse(boneTransforms[bone]);
+	}
+	sceneBvh.move(target.proxy, getWorldBounds(target));
+}
+
+void PickingService::removeInstance(int32_t instance)
+{
+	sceneBvh.remove(instances[instance].proxy);
+	instances[instance].mesh = INVALID_PICK_MESH;
+	instances[instance].boneTransforms.clear();
+	instances[instance].inverseBoneTransforms.clear();
+	freeInstances.push_back(instance);
+}
+
+void PickingService::update()
+{
+	sceneBvh.update();
+}
+
+PickResult PickingService::pick(const Ray& ray, float maxDistance)
+{
+	PickResult result;
+	sceneBvh.raycast(ray, maxDistance, [&](int32_t proxy, float currentMax) {
+		int32_t index = static_cast<int32_t>(sceneBvh.getUserData(proxy));
+		const PickInstance& instance = instances[index];
+		PickMesh& mesh = meshes[instance.mesh];
+		Ray localRay = transformRay(instance.inverseTransform, ray);
+		RayHit hit;
+		bool found = mesh.bones.empty() ? intersectRigid(mesh, localRay, currentMax, hit) : intersectSkinned(mesh, instance, localRay, currentMax, hit);
+		if (!found)
+			return currentMax;
+		result.hit = true;
+		result.userData = instance.userData;
+		result.instance = index;
+		result.triangle = hit.triangle;
+		result.distance = hit.distance;
+		result.position = ray.getPoint(hit.distance);
+		return hit.distance;
+	});
+	return result;
+}
+
+Aabb PickingService::getWorldBounds(const PickInstance& instance) const
+{
+	const PickMesh& mesh = meshes[instance.mesh];
+	if (mesh.bones.empty())
+		return transformBounds(instance.transform, mesh.bounds);
+
+	bool hasBounds = false;
+	Aabb posed = mesh.bounds;
+	for (size_t bone = 0; bone < mesh.bones.size(); bone++)
+	{
+		if (mesh.bones[bone].triangles.empty())
+			continue;
+		Aabb boneBounds = transformBounds(instance.transform * instance.boneTransforms[bone], mesh.bones[bone].bindBounds);
+		posed = hasBounds ? Aabb::merge(posed, boneBounds) : boneBounds;
+		hasBounds = true;
+	}
+	return posed;
+}
+
+bool PickingService::intersectRigid(PickMesh& mesh, const Ray& localRay, float maxDistance, RayHit& hit)
+{
+	if (!mesh.triangleBvh)
+	{
+		mesh.triangleBvh = std::make_unique<TriangleBvh>();
+		mesh.triangleBvh->build(mesh.positions.data(), mesh.indices.data(), mesh.indices.size());
+	}
+	return mesh.triangleBvh->intersect(localRay, maxDistance, hit);
+}
+
+bool PickingService::intersectSkinned(const PickMesh& mesh, const PickInstance& instance, const Ray& localRay, float maxDistance, RayHit& hit) const
+{
+	auto skin = [&](uint32_t vertex) {
+		glm::vec4 bindPosition(mesh.positions[vertex], 1.f);
+		glm::vec4 posed(0.f);
+		for (int i = 0; i < 4; i++)
+		{
+			float weight = mesh.weights[vertex][i];
+			if (weight != 0.f && mesh.joints[vertex][i] < instance.boneTransforms.size())
+				posed += (instance.boneTransforms[mesh.joints[vertex][i]] * bindPosition) * weight;
+		}
+		return glm::vec3(posed);
+	};
+
+	bool found = false;
+	for (size_t bone = 0; bone < mesh.bones.size(); bone++)
+	{
+		const BonePickBounds& bounds = mesh.bones[bone];
+		if (bounds.triangles.empty())
+			continue;
+		// test the bind pose box in the space that moves with the bone
+		Ray boneRay = transformRay(instance.inverseBoneTransforms[bone], localRay);
+		if (bounds.bindBounds.intersectRay(boneRay.origin, 1.f / boneRay.direction, maxDistance) == INFINITY)
+			continue;
+		for (uint32_t triangle : bounds.triangles)
+		{
+			const uint32_t* corners = &mesh.indices[3 * triangle];
+			if (intersectTriangle(localRay, skin(corners[0]), skin(corners[1]), skin(corners[2]), maxDistance, hit))
+			{
+				maxDistance = hit.distance;
+				hit.triangle = triangle;
+				found = true;
+			}
+		}
+	}
+	return found;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "DynamicBvh.hpp"
+#include "TriangleBvh.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct GraphicsAsset;
+
+constexpr uint32_t INVALID_PICK_MESH = 0xffffffff;
+
+/**
+ * @brief Closest object under a ray.
+ */
+struct PickResult
+{
+	bool hit = false;
+	uint64_t userData = 0;               ///< of the instance that was hit
+	int32_t instance = BVH_NULL_NODE;
+	uint32_t triangle = 0;               ///< index of the triangle in the mesh
+	float distance = INFINITY;           ///< along the ray, in lengths of its direction
+	glm::vec3 position = glm::vec3(0.f); ///< world space position of the hit
+};
+
+/**
+ * @brief Ray picking against the triangles of the scene.
+ * The broad phase walks a DynamicBvh over the world bounds of the instances from near to far.
+ * The narrow phase tests the mesh triangles through a TriangleBvh, built the first time a ray reaches the mesh.
+ * Skinned instances are tested through bounds per bone in bind space. Only the triangles of the bones that the
+ * ray hits are skinned and tested, so posing a character costs nothing until it is picked.
+ */
+class PickingService
+{
+public:
+	PickingService() = default;
+
+	/**
+	 * @brief Copies the geometry of an asset. Assets with a skeleton are picked in their current pose.
+	 * @param asset with positions and a triangle list.
+	 * @return mesh index for addInstance.
+	 */
+	uint32_t registerMesh(const GraphicsAsset& asset);
+
+	/**
+	 * @brief Places a mesh in the scene.
+	 * @param mesh returned by registerMesh.
+	 * @param transform from mesh space to world space.
+	 * @param userData is returned in the pick result, e.g. an entity id.
+	 * @return instance index.
+	 */
+	int32_t addInstance(uint32_t mesh, const glm::mat4& transform, uint64_t userData);
+
+	void setTransform(int32_t instance, const glm::mat4& transform);
+
+	/**
+	 * @brief Poses a skinned instance.
+	 * @param instance of a mesh with a skeleton.
+	 * @param boneTransforms are the skinning matrices from bind pose to the current pose, one per bone, e.g. from sampleAnimation.
+	 */
+	void setBoneTransforms(int32_t instance, const glm::mat4* boneTransforms);
+
+	void removeInstance(int32_t instance);
+
+	/**
+	 * @brief Brings the scene tree up to date with the moved instances. Call once per frame before picking.
+	 */
+	void update();
+
+	/**
+	 * @brief Finds the closest triangle hit by the ray.
+	 * @param ray in world space, e.g. Camera::getPickingRay.
+	 * @param maxDistance along the ray.
+	 * @return the hit, if any.
+	 */
+	PickResult pick(const Ray& ray, float maxDistance = INFINITY);
+
+	const DynamicBvh& getSceneBvh() const { return sceneBvh; }
+
+private:
+	struct BonePickBounds
+	{
+		Aabb bindBounds;                ///< bind pose box of the triangles that follow the bone
+		std::vector<uint32_t> triangles;
+	};
+
+	struct PickMesh
+	{
+		std::vector<glm::vec3> positions;
+		std::vector<uint32_t> indices;
+		std::vector<glm::uvec4> joints;   ///< skinned meshes only
+		std::vector<glm::vec4> weights;   ///< skinned meshes only
+		std::vector<BonePickBounds> bones; ///< skinned meshes only
+		Aabb bounds;                      ///< bind pose bounds
+		std::unique_ptr<TriangleBvh> triangleBvh; ///< built on the first ray that reaches the mesh
+	};
+
+	struct PickInstance
+	{
+		uint32_t mesh;
+		int32_t proxy;
+		uint64_t userData;
+		glm::mat4 transform;
+		glm::mat4 inverseTransform;
+		std::vector<glm::mat4> boneTransforms;
+		std::vector<glm::mat4> inverseBoneTransforms;
+	};
+
+	Aabb getWorldBounds(const PickInstance& instance) const;
+	bool intersectRigid(PickMesh& mesh, const Ray& localRay, float maxDistance, RayHit& hit);
+	bool intersectSkinned(const PickMesh& mesh, const PickInstance& instance, const Ray& localRay, float maxDistance, RayHit& hit) const;
+
+	std::vector<PickMesh> meshes;
+	std::vector<PickInstance> instances;
+	std::vector<int32_t> freeInstances;
+	DynamicBvh sceneBvh;
+};
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "BasicAttributes.hpp"
+#include "SimdLanes.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <math.h>
+
+/*
+* Pose kernels shared by the scalar, SSE2 and AVX2 variants. Include only from BasicAttributes*.cpp.
+* Lanes process WIDTH poses at a time, each float of a pose being gathered from the array of poses.
+*/
+
+constexpr size_t POSE_STRIDE = sizeof(Pose) / sizeof(float);
+constexpr size_t AFFINE_STRIDE = sizeof(AffineTransform) / sizeof(float);
+constexpr size_t POSE_POSITION = 0;
+constexpr size_t POSE_ORIENTATION = 3; // x, y, z, w
+constexpr size_t POSE_SCALE = 7;
+constexpr float NLERP_THRESHOLD = 0.95f; // below this cosine (about 36 degrees) nlerp drifts from slerp too much
+
+static_assert(sizeof(Pose) == 10 * sizeof(float), "Pose kernels expect tightly packed poses");
+static_assert(sizeof(AffineTransform) == 12 * sizeof(float), "Pose kernels expect tightly packed affine transforms");
+static_assert(offsetof(glm::quat, x) == 0 && offsetof(glm::quat, w) == 3 * sizeof(float), "Pose kernels expect xyzw quaternions");
+
+// Variants compiled with AVX2 in BasicAttributesAvx2.cpp. They fall back to scalar code when AVX2 is not available to the compiler.
+void composeAffineTransformsAvx2(const Pose* poses, size_t count, AffineTransform* transformsToFill);
+void interpolatePosesAvx2(const Pose* first, const Pose* second, float factor, size_t count, Pose* posesToFill);
+
+namespace
+{
+	template <typename F>
+	inline void composeAffineLanes(const Pose* poses, AffineTransform* transformsToFill)
+	{
+		const float* src = reinterpret_cast<const float*>(poses);
+		float* dst = reinterpret_cast<float*>(transformsToFill);
+
+		F tx = F::loadStrided(src + POSE_POSITION, POSE_STRIDE);
+		F ty = F::loadStrided(src + POSE_POSITION + 1, POSE_STRIDE);
+		F tz = F::loadStrided(src + POSE_POSITION + 2, POSE_STRIDE);
+		F qx = F::loadStrided(src + POSE_ORIENTATION, POSE_STRIDE);
+		F qy = F::loadStrided(src + POSE_ORIENTATION + 1, POSE_STRIDE);
+		F qz = F::loadStrided(src + POSE_ORIENTATION + 2, POSE_STRIDE);
+		F qw = F::loadStrided(src + POSE_ORIENTATION + 3, POSE_STRIDE);
+		F sx = F::loadStrided(src + POSE_SCALE, POSE_STRIDE);
+		F sy = F::loadStrided(src + POSE_SCALE + 1, POSE_STRIDE);
+		F sz = F::loadStrided(src + POSE_SCALE + 2, POSE_STRIDE);
+
+		F one = F::broadcast(1.f);
+		F x2 = qx + qx;
+		F y2 = qy + qy;
+		F z2 = qz + qz;
+		F xx = qx * x2;
+		F yy = qy * y2;
+		F zz = qz * z2;
+		F xy = qx * y2;
+		F xz = qx * z2;
+		F yz = qy * z2;
+		F wx = qw * x2;
+		F wy = qw * y2;
+		F wz = qw * z2;
+
+		// rows of translation * rotation * scale
+		F::storeQuads((one - (yy + zz)) * sx, (xy - wz) * sy, (xz + wy) * sz, tx, dst, AFFINE_STRIDE);
+		F::storeQuads((xy + wz) * sx, (one - (xx + zz)) * sy, (yz - wx) * sz, ty, dst + 4, AFFINE_STRIDE);
+		F::storeQuads((xz - wy) * sx, (yz + wx) * sy, (one - (xx + yy)) * sz, tz, dst + 8, AFFINE_STRIDE);
+	}
+
+	/**
+	 * @brief Spherical interpolation of a single quaternion pair along the shortest arc.
+	 */
+	inline void slerpQuaternion(const float* a, const float* b, float factor, float* quatToFill)
+	{
+		float cosTheta = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+		float sign = (cosTheta < 0.f) ? -1.f : 1.f;
+		cosTheta *= sign;
+		float angle = acosf(fminf(cosTheta, 1.f));
+		float inverseSin = 1.f / sinf(angle);
+		float firstWeight = sinf((1.f - factor) * angle) * inverseSin;
+		float secondWeight = sinf(factor * angle) * inverseSin * sign;
+		for (size_t i = 0; i < 4; i++)
+			quatToFill[i] = a[i] * firstWeight + b[i] * secondWeight;
+	}
+
+	template <typename F>
+	inline void interpolateLanes(const Pose* first, const Pose* second, float factor, Pose* posesToFill)
+	{
+		const float* a = reinterpret_cast<const float*>(first);
+		const float* b = reinterpret_cast<const float*>(second);
+		float* dst = reinterpret_cast<float*>(posesToFill);
+		F t = F::broadcast(factor);
+		F s = F::broadcast(1.f - factor);
+
+		F position[3];
+		F scale[3];
+		for (size_t i = 0; i < 3; i++)
+		{
+			position[i] = fmadd(F::loadStrided(a + POSE_POSITION + i, POSE_STRIDE), s, F::loadStrided(b + POSE_POSITION + i, POSE_STRIDE) * t);
+			scale[i] = fmadd(F::loadStrided(a + POSE_SCALE + i, POSE_STRIDE), s, F::loadStrided(b + POSE_SCALE + i, POSE_STRIDE) * t);
+		}
+
+		F qa[4];
+		F qb[4];
+		for (size_t i = 0; i < 4; i++)
+		{
+			qa[i] = F::loadStrided(a + POSE_ORIENTATION + i, POSE_STRIDE);
+			qb[i] = F::loadStrided(b + POSE_ORIENTATION + i, POSE_STRIDE);
+		}
+		F cosTheta = qa[0] * qb[0] + qa[1] * qb[1] + qa[2] * qb[2] + qa[3] * qb[3];
+		// flips the second quaternion to take the shortest arc
+		F secondWeight = copySign(t, cosTheta);
+		F q[4];
+		for (size_t i = 0; i < 4; i++)
+			q[i] = fmadd(qa[i], s, qb[i] * secondWeight);
+		F inverseLength = F::broadcast(1.f) / sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+
+		// far apart orientations fall back to slerp one lane at a time
+		uint32_t slerpLanes = lessThanMask(abs(cosTheta), F::broadcast(NLERP_THRESHOLD));
+		for (size_t i = 0; i < 4; i++)
+			q[i] = q[i] * inverseLength;
+		for (size_t lane = 0; slerpLanes != 0 && lane < F::WIDTH; lane++)
+		{
+			if ((slerpLanes & (1u << lane)) == 0)
+				continue;
+			float slerped[4];
+			slerpQuaternion(a + lane * POSE_STRIDE + POSE_ORIENTATION, b + lane * POSE_STRIDE + POSE_ORIENTATION, factor, slerped);
+			for (size_t i = 0; i < 4; i++)
+				q[i].setLane(lane, slerped[i]);
+		}
+
+		// stores come last so that the output may alias the inputs
+		F::storeQuads(position[0], position[1], position[2], q[0], dst, POSE_STRIDE);
+		F::storeQuads(q[1], q[2], q[3], scale[0], dst + 4, POSE_STRIDE);
+		scale[1].storeStrided(dst + POSE_SCALE + 1, POSE_STRIDE);
+		scale[2].storeStrided(dst + POSE_SCALE + 2, POSE_STRIDE);
+	}
+
+	template <typename F>
+	inline void composeAffineTransformsWith(const Pose* poses, size_t count, AffineTransform* transformsToFill)
+	{
+		size_t i = 0;
+		for (; i + F::WIDTH <= count; i += F::WIDTH)
+			composeAffineLanes<F>(poses + i, transformsToFill + i);
+		for (; i < count; i++)
+			composeAffineLanes<Lane1>(poses + i, transformsToFill + i);
+	}
+
+	template <typename F>
+	inline void interpolatePosesWith(const Pose* first, const Pose* second, float factor, size_t count, Pose* posesToFill)
+	{
+		size_t i = 0;
+		for (; i + F::WIDTH <= count; i += F::WIDTH)
+			interpolateLanes<F>(first + i, second + i, factor, posesToFill + i);
+		for (; i < count; i++)
+			interpolateLanes<Lane1>(first + i, second + i, factor, posesToFill + i);
+	}
+} // namespace
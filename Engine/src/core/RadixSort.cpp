@@ -0,0 +1,91 @@
+#include "RadixSort.hpp"
+#include "JobSystem.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+constexpr uint32_t RADIX_SORT_PASS_COUNT = 64 / RADIX_SORT_DIGIT_BITS;
+
+namespace
+{
+	inline uint32_t getDigit(uint64_t key, uint32_t pass)
+	{
+		return static_cast<uint32_t>(key >> (pass * RADIX_SORT_DIGIT_BITS)) & (RADIX_SORT_BUCKET_COUNT - 1);
+	}
+
+	/**
+	 * @brief Runs the work once per chunk. parallelFor may hand out several chunks at once when there are no workers.
+	 */
+	template <typename Work>
+	void forEachChunk(size_t count, const Work& work)
+	{
+		JobSystem::getInstance().parallelFor(count, RADIX_SORT_CHUNK_SIZE, [&](size_t begin, size_t end) {
+			for (size_t first = begin; first < end; first += RADIX_SORT_CHUNK_SIZE)
+				work(first / RADIX_SORT_CHUNK_SIZE, first, std::min(first + RADIX_SORT_CHUNK_SIZE, end));
+		});
+	}
+} // namespace
+
+void radixSort(uint64_t* keys, uint32_t* values, uint64_t* keyScratch, uint32_t* valueScratch, size_t count)
+{
+	if (count < 2)
+		return;
+
+	// one read of the keys tells which digits differ at all
+	uint64_t first = keys[0];
+	uint64_t differingBits = 0;
+	for (size_t i = 1; i < count; i++)
+		differingBits |= keys[i] ^ first;
+
+	size_t chunkCount = (count + RADIX_SORT_CHUNK_SIZE - 1) / RADIX_SORT_CHUNK_SIZE;
+	std::vector<uint32_t> offsets(chunkCount * RADIX_SORT_BUCKET_COUNT);
+	uint64_t* sourceKeys = keys;
+	uint32_t* sourceValues = values;
+	uint64_t* targetKeys = keyScratch;
+	uint32_t* targetValues = valueScratch;
+	for (uint32_t pass = 0; pass < RADIX_SORT_PASS_COUNT; pass++)
+	{
+		if (getDigit(differingBits, pass) == 0)
+			continue;
+
+		forEachChunk(count, [&](size_t chunk, size_t begin, size_t end) {
+			uint32_t* histogram = offsets.data() + chunk * RADIX_SORT_BUCKET_COUNT;
+			std::fill(histogram, histogram + RADIX_SORT_BUCKET_COUNT, 0);
+			for (size_t i = begin; i < end; i++)
+				histogram[getDigit(sourceKeys[i], pass)]++;
+		});
+
+		// a bucket holds the keys of every chunk in chunk order, which keeps the sort stable
+		uint32_t offset = 0;
+		for (uint32_t bucket = 0; bucket < RADIX_SORT_BUCKET_COUNT; bucket++)
+		{
+			for (size_t chunk = 0; chunk < chunkCount; chunk++)
+			{
+				uint32_t& entry = offsets[chunk * RADIX_SORT_BUCKET_COUNT + bucket];
+				uint32_t bucketCount = entry;
+				entry = offset;
+				offset += bucketCount;
+			}
+		}
+
+		forEachChunk(count, [&](size_t chunk, size_t begin, size_t end) {
+			uint32_t* chunkOffsets = offsets.data() + chunk * RADIX_SORT_BUCKET_COUNT;
+			for (size_t i = begin; i < end; i++)
+			{
+				uint32_t target = chunkOffsets[getDigit(sourceKeys[i], pass)]++;
+				targetKeys[target] = sourceKeys[i];
+				targetValues[target] = sourceValues[i];
+			}
+		});
+		std::swap(sourceKeys, targetKeys);
+		std::swap(sourceValues, targetValues);
+	}
+
+	if (sourceKeys != keys)
+	{
+		std::memcpy(keys, sourceKeys, count * sizeof(uint64_t));
+		std::memcpy(values, sourceValues, count * sizeof(uint32_t));
+	}
+}
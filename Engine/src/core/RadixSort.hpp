@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+constexpr uint32_t RADIX_SORT_DIGIT_BITS = 8;
+constexpr uint32_t RADIX_SORT_BUCKET_COUNT = 1u << RADIX_SORT_DIGIT_BITS;
+constexpr size_t RADIX_SORT_CHUNK_SIZE = 16384; ///< keys per job
+
+/**
+ * @brief Sorts 64 bit keys in ascending order with a parallel least significant digit radix sort. Values move with their keys.
+ * The sort is stable. Digits that are equal in every key are skipped, so keys whose high bits are mostly constant sort in few passes.
+ * @param keys to sort. Holds the sorted keys afterwards.
+ * @param values that follow the keys, e.g. indices of the sorted items.
+ * @param keyScratch and valueScratch must hold count elements. Their contents are overwritten.
+ * @param count of keys.
+ */
+void radixSort(uint64_t* keys, uint32_t* values, uint64_t* keyScratch, uint32_t* valueScratch, size_t count);
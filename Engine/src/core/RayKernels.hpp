@@ -0,0 +1,169 @@
+#pragma once
+
+#include "SimdLanes.hpp"
+#include "TriangleBvh.hpp"
+
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+/*
+* Ray traversal kernels behind TriangleBvh, shared by the scalar, SSE2 and AVX2 variants.
+* Include only from TriangleBvh*.cpp.
+*/
+
+// Variant compiled with AVX2 in TriangleBvhAvx2.cpp.
+bool intersectTriangleBvhAvx2(const TriangleBvhNode* nodes, const TrianglePacket* packets, uint32_t root, const Ray& ray, float maxDistance, RayHit& hit);
+
+namespace
+{
+	template <typename F>
+	struct RayLanes
+	{
+		F origin[3];
+		F direction[3];
+		F inverseDirection[3];
+	};
+
+	/**
+	 * @brief Slab test of the ray against the eight children of a node.
+	 * @return bit i is set if child i is hit before maxDistance. Its entry distance is written to entryDistances[i].
+	 */
+	template <typename F>
+	inline uint32_t intersectChildren(const TriangleBvhNode& node, const RayLanes<F>& ray, float maxDistance, float* entryDistances)
+	{
+		uint32_t hitMask = 0;
+		F zero = F::broadcast(0.f);
+		F limit = F::broadcast(maxDistance);
+		for (size_t c = 0; c < TRIANGLE_BVH_WIDTH; c += F::WIDTH)
+		{
+			F enter = zero;
+			F leave = limit;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				F toMin = (F::load(node.bounds[axis] + c) - ray.origin[axis]) * ray.inverseDirection[axis];
+				F toMax = (F::load(node.bounds[axis + 3] + c) - ray.origin[axis]) * ray.inverseDirection[axis];
+				enter = max(enter, min(toMin, toMax));
+				leave = min(leave, max(toMin, toMax));
+			}
+			hitMask |= (~lessThanMask(leave, enter) & ((1u << F::WIDTH) - 1)) << c;
+			enter.store(entryDistances + c);
+		}
+		return hitMask & node.childMask;
+	}
+
+	/**
+	 * @brief Moller-Trumbore against the eight triangles of a packet. Updates the hit if a triangle is closer.
+	 */
+	template <typename F>
+	inline bool intersectPacket(const TrianglePacket& packet, const RayLanes<F>& ray, float& maxDistance, RayHit& hit)
+	{
+		bool found = false;
+		F zero = F::broadcast(0.f);
+		F one = F::broadcast(1.f);
+		F epsilon = F::broadcast(1e-12f);
+		for (size_t t = 0; t < TRIANGLE_BVH_WIDTH; t += F::WIDTH)
+		{
+			F e1[3] = { F::load(packet.edge1[0] + t), F::load(packet.edge1[1] + t), F::load(packet.edge1[2] + t) };
+			F e2[3] = { F::load(packet.edge2[0] + t), F::load(packet.edge2[1] + t), F::load(packet.edge2[2] + t) };
+			// p = direction x e2
+			F p[3] = {
+				ray.direction[1] * e2[2] - ray.direction[2] * e2[1],
+				ray.direction[2] * e2[0] - ray.direction[0] * e2[2],
+				ray.direction[0] * e2[1] - ray.direction[1] * e2[0],
+			};
+			F determinant = fmadd(e1[0], p[0], fmadd(e1[1], p[1], e1[2] * p[2]));
+			F inverseDeterminant = one / determinant;
+			F s[3] = {
+				ray.origin[0] - F::load(packet.vertex[0] + t),
+				ray.origin[1] - F::load(packet.vertex[1] + t),
+				ray.origin[2] - F::load(packet.vertex[2] + t),
+			};
+			F u = fmadd(s[0], p[0], fmadd(s[1], p[1], s[2] * p[2])) * inverseDeterminant;
+			// q = s x e1
+			F q[3] = {
+				s[1] * e1[2] - s[2] * e1[1],
+				s[2] * e1[0] - s[0] * e1[2],
+				s[0] * e1[1] - s[1] * e1[0],
+			};
+			F v = fmadd(ray.direction[0], q[0], fmadd(ray.direction[1], q[1], ray.direction[2] * q[2])) * inverseDeterminant;
+			F distance = fmadd(e2[0], q[0], fmadd(e2[1], q[1], e2[2] * q[2])) * inverseDeterminant;
+
+			uint32_t hitMask = lessThanMask(epsilon, abs(determinant))
+				& ~lessThanMask(u, zero) & ~lessThanMask(v, zero) & ~lessThanMask(one, u + v)
+				& lessThanMask(zero, distance) & lessThanMask(distance, F::broadcast(maxDistance));
+			hitMask &= (1u << F::WIDTH) - 1;
+			while (hitMask != 0)
+			{
+				int lane = std::countr_zero(hitMask);
+				hitMask &= hitMask - 1;
+				float laneDistance = distance.lane(lane);
+				if (laneDistance < maxDistance)
+				{
+					maxDistance = laneDistance;
+					hit = { laneDistance, packet.triangles[t + lane], u.lane(lane), v.lane(lane) };
+					found = true;
+				}
+			}
+		}
+		return found;
+	}
+
+	template <typename F>
+	inline bool intersectTriangleBvhWith(const TriangleBvhNode* nodes, const TrianglePacket* packets, uint32_t root, const Ray& ray, float maxDistance, RayHit& hit)
+	{
+		if (root == TRIANGLE_BVH_EMPTY)
+			return false;
+		// plain member access only, glm functions must not be instantiated with AVX2 enabled
+		const float origin[3] = { ray.origin.x, ray.origin.y, ray.origin.z };
+		const float direction[3] = { ray.direction.x, ray.direction.y, ray.direction.z };
+		RayLanes<F> lanes;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			lanes.origin[axis] = F::broadcast(origin[axis]);
+			lanes.direction[axis] = F::broadcast(direction[axis]);
+			lanes.inverseDirection[axis] = F::broadcast(1.f / direction[axis]);
+		}
+
+		struct Entry
+		{
+			uint32_t child;
+			float distance;
+		};
+		Entry stack[TRIANGLE_BVH_STACK_SIZE];
+		size_t stackSize = 0;
+		stack[stackSize++] = { root, 0.f };
+		bool found = false;
+		while (stackSize != 0)
+		{
+			Entry entry = stack[--stackSize];
+			if (maxDistance < entry.distance)
+				continue;
+			if (entry.child & TRIANGLE_BVH_LEAF)
+			{
+				found |= intersectPacket(packets[entry.child & ~TRIANGLE_BVH_LEAF], lanes, maxDistance, hit);
+				continue;
+			}
+
+			const TriangleBvhNode& node = nodes[entry.child];
+			alignas(32) float entryDistances[TRIANGLE_BVH_WIDTH];
+			uint32_t hitMask = intersectChildren(node, lanes, maxDistance, entryDistances);
+			// push far to near, so that the nearest child is visited first
+			size_t first = stackSize;
+			while (hitMask != 0)
+			{
+				// the build bounds the depth, so the stack is never too small
+				assert(stackSize < TRIANGLE_BVH_STACK_SIZE);
+				int c = std::countr_zero(hitMask);
+				hitMask &= hitMask - 1;
+				Entry child = { node.children[c], entryDistances[c] };
+				size_t i = stackSize++;
+				for (; first < i && stack[i - 1].distance < child.distance; i--)
+					stack[i] = stack[i - 1];
+				stack[i] = child;
+			}
+		}
+		return found;
+	}
+} // namespace
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define REHTI_SIMD_X86
+#include <immintrin.h>
+#endif
+
+/*
+* Lane types wrap a register of floats behind one interface, so that a kernel can be written once as a template
+* and instantiated for scalar, SSE2 and AVX2 code.
+*
+* Everything here has internal linkage on purpose. The AVX2 kernels are compiled in their own translation unit with
+* AVX2 enabled, and a shared inline instantiation could otherwise be picked by the linker for the non AVX2 callers.
+* The same reason keeps the lanes away from inline helpers of other libraries.
+*/
+namespace
+{
+	struct Lane1
+	{
+		static constexpr size_t WIDTH = 1;
+		float v;
+
+		static Lane1 broadcast(float f) { return { f }; }
+		static Lane1 load(const float* p) { return { p[0] }; }
+		void store(float* p) const { p[0] = v; }
+		static Lane1 loadStrided(const float* base, size_t stride) { return { base[0] }; }
+		void storeStrided(float* base, size_t stride) const { base[0] = v; }
+		/// Stores four consecutive floats per lane, lane i going to base + i * stride.
+		static void storeQuads(Lane1 a, Lane1 b, Lane1 c, Lane1 d, float* base, size_t stride)
+		{
+			base[0] = a.v;
+			base[1] = b.v;
+			base[2] = c.v;
+			base[3] = d.v;
+		}
+		float lane(size_t i) const { return v; }
+		void setLane(size_t i, float f) { v = f; }
+
+		friend Lane1 operator+(Lane1 a, Lane1 b) { return { a.v + b.v }; }
+		friend Lane1 operator-(Lane1 a, Lane1 b) { return { a.v - b.v }; }
+		friend Lane1 operator*(Lane1 a, Lane1 b) { return { a.v * b.v }; }
+		friend Lane1 operator/(Lane1 a, Lane1 b) { return { a.v / b.v }; }
+		friend Lane1 fmadd(Lane1 a, Lane1 b, Lane1 c) { return { a.v * b.v + c.v }; }
+		friend Lane1 sqrt(Lane1 a) { return { sqrtf(a.v) }; }
+		friend Lane1 abs(Lane1 a) { return { fabsf(a.v) }; }
+		/// Like minps and maxps, the second operand is returned if either one is NaN.
+		friend Lane1 min(Lane1 a, Lane1 b) { return { a.v < b.v ? a.v : b.v }; }
+		friend Lane1 max(Lane1 a, Lane1 b) { return { a.v > b.v ? a.v : b.v }; }
+		friend Lane1 copySign(Lane1 magnitude, Lane1 sign) { return { copysignf(magnitude.v, sign.v) }; }
+		/// Bit i is set if lane i of a is less than lane i of b.
+		friend uint32_t lessThanMask(Lane1 a, Lane1 b) { return (a.v < b.v) ? 1u : 0u; }
+	};
+
+#if defined(REHTI_SIMD_X86)
+	struct Lane4
+	{
+		static constexpr size_t WIDTH = 4;
+		__m128 v;
+
+		static Lane4 broadcast(float f) { return { _mm_set1_ps(f) }; }
+		static Lane4 load(const float* p) { return { _mm_loadu_ps(p) }; }
+		void store(float* p) const { _mm_storeu_ps(p, v); }
+		static Lane4 loadStrided(const float* base, size_t stride)
+		{
+			return { _mm_setr_ps(base[0], base[stride], base[2 * stride], base[3 * stride]) };
+		}
+		void storeStrided(float* base, size_t stride) const
+		{
+			alignas(16) float lanes[WIDTH];
+			_mm_store_ps(lanes, v);
+			for (size_t i = 0; i < WIDTH; i++)
+				base[i * stride] = lanes[i];
+		}
+		static void storeQuads(Lane4 a, Lane4 b, Lane4 c, Lane4 d, float* base, size_t stride)
+		{
+			_MM_TRANSPOSE4_PS(a.v, b.v, c.v, d.v);
+			_mm_storeu_ps(base, a.v);
+			_mm_storeu_ps(base + stride, b.v);
+			_mm_storeu_ps(base + 2 * stride, c.v);
+			_mm_storeu_ps(base + 3 * stride, d.v);
+		}
+		float lane(size_t i) const
+		{
+			alignas(16) float lanes[WIDTH];
+			_mm_store_ps(lanes, v);
+			return lanes[i];
+		}
+		void setLane(size_t i, float f)
+		{
+			alignas(16) float lanes[WIDTH];
+			_mm_store_ps(lanes, v);
+			lanes[i] = f;
+			v = _mm_load_ps(lanes);
+		}
+
+		friend Lane4 operator+(Lane4 a, Lane4 b) { return { _mm_add_ps(a.v, b.v) }; }
+		friend Lane4 operator-(Lane4 a, Lane4 b) { return { _mm_sub_ps(a.v, b.v) }; }
+		friend Lane4 operator*(Lane4 a, Lane4 b) { return { _mm_mul_ps(a.v, b.v) }; }
+		friend Lane4 operator/(Lane4 a, Lane4 b) { return { _mm_div_ps(a.v, b.v) }; }
+		friend Lane4 fmadd(Lane4 a, Lane4 b, Lane4 c) { return { _mm_add_ps(_mm_mul_ps(a.v, b.v), c.v) }; }
+		friend Lane4 sqrt(Lane4 a) { return { _mm_sqrt_ps(a.v) }; }
+		friend Lane4 abs(Lane4 a) { return { _mm_andnot_ps(_mm_set1_ps(-0.f), a.v) }; }
+		friend Lane4 min(Lane4 a, Lane4 b) { return { _mm_min_ps(a.v, b.v) }; }
+		friend Lane4 max(Lane4 a, Lane4 b) { return { _mm_max_ps(a.v, b.v) }; }
+		friend Lane4 copySign(Lane4 magnitude, Lane4 sign)
+		{
+			__m128 signBit = _mm_set1_ps(-0.f);
+			return { _mm_or_ps(_mm_andnot_ps(signBit, magnitude.v), _mm_and_ps(signBit, sign.v)) };
+		}
+		friend uint32_t lessThanMask(Lane4 a, Lane4 b) { return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmplt_ps(a.v, b.v))); }
+	};
+#endif
+
+#if defined(REHTI_SIMD_X86) && defined(__AVX2__)
+	struct Lane8
+	{
+		static constexpr size_t WIDTH = 8;
+		__m256 v;
+
+		static Lane8 broadcast(float f) { return { _mm256_set1_ps(f) }; }
+		static Lane8 load(const float* p) { return { _mm256_loadu_ps(p) }; }
+		void store(float* p) const { _mm256_storeu_ps(p, v); }
+		static Lane8 loadStrided(const float* base, size_t stride)
+		{
+			int s = static_cast<int>(stride);
+			__m256i indices = _mm256_setr_epi32(0, s, 2 * s, 3 * s, 4 * s, 5 * s, 6 * s, 7 * s);
+			return { _mm256_i32gather_ps(base, indices, 4) };
+		}
+		void storeStrided(float* base, size_t stride) const
+		{
+			alignas(32) float lanes[WIDTH];
+			_mm256_store_ps(lanes, v);
+			for (size_t i = 0; i < WIDTH; i++)
+				base[i * stride] = lanes[i];
+		}
+		static void storeQuads(Lane8 a, Lane8 b, Lane8 c, Lane8 d, float* base, size_t stride)
+		{
+			Lane4::storeQuads({ _mm256_castps256_ps128(a.v) }, { _mm256_castps256_ps128(b.v) }, { _mm256_castps256_ps128(c.v) }, { _mm256_castps256_ps128(d.v) }, base, stride);
+			Lane4::storeQuads({ _mm256_extractf128_ps(a.v, 1) }, { _mm256_extractf128_ps(b.v, 1) }, { _mm256_extractf128_ps(c.v, 1) }, { _mm256_extractf128_ps(d.v, 1) }, base + 4 * stride, stride);
+		}
+		float lane(size_t i) const
+		{
+			alignas(32) float lanes[WIDTH];
+			_mm256_store_ps(lanes, v);
+			return lanes[i];
+		}
+		void setLane(size_t i, float f)
+		{
+			alignas(32) float lanes[WIDTH];
+			_mm256_store_ps(lanes, v);
+			lanes[i] = f;
+			v = _mm256_load_ps(lanes);
+		}
+
+		friend Lane8 operator+(Lane8 a, Lane8 b) { return { _mm256_add_ps(a.v, b.v) }; }
+		friend Lane8 operator-(Lane8 a, Lane8 b) { return { _mm256_sub_ps(a.v, b.v) }; }
+		friend Lane8 operator*(Lane8 a, Lane8 b) { return { _mm256_mul_ps(a.v, b.v) }; }
+		friend Lane8 operator/(Lane8 a, Lane8 b) { return { _mm256_div_ps(a.v, b.v) }; }
+		friend Lane8 fmadd(Lane8 a, Lane8 b, Lane8 c) { return { _mm256_fmadd_ps(a.v, b.v, c.v) }; }
+		friend Lane8 sqrt(Lane8 a) { return { _mm256_sqrt_ps(a.v) }; }
+		friend Lane8 abs(Lane8 a) { return { _mm256_andnot_ps(_mm256_set1_ps(-0.f), a.v) }; }
+		friend Lane8 min(Lane8 a, Lane8 b) { return { _mm256_min_ps(a.v, b.v) }; }
+		friend Lane8 max(Lane8 a, Lane8 b) { return { _mm256_max_ps(a.v, b.v) }; }
+		friend Lane8 copySign(Lane8 magnitude, Lane8 sign)
+		{
+			__m256 signBit = _mm256_set1_ps(-0.f);
+			return { _mm256_or_ps(_mm256_andnot_ps(signBit, magnitude.v), _mm256_and_ps(signBit, sign.v)) };
+		}
+		friend uint32_t lessThanMask(Lane8 a, Lane8 b) { return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ))); }
+	};
+#endif
+} // namespace
@@ -0,0 +1,224 @@
+#include "TransformSystem.hpp"
+#include "JobSystem.hpp"
+
+#include <atomic>
+
+constexpr size_t SUBTREES_PER_JOB = 16;
+
+TransformHandle TransformSystem::createTransform(const Pose& localPose, TransformHandle parent)
+{
+	TransformHandle handle;
+	if (!freeHandles.empty())
+	{
+		handle = freeHandles.back();
+		freeHandles.pop_back();
+	}
+	else
+	{
+		handle = static_cast<TransformHandle>(parents.size());
+		positions.emplace_back();
+		orientations.emplace_back();
+		scales.emplace_back();
+		localMatrices.emplace_back();
+		parents.push_back(INVALID_TRANSFORM);
+		firstChildren.push_back(INVALID_TRANSFORM);
+		nextSiblings.push_back(INVALID_TRANSFORM);
+		previousSiblings.push_back(INVALID_TRANSFORM);
+		worldMatrices.emplace_back(1.f);
+		dirtyFlags.push_back(CLEAN);
+	}
+
+	positions[handle] = localPose.position.value;
+	orientations[handle] = localPose.orientation.value;
+	scales[handle] = localPose.scale.value;
+	parents[handle] = INVALID_TRANSFORM;
+	firstChildren[handle] = INVALID_TRANSFORM;
+	nextSiblings[handle] = INVALID_TRANSFORM;
+	previousSiblings[handle] = INVALID_TRANSFORM;
+	if (parent != INVALID_TRANSFORM)
+		attach(handle, parent);
+	markDirty(handle, LOCAL_DIRTY);
+	return handle;
+}
+
+void TransformSystem::destroyTransform(TransformHandle handle)
+{
+	detach(handle);
+	TransformHandle child = firstChildren[handle];
+	while (child != INVALID_TRANSFORM)
+	{
+		TransformHandle next = nextSiblings[child];
+		parents[child] = INVALID_TRANSFORM;
+		previousSiblings[child] = INVALID_TRANSFORM;
+		nextSiblings[child] = INVALID_TRANSFORM;
+		markDirty(child, WORLD_DIRTY);
+		child = next;
+	}
+	firstChildren[handle] = INVALID_TRANSFORM;
+	// a destroyed handle may still sit in the dirty list, update skips it
+	dirtyFlags[handle] = CLEAN;
+	freeHandles.push_back(handle);
+}
+
+void TransformSystem::setParent(TransformHandle handle, TransformHandle parent)
+{
+	if (parents[handle] == parent)
+		return;
+	detach(handle);
+	if (parent != INVALID_TRANSFORM)
+		attach(handle, parent);
+	markDirty(handle, WORLD_DIRTY);
+}
+
+void TransformSystem::setPosition(TransformHandle handle, const glm::vec3& position)
+{
+	positions[handle] = position;
+	markDirty(handle, LOCAL_DIRTY);
+}
+
+void TransformSystem::setOrientation(TransformHandle handle, const glm::quat& orientation)
+{
+	orientations[handle] = orientation;
+	markDirty(handle, LOCAL_DIRTY);
+}
+
+void TransformSystem::setScale(TransformHandle handle, const glm::vec3& scale)
+{
+	scales[handle] = scale;
+	markDirty(handle, LOCAL_DIRTY);
+}
+
+void TransformSystem::setLocalPose(TransformHandle handle, const Pose& pose)
+{
+	positions[handle] = pose.position.value;
+	orientations[handle] = pose.orientation.value;
+	scales[handle] = pose.scale.value;
+	markDirty(handle, LOCAL_DIRTY);
+}
+
+Pose TransformSystem::getLocalPose(TransformHandle handle) const
+{
+	Pose pose{};
+	pose.position = positions[handle];
+	pose.orientation = orientations[handle];
+	pose.scale = scales[handle];
+	return pose;
+}
+
+void TransformSystem::update(JobSystem* jobs)
+{
+	lastUpdateCount = 0;
+	if (dirtyHandles.empty())
+		return;
+
+	// Only the topmost dirty transform of a branch starts a traversal. Its subtree covers the dirty descendants.
+	dirtyRoots.clear();
+	for (TransformHandle handle : dirtyHandles)
+	{
+		uint8_t flags = dirtyFlags[handle];
+		if (flags != CLEAN && (flags & ROOT_QUEUED) == 0 && !hasDirtyAncestor(handle))
+		{
+			dirtyFlags[handle] |= ROOT_QUEUED;
+			dirtyRoots.push_back(handle);
+		}
+	}
+
+	if (jobs == nullptr || dirtyRoots.size() <= SUBTREES_PER_JOB)
+	{
+		std::vector<TransformHandle> stack;
+		for (TransformHandle root : dirtyRoots)
+			lastUpdateCount += updateSubtree(root, stack);
+	}
+	else
+	{
+		// subtrees under different dirty roots are disjoint, so they can be written concurrently
+		std::atomic<size_t> updated = 0;
+		jobs->parallelFor(dirtyRoots.size(), SUBTREES_PER_JOB, [this, &updated](size_t begin, size_t end) {
+			std::vector<TransformHandle> stack;
+			size_t count = 0;
+			for (size_t i = begin; i < end; i++)
+				count += updateSubtree(dirtyRoots[i], stack);
+			updated.fetch_add(count, std::memory_order_relaxed);
+		});
+		lastUpdateCount = updated.load();
+	}
+	dirtyHandles.clear();
+}
+
+void TransformSystem::markDirty(TransformHandle handle, uint8_t flags)
+{
+	if (dirtyFlags[handle] == CLEAN)
+		dirtyHandles.push_back(handle);
+	dirtyFlags[handle] |= flags;
+}
+
+void TransformSystem::attach(TransformHandle handle, TransformHandle parent)
+{
+	parents[handle] = parent;
+	previousSiblings[handle] = INVALID_TRANSFORM;
+	nextSiblings[handle] = firstChildren[parent];
+	if (firstChildren[parent] != INVALID_TRANSFORM)
+		previousSiblings[firstChildren[parent]] = handle;
+	firstChildren[parent] = handle;
+}
+
+void TransformSystem::detach(TransformHandle handle)
+{
+	TransformHandle parent = parents[handle];
+	if (parent == INVALID_TRANSFORM)
+		return;
+	TransformHandle previous = previousSiblings[handle];
+	TransformHandle next = nextSiblings[handle];
+	if (previous != INVALID_TRANSFORM)
+		nextSiblings[previous] = next;
+	else
+		firstChildren[parent] = next;
+	if (next != INVALID_TRANSFORM)
+		previousSiblings[next] = previous;
+	parents[handle] = INVALID_TRANSFORM;
+	previousSiblings[handle] = INVALID_TRANSFORM;
+	nextSiblings[handle] = INVALID_TRANSFORM;
+}
+
+bool TransformSystem::hasDirtyAncestor(TransformHandle handle) const
+{
+	TransformHandle ancestor = parents[handle];
+	while (ancestor != INVALID_TRANSFORM)
+	{
+		if (dirtyFlags[ancestor] != CLEAN)
+			return true;
+		ancestor = parents[ancestor];
+	}
+	return false;
+}
+
+size_t TransformSystem::updateSubtree(TransformHandle root, std::vector<TransformHandle>& stack)
+{
+	size_t updated = 0;
+	stack.clear();
+	stack.push_back(root);
+	// depth first, so a parent is always finished before its children
+	while (!stack.empty())
+	{
+		TransformHandle handle = stack.back();
+		stack.pop_back();
+
+		if (dirtyFlags[handle] & LOCAL_DIRTY)
+		{
+			Pose pose = getLocalPose(handle);
+			localMatrices[handle] = pose.getAffineTransform();
+		}
+		dirtyFlags[handle] = CLEAN;
+
+		TransformHandle parent = parents[handle];
+		if (parent != INVALID_TRANSFORM)
+			worldMatrices[handle] = worldMatrices[parent] * localMatrices[handle].toMat4();
+		else
+			worldMatrices[handle] = localMatrices[handle].toMat4();
+		updated++;
+
+		for (TransformHandle child = firstChildren[handle]; child != INVALID_TRANSFORM; child = nextSiblings[child])
+			stack.push_back(child);
+	}
+	return updated;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "BasicAttributes.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+using TransformHandle = uint32_t;
+constexpr TransformHandle INVALID_TRANSFORM = UINT32_MAX;
+
+/**
+ * @brief Transform component of an entity. The transform data itself lives in the TransformSystem.
+ */
+struct Transform
+{
+	TransformHandle handle = INVALID_TRANSFORM;
+};
+
+/**
+ * @brief Hierarchy of local transforms that are turned into world matrices.
+ * Local positions, orientations and scales are stored in separate arrays. Changing a local transform flags it dirty,
+ * and update recomputes only the dirty subtrees, parents before children, different subtrees in parallel.
+ * Transforms that do not move cost nothing per update.
+ */
+class TransformSystem
+{
+public:
+	/**
+	 * @brief Creates a transform.
+	 * @param localPose is the pose relative to the parent.
+	 * @param parent of the transform, or INVALID_TRANSFORM for a root.
+	 * @return handle of the transform.
+	 */
+	TransformHandle createTransform(const Pose& localPose, TransformHandle parent = INVALID_TRANSFORM);
+
+	/**
+	 * @brief Destroys a transform. Its children become roots and keep their local transforms.
+	 */
+	void destroyTransform(TransformHandle handle);
+
+	/**
+	 * @brief Moves the transform under a new parent. The local transform is kept.
+	 * @param parent is the new parent, or INVALID_TRANSFORM to make the transform a root. Must not be a descendant.
+	 */
+	void setParent(TransformHandle handle, TransformHandle parent);
+
+	void setPosition(TransformHandle handle, const glm::vec3& position);
+	void setOrientation(TransformHandle handle, const glm::quat& orientation);
+	void setScale(TransformHandle handle, const glm::vec3& scale);
+	void setLocalPose(TransformHandle handle, const Pose& pose);
+
+	Pose getLocalPose(TransformHandle handle) const;
+	TransformHandle getParent(TransformHandle handle) const { return parents[handle]; }
+
+	/**
+	 * @brief Returns the world matrix computed by the latest update.
+	 */
+	const glm::mat4& getWorldMatrix(TransformHandle handle) const { return worldMatrices[handle]; }
+
+	/**
+	 * @brief Recomputes the world matrices of every dirty subtree.
+	 * @param jobs spreads independent subtrees over workers. Null updates on the calling thread.
+	 */
+	void update(JobSystem* jobs = nullptr);
+
+	/**
+	 * @brief Returns how many world matrices the latest update recomputed.
+	 */
+	size_t getLastUpdateCount() const { return lastUpdateCount; }
+
+	size_t getTransformCount() const { return parents.size() - freeHandles.size(); }
+
+private:
+	enum DirtyFlags : uint8_t
+	{
+		CLEAN = 0,
+		LOCAL_DIRTY = 1 << 0, // local matrix must be recomposed
+		WORLD_DIRTY = 1 << 1, // world matrix must be recomputed, e.g. after reparenting
+		ROOT_QUEUED = 1 << 2, // already picked as a dirty root during this update
+	};
+
+	void markDirty(TransformHandle handle, uint8_t flags);
+	void attach(TransformHandle handle, TransformHandle parent);
+	void detach(TransformHandle handle);
+	bool hasDirtyAncestor(TransformHandle handle) const;
+	size_t updateSubtree(TransformHandle root, std::vector<TransformHandle>& stack);
+
+	// local transforms
+	std::vector<glm::vec3> positions;
+	std::vector<glm::quat> orientations;
+	std::vector<glm::vec3> scales;
+	std::vector<AffineTransform> localMatrices;
+	// hierarchy links
+	std::vector<TransformHandle> parents;
+	std::vector<TransformHandle> firstChildren;
+	std::vector<TransformHandle> nextSiblings;
+	std::vector<TransformHandle> previousSiblings;
+	// results
+	std::vector<glm::mat4> worldMatrices;
+
+	std::vector<uint8_t> dirtyFlags;
+	std::vector<TransformHandle> dirtyHandles; ///< every handle with a dirty flag, each once
+	std::vector<TransformHandle> dirtyRoots;
+	std::vector<TransformHandle> freeHandles;
+	size_t lastUpdateCount = 0;
+};
@@ -0,0 +1,204 @@
+#include "TriangleBvh.hpp"
+#include "RayKernels.hpp"
+#include "CpuFeatures.hpp"
+
+#include <algorithm>
+
+constexpr int TRIANGLE_BVH_BIN_COUNT = 16;
+
+void TriangleBvh::build(const glm::vec3* positions, const uint32_t* indices, size_t indexCount)
+{
+	nodes.clear();
+	packets.clear();
+	root = TRIANGLE_BVH_EMPTY;
+	triangleCount = indexCount / 3;
+	bounds = { glm::vec3(0.f), glm::vec3(0.f) };
+	if (triangleCount == 0)
+		return;
+
+	std::vector<BuildTriangle> triangles(triangleCount);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		const glm::vec3& a = positions[indices[3 * t]];
+		const glm::vec3& b = positions[indices[3 * t + 1]];
+		const glm::vec3& c = positions[indices[3 * t + 2]];
+		Aabb triangleBounds = { glm::min(glm::min(a, b), c), glm::max(glm::max(a, b), c) };
+		triangles[t] = { triangleBounds, triangleBounds.getCenter(), static_cast<uint32_t>(t) };
+	}
+
+	std::vector<BuildNode> buildNodes;
+	buildNodes.reserve(2 * triangleCount / TRIANGLE_BVH_WIDTH + 1);
+	int32_t buildRoot = buildBinary(buildNodes, triangles.data(), 0, static_cast<uint32_t>(triangleCount), 0);
+	bounds = buildNodes[buildRoot].bounds;
+	root = collapse(buildNodes, buildRoot, triangles.data(), positions, indices);
+}
+
+bool TriangleBvh::intersect(const Ray& ray, float maxDistance, RayHit& hit) const
+{
+	switch (getSimdLevel())
+	{
+	case SimdLevel::AVX2:
+		return intersectTriangleBvhAvx2(nodes.data(), packets.data(), root, ray, maxDistance, hit);
+#if defined(REHTI_SIMD_X86)
+	case SimdLevel::SSE2:
+		return intersectTriangleBvhWith<Lane4>(nodes.data(), packets.data(), root, ray, maxDistance, hit);
+#endif
+	default:
+		return intersectTriangleBvhWith<Lane1>(nodes.data(), packets.data(), root, ray, maxDistance, hit);
+	}
+}
+
+int32_t TriangleBvh::buildBinary(std::vector<BuildNode>& buildNodes, BuildTriangle* triangles, uint32_t first, uint32_t count, uint32_t depth)
+{
+	BuildTriangle* range = triangles + first;
+	Aabb nodeBounds = range[0].bounds;
+	Aabb centroidBounds = { range[0].center, range[0].center };
+	for (uint32_t i = 1; i < count; i++)
+	{
+		nodeBounds = Aabb::merge(nodeBounds, range[i].bounds);
+		centroidBounds = { glm::min(centroidBounds.min, range[i].center), glm::max(centroidBounds.max, range[i].center) };
+	}
+
+	int32_t index = static_cast<int32_t>(buildNodes.size());
+	buildNodes.push_back({ nodeBounds, { -1, -1 }, first, count });
+	if (count <= TRIANGLE_BVH_WIDTH)
+		return index;
+
+	// binned SAH along the longest axis of the centroids
+	glm::vec3 centroidSize = centroidBounds.max - centroidBounds.min;
+	int axis = centroidSize.x < centroidSize.y ? (centroidSize.y < centroidSize.z ? 2 : 1) : (centroidSize.x < centroidSize.z ? 2 : 0);
+	uint32_t middle = count / 2;
+	// SAH may peel off a few triangles per level, deep ranges are split at the median to bound the traversal stack
+	if (0.f < centroidSize[axis] && depth < TRIANGLE_BVH_MEDIAN_DEPTH)
+	{
+		float binScale = TRIANGLE_BVH_BIN_COUNT / centroidSize[axis];
+		float axisMin = centroidBounds.min[axis];
+		auto getBin = [&](const BuildTriangle& triangle) {
+			return std::min(static_cast<int>((triangle.center[axis] - axisMin) * binScale), TRIANGLE_BVH_BIN_COUNT - 1);
+		};
+		Aabb binBounds[TRIANGLE_BVH_BIN_COUNT];
+		uint32_t binCounts[TRIANGLE_BVH_BIN_COUNT] = {};
+		for (uint32_t i = 0; i < count; i++)
+		{
+			int bin = getBin(range[i]);
+			binBounds[bin] = binCounts[bin] == 0 ? range[i].bounds : Aabb::merge(binBounds[bin], range[i].bounds);
+			binCounts[bin]++;
+		}
+
+		float rightAreas[TRIANGLE_BVH_BIN_COUNT];
+		uint32_t rightCounts[TRIANGLE_BVH_BIN_COUNT];
+		Aabb accumulated{};
+		uint32_t accumulatedCount = 0;
+		for (int bin = TRIANGLE_BVH_BIN_COUNT - 1; 0 < bin; bin--)
+		{
+			if (binCounts[bin] != 0)
+				accumulated = accumulatedCount == 0 ? binBounds[bin] : Aabb::merge(accumulated, binBounds[bin]);
+			accumulatedCount += binCounts[bin];
+			rightAreas[bin] = accumulatedCount == 0 ? 0.f : accumulated.getSurfaceArea();
+			rightCounts[bin] = accumulatedCount;
+		}
+		int bestBin = -1;
+		float bestCost = INFINITY;
+		accumulatedCount = 0;
+		for (int bin = 0; bin < TRIANGLE_BVH_BIN_COUNT - 1; bin++)
+		{
+			if (binCounts[bin] != 0)
+				accumulated = accumulatedCount == 0 ? binBounds[bin] : Aabb::merge(accumulated, binBounds[bin]);
+			accumulatedCount += binCounts[bin];
+			if (accumulatedCount == 0 || rightCounts[bin + 1] == 0)
+				continue;
+			float cost = accumulated.getSurfaceArea() * accumulatedCount + rightAreas[bin + 1] * rightCounts[bin + 1];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestBin = bin;
+			}
+		}
+		if (0 <= bestBin)
+		{
+			BuildTriangle* split = std::partition(range, range + count, [&](const BuildTriangle& triangle) { return getBin(triangle) <= bestBin; });
+			middle = static_cast<uint32_t>(split - range);
+		}
+	}
+
+	int32_t left = buildBinary(buildNodes, triangles, first, middle, depth + 1);
+	int32_t right = buildBinary(buildNodes, triangles, first + middle, count - middle, depth + 1);
+	buildNodes[index].children[0] = left;
+	buildNodes[index].children[1] = right;
+	return index;
+}
+
+uint32_t TriangleBvh::collapse(const std::vector<BuildNode>& buildNodes, int32_t buildNode, const BuildTriangle* triangles, const glm::vec3* positions, const uint32_t* indices)
+{
+	if (buildNodes[buildNode].children[0] < 0)
+		return makePacket(buildNodes[buildNode], triangles, positions, indices) | TRIANGLE_BVH_LEAF;
+
+	// open the largest internal children until the node has eight
+	int32_t children[TRIANGLE_BVH_WIDTH];
+	uint32_t childCount = 2;
+	children[0] = buildNodes[buildNode].children[0];
+	children[1] = buildNodes[buildNode].children[1];
+	while (childCount < TRIANGLE_BVH_WIDTH)
+	{
+		int largest = -1;
+		float largestArea = -1.f;
+		for (uint32_t c = 0; c < childCount; c++)
+		{
+			const BuildNode& child = buildNodes[children[c]];
+			if (0 <= child.children[0] && largestArea < child.bounds.getSurfaceArea())
+			{
+				largest = static_cast<int>(c);
+				largestArea = child.bounds.getSurfaceArea();
+			}
+		}
+		if (largest < 0)
+			break;
+		const BuildNode& opened = buildNodes[children[largest]];
+		children[largest] = opened.children[0];
+		children[childCount++] = opened.children[1];
+	}
+
+	uint32_t index = static_cast<uint32_t>(nodes.size());
+	nodes.emplace_back();
+	TriangleBvhNode node{};
+	for (uint32_t c = 0; c < TRIANGLE_BVH_WIDTH; c++)
+	{
+		if (childCount <= c)
+		{
+			node.children[c] = TRIANGLE_BVH_EMPTY;
+			continue;
+		}
+		const Aabb& childBounds = buildNodes[children[c]].bounds;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			node.bounds[axis][c] = childBounds.min[axis];
+			node.bounds[axis + 3][c] = childBounds.max[axis];
+		}
+		node.children[c] = collapse(buildNodes, children[c], triangles, positions, indices);
+		node.childMask |= 1u << c;
+	}
+	// the recursion may have moved the nodes
+	nodes[index] = node;
+	return index;
+}
+
+uint32_t TriangleBvh::makePacket(const BuildNode& leaf, const BuildTriangle* triangles, const glm::vec3* positions, const uint32_t* indices)
+{
+	TrianglePacket packet{};
+	for (uint32_t i = 0; i < leaf.count; i++)
+	{
+		uint32_t triangle = triangles[leaf.first + i].triangle;
+		glm::vec3 a = positions[indices[3 * triangle]];
+		glm::vec3 edge1 = positions[indices[3 * triangle + 1]] - a;
+		glm::vec3 edge2 = positions[indices[3 * triangle + 2]] - a;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			packet.vertex[axis][i] = a[axis];
+			packet.edge1[axis][i] = edge1[axis];
+			packet.edge2[axis][i] = edge2[axis];
+		}
+		packet.triangles[i] = triangle;
+	}
+	packets.push_back(packet);
+	return static_cast<uint32_t>(packets.size() - 1);
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "DynamicBvh.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+constexpr uint32_t TRIANGLE_BVH_WIDTH = 8;                   ///< children per node and triangles per leaf packet
+constexpr uint32_t TRIANGLE_BVH_LEAF = 0x80000000;           ///< set in a child reference that points to a packet
+constexpr uint32_t TRIANGLE_BVH_EMPTY = 0xffffffff;          ///< unused child slot
+constexpr uint32_t TRIANGLE_BVH_MAX_DEPTH = 64;              ///< of the binary build tree, so of the collapsed tree as well
+constexpr uint32_t TRIANGLE_BVH_MEDIAN_DEPTH = TRIANGLE_BVH_MAX_DEPTH - 32; ///< from here on ranges are halved, which ends within 32 levels
+/// each level of the traversal leaves at most seven siblings behind, and the deepest node pushes all eight children
+constexpr size_t TRIANGLE_BVH_STACK_SIZE = (TRIANGLE_BVH_WIDTH - 1) * TRIANGLE_BVH_MAX_DEPTH + 1;
+
+/**
+ * @brief Closest hit of a ray on a triangle mesh.
+ */
+struct RayHit
+{
+	float distance; ///< along the ray, in lengths of its direction
+	uint32_t triangle; ///< index of the triangle, i.e. its first index divided by three
+	float u;        ///< barycentric weight of the second vertex
+	float v;        ///< barycentric weight of the third vertex
+};
+
+/**
+ * @brief Node with eight children whose boxes are stored per component, so that one AVX2 slab test covers all of them.
+ */
+struct alignas(32) TriangleBvhNode
+{
+	float bounds[6][TRIANGLE_BVH_WIDTH];   ///< min x, y, z and max x, y, z of each child
+	uint32_t children[TRIANGLE_BVH_WIDTH]; ///< node index, packet index | TRIANGLE_BVH_LEAF or TRIANGLE_BVH_EMPTY
+	uint32_t childMask;                    ///< bit i is set if child i is used
+};
+
+/**
+ * @brief Up to eight triangles as a first vertex and two edges per component. Unused slots are degenerate and never hit.
+ */
+struct alignas(32) TrianglePacket
+{
+	float vertex[3][TRIANGLE_BVH_WIDTH];
+	float edge1[3][TRIANGLE_BVH_WIDTH];
+	float edge2[3][TRIANGLE_BVH_WIDTH];
+	uint32_t triangles[TRIANGLE_BVH_WIDTH];
+};
+
+/**
+ * @brief Static eight wide BVH over the triangles of a mesh, used for exact ray picking.
+ * It is built with binned SAH as a binary tree that is then collapsed, so a ray visits few nodes and tests
+ * eight boxes or eight triangles per step.
+ */
+class TriangleBvh
+{
+public:
+	TriangleBvh() = default;
+
+	/**
+	 * @brief Builds the tree. The positions and indices are not referenced afterwards.
+	 * @param positions of the vertices.
+	 * @param indices of the triangle list.
+	 * @param indexCount is a multiple of three.
+	 */
+	void build(const glm::vec3* positions, const uint32_t* indices, size_t indexCount);
+
+	/**
+	 * @brief Finds the closest triangle the ray hits. Both faces count.
+	 * Uses the widest instruction set the CPU supports.
+	 * @param ray in the space of the positions.
+	 * @param maxDistance along the ray.
+	 * @param hit receives the closest hit if there is one.
+	 * @return true if a triangle was hit closer than maxDistance.
+	 */
+	bool intersect(const Ray& ray, float maxDistance, RayHit& hit) const;
+
+	const Aabb& getBounds() const { return bounds; }
+	size_t getNodeCount() const { return nodes.size(); }
+	size_t getTriangleCount() const { return triangleCount; }
+
+private:
+	struct BuildNode
+	{
+		Aabb bounds;
+		int32_t children[2]; ///< -1 for leaves
+		uint32_t first;      ///< first triangle of a leaf in the build order
+		uint32_t count;
+	};
+
+	struct BuildTriangle
+	{
+		Aabb bounds;
+		glm::vec3 center;
+		uint32_t triangle;
+	};
+
+	int32_t buildBinary(std::vector<BuildNode>& buildNodes, BuildTriangle* triangles, uint32_t first, uint32_t count, uint32_t depth);
+	uint32_t collapse(const std::vector<BuildNode>& buildNodes, int32_t buildNode, const BuildTriangle* triangles, const glm::vec3* positions, const uint32_t* indices);
+	uint32_t makePacket(const BuildNode& leaf, const BuildTriangle* triangles, const glm::vec3* positions, const uint32_t* indices);
+
+	std::vector<TriangleBvhNode> nodes;
+	std::vector<TrianglePacket> packets;
+	uint32_t root = TRIANGLE_BVH_EMPTY; ///< child reference of the whole tree
+	size_t triangleCount = 0;
+	Aabb bounds = { glm::vec3(0.f), glm::vec3(0.f) };
+};
@@ -0,0 +1,14 @@
+#include "RayKernels.hpp"
+
+// This file is compiled with AVX2 and FMA enabled. It is only called after CpuFeatures has confirmed support.
+
+#if defined(__AVX2__)
+using WideLane = Lane8;
+#else
+using WideLane = Lane1;
+#endif
+
+bool intersectTriangleBvhAvx2(const TriangleBvhNode* nodes, const TrianglePacket* packets, uint32_t root, const Ray& ray, float maxDistance, RayHit& hit)
+{
+	return intersectTriangleBvhWith<WideLane>(nodes, packets, root, ray, maxDistance, hit);
+}
@@ -0,0 +1,110 @@
+#include "BakedAnimation.hpp"
+
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+glm::mat4 BakedAnimationLibrary::getBoneMatrix(uint32_t frame, uint32_t bone) const
+{
+	size_t first = static_cast<size_t>(frame) * getRowLength() + static_cast<size_t>(bone) * BAKED_TEXELS_PER_BONE;
+	glm::vec4 row0 = glm::unpackHalf4x16(texels[first]);
+	glm::vec4 row1 = glm::unpackHalf4x16(texels[first + 1]);
+	glm::vec4 row2 = glm::unpackHalf4x16(texels[first + 2]);
+	// rows back to glm's column major layout
+	return glm::mat4(
+		row0.x, row1.x, row2.x, 0.f,
+		row0.y, row1.y, row2.y, 0.f,
+		row0.z, row1.z, row2.z, 0.f,
+		row0.w, row1.w, row2.w, 1.f);
+}
+
+/**
+ * @brief Packs the upper 3x4 part of the matrix as three RGBA16F rows.
+ */
+inline void packBoneMatrix(const glm::mat4& matrix, uint64_t* texelsToFill)
+{
+	for (uint32_t row = 0; row < BAKED_TEXELS_PER_BONE; row++)
+	{
+		glm::vec4 rowVec = glm::vec4(matrix[0][row], matrix[1][row], matrix[2][row], matrix[3][row]);
+		texelsToFill[row] = glm::packHalf4x16(rowVec);
+	}
+}
+
+BakedAnimationLibrary bakeAnimations(const std::vector<Animation>& animations, const Skeleton& skeleton, const glm::mat4& inverseGlobalTransformation, float samplesPerSecond)
+{
+	BakedAnimationLibrary library{};
+	library.boneCount = static_cast<uint32_t>(skeleton.bones.size());
+	library.frameCount = 0;
+	library.clips.reserve(animations.size());
+
+	// first pass decides the layout
+	for (const Animation& animation : animations)
+	{
+		BakedClipInfo clip{};
+		clip.firstFrame = library.frameCount;
+		clip.framesPerSecond = samplesPerSecond;
+		clip.duration = (0.0 < animation.ticksPerSecond) ? static_cast<float>(animation.totalTicks / animation.ticksPerSecond) : 0.f;
+		// Empty clips still get one frame of bind pose so the clip ids stay valid.
+		clip.frameCount = (animation.animationNodes.empty()) ? 1u : std::max(1u, static_cast<uint32_t>(std::ceil(clip.duration * samplesPerSecond)));
+		library.frameCount += clip.frameCount;
+		library.clips.push_back(clip);
+	}
+
+	library.texels.resize(static_cast<size_t>(library.frameCount) * library.getRowLength());
+	std::vector<glm::mat4> sampledTransformations(library.boneCount, glm::mat4(1.f));
+
+	for (size_t clipIndex = 0; clipIndex < animations.size(); clipIndex++)
+	{
+		const Animation& animation = animations[clipIndex];
+		const BakedClipInfo& clip = library.clips[clipIndex];
+		for (uint32_t frame = 0; frame < clip.frameCount; frame++)
+		{
+			if (!animation.animationNodes.empty())
+			{
+				double seconds = static_cast<double>(frame) / samplesPerSecond;
+				sampleAnimation(animation, skeleton, inverseGlobalTransformation, seconds * animation.ticksPerSecond, sampledTransformations.data());
+			}
+			else
+			{
+				// the matrices still hold the last frame of the previous clip
+				std::fill(sampledTransformations.begin(), sampledTransformations.end(), glm::mat4(1.f));
+			}
+
+			uint64_t* row = library.texels.data() + static_cast<size_t>(clip.firstFrame + frame) * library.getRowLength();
+			for (uint32_t bone = 0; bone < library.boneCount; bone++)
+			{
+				packBoneMatrix(sampledTransformations[bone], row + bone * BAKED_TEXELS_PER_BONE);
+			}
+		}
+	}
+
+	return library;
+}
+
+BakedAnimationBuffers createBakedAnimationBuffers(VmaAllocator& allocator, const BakedAnimationLibrary& library)
+{
+	BakedAnimationBuffers buffers{};
+	// zero sized buffers are invalid, an empty library has nothing to bind
+	if (library.clips.empty() || library.texels.empty())
+		return buffers;
+	VkDeviceSize boneBytes = library.texels.size() * sizeof(uint64_t);
+	VkDeviceSize clipBytes = library.clips.size() * sizeof(BakedClipInfo);
+
+	buffers.bones = createMappedBuffer(allocator, boneBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	std::memcpy(buffers.bones.data, library.texels.data(), boneBytes);
+	vmaFlushAllocation(allocator, buffers.bones.buffer.allocation, 0, VK_WHOLE_SIZE);
+
+	buffers.clips = createMappedBuffer(allocator, clipBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	std::memcpy(buffers.clips.data, library.clips.data(), clipBytes);
+	vmaFlushAllocation(allocator, buffers.clips.buffer.allocation, 0, VK_WHOLE_SIZE);
+
+	return buffers;
+}
+
+void destroyBakedAnimationBuffers(VmaAllocator& allocator, BakedAnimationBuffers& buffers)
+{
+	destroyBuffer(allocator, buffers.bones.buffer);
+	destroyBuffer(allocator, buffers.clips.buffer);
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "GraphicsTypes.hpp"
+#include "GraphicsResources.hpp"
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+/*
+* Baked animations sample every clip of a skeleton offline into a table of bone matrices.
+* Crowds can then be animated on the GPU with only a clip id and a time offset per instance.
+*/
+
+constexpr uint32_t BAKED_TEXELS_PER_BONE = 3; // a bone is stored as a 3x4 affine matrix, one RGBA16F texel per row
+constexpr float DEFAULT_BAKE_SAMPLE_RATE = 30.f;
+
+/**
+ * @brief Describes where a clip lives in the baked data. Matches the std430 layout of the crowd shader.
+ */
+struct BakedClipInfo
+{
+	uint32_t firstFrame;   ///< first row of the clip in the baked data
+	uint32_t frameCount;   ///< number of rows baked for the clip
+	float framesPerSecond; ///< sample rate of the clip
+	float duration;        ///< duration of the clip in seconds
+};
+
+/**
+ * @brief Per instance data of an instanced crowd character. Matches the std430 layout of the crowd shader.
+ */
+struct BakedAnimationInstance
+{
+	glm::mat4 model;   ///< model matrix of the instance
+	uint32_t clipId;   ///< index of the clip in the baked library
+	float timeOffset;  ///< time offset in seconds so instances do not move in lockstep
+	uint32_t padding[2];
+};
+
+/**
+ * @brief Push constants of the crowd shader.
+ */
+struct BakedCrowdConstants
+{
+	glm::mat4 viewProjection;
+	float time;         ///< global time in seconds
+	uint32_t boneCount; ///< bones per baked frame
+};
+
+/**
+ * @brief Baked bone matrices of all clips of a skeleton.
+ * Each frame is a row of boneCount * BAKED_TEXELS_PER_BONE half precision RGBA texels.
+ */
+struct BakedAnimationLibrary
+{
+	uint32_t boneCount;
+	uint32_t frameCount;
+	std::vector<BakedClipInfo> clips;
+	std::vector<uint64_t> texels; ///< packed RGBA16F texels, frame rows one after another
+
+	/**
+	 * @brief Returns the number of texels in a single frame.
+	 */
+	uint32_t getRowLength() const { return boneCount * BAKED_TEXELS_PER_BONE; }
+
+	/**
+	 * @brief Decodes the bone matrix at the given frame and bone. Used for validating the bake on the CPU.
+	 * @param frame is the absolute row in the baked data.
+	 * @param bone index in the skeleton.
+	 * @return the bone matrix at half precision.
+	 */
+	glm::mat4 getBoneMatrix(uint32_t frame, uint32_t bone) const;
+};
+
+/**
+ * @brief GPU side of a baked library. Bound as storage buffers to the crowd shader.
+ */
+struct BakedAnimationBuffers
+{
+	MappedBuffer bones; ///< the texels of the library
+	MappedBuffer clips; ///< the clip table of the library
+};
+
+/**
+ * @brief Samples every animation at a fixed rate and packs the bone matrices at half precision.
+ * @param animations is the clip library. Clip ids follow the order of this list.
+ * @param skeleton the animations are played on.
+ * @param inverseGlobalTransformation of the character.
+ * @param samplesPerSecond is the bake rate.
+ * @return the baked library.
+ */
+BakedAnimationLibrary bakeAnimations(const std::vector<Animation>& animations, const Skeleton& skeleton, const glm::mat4& inverseGlobalTransformation, float samplesPerSecond = DEFAULT_BAKE_SAMPLE_RATE);
+
+/**
+ * @brief Uploads a baked library to storage buffers.
+ * @param allocator to allocate the buffers with.
+ * @param library to upload.
+ * @return the created buffers, null handles if the library has no clips.
+ */
+BakedAnimationBuffers createBakedAnimationBuffers(VmaAllocator& allocator, const BakedAnimationLibrary& library);
+
+void destroyBakedAnimationBuffers(VmaAllocator& allocator, BakedAnimationBuffers& buffers);
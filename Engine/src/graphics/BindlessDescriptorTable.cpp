@@ -0,0 +1,214 @@
+#include "BindlessDescriptorTable.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+#define VK_CHECK(x, msg) if (x != VK_SUCCESS) { throw std::runtime_error(msg); }
+
+BindlessSlotAllocator::BindlessSlotAllocator(uint32_t capacity)
+	: capacity(capacity), highWater(0), allocatedCount(0), currentFrame(0), retiredSlots(1)
+{
+}
+
+void BindlessSlotAllocator::reset(uint32_t capacity, uint32_t frameCount)
+{
+	this->capacity = capacity;
+	highWater = 0;
+	allocatedCount = 0;
+	currentFrame = 0;
+	freeSlots.clear();
+	retiredSlots.assign(std::max(frameCount, 1u), {});
+}
+
+uint32_t BindlessSlotAllocator::allocate()
+{
+	uint32_t slot;
+	if (!freeSlots.empty())
+	{
+		std::pop_heap(freeSlots.begin(), freeSlots.end(), std::greater<uint32_t>());
+		slot = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	else if (highWater < capacity)
+	{
+		slot = highWater++;
+	}
+	else
+	{
+		return INVALID_BINDLESS_SLOT;
+	}
+	allocatedCount++;
+	return slot;
+}
+
+void BindlessSlotAllocator::release(uint32_t slot)
+{
+	if (slot == INVALID_BINDLESS_SLOT)
+		return;
+	retiredSlots[currentFrame].push_back(slot);
+	allocatedCount--;
+}
+
+void BindlessSlotAllocator::beginFrame(uint32_t frameIndex)
+{
+	currentFrame = frameIndex % retiredSlots.size();
+	// frames finish in order, so when this one has signaled so have the ones in flight when the slots were released
+	for (uint32_t slot : retiredSlots[currentFrame])
+	{
+		freeSlots.push_back(slot);
+		std::push_heap(freeSlots.begin(), freeSlots.end(), std::greater<uint32_t>());
+	}
+	retiredSlots[currentFrame].clear();
+}
+
+BindlessDescriptorTable::BindlessDescriptorTable()
+	: device(VK_NULL_HANDLE), layout(VK_NULL_HANDLE), pool(VK_NULL_HANDLE), set(VK_NULL_HANDLE)
+{
+}
+
+BindlessDescriptorTable::~BindlessDescriptorTable()
+{
+	cleanup();
+}
+
+void BindlessDescriptorTable::initialize(VkPhysicalDevice physDevice, VkDevice device, uint32_t frameCount, const BindlessLimits& limits)
+{
+	this->device = device;
+
+	VkPhysicalDeviceDescriptorIndexingProperties indexingProperties{};
+	indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+	VkPhysicalDeviceProperties2 properties{};
+	properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	properties.pNext = &indexingProperties;
+	vkGetPhysicalDeviceProperties2(physDevice, &properties);
+	// every array counts against the per stage limit as well, the descriptors of other sets need room too
+	uint32_t perStage = indexingProperties.maxPerStageDescriptorUpdateAfterBindResources;
+	this->limits.sampledImages = std::min({ limits.sampledImages, indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages, perStage / 2 });
+	this->limits.storageBuffers = std::min({ limits.storageBuffers, indexingProperties.maxDescriptorSetUpdateAfterBindStorageBuffers, perStage / 4 });
+	this->limits.samplers = std::min({ limits.samplers, indexingProperties.maxDescriptorSetUpdateAfterBindSamplers, perStage / 8 });
+
+	std::array<uint32_t, static_cast<size_t>(BindlessResourceType::COUNT)> counts = { this->limits.sampledImages, this->limits.storageBuffers, this->limits.samplers };
+	std::array<VkDescriptorType, static_cast<size_t>(BindlessResourceType::COUNT)> types = { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_SAMPLER };
+	std::array<VkDescriptorSetLayoutBinding, static_cast<size_t>(BindlessResourceType::COUNT)> bindings{};
+	std::array<VkDescriptorBindingFlags, static_cast<size_t>(BindlessResourceType::COUNT)> bindingFlags{};
+	std::array<VkDescriptorPoolSize, static_cast<size_t>(BindlessResourceType::COUNT)> poolSizes{};
+	for (uint32_t i = 0; i < bindings.size(); i++)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorType = types[i];
+		bindings[i].descriptorCount = counts[i];
+		bindings[i].stageFlags = VK_SHADER_STAGE_ALL;
+		// slots are rewritten while pending command buffers still use the set, though never the slots those read
+		bindingFlags[i] = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+		poolSizes[i] = { types[i], counts[i] };
+		slots[i].reset(counts[i], frameCount);
+	}
+
+	// created directly, no other set shares the layout so interning it gains nothing
+	VkDescriptorSetLayoutBindingFlagsCreateInfo flagsInfo{};
+	flagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+	flagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+	flagsInfo.pBindingFlags = bindingFlags.data();
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.pNext = &flagsInfo;
+	layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+	VK_CHECK(vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &layout), "Failed to create the bindless descriptor set layout");
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+	poolInfo.maxSets = 1;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+	VK_CHECK(vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool), "Failed to create the bindless descriptor pool");
+
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = pool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &layout;
+	VK_CHECK(vkAllocateDescriptorSets(device, &allocInfo, &set), "Failed to allocate the bindless descriptor set");
+}
+
+void BindlessDescriptorTable::cleanup()
+{
+	if (device == VK_NULL_HANDLE)
+		return;
+	// the set is freed with its pool
+	vkDestroyDescriptorPool(device, pool, nullptr);
+	vkDestroyDescriptorSetLayout(device, layout, nullptr);
+	for (BindlessSlotAllocator& allocator : slots)
+		allocator.reset(0);
+	pool = VK_NULL_HANDLE;
+	layout = VK_NULL_HANDLE;
+	set = VK_NULL_HANDLE;
+	device = VK_NULL_HANDLE;
+}
+
+uint32_t BindlessDescriptorTable::addSampledImage(VkImageView imageView, VkImageLayout imageLayout)
+{
+	VkDescriptorImageInfo imageInfo{};
+	imageInfo.imageView = imageView;
+	imageInfo.imageLayout = imageLayout;
+	return add(BindlessResourceType::SAMPLED_IMAGE, &imageInfo, nullptr);
+}
+
+uint32_t BindlessDescriptorTable::addStorageBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+{
+	VkDescriptorBufferInfo bufferInfo{};
+	bufferInfo.buffer = buffer;
+	bufferInfo.offset = offset;
+	bufferInfo.range = range;
+	return add(BindlessResourceType::STORAGE_BUFFER, nullptr, &bufferInfo);
+}
+
+uint32_t BindlessDescriptorTable::addSampler(VkSampler sampler)
+{
+	VkDescriptorImageInfo imageInfo{};
+	imageInfo.sampler = sampler;
+	return add(BindlessResourceType::SAMPLER, &imageInfo, nullptr);
+}
+
+void BindlessDescriptorTable::remove(BindlessResourceType type, uint32_t slot)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	slots[static_cast<size_t>(type)].release(slot);
+}
+
+void BindlessDescriptorTable::beginFrame(uint32_t frameIndex)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for (BindlessSlotAllocator& allocator : slots)
+		allocator.beginFrame(frameIndex);
+}
+
+void BindlessDescriptorTable::bind(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout pipelineLayout, uint32_t setIndex) const
+{
+	vkCmdBindDescriptorSets(commandBuffer, bindPoint, pipelineLayout, setIndex, 1, &set, 0, nullptr);
+}
+
+uint32_t BindlessDescriptorTable::add(BindlessResourceType type, const VkDescriptorImageInfo* imageInfo, const VkDescriptorBufferInfo* bufferInfo)
+{
+	static constexpr VkDescriptorType DESCRIPTOR_TYPES[] = { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_SAMPLER };
+	std::lock_guard<std::mutex> lock(mutex);
+	uint32_t slot = slots[static_cast<size_t>(type)].allocate();
+	if (slot == INVALID_BINDLESS_SLOT)
+		return INVALID_BINDLESS_SLOT;
+
+	VkWriteDescriptorSet write{};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet = set;
+	write.dstBinding = static_cast<uint32_t>(type);
+	write.dstArrayElement = slot;
+	write.descriptorCount = 1;
+	write.descriptorType = DESCRIPTOR_TYPES[static_cast<size_t>(type)];
+	write.pImageInfo = imageInfo;
+	write.pBufferInfo = bufferInfo;
+	// update after bind lets the write land while frames that use other slots are recorded or executing
+	vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+	return slot;
+}
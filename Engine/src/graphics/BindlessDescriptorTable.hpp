@@ -0,0 +1,163 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/*
+* In bindless mode every texture, storage buffer and sampler lives in one large descriptor set, which is bound once per
+* pipeline layout instead of once per object. Resources are referred to by their slot in the arrays of the set, passed to
+* the shaders through push constants or instance data. The set is created with update after bind, so slots are written
+* while command buffers that use the set are recorded or executing, and only partially bound, so free slots stay unwritten.
+*
+* The arrays are declared in GLSL with GL_EXT_nonuniform_qualifier as
+*     layout(set = S, binding = 0) uniform texture2D textures[];
+*     layout(set = S, binding = 1) buffer StorageBuffers { uint words[]; } storageBuffers[];
+*     layout(set = S, binding = 2) uniform sampler samplers[];
+* and sampled as texture(sampler2D(textures[nonuniformEXT(index)], samplers[sampler]), uv).
+*/
+
+constexpr uint32_t INVALID_BINDLESS_SLOT = 0xffffffff;
+
+/**
+ * @brief Kind of resource, which is also its binding in the bindless set.
+ */
+enum class BindlessResourceType : uint32_t
+{
+	SAMPLED_IMAGE = 0,
+	STORAGE_BUFFER = 1,
+	SAMPLER = 2,
+	COUNT = 3,
+};
+
+/**
+ * @brief Lengths of the arrays of the bindless set. Clamped to the limits of the device.
+ */
+struct BindlessLimits
+{
+	uint32_t sampledImages = 16384;
+	uint32_t storageBuffers = 4096;
+	uint32_t samplers = 128;
+};
+
+/**
+ * @brief Hands out the slots of one array of the bindless set through a free list.
+ * Released slots are retired with the frame that released them, since frames in flight may still read them, and are
+ * handed out again when that frame begins its next round, after its fence has signaled.
+ * Freed slots are reused lowest first, so the used part of the array stays compact.
+ */
+class BindlessSlotAllocator
+{
+public:
+	explicit BindlessSlotAllocator(uint32_t capacity = 0);
+
+	/**
+	 * @brief Frees every slot and sets the length of the array.
+	 * @param frameCount number of frames in flight, each keeps its own list of retired slots.
+	 */
+	void reset(uint32_t capacity, uint32_t frameCount = 1);
+
+	/**
+	 * @return a free slot, or INVALID_BINDLESS_SLOT if the array is full.
+	 */
+	uint32_t allocate();
+
+	/**
+	 * @brief Releases an allocated slot into the retire list of the current frame.
+	 * It is not handed out again before that frame begins again.
+	 */
+	void release(uint32_t slot);
+
+	/**
+	 * @brief Frees the slots retired the last time this frame was current and makes it the current frame.
+	 * Call once the fence of the frame has signaled, when the GPU is done with every frame that could read them.
+	 */
+	void beginFrame(uint32_t frameIndex);
+
+	uint32_t getCapacity() const { return capacity; }
+	uint32_t getAllocatedCount() const { return allocatedCount; }
+
+private:
+	uint32_t capacity;
+	uint32_t highWater;      ///< slots from here on have never been handed out
+	uint32_t allocatedCount;
+	std::vector<uint32_t> freeSlots;    ///< a heap with the lowest slot on top
+	uint32_t currentFrame;
+	std::vector<std::vector<uint32_t>> retiredSlots; ///< per frame in flight
+};
+
+/**
+ * @brief The global descriptor set of bindless mode, see VulkanBackendFlags::BINDLESS_DESCRIPTORS.
+ * Requires the descriptor indexing features of Vulkan 1.2. Adding and removing resources is thread safe.
+ */
+class BindlessDescriptorTable
+{
+public:
+	BindlessDescriptorTable();
+	~BindlessDescriptorTable();
+
+	BindlessDescriptorTable(const BindlessDescriptorTable&) = delete;
+	BindlessDescriptorTable& operator=(const BindlessDescriptorTable&) = delete;
+
+	/**
+	 * @brief Creates the layout, the pool and the set.
+	 * @param physDevice whose descriptor indexing limits clamp the requested lengths.
+	 * @param device created with the descriptor indexing features enabled.
+	 * @param frameCount number of frames in flight, removed slots are reused after their frame comes around again.
+	 * @param limits requested lengths of the arrays.
+	 */
+	void initialize(VkPhysicalDevice physDevice, VkDevice device, uint32_t frameCount, const BindlessLimits& limits = {});
+
+	void cleanup();
+
+	/**
+	 * @brief Writes an image view into a free slot.
+	 * @return the slot, or INVALID_BINDLESS_SLOT if the array is full.
+	 */
+	uint32_t addSampledImage(VkImageView imageView, VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+	/**
+	 * @brief Writes a range of a storage buffer into a free slot.
+	 * @return the slot, or INVALID_BINDLESS_SLOT if the array is full.
+	 */
+	uint32_t addStorageBuffer(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+
+	/**
+	 * @brief Writes a sampler into a free slot.
+	 * @return the slot, or INVALID_BINDLESS_SLOT if the array is full.
+	 */
+	uint32_t addSampler(VkSampler sampler);
+
+	/**
+	 * @brief Releases a slot. The descriptor stays valid for the frames in flight until the current frame begins again.
+	 */
+	void remove(BindlessResourceType type, uint32_t slot);
+
+	/**
+	 * @brief Frees the slots removed the last time this frame was current. Call after waiting for the fence of the frame.
+	 */
+	void beginFrame(uint32_t frameIndex);
+
+	/**
+	 * @brief Binds the set. Stays bound across pipelines of the same layout, so this is needed once per layout in a command buffer.
+	 */
+	void bind(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout pipelineLayout, uint32_t setIndex) const;
+
+	VkDescriptorSetLayout getLayout() const { return layout; }
+	VkDescriptorSet getSet() const { return set; }
+	const BindlessLimits& getLimits() const { return limits; }
+
+private:
+	uint32_t add(BindlessResourceType type, const VkDescriptorImageInfo* imageInfo, const VkDescriptorBufferInfo* bufferInfo);
+
+	VkDevice device;
+	VkDescriptorSetLayout layout;
+	VkDescriptorPool pool;
+	VkDescriptorSet set;
+	BindlessLimits limits;
+	std::array<BindlessSlotAllocator, static_cast<size_t>(BindlessResourceType::COUNT)> slots;
+	std::mutex mutex; ///< guards the slots and the writes to the set
+};
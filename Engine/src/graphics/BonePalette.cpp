@@ -0,0 +1,104 @@
+#include "BonePalette.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+constexpr VkDeviceSize BYTES_PER_BONE = PALETTE_VEC4S_PER_BONE * sizeof(glm::vec4);
+
+void BonePaletteBuffer::create(VmaAllocator& allocator, uint32_t concurrentFrames, uint32_t boneCapacity)
+{
+	this->allocator = allocator;
+	frames.resize(concurrentFrames);
+	for (FramePalette& frame : frames)
+	{
+		frame.buffer = createMappedBuffer(allocator, boneCapacity * BYTES_PER_BONE, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+		frame.boneCapacity = boneCapacity;
+		frame.resized = false;
+	}
+	currentFrame = 0;
+	bonesWritten = 0;
+}
+
+void BonePaletteBuffer::destroy()
+{
+	for (FramePalette& frame : frames)
+	{
+		destroyBuffer(allocator, frame.buffer.buffer);
+	}
+	for (RetiredPalette& retired : retiredBuffers)
+	{
+		destroyBuffer(allocator, retired.buffer);
+	}
+	frames.clear();
+	retiredBuffers.clear();
+}
+
+void BonePaletteBuffer::beginFrame(uint32_t frameIndex)
+{
+	currentFrame = frameIndex % static_cast<uint32_t>(frames.size());
+	bonesWritten = 0;
+	// the fence of the frame has signaled, so the buffers it outgrew are no longer read
+	auto firstKept = std::partition(retiredBuffers.begin(), retiredBuffers.end(), [this](const RetiredPalette& retired) { return retired.frame == currentFrame; });
+	for (auto retired = retiredBuffers.begin(); retired != firstKept; retired++)
+	{
+		destroyBuffer(allocator, retired->buffer);
+	}
+	retiredBuffers.erase(retiredBuffers.begin(), firstKept);
+}
+
+uint32_t BonePaletteBuffer::pushPalette(const glm::mat4* transformations, uint32_t boneCount)
+{
+	if (frames[currentFrame].boneCapacity < bonesWritten + boneCount)
+		grow(bonesWritten + boneCount);
+
+	uint32_t offset = bonesWritten;
+	glm::vec4* rows = static_cast<glm::vec4*>(frames[currentFrame].buffer.data) + static_cast<size_t>(offset) * PALETTE_VEC4S_PER_BONE;
+	for (uint32_t bone = 0; bone < boneCount; bone++)
+	{
+		const glm::mat4& matrix = transformations[bone];
+		// transposed, so that the translation ends up in the w components
+		for (uint32_t row = 0; row < PALETTE_VEC4S_PER_BONE; row++)
+		{
+			rows[row] = glm::vec4(matrix[0][row], matrix[1][row], matrix[2][row], matrix[3][row]);
+		}
+		rows += PALETTE_VEC4S_PER_BONE;
+	}
+	bonesWritten += boneCount;
+	return offset;
+}
+
+void BonePaletteBuffer::endFrame()
+{
+	if (0 < bonesWritten)
+		vmaFlushAllocation(allocator, frames[currentFrame].buffer.buffer.allocation, 0, bonesWritten * BYTES_PER_BONE);
+}
+
+VkDescriptorBufferInfo BonePaletteBuffer::getDescriptorInfo() const
+{
+	VkDescriptorBufferInfo info{};
+	info.buffer = frames[currentFrame].buffer.buffer.buffer;
+	info.offset = 0;
+	info.range = VK_WHOLE_SIZE;
+	return info;
+}
+
+bool BonePaletteBuffer::consumeResize()
+{
+	bool resized = frames[currentFrame].resized;
+	frames[currentFrame].resized = false;
+	return resized;
+}
+
+void BonePaletteBuffer::grow(uint32_t requiredBones)
+{
+	FramePalette& frame = frames[currentFrame];
+	uint32_t newCapacity = std::max(requiredBones, frame.boneCapacity * 2);
+	MappedBuffer newBuffer = createMappedBuffer(allocator, newCapacity * BYTES_PER_BONE, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	std::memcpy(newBuffer.data, frame.buffer.data, bonesWritten * BYTES_PER_BONE);
+	// draws of this frame recorded before the growth still read the old buffer, it lives until the frame comes around again
+	retiredBuffers.push_back({ frame.buffer.buffer, currentFrame });
+
+	frame.buffer = newBuffer;
+	frame.boneCapacity = newCapacity;
+	frame.resized = true;
+}
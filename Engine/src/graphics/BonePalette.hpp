@@ -0,0 +1,98 @@
+#pragma once
+
+#include "GraphicsResources.hpp"
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+/*
+* The bone palette packs the skinning matrices of every visible skinned instance into one storage buffer per frame.
+* Instances find their own palette with the offset returned by pushPalette, passed to the shader as a push constant.
+*/
+
+constexpr uint32_t PALETTE_VEC4S_PER_BONE = 3; // a bone is stored as a 3x4 affine matrix, one row per vec4
+constexpr uint32_t DEFAULT_PALETTE_BONE_CAPACITY = 4096;
+
+/**
+ * @brief Push constants of the skinned shader.
+ */
+struct SkinnedPushConstants
+{
+	glm::mat4 model;
+	uint32_t paletteOffset; ///< index of the first bone of the instance in the palette
+};
+
+/**
+ * @brief Ring of persistently mapped storage buffers, one per concurrent frame.
+ */
+class BonePaletteBuffer
+{
+public:
+	/**
+	 * @brief Creates a palette buffer for every concurrent frame.
+	 * @param allocator to allocate the buffers with.
+	 * @param concurrentFrames is the number of frames in flight.
+	 * @param boneCapacity is the initial number of bones a single frame can hold.
+	 */
+	void create(VmaAllocator& allocator, uint32_t concurrentFrames, uint32_t boneCapacity = DEFAULT_PALETTE_BONE_CAPACITY);
+
+	void destroy();
+
+	/**
+	 * @brief Starts filling the buffer of the given frame. The fence of the frame must have been waited on.
+	 * Destroys the buffers the frame outgrew when it was last recorded.
+	 * @param frameIndex is the index of the concurrent frame.
+	 */
+	void beginFrame(uint32_t frameIndex);
+
+	/**
+	 * @brief Appends the palette of one instance to the current frame. Grows the buffer if it is full.
+	 * @param transformations are the skinning matrices of the instance. Only the upper 3x4 part is stored.
+	 * @param boneCount is the number of bones the instance actually uses.
+	 * @return offset of the first bone of the instance, in bones.
+	 */
+	uint32_t pushPalette(const glm::mat4* transformations, uint32_t boneCount);
+
+	/**
+	 * @brief Flushes the written range of the current frame so the GPU can see it.
+	 */
+	void endFrame();
+
+	/**
+	 * @brief Returns the descriptor info of the buffer of the current frame.
+	 */
+	VkDescriptorBufferInfo getDescriptorInfo() const;
+
+	/**
+	 * @brief Returns true once after the buffer of the current frame was reallocated, so its descriptor can be rewritten.
+	 */
+	bool consumeResize();
+
+	uint32_t getBoneCount() const { return bonesWritten; }
+
+private:
+	struct FramePalette
+	{
+		MappedBuffer buffer;
+		uint32_t boneCapacity;
+		bool resized;
+	};
+
+	/**
+	 * @brief Buffer replaced by grow, still referenced by the command buffers of its frame.
+	 */
+	struct RetiredPalette
+	{
+		Buffer buffer;
+		uint32_t frame; ///< destroyed when this frame begins again
+	};
+
+	void grow(uint32_t requiredBones);
+
+	VmaAllocator allocator = VK_NULL_HANDLE;
+	std::vector<FramePalette> frames;
+	std::vector<RetiredPalette> retiredBuffers;
+	uint32_t currentFrame = 0;
+	uint32_t bonesWritten = 0;
+};
@@ -67,6 +67,11 @@ glm::mat4 Camera::getWorldToScreenMatrix() const
 	return projectionMatrix * getViewMatrix();
 }
 
+Frustum Camera::getFrustum() const
+{
+	return Frustum::fromViewProjection(getWorldToScreenMatrix());
+}
+
 glm::vec3 Camera::getCameraRay(double x, double y) const
 {
 	std::cout << "Asked screen coordinates: " << x << ", " << y << "\n"
@@ -87,6 +92,19 @@ glm::vec3 Camera::getCameraRay(double x, double y) const
 	return ray;
 }
 
+Ray Camera::getPickingRay(double x, double y) const
+{
+	// Vulkan clip space: y points down like the screen and depth goes from 0 at the near plane to 1 at the far plane
+	float normx = (2.f * static_cast<float>(x)) / width - 1.f;
+	float normy = (2.f * static_cast<float>(y)) / height - 1.f;
+	glm::mat4 screenToWorld = glm::inverse(getWorldToScreenMatrix());
+	glm::vec4 nearPoint = screenToWorld * glm::vec4(normx, normy, 0.f, 1.f);
+	glm::vec4 farPoint = screenToWorld * glm::vec4(normx, normy, 1.f, 1.f);
+	glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+	glm::vec3 direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+	return { origin, direction };
+}
+
 uint32_t Camera::getUboSize()
 {
 	return sizeof(glm::mat4);
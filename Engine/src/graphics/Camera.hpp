@@ -1,4 +1,5 @@
 #pragma once
+#include "DynamicBvh.hpp"
 #include <glm/glm.hpp>
 #include <glm/gtc/constants.hpp>
 #include <functional>
@@ -46,12 +47,26 @@ public:
 	 */
 	glm::vec3 getCameraRay(double x, double y) const;
 
+	/**
+	 * @brief Returns the world space ray through a point of the screen, unprojected with the same matrices used for drawing.
+	 * @param x of the point in pixels from the left.
+	 * @param y of the point in pixels from the top.
+	 * @return Ray from the near plane with a unit length direction, so distances along it are in world units.
+	 */
+	Ray getPickingRay(double x, double y) const;
+
 	/**
 	 * @brief Returns the world to screen matrix.
 	 * @return World to screen matrix.
 	 */
 	glm::mat4 getWorldToScreenMatrix() const;
 
+	/**
+	 * @brief Returns the view frustum in world space.
+	 * @return Frustum of the world to screen matrix.
+	 */
+	Frustum getFrustum() const;
+
 	/**
 	 * @brief Returns the size of the camera's UBO.
 	 * @return Size of the camera's UBO.
@@ -0,0 +1,168 @@
+#include "CommandRecorder.hpp"
+#include "JobSystem.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+
+#define VK_CHECK(x, msg) if (x != VK_SUCCESS) { throw std::runtime_error(msg); }
+
+CommandRecorder::CommandRecorder()
+	: device(VK_NULL_HANDLE), queueFamily(0), slotCount(0), currentFrame(0)
+{
+}
+
+CommandRecorder::~CommandRecorder()
+{
+	cleanup();
+}
+
+void CommandRecorder::initialize(VkDevice device, uint32_t queueFamily, uint32_t concurrentFrames, uint32_t slotCount)
+{
+	this->device = device;
+	this->queueFamily = queueFamily;
+	this->slotCount = std::max<uint32_t>(slotCount, 1);
+	currentFrame = 0;
+
+	frames.resize(concurrentFrames);
+	for (FrameCommands& frame : frames)
+	{
+		frame.primaryPool = createPool();
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = frame.primaryPool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+		VK_CHECK(vkAllocateCommandBuffers(device, &allocInfo, &frame.primary), "Failed to allocate a primary command buffer");
+
+		frame.slots.resize(this->slotCount);
+		for (RecordingSlot& slot : frame.slots)
+		{
+			slot.pool = createPool();
+			slot.usedSecondaries = 0;
+		}
+	}
+}
+
+void CommandRecorder::cleanup()
+{
+	if (device == VK_NULL_HANDLE)
+		return;
+	// destroying a pool frees its command buffers
+	for (FrameCommands& frame : frames)
+	{
+		vkDestroyCommandPool(device, frame.primaryPool, nullptr);
+		for (RecordingSlot& slot : frame.slots)
+			vkDestroyCommandPool(device, slot.pool, nullptr);
+	}
+	frames.clear();
+	device = VK_NULL_HANDLE;
+}
+
+VkCommandBuffer CommandRecorder::beginFrame(uint32_t frameIndex)
+{
+	currentFrame = frameIndex;
+	FrameCommands& frame = frames[currentFrame];
+	VK_CHECK(vkResetCommandPool(device, frame.primaryPool, 0), "Failed to reset a command pool");
+	for (RecordingSlot& slot : frame.slots)
+	{
+		VK_CHECK(vkResetCommandPool(device, slot.pool, 0), "Failed to reset a command pool");
+		slot.usedSecondaries = 0;
+	}
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	VK_CHECK(vkBeginCommandBuffer(frame.primary, &beginInfo), "Failed to begin a primary command buffer");
+	return frame.primary;
+}
+
+DrawListStats CommandRecorder::recordDrawList(const VkCommandBufferInheritanceInfo& inheritance, const DrawList& drawList, const DrawStateTable& states,
+	const GeometryBuffers& geometryBuffers, const std::function<void(VkCommandBuffer)>& setup)
+{
+	size_t batchCount = drawList.getBatches().size();
+	if (batchCount == 0)
+		return DrawListStats{};
+
+	FrameCommands& frame = frames[currentFrame];
+	size_t sliceCount = std::min<size_t>(slotCount, (batchCount + MIN_BATCHES_PER_SECONDARY - 1) / MIN_BATCHES_PER_SECONDARY);
+	// allocate on this thread, the workers only record
+	std::vector<VkCommandBuffer> secondaries(sliceCount);
+	for (size_t slice = 0; slice < sliceCount; slice++)
+		secondaries[slice] = acquireSecondary(frame.slots[slice]);
+
+	std::vector<DrawListStats> sliceStats(sliceCount);
+	std::atomic<bool> failed = false;
+	JobSystem::getInstance().parallelFor(sliceCount, 1, [&](size_t begin, size_t end) {
+		for (size_t slice = begin; slice < end; slice++)
+		{
+			VkCommandBuffer commandBuffer = secondaries[slice];
+			VkCommandBufferBeginInfo beginInfo{};
+			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+			beginInfo.pInheritanceInfo = &inheritance;
+			if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+			{
+				failed = true;
+				continue;
+			}
+			if (setup)
+				setup(commandBuffer);
+			size_t firstBatch = batchCount * slice / sliceCount;
+			size_t lastBatch = batchCount * (slice + 1) / sliceCount;
+			sliceStats[slice] = drawList.record(commandBuffer, states, geometryBuffers, firstBatch, lastBatch - firstBatch);
+			if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+				failed = true;
+		}
+	});
+	if (failed)
+		throw std::runtime_error("Failed to record a secondary command buffer");
+
+	vkCmdExecuteCommands(frame.primary, static_cast<uint32_t>(sliceCount), secondaries.data());
+
+	DrawListStats stats;
+	for (const DrawListStats& slice : sliceStats)
+	{
+		stats.pipelineBinds += slice.pipelineBinds;
+		stats.materialBinds += slice.materialBinds;
+		stats.descriptorSetBinds += slice.descriptorSetBinds;
+		stats.geometryBinds += slice.geometryBinds;
+		stats.drawCalls += slice.drawCalls;
+	}
+	return stats;
+}
+
+VkCommandBuffer CommandRecorder::endFrame()
+{
+	VkCommandBuffer primary = frames[currentFrame].primary;
+	VK_CHECK(vkEndCommandBuffer(primary), "Failed to end a primary command buffer");
+	return primary;
+}
+
+VkCommandPool CommandRecorder::createPool() const
+{
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.queueFamilyIndex = queueFamily;
+	// buffers live for a single frame and are only reset with the whole pool
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	VkCommandPool pool;
+	VK_CHECK(vkCreateCommandPool(device, &poolInfo, nullptr, &pool), "Failed to create a command pool");
+	return pool;
+}
+
+VkCommandBuffer CommandRecorder::acquireSecondary(RecordingSlot& slot)
+{
+	if (slot.usedSecondaries == slot.secondaries.size())
+	{
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = slot.pool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		allocInfo.commandBufferCount = 1;
+		VkCommandBuffer commandBuffer;
+		VK_CHECK(vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer), "Failed to allocate a secondary command buffer");
+		slot.secondaries.push_back(commandBuffer);
+	}
+	return slot.secondaries[slot.usedSecondaries++];
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "DrawList.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/*
+* Command buffers of a frame come from pools owned by that frame. Each recording slot of a frame has its own pool,
+* so the slots record secondary command buffers on the job system without locking. Instead of resetting single buffers,
+* every pool of a frame is reset at once when the frame begins again.
+*/
+
+constexpr uint32_t MIN_BATCHES_PER_SECONDARY = 64; ///< smaller slices are not worth a secondary command buffer
+
+class CommandRecorder
+{
+
+public:
+	CommandRecorder();
+	~CommandRecorder();
+
+	/**
+	 * @brief Creates the command pools and the primary command buffers.
+	 * @param device to create the pools on.
+	 * @param queueFamily the command buffers are submitted to.
+	 * @param concurrentFrames is the number of frames in flight.
+	 * @param slotCount is the number of secondary command buffers a draw list is split into at most, e.g. the job system workers plus one.
+	 */
+	void initialize(VkDevice device, uint32_t queueFamily, uint32_t concurrentFrames, uint32_t slotCount);
+
+	/**
+	 * @brief Destroys the pools. The GPU must be done with every frame.
+	 */
+	void cleanup();
+
+	/**
+	 * @brief Resets the pools of the frame and begins its primary command buffer. Call after waiting on the frame's fence.
+	 * @param frameIndex is the index of the concurrent frame.
+	 * @return the primary command buffer of the frame.
+	 */
+	VkCommandBuffer beginFrame(uint32_t frameIndex);
+
+	/**
+	 * @brief Records the batches of a sorted draw list into secondary command buffers in parallel and executes them from the primary in order.
+	 * Must be called inside a render pass begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS, or dynamic rendering
+	 * begun with VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT.
+	 * @param inheritance describes the render pass the secondaries continue. With dynamic rendering its pNext holds a VkCommandBufferInheritanceRenderingInfo.
+	 * @param drawList to record. Must be sorted.
+	 * @param states the ids of the draw keys refer to.
+	 * @param geometryBuffers holding the meshes.
+	 * @param setup is recorded at the start of every secondary, e.g. viewport, scissor and push constants. Called from worker threads.
+	 * @return the binds and draws of every secondary combined.
+	 */
+	DrawListStats recordDrawList(const VkCommandBufferInheritanceInfo& inheritance, const DrawList& drawList, const DrawStateTable& states,
+		const GeometryBuffers& geometryBuffers, const std::function<void(VkCommandBuffer)>& setup = nullptr);
+
+	/**
+	 * @brief Ends the primary command buffer of the frame.
+	 * @return the primary command buffer, ready to submit.
+	 */
+	VkCommandBuffer endFrame();
+
+	VkCommandBuffer getPrimaryCommandBuffer() const { return frames[currentFrame].primary; }
+	uint32_t getSlotCount() const { return slotCount; }
+
+private:
+	struct RecordingSlot
+	{
+		VkCommandPool pool;
+		std::vector<VkCommandBuffer> secondaries; ///< allocated on demand, reused every frame
+		uint32_t usedSecondaries;
+	};
+
+	struct FrameCommands
+	{
+		VkCommandPool primaryPool;
+		VkCommandBuffer primary;
+		std::vector<RecordingSlot> slots;
+	};
+
+	VkCommandPool createPool() const;
+	VkCommandBuffer acquireSecondary(RecordingSlot& slot);
+
+	VkDevice device;
+	uint32_t queueFamily;
+	uint32_t slotCount;
+	uint32_t currentFrame;
+	std::vector<FrameCommands> frames;
+};
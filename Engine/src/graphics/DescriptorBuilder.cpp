@@ -1,21 +1,66 @@
 #include "DescriptorBuilder.hpp"
 
-PoolManager::PoolManager(VkDevice device)
-	: logDevice(device), currentPool(VK_NULL_HANDLE)
+#include <cmath>
+
+namespace
 {
-}
+	std::vector<VkDescriptorPoolSize>::iterator findPoolSize(std::vector<VkDescriptorPoolSize>& sizes, VkDescriptorType type)
+	{
+		return std::find_if(sizes.begin(), sizes.end(), [type](const VkDescriptorPoolSize& size) { return size.type == type; });
+	}
+} // namespace
 
-PoolManager::~PoolManager()
+std::vector<VkDescriptorPoolSize> computeDescriptorPoolSizes(const std::array<uint32_t, TRACKED_DESCRIPTOR_TYPE_COUNT>& typeCounts, uint32_t setCount, uint32_t setsPerPool)
 {
-	for (auto& pool : usedPools)
+	std::vector<VkDescriptorPoolSize> sizes;
+	if (setCount == 0)
 	{
-		vkDestroyDescriptorPool(logDevice, pool, nullptr);
+		for (const DescriptorPoolSizeRatio& ratio : DEFAULT_POOL_SIZE_RATIOS)
+			sizes.push_back({ ratio.type, static_cast<uint32_t>(std::ceil(ratio.ratio * setsPerPool)) });
+		return sizes;
+	}
+	for (uint32_t type = 0; type < TRACKED_DESCRIPTOR_TYPE_COUNT; type++)
+	{
+		if (typeCounts[type] == 0)
+			continue;
+		float perSet = static_cast<float>(typeCounts[type]) / setCount;
+		sizes.push_back({ static_cast<VkDescriptorType>(type), static_cast<uint32_t>(std::ceil(perSet * setsPerPool * POOL_SIZE_HEADROOM)) });
 	}
+	return sizes;
+}
 
-	for (auto& pool : freePools)
+bool descriptorPoolSizesChanged(const std::vector<VkDescriptorPoolSize>& current, const std::vector<VkDescriptorPoolSize>& observed)
+{
+	if (current.size() != observed.size())
+		return true;
+	for (const VkDescriptorPoolSize& size : observed)
 	{
-		vkDestroyDescriptorPool(logDevice, pool, nullptr);
+		auto match = std::find_if(current.begin(), current.end(), [&size](const VkDescriptorPoolSize& other) { return other.type == size.type; });
+		if (match == current.end())
+			return true;
+		// a type the pools hold none of has changed once it is used at all
+		if (match->descriptorCount == 0)
+		{
+			if (size.descriptorCount != 0)
+				return true;
+			continue;
+		}
+		float change = std::abs(static_cast<float>(size.descriptorCount) - static_cast<float>(match->descriptorCount)) / match->descriptorCount;
+		if (POOL_RESIZE_THRESHOLD < change)
+			return true;
 	}
+	return false;
+}
+
+PoolManager::PoolManager(VkDevice device, uint32_t setsPerPool)
+	: logDevice(device), currentPool(VK_NULL_HANDLE), setsPerPool(setsPerPool), typeCounts{}, countedSets(0), allocatedSets(0), resizes(0)
+{
+	poolSizes = computeDescriptorPoolSizes(typeCounts, 0, setsPerPool);
+}
+
+PoolManager::~PoolManager()
+{
+	destroyPools();
 }
 
 void PoolManager::resetPools()
@@ -28,9 +73,68 @@ void PoolManager::resetPools()
 	}
 	usedPools.clear();
 	currentPool = VK_NULL_HANDLE;
+
+	// size the pools for the mix of the frame that just ended, unless it was close to what they hold already
+	if (countedSets != 0)
+	{
+		std::vector<VkDescriptorPoolSize> observed = computeDescriptorPoolSizes(typeCounts, countedSets, setsPerPool);
+		if (descriptorPoolSizesChanged(poolSizes, observed))
+		{
+			destroyPools();
+			poolSizes = std::move(observed);
+			resizes++;
+		}
+	}
+	typeCounts.fill(0);
+	countedSets = 0;
+	allocatedSets = 0;
 }
 
 bool PoolManager::allocateDescriptorSet(VkDescriptorSetLayout layout, VkDescriptorSet& descSet)
+{
+	if (!allocateFromPools(layout, descSet))
+		return false;
+	allocatedSets++;
+	return true;
+}
+
+bool PoolManager::allocateDescriptorSet(VkDescriptorSetLayout layout, const VkDescriptorSetLayoutBinding* bindings, uint32_t bindingCount, VkDescriptorSet& descSet)
+{
+	// counted first, so that a pool created for this set already holds its types
+	for (uint32_t i = 0; i < bindingCount; i++)
+	{
+		if (bindings[i].descriptorType < TRACKED_DESCRIPTOR_TYPE_COUNT)
+			typeCounts[bindings[i].descriptorType] += bindings[i].descriptorCount;
+	}
+	countedSets++;
+	bool typesMissing = false;
+	for (uint32_t i = 0; i < bindingCount; i++)
+	{
+		if (bindings[i].descriptorType < TRACKED_DESCRIPTOR_TYPE_COUNT)
+			typesMissing |= findPoolSize(poolSizes, bindings[i].descriptorType) == poolSizes.end();
+	}
+	if (typesMissing)
+	{
+		// the pools cannot hold the set at all, start new ones with the types seen so far
+		for (VkDescriptorPool pool : freePools)
+			vkDestroyDescriptorPool(logDevice, pool, nullptr);
+		freePools.clear();
+		currentPool = VK_NULL_HANDLE;
+		std::vector<VkDescriptorPoolSize> observed = computeDescriptorPoolSizes(typeCounts, countedSets, setsPerPool);
+		for (const VkDescriptorPoolSize& size : observed)
+		{
+			auto match = findPoolSize(poolSizes, size.type);
+			if (match == poolSizes.end())
+				poolSizes.push_back(size);
+			else
+				match->descriptorCount = std::max(match->descriptorCount, size.descriptorCount);
+		}
+		resizes++;
+	}
+	return allocateDescriptorSet(layout, descSet);
+}
+
+bool PoolManager::allocateFromPools(VkDescriptorSetLayout layout, VkDescriptorSet& descSet)
 {
 	// Make sure we have a pool
 	if (currentPool == VK_NULL_HANDLE)
@@ -54,6 +158,7 @@ bool PoolManager::allocateDescriptorSet(VkDescriptorSetLayout layout, VkDescript
 		case VK_SUCCESS:
 			return true;
 		case VK_ERROR_OUT_OF_POOL_MEMORY:
+		case VK_ERROR_FRAGMENTED_POOL:
 			realloc = true;
 			break;
 		default:
@@ -95,77 +200,205 @@ VkDescriptorPool PoolManager::createPool(VkDevice device, VkDescriptorPoolCreate
 	return pool;
 }
 
+DescriptorPoolStats PoolManager::getStats() const
+{
+	DescriptorPoolStats stats;
+	stats.pools = static_cast<uint32_t>(freePools.size() + usedPools.size());
+	stats.usedPools = static_cast<uint32_t>(usedPools.size());
+	stats.allocatedSets = allocatedSets;
+	stats.resizes = resizes;
+	for (const VkDescriptorPoolSize& size : poolSizes)
+		stats.poolDescriptors += static_cast<uint64_t>(size.descriptorCount) * stats.pools;
+	return stats;
+}
+
 VkDescriptorPool PoolManager::grabPool()
 {
 	VkDescriptorPool pool;
 	if (freePools.empty())
 	{
-		pool = createPool(logDevice, 0, 1000, STANDARD_POOL_SIZES);
+		createPool(logDevice, 0, setsPerPool, poolSizes);
 	}
-	else
+	auto lastDescpool = freePools.back();
+	freePools.pop_back();
+	pool = lastDescpool;
+	return pool;
+}
+
+void PoolManager::destroyPools()
+{
+	for (auto& pool : usedPools)
 	{
-		auto lastDescpool = freePools.back();
-		freePools.pop_back();
-		pool = lastDescpool;
+		vkDestroyDescriptorPool(logDevice, pool, nullptr);
 	}
-	return pool;
+
+	for (auto& pool : freePools)
+	{
+		vkDestroyDescriptorPool(logDevice, pool, nullptr);
+	}
+	usedPools.clear();
+	freePools.clear();
+	currentPool = VK_NULL_HANDLE;
 }
 
-DescriptorSetLayoutCache::DescriptorSetLayoutCache(VkDevice device)
-	: logDevice(device)
+FrameDescriptorAllocator::FrameDescriptorAllocator()
+	: slotCount(0), currentFrame(0)
 {
 }
 
-DescriptorSetLayoutCache::~DescriptorSetLayoutCache()
+FrameDescriptorAllocator::~FrameDescriptorAllocator()
 {
-	for (auto& layout : layoutCache)
-	{
-		vkDestroyDescriptorSetLayout(logDevice, layout.second, nullptr);
-	}
+	cleanup();
 }
 
-VkDescriptorSetLayout DescriptorSetLayoutCache::createDescriptorSetLayout(VkDescriptorSetLayoutCreateInfo& layoutInfo)
+void FrameDescriptorAllocator::initialize(VkDevice device, uint32_t concurrentFrames, uint32_t slotCount)
 {
-	DescriptorSetLayoutInfo info{};
-	info.bindings.reserve(layoutInfo.bindingCount);
+	this->slotCount = slotCount;
+	currentFrame = 0;
+	poolManagers.clear();
+	for (uint32_t i = 0; i < concurrentFrames * slotCount; i++)
+		poolManagers.push_back(std::make_unique<PoolManager>(device));
+}
 
-	bool sorted = true;
-	int lastBinding = -1;
+void FrameDescriptorAllocator::cleanup()
+{
+	poolManagers.clear();
+	slotCount = 0;
+	currentFrame = 0;
+}
 
-	for (uint32_t i = 0; i < layoutInfo.bindingCount; i++)
-	{
-		VkDescriptorSetLayoutBinding binding = layoutInfo.pBindings[i];
-		info.bindings.push_back(binding);
+void FrameDescriptorAllocator::beginFrame(uint32_t frameIndex)
+{
+	currentFrame = frameIndex;
+	for (uint32_t slot = 0; slot < slotCount; slot++)
+		poolManagers[frameIndex * slotCount + slot]->resetPools();
+}
 
-		if (lastBinding < binding.binding) // check order
-		{
-			sorted = false;
-		}
-		lastBinding = static_cast<int>(binding.binding);
+DescriptorPoolStats FrameDescriptorAllocator::getStats() const
+{
+	DescriptorPoolStats stats;
+	for (const std::unique_ptr<PoolManager>& poolManager : poolManagers)
+	{
+		DescriptorPoolStats managerStats = poolManager->getStats();
+		stats.pools += managerStats.pools;
+		stats.usedPools += managerStats.usedPools;
+		stats.allocatedSets += managerStats.allocatedSets;
+		stats.resizes += managerStats.resizes;
+		stats.poolDescriptors += managerStats.poolDescriptors;
 	}
+	return stats;
+}
 
-	if (!sorted)
-		std::sort(info.bindings.begin(), info.bindings.end(), [](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b)
-			{
-				return a.binding < b.binding;
-			});
-	// Info is now sanitized and sorted
-	VkDescriptorSetLayout layout;
-
-	auto layoutIt = layoutCache.find(info);
-	if (layoutIt != layoutCache.end())
-	{ // found
-		return layoutIt->second;
+HandleCacheKey makeDescriptorSetLayoutKey(const VkDescriptorSetLayoutCreateInfo& layoutInfo)
+{
+	const VkDescriptorBindingFlags* bindingFlags = nullptr;
+	for (const VkBaseInStructure* next = static_cast<const VkBaseInStructure*>(layoutInfo.pNext); next != nullptr; next = next->pNext)
+	{
+		if (next->sType != VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO)
+			throw std::runtime_error("Descriptor set layouts can only be cached with binding flags in pNext");
+		bindingFlags = reinterpret_cast<const VkDescriptorSetLayoutBindingFlagsCreateInfo*>(next)->pBindingFlags;
 	}
-	else
-	{ // not found
-		if (vkCreateDescriptorSetLayout(logDevice, &layoutInfo, nullptr, &layout) != VK_SUCCESS)
+
+	HandleCacheKey key;
+	key.push(layoutInfo.flags);
+	key.push(layoutInfo.bindingCount);
+	auto pushBinding = [&](uint32_t i) {
+		const VkDescriptorSetLayoutBinding& binding = layoutInfo.pBindings[i];
+		key.push(binding.binding);
+		key.push(binding.descriptorType);
+		key.push(binding.descriptorCount);
+		key.push(binding.stageFlags);
+		key.push(bindingFlags != nullptr ? bindingFlags[i] : 0);
+		if (binding.pImmutableSamplers != nullptr)
 		{
-			throw std::runtime_error("Failed to create descriptor set layout");
+			for (uint32_t sampler = 0; sampler < binding.descriptorCount; sampler++)
+				key.pushHandle(binding.pImmutableSamplers[sampler]);
 		}
-		layoutCache[info] = layout;
+	};
+
+	bool sorted = std::is_sorted(layoutInfo.pBindings, layoutInfo.pBindings + layoutInfo.bindingCount,
+		[](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) { return a.binding < b.binding; });
+	if (sorted)
+	{
+		for (uint32_t i = 0; i < layoutInfo.bindingCount; i++)
+			pushBinding(i);
+		return key;
+	}
+	// only unsorted infos pay for sorting
+	std::vector<uint32_t> order(layoutInfo.bindingCount);
+	for (uint32_t i = 0; i < layoutInfo.bindingCount; i++)
+		order[i] = i;
+	std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return layoutInfo.pBindings[a].binding < layoutInfo.pBindings[b].binding; });
+	for (uint32_t i : order)
+		pushBinding(i);
+	return key;
+}
+
+HandleCacheKey makePipelineLayoutKey(const VkPipelineLayoutCreateInfo& layoutInfo)
+{
+	HandleCacheKey key;
+	key.push(layoutInfo.flags);
+	key.push(layoutInfo.setLayoutCount);
+	for (uint32_t i = 0; i < layoutInfo.setLayoutCount; i++)
+		key.pushHandle(layoutInfo.pSetLayouts[i]);
+	key.push(layoutInfo.pushConstantRangeCount);
+	for (uint32_t i = 0; i < layoutInfo.pushConstantRangeCount; i++)
+	{
+		key.push(layoutInfo.pPushConstantRanges[i].stageFlags);
+		key.push(layoutInfo.pPushConstantRanges[i].offset);
+		key.push(layoutInfo.pPushConstantRanges[i].size);
 	}
-	return layout;
+	return key;
+}
+
+HandleCacheKey makeSamplerKey(const VkSamplerCreateInfo& samplerInfo)
+{
+	if (samplerInfo.pNext != nullptr)
+		throw std::runtime_error("Samplers with a pNext chain cannot be cached");
+	HandleCacheKey key;
+	key.push(samplerInfo.flags);
+	key.push(samplerInfo.magFilter);
+	key.push(samplerInfo.minFilter);
+	key.push(samplerInfo.mipmapMode);
+	key.push(samplerInfo.addressModeU);
+	key.push(samplerInfo.addressModeV);
+	key.push(samplerInfo.addressModeW);
+	key.pushFloat(samplerInfo.mipLodBias);
+	key.push(samplerInfo.anisotropyEnable);
+	key.pushFloat(samplerInfo.maxAnisotropy);
+	key.push(samplerInfo.compareEnable);
+	key.push(samplerInfo.compareOp);
+	key.pushFloat(samplerInfo.minLod);
+	key.pushFloat(samplerInfo.maxLod);
+	key.push(samplerInfo.borderColor);
+	key.push(samplerInfo.unnormalizedCoordinates);
+	return key;
+}
+
+DescriptorSetLayoutCache::DescriptorSetLayoutCache(VkDevice device)
+	: logDevice(device)
+{
+}
+
+DescriptorSetLayoutCache::~DescriptorSetLayoutCache()
+{
+	pipelineLayoutCache.clear([this](VkPipelineLayout layout) { vkDestroyPipelineLayout(logDevice, layout, nullptr); });
+	layoutCache.clear([this](VkDescriptorSetLayout layout) { vkDestroyDescriptorSetLayout(logDevice, layout, nullptr); });
+	samplerCache.clear([this](VkSampler sampler) { vkDestroySampler(logDevice, sampler, nullptr); });
+}
+
+VkDescriptorSetLayout DescriptorSetLayoutCache::createDescriptorSetLayout(const VkDescriptorSetLayoutCreateInfo& layoutInfo)
+{
+	return layoutCache.getOrCreate(makeDescriptorSetLayoutKey(layoutInfo),
+		[&]() {
+			VkDescriptorSetLayout layout;
+			if (vkCreateDescriptorSetLayout(logDevice, &layoutInfo, nullptr, &layout) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to create descriptor set layout");
+			}
+			return layout;
+		},
+		[this](VkDescriptorSetLayout layout) { vkDestroyDescriptorSetLayout(logDevice, layout, nullptr); });
 }
 
 VkDescriptorSetLayout DescriptorSetLayoutCache::createDescriptorSetLayout(const VkDescriptorSetLayoutBinding* bindings, uint32_t bindingCount)
@@ -178,47 +411,46 @@ VkDescriptorSetLayout DescriptorSetLayoutCache::createDescriptorSetLayout(const
 	return createDescriptorSetLayout(layoutInfo);
 }
 
-bool DescriptorSetLayoutCache::DescriptorSetLayoutInfo::operator==(const DescriptorSetLayoutInfo& other) const
+VkPipelineLayout DescriptorSetLayoutCache::createPipelineLayout(const VkPipelineLayoutCreateInfo& layoutInfo)
 {
-	if (bindings.size() != other.bindings.size())
-	{
-		return false;
-	}
-	for (uint32_t i = 0; i < bindings.size(); i++)
-	{
-		VkDescriptorSetLayoutBinding bindingThis = bindings[i];
-		VkDescriptorSetLayoutBinding bindingThat = other.bindings[i];
-
-		if (bindingThis.binding != bindingThat.binding ||
-			bindingThis.descriptorCount != bindingThat.descriptorCount ||
-			bindingThis.descriptorType != bindingThat.descriptorType ||
-			bindingThis.stageFlags != bindingThat.stageFlags)
-		{
-			return false;
-		}
-	}
-
-	return true;
+	return pipelineLayoutCache.getOrCreate(makePipelineLayoutKey(layoutInfo),
+		[&]() {
+			VkPipelineLayout layout;
+			if (vkCreatePipelineLayout(logDevice, &layoutInfo, nullptr, &layout) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Pipeline layout creation failed");
+			}
+			return layout;
+		},
+		[this](VkPipelineLayout layout) { vkDestroyPipelineLayout(logDevice, layout, nullptr); });
 }
 
-size_t DescriptorSetLayoutCache::DescriptorSetLayoutInfo::hash() const
+VkSampler DescriptorSetLayoutCache::createSampler(const VkSamplerCreateInfo& samplerInfo)
 {
-	size_t res = std::hash<size_t>()(bindings.size());
-
-	for (const VkDescriptorSetLayoutBinding& bind : bindings)
-	{
-		size_t byteSize = sizeof(char);
-		size_t bindHash = bind.binding | bind.descriptorCount << 8 | bind.descriptorType << 16 | bind.stageFlags << 24;
-		res ^= std::hash<size_t>()(bindHash);
-	}
-	return res;
+	return samplerCache.getOrCreate(makeSamplerKey(samplerInfo),
+		[&]() {
+			VkSampler sampler;
+			if (vkCreateSampler(logDevice, &samplerInfo, nullptr, &sampler) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to create sampler");
+			}
+			return sampler;
+		},
+		[this](VkSampler sampler) { vkDestroySampler(logDevice, sampler, nullptr); });
 }
 
 DescriptorBuilder::DescriptorBuilder(VkDevice device)
 	: currentBinding(0)
 {
-	pPoolManager = std::make_unique<PoolManager>(device);
-	pLayoutCache = std::make_unique<DescriptorSetLayoutCache>(device);
+	ownedPoolManager = std::make_unique<PoolManager>(device);
+	ownedLayoutCache = std::make_unique<DescriptorSetLayoutCache>(device);
+	pPoolManager = ownedPoolManager.get();
+	pLayoutCache = ownedLayoutCache.get();
+}
+
+DescriptorBuilder::DescriptorBuilder(PoolManager& poolManager, DescriptorSetLayoutCache& layoutCache)
+	: currentBinding(0), pPoolManager(&poolManager), pLayoutCache(&layoutCache)
+{
 }
 
 DescriptorBuilder::~DescriptorBuilder()
@@ -336,7 +568,7 @@ bool DescriptorBuilder::build(VkDescriptorSet& set, VkDescriptorSetLayout& layou
 
 	layout = pLayoutCache->createDescriptorSetLayout(layoutInfo); // caches the layout if created
 	// Allocate the set
-	if (!pPoolManager->allocateDescriptorSet(layout, set))
+	if (!pPoolManager->allocateDescriptorSet(layout, layoutBindings.data(), static_cast<uint32_t>(layoutBindings.size()), set))
 	{
 		return false;
 	}
@@ -368,7 +600,7 @@ void DescriptorBuilder::setDescriptorSetLayout(const VkDescriptorSetLayoutBindin
 	layout = pLayoutCache->createDescriptorSetLayout(bindings, bindingCount);
 }
 
-VkDescriptorSetLayout DescriptorBuilder::createDescriptorSetLayout(VkDescriptorSetLayoutCreateInfo& layoutInfo)
+VkDescriptorSetLayout DescriptorBuilder::createDescriptorSetLayout(const VkDescriptorSetLayoutCreateInfo& layoutInfo)
 {
 	return pLayoutCache->createDescriptorSetLayout(layoutInfo);
 }
@@ -1,51 +1,103 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
 #include <functional>
 #include <stdexcept>
 #include <vulkan/vulkan.h>
 
+#include "HandleCache.hpp"
+
 #include <memory>
 #include <unordered_map>
 #include <vector>
 // Chunk size for descriptor pool allocations
-constexpr VkDeviceSize POOL_CHUNK_SIZE = 256;
-
-// Standard pool sizes for descriptor types
-const std::vector<VkDescriptorPoolSize> STANDARD_POOL_SIZES({ {VK_DESCRIPTOR_TYPE_SAMPLER, 1000},
-															 {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1000},
-															 {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1000},
-															 {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1000},
-															 {VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, 1000},
-															 {VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, 1000},
-															 {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1000},
-															 {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1000},
-															 {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1000},
-															 {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1000},
-															 {VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1000} });
+constexpr uint32_t POOL_CHUNK_SIZE = 256; ///< sets per pool
+
+constexpr uint32_t TRACKED_DESCRIPTOR_TYPE_COUNT = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT + 1; ///< core descriptor types, counted per pool manager
+constexpr float POOL_SIZE_HEADROOM = 1.25f;       ///< pools hold this much more of each type than the observed mix needs
+constexpr float POOL_RESIZE_THRESHOLD = 0.25f;    ///< relative change of a type that recreates the pools on reset
+
+/**
+ * @brief Descriptors of a type per set in a pool.
+ */
+struct DescriptorPoolSizeRatio
+{
+	VkDescriptorType type;
+	float ratio;
+};
+
+// Pool sizes before any set has been allocated, for the descriptor types the renderer uses
+const std::vector<DescriptorPoolSizeRatio> DEFAULT_POOL_SIZE_RATIOS({ {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2.f},
+																	   {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.f},
+																	   {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.f},
+																	   {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4.f},
+																	   {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1.f},
+																	   {VK_DESCRIPTOR_TYPE_SAMPLER, 1.f},
+																	   {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.f} });
+
+/**
+ * @brief Pool usage of one or more pool managers.
+ */
+struct DescriptorPoolStats
+{
+	uint32_t pools = 0;          ///< pools alive
+	uint32_t usedPools = 0;      ///< pools holding sets since the last reset
+	uint32_t allocatedSets = 0;  ///< since the last reset
+	uint32_t resizes = 0;        ///< times the pools were recreated for a changed descriptor mix
+	uint64_t poolDescriptors = 0; ///< capacity of every pool alive, in descriptors
+};
+
+/**
+ * @brief Sizes descriptor pools from the descriptor types of the sets allocated since the last reset.
+ * @param typeCounts are the descriptors of each type, indexed by VkDescriptorType.
+ * @param setCount is the number of sets they were allocated for. Zero returns the default sizes.
+ * @param setsPerPool is the maxSets of the pools.
+ * @return sizes of the types that were used, with POOL_SIZE_HEADROOM.
+ */
+std::vector<VkDescriptorPoolSize> computeDescriptorPoolSizes(const std::array<uint32_t, TRACKED_DESCRIPTOR_TYPE_COUNT>& typeCounts, uint32_t setCount, uint32_t setsPerPool);
+
+/**
+ * @brief Tells whether any type of the pool sizes moved by more than POOL_RESIZE_THRESHOLD, or appeared or disappeared.
+ */
+bool descriptorPoolSizesChanged(const std::vector<VkDescriptorPoolSize>& current, const std::vector<VkDescriptorPoolSize>& observed);
 
 /// <summary>
 /// This class manages descriptor pools, and allows for the allocation of descriptor sets.
+/// Pools are sized for the mix of descriptor types allocated from the manager, and are recreated on reset when the mix changes.
+/// Not thread safe, see FrameDescriptorAllocator for one manager per frame and thread.
 /// </summary>
 class PoolManager
 {
 public:
-	PoolManager(VkDevice device);
+	PoolManager(VkDevice device, uint32_t setsPerPool = POOL_CHUNK_SIZE);
 	~PoolManager();
 
 	/// <summary>
-	/// Resets pools
+	/// Resets pools. Recreates them if the descriptor mix since the last reset needs other sizes.
 	/// </summary>
 	void resetPools();
 
 	/// <summary>
-	/// Allocates a descriptor set from the pool
+	/// Allocates a descriptor set from the pool.
+	/// Its descriptors are not counted towards the sizes of the next pools, as the layout does not tell them.
+	/// Use the overload with the bindings for sets allocated every frame.
 	/// </summary>
 	/// <param name="layout">Layout to be used</param>
 	/// <param name="descSet">Descriptor set to be allocated</param>
 	/// <returns></returns>
 	bool allocateDescriptorSet(VkDescriptorSetLayout layout, VkDescriptorSet& descSet);
 
+	/**
+	 * @brief Allocates a descriptor set and counts its descriptors towards the sizes of the next pools.
+	 * @param layout of the set.
+	 * @param bindings the layout was created from.
+	 * @param bindingCount of the bindings.
+	 * @param descSet receives the set.
+	 * @return false if the set could not be allocated.
+	 */
+	bool allocateDescriptorSet(VkDescriptorSetLayout layout, const VkDescriptorSetLayoutBinding* bindings, uint32_t bindingCount, VkDescriptorSet& descSet);
+
 	/// <summary>
 	/// Allocates a descriptor pool and adds it to the free pools.
 	/// </summary>
@@ -66,6 +118,8 @@ public:
 		return logDevice;
 	}
 
+	DescriptorPoolStats getStats() const;
+
 private:
 	/// <summary>
 	/// Returns a pool from free pools or creates a new one.
@@ -74,14 +128,94 @@ private:
 	/// <returns></returns>
 	VkDescriptorPool grabPool();
 
+	/**
+	 * @brief Allocates from the current pool, moving on to a new pool once if it is full.
+	 */
+	bool allocateFromPools(VkDescriptorSetLayout layout, VkDescriptorSet& descSet);
+
+	void destroyPools();
+
 	VkDevice logDevice;
 	VkDescriptorPool currentPool;
 	std::vector<VkDescriptorPool> freePools;
 	std::vector<VkDescriptorPool> usedPools;
+
+	uint32_t setsPerPool;
+	std::vector<VkDescriptorPoolSize> poolSizes;  ///< of the pools alive
+	std::array<uint32_t, TRACKED_DESCRIPTOR_TYPE_COUNT> typeCounts; ///< descriptors allocated since the last reset
+	uint32_t countedSets;                          ///< sets counted in typeCounts
+	uint32_t allocatedSets;
+	uint32_t resizes;
+};
+
+/**
+ * @brief Pool managers for each frame in flight and each recording slot, so worker threads allocate sets without locking.
+ * Sets live until their frame begins again, when every pool of the frame is reset at once.
+ */
+class FrameDescriptorAllocator
+{
+public:
+	FrameDescriptorAllocator();
+	~FrameDescriptorAllocator();
+
+	/**
+	 * @param device to create the pools on.
+	 * @param concurrentFrames is the number of frames in flight.
+	 * @param slotCount is the number of threads allocating at once, e.g. the job system workers plus one.
+	 */
+	void initialize(VkDevice device, uint32_t concurrentFrames, uint32_t slotCount);
+
+	/**
+	 * @brief Destroys the pools. The GPU must be done with every frame.
+	 */
+	void cleanup();
+
+	/**
+	 * @brief Resets the pools of the frame. Call after waiting on the frame's fence.
+	 * @param frameIndex is the index of the concurrent frame.
+	 */
+	void beginFrame(uint32_t frameIndex);
+
+	/**
+	 * @brief Returns the pool manager of a slot in the current frame. Only one thread may use a slot at a time.
+	 * @param slot e.g. the slice index of a parallel recording.
+	 */
+	PoolManager& getPoolManager(uint32_t slot) { return *poolManagers[currentFrame * slotCount + slot]; }
+
+	uint32_t getSlotCount() const { return slotCount; }
+
+	/**
+	 * @brief Returns the pool usage of every frame and slot combined.
+	 */
+	DescriptorPoolStats getStats() const;
+
+private:
+	std::vector<std::unique_ptr<PoolManager>> poolManagers; ///< slotCount per frame
+	uint32_t slotCount;
+	uint32_t currentFrame;
 };
 
+/**
+ * @brief Flattens a descriptor set layout into its cache key. Bindings are keyed in binding order, so their order in the info does not matter.
+ * @throws std::runtime_error if the pNext chain holds anything but binding flags.
+ */
+HandleCacheKey makeDescriptorSetLayoutKey(const VkDescriptorSetLayoutCreateInfo& layoutInfo);
+
+/**
+ * @brief Flattens a pipeline layout into its cache key.
+ */
+HandleCacheKey makePipelineLayoutKey(const VkPipelineLayoutCreateInfo& layoutInfo);
+
+/**
+ * @brief Flattens a sampler into its cache key.
+ * @throws std::runtime_error if the info has a pNext chain.
+ */
+HandleCacheKey makeSamplerKey(const VkSamplerCreateInfo& samplerInfo);
+
 /// <summary>
-/// The use of this class is to cache descriptor set layouts.
+/// The use of this class is to cache descriptor set layouts, pipeline layouts and samplers.
+/// Equal create infos return the same object. Thread safe, lookups of cached objects only take a shared lock.
+/// The objects live as long as the cache.
 /// </summary>
 class DescriptorSetLayoutCache
 {
@@ -89,12 +223,15 @@ public:
 	DescriptorSetLayoutCache(VkDevice device);
 	~DescriptorSetLayoutCache();
 
+	DescriptorSetLayoutCache(const DescriptorSetLayoutCache&) = delete;
+	DescriptorSetLayoutCache& operator=(const DescriptorSetLayoutCache&) = delete;
+
 	/// <summary>
 	/// Creates a descriptor set layout from the given info, or returns one from the cache if it already exists.
 	/// </summary>
 	/// <param name="layoutInfo">Layout info</param>
 	/// <returns>Allocated descriptor set layout</returns>
-	VkDescriptorSetLayout createDescriptorSetLayout(VkDescriptorSetLayoutCreateInfo& layoutInfo);
+	VkDescriptorSetLayout createDescriptorSetLayout(const VkDescriptorSetLayoutCreateInfo& layoutInfo);
 
 	/// <summary>
 	/// Creates a descriptor set layout from the given bindings, or returns one from the cache if it already exists.
@@ -105,24 +242,25 @@ public:
 	VkDescriptorSetLayout createDescriptorSetLayout(const VkDescriptorSetLayoutBinding* bindings,
 		uint32_t bindingCount);
 
-	struct DescriptorSetLayoutInfo
-	{
-		std::vector<VkDescriptorSetLayoutBinding> bindings;
-		bool operator==(const DescriptorSetLayoutInfo& other) const;
-		size_t hash() const;
-	};
+	/**
+	 * @brief Creates a pipeline layout from the given info, or returns one from the cache if it already exists.
+	 */
+	VkPipelineLayout createPipelineLayout(const VkPipelineLayoutCreateInfo& layoutInfo);
 
-private:
-	struct DescriptorLayoutHasher
-	{
-		size_t operator()(const DescriptorSetLayoutInfo& info) const
-		{
-			return info.hash();
-		}
-	};
+	/**
+	 * @brief Creates a sampler from the given info, or returns one from the cache if it already exists.
+	 */
+	VkSampler createSampler(const VkSamplerCreateInfo& samplerInfo);
 
+	uint32_t getDescriptorSetLayoutCount() const { return layoutCache.size(); }
+	uint32_t getPipelineLayoutCount() const { return pipelineLayoutCache.size(); }
+	uint32_t getSamplerCount() const { return samplerCache.size(); }
+
+private:
 	VkDevice logDevice;
-	std::unordered_map<DescriptorSetLayoutInfo, VkDescriptorSetLayout, DescriptorLayoutHasher> layoutCache;
+	ShardedHandleCache<VkDescriptorSetLayout> layoutCache;
+	ShardedHandleCache<VkPipelineLayout> pipelineLayoutCache;
+	ShardedHandleCache<VkSampler> samplerCache;
 };
 
 /// <summary>
@@ -132,6 +270,12 @@ class DescriptorBuilder
 {
 public:
 	DescriptorBuilder(VkDevice device);
+
+	/**
+	 * @brief Creates a builder that allocates from the given pools and caches layouts in the given cache, e.g. one per job
+	 * with the pool manager of its FrameDescriptorAllocator slot.
+	 */
+	DescriptorBuilder(PoolManager& poolManager, DescriptorSetLayoutCache& layoutCache);
 	~DescriptorBuilder();
 
 	/// <summary>
@@ -205,7 +349,7 @@ public:
 	/// </summary>
 	/// <param name="layoutInfo">Layout info</param>
 	/// <returns>Allocated descriptor set layout</returns>
-	VkDescriptorSetLayout createDescriptorSetLayout(VkDescriptorSetLayoutCreateInfo& layoutInfo);
+	VkDescriptorSetLayout createDescriptorSetLayout(const VkDescriptorSetLayoutCreateInfo& layoutInfo);
 
 	/// <summary>
 	/// Creates a descriptor set layout using builders layoutCache member
@@ -223,6 +367,8 @@ private:
 	std::vector<VkWriteDescriptorSet> writeSets;
 	std::vector<VkDescriptorSetLayoutBinding> layoutBindings;
 
-	std::unique_ptr<PoolManager> pPoolManager;
-	std::unique_ptr<DescriptorSetLayoutCache> pLayoutCache;
+	PoolManager* pPoolManager;
+	DescriptorSetLayoutCache* pLayoutCache;
+	std::unique_ptr<PoolManager> ownedPoolManager;              ///< unless borrowed
+	std::unique_ptr<DescriptorSetLayoutCache> ownedLayoutCache; ///< unless borrowed
 };
\ No newline at end of file
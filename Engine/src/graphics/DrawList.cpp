@@ -0,0 +1,137 @@
+#include "DrawList.hpp"
+#include "RadixSort.hpp"
+
+#include <algorithm>
+
+uint32_t quantizeDrawDepth(float depth, float maxDepth, bool backToFront)
+{
+	constexpr uint32_t MAX_DEPTH = (1u << DRAW_KEY_DEPTH_BITS) - 1;
+	float normalized = std::clamp(depth / maxDepth, 0.f, 1.f);
+	uint32_t quantized = static_cast<uint32_t>(normalized * MAX_DEPTH);
+	return backToFront ? MAX_DEPTH - quantized : quantized;
+}
+
+void DrawList::clear()
+{
+	keys.clear();
+	draws.clear();
+	batches.clear();
+}
+
+void DrawList::reserve(size_t drawCount)
+{
+	keys.reserve(drawCount);
+	draws.reserve(drawCount);
+}
+
+void DrawList::sort()
+{
+	keyScratch.resize(keys.size());
+	drawScratch.resize(draws.size());
+	radixSort(keys.data(), draws.data(), keyScratch.data(), drawScratch.data(), keys.size());
+
+	batches.clear();
+	for (uint32_t i = 0; i < keys.size(); i++)
+	{
+		if (batches.empty() || ((batches.back().key ^ keys[i]) & DRAW_KEY_STATE_MASK) != 0)
+			batches.push_back({ keys[i], i, 0 });
+		batches.back().drawCount++;
+	}
+}
+
+DrawListStats DrawList::record(VkCommandBuffer commandBuffer, const DrawStateTable& states, const GeometryBuffers& geometryBuffers,
+	size_t firstBatch, size_t batchCount) const
+{
+	return visitBatches(commandBuffer, states, &geometryBuffers, firstBatch, batchCount);
+}
+
+DrawListStats DrawList::countCommands(const DrawStateTable& states, size_t firstBatch, size_t batchCount) const
+{
+	return visitBatches(VK_NULL_HANDLE, states, nullptr, firstBatch, batchCount);
+}
+
+DrawListStats DrawList::visitBatches(VkCommandBuffer commandBuffer, const DrawStateTable& states, const GeometryBuffers* geometryBuffers,
+	size_t firstBatch, size_t batchCount) const
+{
+	bool recording = geometryBuffers != nullptr;
+	DrawListStats stats;
+	size_t lastBatch = std::min(batches.size(), firstBatch + std::min(batchCount, batches.size()));
+	bool bindless = states.bindlessSet != VK_NULL_HANDLE;
+	const DrawPipelineState* boundPipeline = nullptr;
+	VkPipelineLayout boundPipelineLayout = VK_NULL_HANDLE;
+	bool setsBound = false;
+	VkDescriptorSet boundMaterial = VK_NULL_HANDLE;
+	uint32_t pushedMaterial = UINT32_MAX;
+	VertexAttributeFlags boundLayout = FLAG_NONE;
+	for (size_t b = firstBatch; b < lastBatch; b++)
+	{
+		const DrawBatch& batch = batches[b];
+		const DrawPipelineState& pipeline = states.pipelines[getDrawKeyPipeline(batch.key)];
+		if (&pipeline != boundPipeline)
+		{
+			if (recording)
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.pipeline);
+			boundPipeline = &pipeline;
+			// a new layout may not keep the material set
+			boundMaterial = VK_NULL_HANDLE;
+			stats.pipelineBinds++;
+		}
+		if (!setsBound || pipeline.pipelineLayout != boundPipelineLayout)
+		{
+			// sets stay bound across pipelines of the same layout
+			if (states.frameSet != VK_NULL_HANDLE)
+			{
+				if (recording)
+					vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.pipelineLayout, 0, 1, &states.frameSet,
+						static_cast<uint32_t>(states.frameSetOffsets.size()), states.frameSetOffsets.data());
+				stats.descriptorSetBinds++;
+			}
+			if (bindless)
+			{
+				if (recording)
+					vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.pipelineLayout, states.materialSetIndex, 1, &states.bindlessSet, 0, nullptr);
+				stats.descriptorSetBinds++;
+			}
+			boundPipelineLayout = pipeline.pipelineLayout;
+			setsBound = true;
+			pushedMaterial = UINT32_MAX;
+		}
+		if (bindless)
+		{
+			uint32_t material = states.bindlessMaterials[getDrawKeyMaterial(batch.key)];
+			if (material != pushedMaterial)
+			{
+				if (recording)
+					vkCmdPushConstants(commandBuffer, pipeline.pipelineLayout, states.materialPushStages, states.materialPushOffset, sizeof(material), &material);
+				pushedMaterial = material;
+				stats.materialBinds++;
+			}
+		}
+		else
+		{
+			VkDescriptorSet material = states.materials[getDrawKeyMaterial(batch.key)];
+			if (material != boundMaterial)
+			{
+				if (recording)
+					vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.pipelineLayout, states.materialSetIndex, 1, &material, 0, nullptr);
+				boundMaterial = material;
+				stats.materialBinds++;
+				stats.descriptorSetBinds++;
+			}
+		}
+		if (pipeline.vertexLayout != boundLayout)
+		{
+			if (recording)
+				geometryBuffers->bind(commandBuffer, pipeline.vertexLayout);
+			boundLayout = pipeline.vertexLayout;
+			stats.geometryBinds++;
+		}
+		if (recording)
+		{
+			const GeometryAllocation& mesh = states.meshes[getDrawKeyMesh(batch.key)];
+			vkCmdDrawIndexed(commandBuffer, mesh.indexCount, batch.drawCount, mesh.firstIndex, static_cast<int32_t>(mesh.vertexOffset), batch.firstDraw);
+		}
+		stats.drawCalls++;
+	}
+	return stats;
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include "GeometryBuffers.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+* Draws are described by one 64 bit key each. From the most significant bit down the key holds the pass, the pipeline,
+* the material and the mesh, so sorting the keys groups draws by the state that is most expensive to change. The lowest bits
+* hold the quantized depth, which orders the draws of one state front to back, or back to front for blended passes.
+*/
+
+constexpr uint32_t DRAW_KEY_DEPTH_BITS = 16;
+constexpr uint32_t DRAW_KEY_MESH_BITS = 16;
+constexpr uint32_t DRAW_KEY_MATERIAL_BITS = 16;
+constexpr uint32_t DRAW_KEY_PIPELINE_BITS = 12;
+constexpr uint32_t DRAW_KEY_PASS_BITS = 4;
+
+constexpr uint32_t DRAW_KEY_MESH_SHIFT = DRAW_KEY_DEPTH_BITS;
+constexpr uint32_t DRAW_KEY_MATERIAL_SHIFT = DRAW_KEY_MESH_SHIFT + DRAW_KEY_MESH_BITS;
+constexpr uint32_t DRAW_KEY_PIPELINE_SHIFT = DRAW_KEY_MATERIAL_SHIFT + DRAW_KEY_MATERIAL_BITS;
+constexpr uint32_t DRAW_KEY_PASS_SHIFT = DRAW_KEY_PIPELINE_SHIFT + DRAW_KEY_PIPELINE_BITS;
+constexpr uint64_t DRAW_KEY_STATE_MASK = ~((1ull << DRAW_KEY_DEPTH_BITS) - 1); ///< every bit but the depth
+
+/**
+ * @brief Packs the state of a draw into a sort key. Each id must fit its field.
+ * @param pass the draw belongs to. Lower passes are drawn first.
+ * @param pipeline index in the DrawStateTable.
+ * @param material index in the DrawStateTable.
+ * @param mesh index in the DrawStateTable.
+ * @param depth from quantizeDrawDepth.
+ */
+constexpr uint64_t makeDrawKey(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh, uint32_t depth)
+{
+	return static_cast<uint64_t>(pass) << DRAW_KEY_PASS_SHIFT
+		| static_cast<uint64_t>(pipeline) << DRAW_KEY_PIPELINE_SHIFT
+		| static_cast<uint64_t>(material) << DRAW_KEY_MATERIAL_SHIFT
+		| static_cast<uint64_t>(mesh) << DRAW_KEY_MESH_SHIFT
+		| depth;
+}
+
+constexpr uint32_t getDrawKeyPass(uint64_t key) { return static_cast<uint32_t>(key >> DRAW_KEY_PASS_SHIFT) & ((1u << DRAW_KEY_PASS_BITS) - 1); }
+constexpr uint32_t getDrawKeyPipeline(uint64_t key) { return static_cast<uint32_t>(key >> DRAW_KEY_PIPELINE_SHIFT) & ((1u << DRAW_KEY_PIPELINE_BITS) - 1); }
+constexpr uint32_t getDrawKeyMaterial(uint64_t key) { return static_cast<uint32_t>(key >> DRAW_KEY_MATERIAL_SHIFT) & ((1u << DRAW_KEY_MATERIAL_BITS) - 1); }
+constexpr uint32_t getDrawKeyMesh(uint64_t key) { return static_cast<uint32_t>(key >> DRAW_KEY_MESH_SHIFT) & ((1u << DRAW_KEY_MESH_BITS) - 1); }
+constexpr uint32_t getDrawKeyDepth(uint64_t key) { return static_cast<uint32_t>(key) & ((1u << DRAW_KEY_DEPTH_BITS) - 1); }
+
+/**
+ * @brief Quantizes a view depth for the depth field of a draw key.
+ * @param depth is the distance from the camera.
+ * @param maxDepth is the depth mapped to the largest value, e.g. the far plane. Larger depths are clamped.
+ * @param backToFront reverses the order, for blended passes.
+ */
+uint32_t quantizeDrawDepth(float depth, float maxDepth, bool backToFront = false);
+
+/**
+ * @brief Consecutive sorted draws that share every state. Recorded as one instanced draw.
+ */
+struct DrawBatch
+{
+	uint64_t key;       ///< key of the first draw
+	uint32_t firstDraw; ///< index of the first draw in the sorted order, used as firstInstance
+	uint32_t drawCount; ///< instance count
+};
+
+struct DrawPipelineState
+{
+	VkPipeline pipeline;
+	VkPipelineLayout pipelineLayout;
+	VertexAttributeFlags vertexLayout;
+};
+
+/**
+ * @brief Vulkan objects the ids of the draw keys refer to.
+ */
+struct DrawStateTable
+{
+	std::vector<DrawPipelineState> pipelines;
+	std::vector<VkDescriptorSet> materials;
+	std::vector<GeometryAllocation> meshes;
+	VkDescriptorSet frameSet = VK_NULL_HANDLE; ///< bound at set 0 along with every pipeline layout, e.g. the instance data of the frame
+	std::vector<uint32_t> frameSetOffsets;     ///< dynamic offsets of frameSet, e.g. of the view constants in the FrameUniformRing
+	uint32_t materialSetIndex = 1;             ///< set the materials are bound at
+
+	// bindless mode, used instead of materials when bindlessSet is set
+	VkDescriptorSet bindlessSet = VK_NULL_HANDLE;   ///< BindlessDescriptorTable::getSet, bound at materialSetIndex along with every pipeline layout
+	std::vector<uint32_t> bindlessMaterials;        ///< per material, the value pushed for its draws, e.g. its texture slot
+	VkShaderStageFlags materialPushStages = VK_SHADER_STAGE_FRAGMENT_BIT;
+	uint32_t materialPushOffset = 0;                ///< of the uint32_t in the push constants
+};
+
+/**
+ * @brief Number of commands a recorded draw list took. Binds follow the number of unique states, not the number of draws.
+ */
+struct DrawListStats
+{
+	uint32_t pipelineBinds = 0;
+	uint32_t materialBinds = 0;  ///< descriptor set binds, or pushed material indices in bindless mode
+	uint32_t descriptorSetBinds = 0;
+	uint32_t geometryBinds = 0;
+	uint32_t drawCalls = 0;
+};
+
+/**
+ * @brief Visible draws of a frame. Add a key per draw, sort, then record the batches.
+ * The draws of a batch are instances firstDraw to firstDraw + drawCount - 1, so the shaders find the data of sorted draw i at index i
+ * of a per frame buffer. Fill it in the order of getSortedDraws.
+ */
+class DrawList
+{
+public:
+	DrawList() = default;
+
+	void clear();
+	void reserve(size_t drawCount);
+
+	/**
+	 * @brief Adds a draw.
+	 * @param key from makeDrawKey.
+	 * @param draw identifies the draw to the caller, e.g. an instance index. Returned in sorted order by getSortedDraws.
+	 */
+	void add(uint64_t key, uint32_t draw)
+	{
+		keys.push_back(key);
+		draws.push_back(draw);
+	}
+
+	/**
+	 * @brief Sorts the draws by key with a parallel radix sort and merges draws of equal state into batches.
+	 */
+	void sort();
+
+	/**
+	 * @brief Records the batches, binding the pipeline, material and geometry only when they change. Must be recorded inside a render pass.
+	 * In bindless mode the descriptor sets are bound once per pipeline layout and the materials are pushed as indices.
+	 * @param commandBuffer to record into.
+	 * @param states the ids of the keys refer to.
+	 * @param geometryBuffers holding the meshes.
+	 * @param firstBatch and batchCount select a range of the batches, e.g. the slice of one secondary command buffer.
+	 * @return the number of binds and draws recorded.
+	 */
+	DrawListStats record(VkCommandBuffer commandBuffer, const DrawStateTable& states, const GeometryBuffers& geometryBuffers,
+		size_t firstBatch = 0, size_t batchCount = SIZE_MAX) const;
+
+	/**
+	 * @brief Counts the binds and draws record would take without recording anything.
+	 * @param states the ids of the keys refer to.
+	 * @param firstBatch and batchCount select a range of the batches, as in record.
+	 */
+	DrawListStats countCommands(const DrawStateTable& states, size_t firstBatch = 0, size_t batchCount = SIZE_MAX) const;
+
+	size_t size() const { return keys.size(); }
+	const std::vector<uint64_t>& getSortedKeys() const { return keys; }
+	const std::vector<uint32_t>& getSortedDraws() const { return draws; }
+	const std::vector<DrawBatch>& getBatches() const { return batches; }
+
+private:
+	/**
+	 * @brief Walks the batches as record does. Records only when geometryBuffers is given.
+	 */
+	DrawListStats visitBatches(VkCommandBuffer commandBuffer, const DrawStateTable& states, const GeometryBuffers* geometryBuffers,
+		size_t firstBatch, size_t batchCount) const;
+
+	std::vector<uint64_t> keys;
+	std::vector<uint32_t> draws;
+	std::vector<uint64_t> keyScratch;
+	std::vector<uint32_t> drawScratch;
+	std::vector<DrawBatch> batches;
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "ShaderCache.hpp"
+#include <Vertex.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/**
+ * @brief Shader compiled to SPIR-V and reflected at build time. The generated EmbeddedShaders.hpp holds one per shader
+ * and vertex attribute permutation, as constant tables that need no initialization at startup.
+ */
+struct EmbeddedShader
+{
+	const char* name;                ///< file name in resources/shaders, e.g. "test.vert"
+	VertexAttributeFlags attributes; ///< permutation the shader was compiled for, zero if it has none
+	VkShaderStageFlagBits stage;
+	const uint32_t* code;
+	size_t codeWords;
+	const ShaderBindingReflection* bindings;
+	uint32_t bindingCount;
+	const VkPushConstantRange* pushConstantRanges;
+	uint32_t pushConstantCount;
+	const ShaderInterfaceReflection* inputs;
+	uint32_t inputCount;
+	const ShaderInterfaceReflection* outputs;
+	uint32_t outputCount;
+
+	/**
+	 * @brief Copies the tables into the form the shader cache and ShaderTools work with.
+	 */
+	ShaderCacheEntry toCacheEntry() const
+	{
+		ShaderCacheEntry entry;
+		entry.code.assign(code, code + codeWords);
+		entry.reflection.stage = stage;
+		entry.reflection.bindings.assign(bindings, bindings + bindingCount);
+		entry.reflection.pushConstantRanges.assign(pushConstantRanges, pushConstantRanges + pushConstantCount);
+		entry.reflection.inputs.assign(inputs, inputs + inputCount);
+		entry.reflection.outputs.assign(outputs, outputs + outputCount);
+		return entry;
+	}
+};
+
+/**
+ * @brief Finds a shader that was embedded at build time.
+ * @param name of the shader file, e.g. "test.vert".
+ * @param attributes of the permutation. Zero for shaders without permutations.
+ * @return the shader or nullptr if it was not embedded.
+ */
+const EmbeddedShader* findEmbeddedShader(std::string_view name, VertexAttributeFlags attributes = static_cast<VertexAttributeFlags>(0));
@@ -0,0 +1,146 @@
+#include "GeometryBuffers.hpp"
+
+#include <stdexcept>
+
+GeometryBuffers::GeometryBuffers()
+	: allocator(VK_NULL_HANDLE), uploader(nullptr), vertexCapacity(0), indexCapacity(0), indexBuffer{}
+{
+}
+
+void GeometryBuffers::initialize(VmaAllocator allocator, UploadManager* uploader, uint32_t vertexCapacity, uint32_t indexCapacity)
+{
+	this->allocator = allocator;
+	this->uploader = uploader;
+	this->vertexCapacity = vertexCapacity;
+	this->indexCapacity = indexCapacity;
+	indexAllocator.reset(indexCapacity);
+	if (allocator == VK_NULL_HANDLE)
+		return;
+	indexBuffer = createBuffer(this->allocator, static_cast<VkDeviceSize>(indexCapacity) * sizeof(uint32_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+	if (indexBuffer.buffer == VK_NULL_HANDLE)
+		throw std::runtime_error("Failed to create the geometry index buffer");
+}
+
+void GeometryBuffers::cleanup()
+{
+	if (allocator != VK_NULL_HANDLE)
+	{
+		for (GeometryPool& pool : pools)
+		{
+			destroyBuffer(allocator, pool.vertexBuffer);
+		}
+		destroyBuffer(allocator, indexBuffer);
+	}
+	pools.clear();
+	indexAllocator.reset(0);
+	allocator = VK_NULL_HANDLE;
+}
+
+GeometryAllocation GeometryBuffers::allocate(VertexAttributeFlags layout, uint32_t vertexCount, uint32_t indexCount)
+{
+	GeometryPool* pool = findPool(layout);
+	if (pool == nullptr)
+	{
+		GeometryPool newPool{};
+		newPool.layout = layout;
+		newPool.stride = getVertexStride(layout);
+		if (newPool.stride == 0)
+			return {};
+		if (allocator != VK_NULL_HANDLE)
+			newPool.vertexBuffer = createBuffer(allocator, static_cast<VkDeviceSize>(vertexCapacity) * newPool.stride, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+		if (allocator != VK_NULL_HANDLE && newPool.vertexBuffer.buffer == VK_NULL_HANDLE)
+			throw std::runtime_error("Failed to create a geometry vertex buffer");
+		newPool.vertexAllocator.reset(vertexCapacity);
+		pools.push_back(std::move(newPool));
+		pool = &pools.back();
+	}
+
+	GeometryAllocation allocation{};
+	allocation.layout = layout;
+	allocation.vertexRange = pool->vertexAllocator.allocate(vertexCount);
+	if (!allocation.vertexRange.isValid())
+		return {};
+	allocation.indexRange = indexAllocator.allocate(indexCount);
+	if (!allocation.indexRange.isValid())
+	{
+		pool->vertexAllocator.free(allocation.vertexRange);
+		return {};
+	}
+
+	allocation.vertexOffset = allocation.vertexRange.offset;
+	allocation.vertexCount = vertexCount;
+	allocation.firstIndex = allocation.indexRange.offset;
+	allocation.indexCount = indexCount;
+	return allocation;
+}
+
+UploadTicket GeometryBuffers::upload(const GeometryAllocation& allocation, const FullVertex* vertices, const uint32_t* indices)
+{
+	GeometryPool* pool = findPool(allocation.layout);
+	if (pool == nullptr || !allocation.isValid() || uploader == nullptr)
+		return 0;
+
+	// packing happens on the uploading thread, the staging copy is its only other touch of the data
+	thread_local std::vector<uint8_t> packedVertices;
+	VkDeviceSize vertexBytes = static_cast<VkDeviceSize>(allocation.vertexCount) * pool->stride;
+	packedVertices.resize(vertexBytes);
+	packVertices(vertices, allocation.vertexCount, allocation.layout, packedVertices.data());
+
+	uploader->uploadBuffer(pool->vertexBuffer.buffer, static_cast<VkDeviceSize>(allocation.vertexOffset) * pool->stride, packedVertices.data(), vertexBytes);
+	return uploader->uploadBuffer(indexBuffer.buffer, static_cast<VkDeviceSize>(allocation.firstIndex) * sizeof(uint32_t), indices, static_cast<VkDeviceSize>(allocation.indexCount) * sizeof(uint32_t));
+}
+
+void GeometryBuffers::free(GeometryAllocation& allocation)
+{
+	GeometryPool* pool = findPool(allocation.layout);
+	if (pool != nullptr)
+		pool->vertexAllocator.free(allocation.vertexRange);
+	indexAllocator.free(allocation.indexRange);
+	allocation = GeometryAllocation{};
+}
+
+void GeometryBuffers::bind(VkCommandBuffer commandBuffer, VertexAttributeFlags layout) const
+{
+	const GeometryPool* pool = findPool(layout);
+	if (pool == nullptr)
+		return;
+	VkDeviceSize offset = 0;
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &pool->vertexBuffer.buffer, &offset);
+	vkCmdBindIndexBuffer(commandBuffer, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+}
+
+VkBuffer GeometryBuffers::getVertexBuffer(VertexAttributeFlags layout) const
+{
+	const GeometryPool* pool = findPool(layout);
+	return (pool != nullptr) ? pool->vertexBuffer.buffer : VK_NULL_HANDLE;
+}
+
+VkDeviceSize GeometryBuffers::getUsedBytes() const
+{
+	VkDeviceSize used = static_cast<VkDeviceSize>(indexAllocator.getSize() - indexAllocator.getFreeStorage()) * sizeof(uint32_t);
+	for (const GeometryPool& pool : pools)
+	{
+		used += static_cast<VkDeviceSize>(pool.vertexAllocator.getSize() - pool.vertexAllocator.getFreeStorage()) * pool.stride;
+	}
+	return used;
+}
+
+GeometryPool* GeometryBuffers::findPool(VertexAttributeFlags layout)
+{
+	for (GeometryPool& pool : pools)
+	{
+		if (pool.layout == layout)
+			return &pool;
+	}
+	return nullptr;
+}
+
+const GeometryPool* GeometryBuffers::findPool(VertexAttributeFlags layout) const
+{
+	for (const GeometryPool& pool : pools)
+	{
+		if (pool.layout == layout)
+			return &pool;
+	}
+	return nullptr;
+}
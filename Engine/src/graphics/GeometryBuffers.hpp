@@ -0,0 +1,121 @@
+#pragma once
+
+#include "GraphicsResources.hpp"
+#include "OffsetAllocator.hpp"
+#include "UploadManager.hpp"
+#include "Vertex.hpp"
+
+#include <cstdint>
+#include <vector>
+
+/*
+* Geometry of every mesh lives in a few large buffers. Vertices are grouped by vertex layout so a layout needs one bind per frame,
+* indices of all layouts share one buffer. Meshes are addressed by firstIndex and vertexOffset, ready for indirect draws.
+*/
+
+// the buffers are allocated whole up front, a full vertex layout costs about 27 MB at the default capacity
+constexpr uint32_t DEFAULT_GEOMETRY_VERTEX_CAPACITY = 1u << 18; ///< vertices per layout
+constexpr uint32_t DEFAULT_GEOMETRY_INDEX_CAPACITY = 1u << 21;  ///< indices shared by all layouts
+
+/**
+ * @brief Location of a mesh in the geometry buffers.
+ */
+struct GeometryAllocation
+{
+	VertexAttributeFlags layout = FLAG_NONE;
+	uint32_t vertexOffset = 0; ///< first vertex of the mesh in the layout's vertex buffer
+	uint32_t vertexCount = 0;
+	uint32_t firstIndex = 0;   ///< first index of the mesh in the index buffer. Indices are relative to vertexOffset.
+	uint32_t indexCount = 0;
+	OffsetAllocation vertexRange;
+	OffsetAllocation indexRange;
+
+	bool isValid() const { return vertexRange.isValid() && indexRange.isValid(); }
+};
+
+/**
+ * @brief Vertex buffer of a single vertex layout.
+ */
+struct GeometryPool
+{
+	VertexAttributeFlags layout;
+	uint32_t stride;                 ///< bytes per vertex
+	Buffer vertexBuffer;
+	OffsetAllocator vertexAllocator; ///< allocates in vertices
+};
+
+class GeometryBuffers
+{
+
+public:
+	GeometryBuffers();
+
+	/**
+	 * @brief Creates the shared index buffer. Vertex buffers are created when a layout is first used.
+	 * Without an allocator and an uploader no buffers are created and only the ranges are handed out, which runs the
+	 * bookkeeping of the callers without a device.
+	 * @param allocator to allocate the buffers with.
+	 * @param uploader to copy the geometry to device local memory with. Must outlive the buffers.
+	 * @param vertexCapacity is the number of vertices of each layout's buffer.
+	 * @param indexCapacity is the number of indices of the shared index buffer.
+	 */
+	void initialize(VmaAllocator allocator, UploadManager* uploader, uint32_t vertexCapacity = DEFAULT_GEOMETRY_VERTEX_CAPACITY, uint32_t indexCapacity = DEFAULT_GEOMETRY_INDEX_CAPACITY);
+
+	/**
+	 * @brief Destroys every buffer. The GPU must be idle.
+	 */
+	void cleanup();
+
+	/**
+	 * @brief Reserves room for a mesh.
+	 * @return the allocation, which is not valid if either buffer ran out of space.
+	 */
+	GeometryAllocation allocate(VertexAttributeFlags layout, uint32_t vertexCount, uint32_t indexCount);
+
+	/**
+	 * @brief Writes the vertices and indices of a mesh into its allocation.
+	 * @param allocation to write to.
+	 * @param vertices must hold allocation.vertexCount full vertices. They are packed to the allocation's layout.
+	 * @param indices must hold allocation.indexCount indices.
+	 * @return ticket of the upload. The mesh may be drawn once it is ready.
+	 */
+	UploadTicket upload(const GeometryAllocation& allocation, const FullVertex* vertices, const uint32_t* indices);
+
+	/**
+	 * @brief Returns whether an upload may be used by the graphics queue.
+	 */
+	bool isReady(UploadTicket ticket) const { return uploader == nullptr || uploader->isReady(ticket); }
+
+	/**
+	 * @brief Returns the ranges of the allocation to the buffers. The GPU must be done with them.
+	 */
+	void free(GeometryAllocation& allocation);
+
+	/**
+	 * @brief Binds the vertex buffer of the layout and the shared index buffer.
+	 */
+	void bind(VkCommandBuffer commandBuffer, VertexAttributeFlags layout) const;
+
+	/**
+	 * @brief Returns the vertex buffer of the layout or VK_NULL_HANDLE if the layout is not in use.
+	 */
+	VkBuffer getVertexBuffer(VertexAttributeFlags layout) const;
+	VkBuffer getIndexBuffer() const { return indexBuffer.buffer; }
+
+	/**
+	 * @brief Returns the number of bytes in use in all buffers.
+	 */
+	VkDeviceSize getUsedBytes() const;
+
+private:
+	GeometryPool* findPool(VertexAttributeFlags layout);
+	const GeometryPool* findPool(VertexAttributeFlags layout) const;
+
+	VmaAllocator allocator;
+	UploadManager* uploader;
+	uint32_t vertexCapacity;
+	uint32_t indexCapacity;
+	std::vector<GeometryPool> pools; ///< a handful of layouts, searched linearly
+	Buffer indexBuffer;
+	OffsetAllocator indexAllocator;  ///< allocates in indices
+};
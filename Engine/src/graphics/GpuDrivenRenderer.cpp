@@ -0,0 +1,384 @@
+#include "GpuDrivenRenderer.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+#define VK_CHECK(x, msg) if (x != VK_SUCCESS) { throw std::runtime_error(msg); }
+
+constexpr uint32_t CULL_BINDING_COUNT = 5;
+
+static_assert(sizeof(GpuInstance) == 96, "GpuInstance must match the std430 layout of the shaders");
+static_assert(sizeof(GpuMesh) == 96, "GpuMesh must match the std430 layout of cull.comp");
+static_assert(sizeof(CullConstants) <= 128, "Cull constants must fit the guaranteed push constant size");
+
+GpuDrivenRenderer::GpuDrivenRenderer()
+	: device(VK_NULL_HANDLE), allocator(VK_NULL_HANDLE), maxInstances(0), maxMeshes(0), maxCommands(0), currentFrame(0),
+	meshBuffer{}, bucketBuffer{}, meshCount(0), instanceHighWater(0),
+	descriptorPool(VK_NULL_HANDLE), cullSetLayout(VK_NULL_HANDLE), drawSetLayout(VK_NULL_HANDLE), cullPipelineLayout(VK_NULL_HANDLE), cullPipeline(VK_NULL_HANDLE)
+{
+}
+
+void GpuDrivenRenderer::initialize(VkDevice device, VmaAllocator allocator, VkShaderModule cullShader, uint32_t concurrentFrames, uint32_t maxInstances, uint32_t maxMeshes)
+{
+	this->device = device;
+	this->allocator = allocator;
+	this->maxInstances = maxInstances;
+	this->maxMeshes = maxMeshes;
+	// a visible instance takes one command, so no bucket layout can need more
+	maxCommands = maxInstances;
+	currentFrame = 0;
+
+	instances.resize(maxInstances);
+	dirtyFrames.assign(maxInstances, 0);
+
+	frames.resize(concurrentFrames);
+	for (FrameResources& frame : frames)
+	{
+		frame.instances = createMappedBuffer(this->allocator, static_cast<VkDeviceSize>(maxInstances) * sizeof(GpuInstance), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+		frame.drawCommands = createBuffer(this->allocator, static_cast<VkDeviceSize>(maxCommands) * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+		frame.drawCounts = createBuffer(this->allocator, MAX_DRAW_BUCKETS * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+		if (frame.instances.data == nullptr || frame.drawCommands.buffer == VK_NULL_HANDLE || frame.drawCounts.buffer == VK_NULL_HANDLE)
+			throw std::runtime_error("Failed to create GPU driven frame buffers");
+	}
+	meshBuffer = createMappedBuffer(this->allocator, static_cast<VkDeviceSize>(maxMeshes) * sizeof(GpuMesh), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	bucketBuffer = createMappedBuffer(this->allocator, MAX_DRAW_BUCKETS * sizeof(GpuBucket), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	if (meshBuffer.data == nullptr || bucketBuffer.data == nullptr)
+		throw std::runtime_error("Failed to create GPU driven mesh buffers");
+
+	createDescriptors();
+	createCullPipeline(cullShader);
+}
+
+void GpuDrivenRenderer::cleanup()
+{
+	if (device == VK_NULL_HANDLE)
+		return;
+	vkDestroyPipeline(device, cullPipeline, nullptr);
+	vkDestroyPipelineLayout(device, cullPipelineLayout, nullptr);
+	vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+	vkDestroyDescriptorSetLayout(device, cullSetLayout, nullptr);
+	vkDestroyDescriptorSetLayout(device, drawSetLayout, nullptr);
+	for (FrameResources& frame : frames)
+	{
+		destroyBuffer(allocator, frame.instances.buffer);
+		destroyBuffer(allocator, frame.drawCommands);
+		destroyBuffer(allocator, frame.drawCounts);
+	}
+	frames.clear();
+	destroyBuffer(allocator, meshBuffer.buffer);
+	destroyBuffer(allocator, bucketBuffer.buffer);
+	instances.clear();
+	dirtyFrames.clear();
+	dirtyInstances.clear();
+	freeInstances.clear();
+	buckets.clear();
+	meshCount = 0;
+	instanceHighWater = 0;
+	device = VK_NULL_HANDLE;
+}
+
+uint32_t GpuDrivenRenderer::registerMesh(const GeometryAllocation* lods, uint32_t lodCount, const glm::vec4& lodDistances)
+{
+	if (maxMeshes <= meshCount)
+		throw std::runtime_error("GPU driven mesh capacity exceeded");
+
+	GpuMesh mesh{};
+	mesh.lodCount = std::min(lodCount, MAX_MESH_LODS);
+	mesh.lodDistances = lodDistances;
+	for (uint32_t i = 0; i < mesh.lodCount; i++)
+	{
+		mesh.lods[i].firstIndex = lods[i].firstIndex;
+		mesh.lods[i].indexCount = lods[i].indexCount;
+		mesh.lods[i].vertexOffset = static_cast<int32_t>(lods[i].vertexOffset);
+	}
+
+	uint32_t meshIndex = meshCount++;
+	std::memcpy(static_cast<GpuMesh*>(meshBuffer.data) + meshIndex, &mesh, sizeof(GpuMesh));
+	vmaFlushAllocation(allocator, meshBuffer.buffer.allocation, meshIndex * sizeof(GpuMesh), sizeof(GpuMesh));
+	return meshIndex;
+}
+
+uint32_t GpuDrivenRenderer::createBucket(VkPipeline pipeline, VkPipelineLayout pipelineLayout, VertexAttributeFlags layout, uint32_t capacity)
+{
+	uint32_t firstCommand = buckets.empty() ? 0 : buckets.back().firstCommand + buckets.back().capacity;
+	if (MAX_DRAW_BUCKETS <= buckets.size() || maxCommands < firstCommand + capacity)
+		throw std::runtime_error("GPU driven bucket capacity exceeded");
+
+	// Buckets are created at load time, before any frame that could read the table is in flight.
+	uint32_t bucketIndex = static_cast<uint32_t>(buckets.size());
+	buckets.push_back(DrawBucket{ pipeline, pipelineLayout, layout, firstCommand, capacity });
+	GpuBucket gpuBucket{ firstCommand, capacity };
+	std::memcpy(static_cast<GpuBucket*>(bucketBuffer.data) + bucketIndex, &gpuBucket, sizeof(GpuBucket));
+	vmaFlushAllocation(allocator, bucketBuffer.buffer.allocation, bucketIndex * sizeof(GpuBucket), sizeof(GpuBucket));
+	return bucketIndex;
+}
+
+uint32_t GpuDrivenRenderer::addInstance(const GpuInstance& instance)
+{
+	uint32_t handle;
+	if (!freeInstances.empty())
+	{
+		handle = freeInstances.back();
+		freeInstances.pop_back();
+	}
+	else if (instanceHighWater < maxInstances)
+	{
+		handle = instanceHighWater++;
+	}
+	else
+	{
+		return INVALID_INSTANCE;
+	}
+	instances[handle] = instance;
+	markDirty(handle);
+	return handle;
+}
+
+void GpuDrivenRenderer::updateInstance(uint32_t instance, const GpuInstance& data)
+{
+	instances[instance] = data;
+	markDirty(instance);
+}
+
+void GpuDrivenRenderer::updateTransform(uint32_t instance, const glm::mat4& model)
+{
+	instances[instance].model = model;
+	markDirty(instance);
+}
+
+void GpuDrivenRenderer::removeInstance(uint32_t instance)
+{
+	// the cull shader skips hidden instances, so the slot can stay in the dispatch
+	instances[instance].bucket = INVALID_BUCKET;
+	markDirty(instance);
+	freeInstances.push_back(instance);
+}
+
+void GpuDrivenRenderer::beginFrame(uint32_t frameIndex)
+{
+	currentFrame = frameIndex % static_cast<uint32_t>(frames.size());
+	FrameResources& frame = frames[currentFrame];
+	uint8_t frameBit = static_cast<uint8_t>(1u << currentFrame);
+	GpuInstance* mapped = static_cast<GpuInstance*>(frame.instances.data);
+
+	size_t kept = 0;
+	for (size_t i = 0; i < dirtyInstances.size(); i++)
+	{
+		uint32_t instance = dirtyInstances[i];
+		if (dirtyFrames[instance] & frameBit)
+		{
+			mapped[instance] = instances[instance];
+			dirtyFrames[instance] &= ~frameBit;
+		}
+		// other frames may still miss the data
+		if (dirtyFrames[instance] != 0)
+			dirtyInstances[kept++] = instance;
+	}
+	dirtyInstances.resize(kept);
+	vmaFlushAllocation(allocator, frame.instances.buffer.allocation, 0, static_cast<VkDeviceSize>(instanceHighWater) * sizeof(GpuInstance));
+}
+
+void GpuDrivenRenderer::recordCull(VkCommandBuffer commandBuffer, const glm::mat4& viewProjection, const glm::vec3& cameraPosition, float lodScale)
+{
+	FrameResources& frame = frames[currentFrame];
+	uint32_t bucketCount = static_cast<uint32_t>(buckets.size());
+	if (bucketCount == 0 || instanceHighWater == 0)
+		return;
+
+	vkCmdFillBuffer(commandBuffer, frame.drawCounts.buffer, 0, bucketCount * sizeof(uint32_t), 0);
+
+	VkBufferMemoryBarrier2 clearBarrier{};
+	clearBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+	clearBarrier.srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+	clearBarrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	clearBarrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	clearBarrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+	clearBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	clearBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	clearBarrier.buffer = frame.drawCounts.buffer;
+	clearBarrier.offset = 0;
+	clearBarrier.size = VK_WHOLE_SIZE;
+	VkDependencyInfo clearDependency{};
+	clearDependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	clearDependency.bufferMemoryBarrierCount = 1;
+	clearDependency.pBufferMemoryBarriers = &clearBarrier;
+	vkCmdPipelineBarrier2(commandBuffer, &clearDependency);
+
+	CullConstants constants{};
+	Frustum frustum = Frustum::fromViewProjection(viewProjection);
+	std::copy(std::begin(frustum.planes), std::end(frustum.planes), constants.frustumPlanes);
+	constants.cameraPosition = glm::vec4(cameraPosition, lodScale);
+	constants.instanceCount = instanceHighWater;
+	constants.bucketCount = bucketCount;
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &frame.cullSet, 0, nullptr);
+	vkCmdPushConstants(commandBuffer, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullConstants), &constants);
+	vkCmdDispatch(commandBuffer, (instanceHighWater + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE, 1, 1);
+
+	// commands and counts feed the indirect draws
+	VkBufferMemoryBarrier2 drawBarriers[2]{};
+	for (VkBufferMemoryBarrier2& barrier : drawBarriers)
+	{
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+		barrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+		barrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+		barrier.dstStageMask = VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT;
+		barrier.dstAccessMask = VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.offset = 0;
+		barrier.size = VK_WHOLE_SIZE;
+	}
+	drawBarriers[0].buffer = frame.drawCommands.buffer;
+	drawBarriers[1].buffer = frame.drawCounts.buffer;
+	VkDependencyInfo drawDependency{};
+	drawDependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	drawDependency.bufferMemoryBarrierCount = 2;
+	drawDependency.pBufferMemoryBarriers = drawBarriers;
+	vkCmdPipelineBarrier2(commandBuffer, &drawDependency);
+}
+
+void GpuDrivenRenderer::recordDraws(VkCommandBuffer commandBuffer, const GeometryBuffers& geometryBuffers, const glm::mat4& viewProjection)
+{
+	if (instanceHighWater == 0)
+		return;
+	FrameResources& frame = frames[currentFrame];
+	GpuDrawConstants constants{ viewProjection };
+
+	VkPipeline boundPipeline = VK_NULL_HANDLE;
+	VertexAttributeFlags boundLayout = FLAG_NONE;
+	for (uint32_t bucketIndex = 0; bucketIndex < buckets.size(); bucketIndex++)
+	{
+		const DrawBucket& bucket = buckets[bucketIndex];
+		if (bucket.pipeline != boundPipeline)
+		{
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, bucket.pipeline);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, bucket.pipelineLayout, 0, 1, &frame.drawSet, 0, nullptr);
+			vkCmdPushConstants(commandBuffer, bucket.pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GpuDrawConstants), &constants);
+			boundPipeline = bucket.pipeline;
+		}
+		if (bucket.layout != boundLayout)
+		{
+			geometryBuffers.bind(commandBuffer, bucket.layout);
+			boundLayout = bucket.layout;
+		}
+		vkCmdDrawIndexedIndirectCount(commandBuffer,
+			frame.drawCommands.buffer, static_cast<VkDeviceSize>(bucket.firstCommand) * sizeof(VkDrawIndexedIndirectCommand),
+			frame.drawCounts.buffer, bucketIndex * sizeof(uint32_t),
+			bucket.capacity, sizeof(VkDrawIndexedIndirectCommand));
+	}
+}
+
+VkDescriptorBufferInfo GpuDrivenRenderer::getInstanceBufferInfo() const
+{
+	VkDescriptorBufferInfo info{};
+	info.buffer = frames[currentFrame].instances.buffer.buffer;
+	info.offset = 0;
+	info.range = VK_WHOLE_SIZE;
+	return info;
+}
+
+void GpuDrivenRenderer::markDirty(uint32_t instance)
+{
+	if (dirtyFrames[instance] == 0)
+		dirtyInstances.push_back(instance);
+	dirtyFrames[instance] = static_cast<uint8_t>((1u << frames.size()) - 1u);
+}
+
+void GpuDrivenRenderer::createDescriptors()
+{
+	VkDescriptorSetLayoutBinding cullBindings[CULL_BINDING_COUNT]{};
+	for (uint32_t i = 0; i < CULL_BINDING_COUNT; i++)
+	{
+		cullBindings[i].binding = i;
+		cullBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		cullBindings[i].descriptorCount = 1;
+		cullBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = CULL_BINDING_COUNT;
+	layoutInfo.pBindings = cullBindings;
+	VK_CHECK(vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &cullSetLayout), "Failed to create the cull descriptor set layout");
+
+	VkDescriptorSetLayoutBinding drawBinding{};
+	drawBinding.binding = 0;
+	drawBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	drawBinding.descriptorCount = 1;
+	drawBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+	layoutInfo.bindingCount = 1;
+	layoutInfo.pBindings = &drawBinding;
+	VK_CHECK(vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &drawSetLayout), "Failed to create the draw descriptor set layout");
+
+	uint32_t frameCount = static_cast<uint32_t>(frames.size());
+	VkDescriptorPoolSize poolSize{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, frameCount * (CULL_BINDING_COUNT + 1) };
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = frameCount * 2;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+	VK_CHECK(vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool), "Failed to create the GPU driven descriptor pool");
+
+	for (FrameResources& frame : frames)
+	{
+		VkDescriptorSetLayout setLayouts[2] = { cullSetLayout, drawSetLayout };
+		VkDescriptorSet sets[2];
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = descriptorPool;
+		allocInfo.descriptorSetCount = 2;
+		allocInfo.pSetLayouts = setLayouts;
+		VK_CHECK(vkAllocateDescriptorSets(device, &allocInfo, sets), "Failed to allocate GPU driven descriptor sets");
+		frame.cullSet = sets[0];
+		frame.drawSet = sets[1];
+
+		VkDescriptorBufferInfo bufferInfos[CULL_BINDING_COUNT] = {
+			{ frame.instances.buffer.buffer, 0, VK_WHOLE_SIZE },
+			{ meshBuffer.buffer.buffer, 0, VK_WHOLE_SIZE },
+			{ bucketBuffer.buffer.buffer, 0, VK_WHOLE_SIZE },
+			{ frame.drawCommands.buffer, 0, VK_WHOLE_SIZE },
+			{ frame.drawCounts.buffer, 0, VK_WHOLE_SIZE },
+		};
+		VkWriteDescriptorSet writes[CULL_BINDING_COUNT + 1]{};
+		for (uint32_t i = 0; i < CULL_BINDING_COUNT; i++)
+		{
+			writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[i].dstSet = frame.cullSet;
+			writes[i].dstBinding = i;
+			writes[i].descriptorCount = 1;
+			writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes[i].pBufferInfo = &bufferInfos[i];
+		}
+		writes[CULL_BINDING_COUNT] = writes[0];
+		writes[CULL_BINDING_COUNT].dstSet = frame.drawSet;
+		vkUpdateDescriptorSets(device, CULL_BINDING_COUNT + 1, writes, 0, nullptr);
+	}
+}
+
+void GpuDrivenRenderer::createCullPipeline(VkShaderModule cullShader)
+{
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(CullConstants);
+
+	VkPipelineLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layoutInfo.setLayoutCount = 1;
+	layoutInfo.pSetLayouts = &cullSetLayout;
+	layoutInfo.pushConstantRangeCount = 1;
+	layoutInfo.pPushConstantRanges = &pushConstantRange;
+	VK_CHECK(vkCreatePipelineLayout(device, &layoutInfo, nullptr, &cullPipelineLayout), "Failed to create the cull pipeline layout");
+
+	VkComputePipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = cullShader;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = cullPipelineLayout;
+	VK_CHECK(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &cullPipeline), "Failed to create the cull pipeline");
+}
@@ -0,0 +1,224 @@
+#pragma once
+
+#include "FrustumCulling.hpp"
+#include "GeometryBuffers.hpp"
+#include "GraphicsResources.hpp"
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+/*
+* GPU driven rendering keeps every instance in storage buffers. A compute pass culls the instances against the frustum,
+* picks a level of detail and writes one indexed indirect draw per visible instance into the range of the instance's bucket.
+* Each bucket is then drawn with a single vkCmdDrawIndexedIndirectCount, so the CPU cost of a frame does not depend on the instance count.
+*/
+
+constexpr uint32_t MAX_MESH_LODS = 4;
+constexpr uint32_t INVALID_BUCKET = 0xffffffff;
+constexpr uint32_t INVALID_INSTANCE = 0xffffffff;
+constexpr uint32_t CULL_WORKGROUP_SIZE = 64; ///< must match local_size_x of cull.comp
+constexpr uint32_t DEFAULT_MAX_INSTANCES = 1u << 16;
+constexpr uint32_t DEFAULT_MAX_MESHES = 4096;
+constexpr uint32_t MAX_DRAW_BUCKETS = 64;
+
+/**
+ * @brief Instance data as the cull and draw shaders see it. Matches the std430 layout of the shaders.
+ */
+struct GpuInstance
+{
+	glm::mat4 model;
+	glm::vec4 boundingSphere; ///< center in model space and radius
+	uint32_t meshIndex;       ///< index returned by registerMesh
+	uint32_t materialIndex;
+	uint32_t bucket;          ///< bucket the instance is drawn in, INVALID_BUCKET hides it
+	uint32_t padding;
+};
+
+struct GpuMeshLod
+{
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	int32_t vertexOffset;
+	uint32_t padding;
+};
+
+/**
+ * @brief Levels of detail of a mesh. Matches the std430 layout of the cull shader.
+ */
+struct GpuMesh
+{
+	GpuMeshLod lods[MAX_MESH_LODS];
+	glm::vec4 lodDistances; ///< distance at which lod i + 1 takes over from lod i
+	uint32_t lodCount;
+	uint32_t padding[3];
+};
+
+/**
+ * @brief Range of draw commands a bucket owns. Matches the std430 layout of the cull shader.
+ */
+struct GpuBucket
+{
+	uint32_t firstCommand;
+	uint32_t capacity;
+};
+
+/**
+ * @brief Push constants of the cull shader.
+ */
+struct CullConstants
+{
+	glm::vec4 frustumPlanes[6]; ///< plane normals point inside the frustum
+	glm::vec4 cameraPosition;   ///< w scales the distances used for lod selection
+	uint32_t instanceCount;
+	uint32_t bucketCount;
+	uint32_t padding[2];
+};
+
+/**
+ * @brief Push constants of gpu_driven.vert.
+ */
+struct GpuDrawConstants
+{
+	glm::mat4 viewProjection;
+};
+
+/**
+ * @brief Instances sharing a pipeline and a vertex layout. Drawn with one indirect call.
+ */
+struct DrawBucket
+{
+	VkPipeline pipeline;
+	VkPipelineLayout pipelineLayout;
+	VertexAttributeFlags layout; ///< vertex layout of every mesh in the bucket
+	uint32_t firstCommand;
+	uint32_t capacity;           ///< maximum number of visible instances drawn
+};
+
+class GpuDrivenRenderer
+{
+
+public:
+	GpuDrivenRenderer();
+
+	/**
+	 * @brief Creates the buffers, descriptor sets and the cull pipeline.
+	 * @param device to create the objects on.
+	 * @param allocator to allocate the buffers with.
+	 * @param cullShader is the compiled cull.comp.
+	 * @param concurrentFrames is the number of frames in flight.
+	 * @param maxInstances is the instance capacity.
+	 * @param maxMeshes is the mesh capacity.
+	 */
+	void initialize(VkDevice device, VmaAllocator allocator, VkShaderModule cullShader, uint32_t concurrentFrames,
+		uint32_t maxInstances = DEFAULT_MAX_INSTANCES, uint32_t maxMeshes = DEFAULT_MAX_MESHES);
+
+	/**
+	 * @brief Destroys everything. The GPU must be idle.
+	 */
+	void cleanup();
+
+	/**
+	 * @brief Registers the levels of detail of a mesh, finest first.
+	 * @param lods are the geometry allocations of each level. All of them must share one vertex layout.
+	 * @param lodCount is the number of levels, at most MAX_MESH_LODS.
+	 * @param lodDistances is the distance at which level i + 1 takes over from level i.
+	 * @return index of the mesh for GpuInstance::meshIndex.
+	 */
+	uint32_t registerMesh(const GeometryAllocation* lods, uint32_t lodCount, const glm::vec4& lodDistances);
+
+	/**
+	 * @brief Creates a bucket drawn with the given pipeline.
+	 * @param pipeline to draw with. Its set 0 must hold the instance buffer at binding 0.
+	 * @param pipelineLayout of the pipeline.
+	 * @param layout is the vertex layout of the meshes drawn in the bucket.
+	 * @param capacity is the maximum number of visible instances drawn from the bucket.
+	 * @return index of the bucket for GpuInstance::bucket.
+	 */
+	uint32_t createBucket(VkPipeline pipeline, VkPipelineLayout pipelineLayout, VertexAttributeFlags layout, uint32_t capacity);
+
+	/**
+	 * @brief Adds an instance.
+	 * @return handle of the instance, or INVALID_INSTANCE if the renderer is full.
+	 */
+	uint32_t addInstance(const GpuInstance& instance);
+
+	void updateInstance(uint32_t instance, const GpuInstance& data);
+	void updateTransform(uint32_t instance, const glm::mat4& model);
+	void removeInstance(uint32_t instance);
+
+	/**
+	 * @brief Writes the instances changed since their frame buffer was last used. Call after waiting on the frame's fence.
+	 * @param frameIndex is the index of the concurrent frame.
+	 */
+	void beginFrame(uint32_t frameIndex);
+
+	/**
+	 * @brief Records the cull pass. Must be recorded outside of a render pass.
+	 * @param commandBuffer to record into.
+	 * @param viewProjection of the camera.
+	 * @param cameraPosition in world space.
+	 * @param lodScale scales the camera distance before lod selection.
+	 */
+	void recordCull(VkCommandBuffer commandBuffer, const glm::mat4& viewProjection, const glm::vec3& cameraPosition, float lodScale = 1.f);
+
+	/**
+	 * @brief Records one indirect draw per bucket. Must be recorded inside the render pass.
+	 * @param commandBuffer to record into.
+	 * @param geometryBuffers holding the meshes.
+	 * @param viewProjection pushed to the pipelines as GpuDrawConstants.
+	 */
+	void recordDraws(VkCommandBuffer commandBuffer, const GeometryBuffers& geometryBuffers, const glm::mat4& viewProjection);
+
+	/**
+	 * @brief Returns the descriptor info of the instance buffer of the current frame, for the draw pipelines.
+	 */
+	VkDescriptorBufferInfo getInstanceBufferInfo() const;
+
+	/**
+	 * @brief Returns the descriptor set holding the instance buffer of the current frame at binding 0.
+	 */
+	VkDescriptorSet getDrawDescriptorSet() const { return frames[currentFrame].drawSet; }
+	VkDescriptorSetLayout getDrawDescriptorSetLayout() const { return drawSetLayout; }
+
+	uint32_t getInstanceCount() const { return instanceHighWater - static_cast<uint32_t>(freeInstances.size()); }
+
+private:
+	struct FrameResources
+	{
+		MappedBuffer instances;
+		Buffer drawCommands;
+		Buffer drawCounts;
+		VkDescriptorSet cullSet;
+		VkDescriptorSet drawSet;
+	};
+
+	void markDirty(uint32_t instance);
+	void createDescriptors();
+	void createCullPipeline(VkShaderModule cullShader);
+
+	VkDevice device;
+	VmaAllocator allocator;
+	uint32_t maxInstances;
+	uint32_t maxMeshes;
+	uint32_t maxCommands;
+	uint32_t currentFrame;
+
+	std::vector<FrameResources> frames;
+	MappedBuffer meshBuffer;   ///< appended only, so entries in use by the GPU never change
+	MappedBuffer bucketBuffer; ///< written when a bucket is created
+	uint32_t meshCount;
+	std::vector<DrawBucket> buckets;
+
+	std::vector<GpuInstance> instances;  ///< CPU copy of every instance
+	std::vector<uint8_t> dirtyFrames;    ///< bit per frame whose buffer misses the latest data
+	std::vector<uint32_t> dirtyInstances;
+	std::vector<uint32_t> freeInstances;
+	uint32_t instanceHighWater;          ///< instances at or above this were never used
+
+	VkDescriptorPool descriptorPool;
+	VkDescriptorSetLayout cullSetLayout;
+	VkDescriptorSetLayout drawSetLayout;
+	VkPipelineLayout cullPipelineLayout;
+	VkPipeline cullPipeline;
+};
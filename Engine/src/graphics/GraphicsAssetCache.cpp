@@ -1 +1,232 @@
-#include "GraphicsAssetCache.hpp"
\ No newline at end of file
+#include "GraphicsAssetCache.hpp"
+#include "AssetLoader.hpp"
+
+#include <cstring>
+
+constexpr uint64_t FNV_PRIME = 1099511628211ull;
+constexpr uint64_t WORD_PRIME_1 = 0x9e3779b185ebca87ull;
+constexpr uint64_t WORD_PRIME_2 = 0xc2b2ae3d27d4eb4full;
+
+GraphicsAssetCache::GraphicsAssetCache()
+	: geometryBuffers(nullptr)
+{
+}
+
+GraphicsAssetCache::~GraphicsAssetCache()
+{
+	cleanup();
+}
+
+void GraphicsAssetCache::initialize(GeometryBuffers* geometryBuffers, uint32_t framesInFlight, VkDeviceSize budget)
+{
+	this->geometryBuffers = geometryBuffers;
+	this->framesInFlight = framesInFlight;
+	this->budget = budget;
+}
+
+void GraphicsAssetCache::cleanup()
+{
+	if (geometryBuffers == nullptr)
+		return;
+	for (auto& [id, entry] : entries)
+	{
+		destroyEntry(entry);
+	}
+	for (CachedModelEntry& entry : retiredEntries)
+	{
+		destroyEntry(entry);
+	}
+	entries.clear();
+	entriesByContent.clear();
+	unreferencedEntries.clear();
+	retiredEntries.clear();
+	unreferencedBytes = 0;
+	stats.entryCount = 0;
+	geometryBuffers = nullptr;
+}
+
+void GraphicsAssetCache::beginFrame()
+{
+	currentFrame++;
+	// frames older than framesInFlight have had their fences waited on
+	size_t kept = 0;
+	for (size_t i = 0; i < retiredEntries.size(); i++)
+	{
+		if (retiredEntries[i].lastUsedFrame + framesInFlight <= currentFrame)
+			destroyEntry(retiredEntries[i]);
+		else
+			retiredEntries[kept++] = retiredEntries[i];
+	}
+	retiredEntries.resize(kept);
+}
+
+MeshHandle GraphicsAssetCache::acquireMesh(const GraphicsAsset& asset)
+{
+	MeshContentKey contentKey = getContentKey(asset);
+	auto existing = entriesByContent.find(contentKey);
+	if (existing != entriesByContent.end())
+	{
+		stats.hits++;
+		return addReference(MeshHandle{ existing->second });
+	}
+
+	GeometryAllocation geometry = geometryBuffers->allocate(asset.attributes, static_cast<uint32_t>(asset.vertices.size()), static_cast<uint32_t>(asset.indices.size()));
+	if (!geometry.isValid())
+	{
+		// Retire every unreferenced mesh so the space frees up once the GPU is done with them.
+		VkDeviceSize previousBudget = budget;
+		budget = 0;
+		evictToBudget();
+		budget = previousBudget;
+		return MeshHandle{};
+	}
+	UploadTicket uploadTicket = geometryBuffers->upload(geometry, asset.vertices.data(), asset.indices.data());
+
+	stats.misses++;
+	CachedModelEntry entry{};
+	entry.geometry = geometry;
+	entry.uploadTicket = uploadTicket;
+	entry.entryId = nextEntryId++;
+	entry.referenceCount = 1;
+	entry.contentKey = contentKey;
+	entry.sizeInBytes = static_cast<VkDeviceSize>(geometry.vertexCount) * getVertexStride(geometry.layout) + static_cast<VkDeviceSize>(geometry.indexCount) * sizeof(uint32_t);
+	entry.lastUsedFrame = currentFrame;
+	entry.lruPosition = unreferencedEntries.end();
+
+	entriesByContent.emplace(contentKey, entry.entryId);
+	entries[entry.entryId] = entry;
+	stats.residentBytes += entry.sizeInBytes;
+	stats.entryCount = entries.size();
+	return MeshHandle{ entry.entryId };
+}
+
+MeshHandle GraphicsAssetCache::addReference(MeshHandle handle)
+{
+	auto found = entries.find(handle.entryId);
+	if (found == entries.end())
+		return MeshHandle{};
+
+	CachedModelEntry& entry = found->second;
+	if (entry.referenceCount == 0)
+	{
+		// back in use, no longer an eviction candidate
+		unreferencedEntries.erase(entry.lruPosition);
+		entry.lruPosition = unreferencedEntries.end();
+		unreferencedBytes -= entry.sizeInBytes;
+	}
+	entry.referenceCount++;
+	return handle;
+}
+
+void GraphicsAssetCache::releaseMesh(MeshHandle handle)
+{
+	auto found = entries.find(handle.entryId);
+	if (found == entries.end() || found->second.referenceCount == 0)
+		return;
+
+	CachedModelEntry& entry = found->second;
+	entry.referenceCount--;
+	if (entry.referenceCount == 0)
+	{
+		entry.lruPosition = unreferencedEntries.insert(unreferencedEntries.end(), entry.entryId);
+		unreferencedBytes += entry.sizeInBytes;
+		evictToBudget();
+	}
+}
+
+const CachedModelEntry* GraphicsAssetCache::useMesh(MeshHandle handle)
+{
+	auto found = entries.find(handle.entryId);
+	if (found == entries.end() || !geometryBuffers->isReady(found->second.uploadTicket))
+		return nullptr;
+	found->second.lastUsedFrame = currentFrame;
+	return &found->second;
+}
+
+void GraphicsAssetCache::setBudget(VkDeviceSize budget)
+{
+	this->budget = budget;
+	evictToBudget();
+}
+
+uint64_t GraphicsAssetCache::hashBytes(const void* data, size_t size, uint64_t seed)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	uint64_t hash = seed;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+uint64_t GraphicsAssetCache::hashWords(const void* data, size_t size, uint64_t seed)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	uint64_t hash = seed + WORD_PRIME_2 + size;
+	size_t i = 0;
+	for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+	{
+		uint64_t word;
+		std::memcpy(&word, bytes + i, sizeof(word));
+		word *= WORD_PRIME_2;
+		word = (word << 31) | (word >> 33);
+		hash ^= word * WORD_PRIME_1;
+		hash = ((hash << 27) | (hash >> 37)) * WORD_PRIME_1 + WORD_PRIME_2;
+	}
+	for (; i < size; i++)
+	{
+		hash ^= bytes[i] * WORD_PRIME_1;
+		hash = ((hash << 11) | (hash >> 53)) * WORD_PRIME_2;
+	}
+	// spread the last rounds over every bit
+	hash ^= hash >> 33;
+	hash *= WORD_PRIME_2;
+	hash ^= hash >> 29;
+	hash *= WORD_PRIME_1;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+MeshContentKey GraphicsAssetCache::getContentKey(const GraphicsAsset& asset)
+{
+	size_t vertexBytes = asset.vertices.size() * sizeof(FullVertex);
+	size_t indexBytes = asset.indices.size() * sizeof(uint32_t);
+	MeshContentKey key{};
+	key.hashes[0] = hashBytes(asset.vertices.data(), vertexBytes);
+	key.hashes[0] = hashBytes(asset.indices.data(), indexBytes, key.hashes[0]);
+	key.hashes[1] = hashWords(asset.vertices.data(), vertexBytes);
+	key.hashes[1] = hashWords(asset.indices.data(), indexBytes, key.hashes[1]);
+	key.attributes = asset.attributes;
+	key.vertexCount = static_cast<uint32_t>(asset.vertices.size());
+	key.indexCount = static_cast<uint32_t>(asset.indices.size());
+	return key;
+}
+
+void GraphicsAssetCache::evictToBudget()
+{
+	// Referenced meshes are never evicted, so the budget only bounds what is kept around for reuse.
+	while (budget < unreferencedBytes && !unreferencedEntries.empty())
+	{
+		uint64_t entryId = unreferencedEntries.front();
+		unreferencedEntries.pop_front();
+
+		auto found = entries.find(entryId);
+		CachedModelEntry& entry = found->second;
+		unreferencedBytes -= entry.sizeInBytes;
+		entriesByContent.erase(entry.contentKey);
+		// the GPU copy lives on until the frames drawing it are done
+		retiredEntries.push_back(entry);
+		entries.erase(found);
+
+		stats.evictions++;
+		stats.entryCount = entries.size();
+	}
+}
+
+void GraphicsAssetCache::destroyEntry(CachedModelEntry& entry)
+{
+	stats.residentBytes -= entry.sizeInBytes;
+	geometryBuffers->free(entry.geometry);
+}
@@ -1,16 +1,79 @@
 #pragma once
 
-#include "GraphicsResources.hpp"
+#include "GeometryBuffers.hpp"
 #include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+struct GraphicsAsset;
+
+constexpr VkDeviceSize DEFAULT_MESH_CACHE_BUDGET = 512ull * 1024ull * 1024ull;
+
+/**
+ * @brief Identifies a mesh by its content. Two unrelated 64 bit hashes together with the sizes make a collision of
+ * different meshes practically impossible, so no copy of the data is needed to tell them apart.
+ */
+struct MeshContentKey
+{
+	uint64_t hashes[2];
+	VertexAttributeFlags attributes;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+
+	bool operator==(const MeshContentKey& other) const
+	{
+		return hashes[0] == other.hashes[0] && hashes[1] == other.hashes[1] && attributes == other.attributes
+			&& vertexCount == other.vertexCount && indexCount == other.indexCount;
+	}
+};
+
+struct MeshContentKeyHash
+{
+	size_t operator()(const MeshContentKey& key) const { return static_cast<size_t>(key.hashes[0]); }
+};
 
 struct CachedModelEntry
 {
-	Buffer vertexBuffer;
-	Buffer indexBuffer;
+	GeometryAllocation geometry; ///< location of the mesh in the geometry buffers
+	UploadTicket uploadTicket;   ///< the mesh can be drawn once its upload is ready
 	uint64_t entryId;
 	uint32_t referenceCount;
+	MeshContentKey contentKey; ///< of the vertex and index data
+	VkDeviceSize sizeInBytes; ///< GPU memory used by the geometry
+	uint64_t lastUsedFrame;   ///< latest frame that may have drawn the entry
+	std::list<uint64_t>::iterator lruPosition; ///< position in the list of unreferenced entries
+};
+
+/**
+ * @brief Handle to a mesh in the cache. Holding a handle means holding one reference.
+ */
+struct MeshHandle
+{
+	uint64_t entryId = 0; ///< zero is never a valid entry
+
+	bool isValid() const { return entryId != 0; }
+};
+
+struct GraphicsAssetCacheStats
+{
+	VkDeviceSize residentBytes = 0; ///< bytes of every entry that still owns GPU memory, retired ones included
+	uint64_t hits = 0;              ///< acquires served by an existing entry
+	uint64_t misses = 0;            ///< acquires that had to upload
+	uint64_t evictions = 0;         ///< entries dropped to stay within the budget
+	size_t entryCount = 0;
+
+	double getHitRate() const { return (0 < hits + misses) ? static_cast<double>(hits) / static_cast<double>(hits + misses) : 0.0; }
 };
 
+/**
+ * @brief Deduplicating cache of GPU meshes.
+ * Meshes are keyed by a 128 bit hash of their content, so loading the same model twice shares one upload.
+ * The content itself is not kept on the CPU.
+ * Entries without references stay resident until the memory budget is exceeded, then the least recently used ones are evicted.
+ * An evicted entry is destroyed only after every frame that may have drawn it has finished on the GPU.
+ * Not thread safe, meant to be used from the render thread.
+ */
 class GraphicsAssetCache
 {
 
@@ -18,7 +81,83 @@ public:
 	GraphicsAssetCache();
 	~GraphicsAssetCache();
 
+	/**
+	 * @brief Sets up the cache.
+	 * @param geometryBuffers to place the meshes in. Must outlive the cache.
+	 * @param framesInFlight is the number of frames the GPU may be behind the CPU.
+	 * @param budget is the number of bytes that unreferenced entries may keep resident.
+	 */
+	void initialize(GeometryBuffers* geometryBuffers, uint32_t framesInFlight, VkDeviceSize budget = DEFAULT_MESH_CACHE_BUDGET);
+
+	/**
+	 * @brief Destroys every entry. The GPU must be idle.
+	 */
+	void cleanup();
+
+	/**
+	 * @brief Advances the frame counter and destroys retired entries the GPU is done with.
+	 * Call after waiting on the fence of the frame about to be recorded.
+	 */
+	void beginFrame();
+
+	/**
+	 * @brief Returns a handle to the mesh of the asset, uploading it only if no identical mesh is cached.
+	 * @return the handle, which is not valid if the geometry buffers are full.
+	 */
+	MeshHandle acquireMesh(const GraphicsAsset& asset);
+
+	/**
+	 * @brief Adds a reference to an existing mesh.
+	 * @return the same handle.
+	 */
+	MeshHandle addReference(MeshHandle handle);
+
+	/**
+	 * @brief Drops a reference. The mesh stays cached and may be evicted once unreferenced.
+	 */
+	void releaseMesh(MeshHandle handle);
+
+	/**
+	 * @brief Returns the entry of the handle and marks it used in the current frame. Call when recording a draw.
+	 * @return the entry or nullptr if the handle is not valid or the mesh is still uploading.
+	 */
+	const CachedModelEntry* useMesh(MeshHandle handle);
+
+	void setBudget(VkDeviceSize budget);
+
+	const GraphicsAssetCacheStats& getStats() const { return stats; }
+
+	/**
+	 * @brief FNV-1a hash of a byte range.
+	 * @param seed allows hashing several ranges in a row.
+	 */
+	static uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 14695981039346656037ull);
+
+	/**
+	 * @brief Hash of a byte range in rounds of 8 byte words, unrelated to hashBytes.
+	 * @param seed allows hashing several ranges in a row.
+	 */
+	static uint64_t hashWords(const void* data, size_t size, uint64_t seed = 0);
+
+	/**
+	 * @brief Key of the vertices, indices and attributes of the asset.
+	 */
+	static MeshContentKey getContentKey(const GraphicsAsset& asset);
+
 private:
-	VmaAllocator allocator;
-};
+	void evictToBudget();
+	void destroyEntry(CachedModelEntry& entry);
 
+	GeometryBuffers* geometryBuffers;
+	uint32_t framesInFlight = 2;
+	VkDeviceSize budget = DEFAULT_MESH_CACHE_BUDGET;
+	uint64_t currentFrame = 0;
+	uint64_t nextEntryId = 1;
+
+	std::unordered_map<uint64_t, CachedModelEntry> entries;  ///< by entry id
+	std::unordered_map<MeshContentKey, uint64_t, MeshContentKeyHash> entriesByContent; ///< content key to entry id
+	std::list<uint64_t> unreferencedEntries;                 ///< least recently used first
+	VkDeviceSize unreferencedBytes = 0;
+	std::vector<CachedModelEntry> retiredEntries;            ///< evicted, waiting for the GPU
+	GraphicsAssetCacheStats stats;
+};
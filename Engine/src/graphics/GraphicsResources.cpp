@@ -4,6 +4,9 @@
 #include <vulkan/vulkan.h>
 #include <vma/vk_mem_alloc.h>
 
+#include <stdexcept>
+
+#define VK_CHECK(x, msg) if (x != VK_SUCCESS) { throw std::runtime_error(msg); }
 
 Buffer createBuffer(VmaAllocator& allocator, VkDeviceSize size, VkBufferUsageFlags flags)
 {
@@ -16,10 +19,44 @@ Buffer createBuffer(VmaAllocator& allocator, VkDeviceSize size, VkBufferUsageFla
 	VmaAllocationCreateInfo allocInfo{};
 	allocInfo.usage = VMA_MEMORY_USAGE_AUTO;
 
-	vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &newBuffer.buffer, &newBuffer.allocation, nullptr);
+	VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &newBuffer.buffer, &newBuffer.allocation, nullptr), "Failed to create a buffer");
 	return newBuffer;
 }
 
+MappedBuffer createMappedBuffer(VmaAllocator& allocator, VkDeviceSize size, VkBufferUsageFlags flags, VkMemoryPropertyFlags requiredMemoryFlags)
+{
+	MappedBuffer newBuffer{};
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	bufferInfo.usage = flags;
+
+	VmaAllocationCreateInfo allocInfo{};
+	allocInfo.usage = VMA_MEMORY_USAGE_AUTO;
+	allocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+	allocInfo.requiredFlags = requiredMemoryFlags;
+
+	VmaAllocationInfo allocationInfo{};
+	VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &newBuffer.buffer.buffer, &newBuffer.buffer.allocation, &allocationInfo), "Failed to create a mapped buffer");
+	if (allocationInfo.pMappedData == nullptr)
+	{
+		vmaDestroyBuffer(allocator, newBuffer.buffer.buffer, newBuffer.buffer.allocation);
+		throw std::runtime_error("Failed to map a buffer");
+	}
+	newBuffer.data = allocationInfo.pMappedData;
+	newBuffer.size = size;
+	return newBuffer;
+}
+
+void destroyBuffer(VmaAllocator& allocator, Buffer& buffer)
+{
+	if (buffer.buffer == VK_NULL_HANDLE)
+		return;
+	vmaDestroyBuffer(allocator, buffer.buffer, buffer.allocation);
+	buffer.buffer = VK_NULL_HANDLE;
+	buffer.allocation = VK_NULL_HANDLE;
+}
+
 Image createImage(VmaAllocator& allocator, uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags flags)
 {
 	Image newImage{};
@@ -40,7 +77,7 @@ Image createImage(VmaAllocator& allocator, uint32_t width, uint32_t height, VkFo
 
 	VmaAllocationCreateInfo allocInfo{};
 	allocInfo.usage = VMA_MEMORY_USAGE_AUTO;
-	vmaCreateImage(allocator, &imageInfo, &allocInfo, &newImage.image, &newImage.allocation, nullptr);
+	VK_CHECK(vmaCreateImage(allocator, &imageInfo, &allocInfo, &newImage.image, &newImage.allocation, nullptr), "Failed to create an image");
 
 	VkImageViewCreateInfo viewInfo{};
 	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -55,7 +92,22 @@ Image createImage(VmaAllocator& allocator, uint32_t width, uint32_t height, VkFo
 
 	VmaAllocatorInfo allocatorInfo{};
 	vmaGetAllocatorInfo(allocator, &allocatorInfo);
-	vkCreateImageView(allocatorInfo.device, &viewInfo, nullptr, &newImage.view);
+	if (vkCreateImageView(allocatorInfo.device, &viewInfo, nullptr, &newImage.view) != VK_SUCCESS)
+	{
+		vmaDestroyImage(allocator, newImage.image, newImage.allocation);
+		throw std::runtime_error("Failed to create an image view");
+	}
 
 	return newImage;
 }
+
+void destroyImage(VmaAllocator& allocator, Image& image)
+{
+	if (image.image == VK_NULL_HANDLE)
+		return;
+	VmaAllocatorInfo allocatorInfo{};
+	vmaGetAllocatorInfo(allocator, &allocatorInfo);
+	vkDestroyImageView(allocatorInfo.device, image.view, nullptr);
+	vmaDestroyImage(allocator, image.image, image.allocation);
+	image = Image{};
+}
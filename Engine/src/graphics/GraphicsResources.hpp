@@ -16,18 +16,45 @@ struct Buffer
 	VmaAllocation allocation;
 };
 
+/**
+ * @brief MappedBuffer is a buffer in host visible memory that stays mapped for its whole lifetime.
+ */
+struct MappedBuffer
+{
+	Buffer buffer;
+	void* data;        ///< pointer to the mapped memory
+	VkDeviceSize size; ///< size of the buffer in bytes
+};
+
 /**
  * @brief Image consists of view, image and allocation.
  */
 struct Image
 {
-	VkImage image;
-	VkImageView view;
-	VmaAllocation allocation;
+	VkImage image = VK_NULL_HANDLE;
+	VkImageView view = VK_NULL_HANDLE;
+	VmaAllocation allocation = VK_NULL_HANDLE;
 };
 
 
 
 Buffer createBuffer(VmaAllocator& allocator, VkDeviceSize size, VkBufferUsageFlags flags);
 
+/**
+ * @brief Creates a persistently mapped buffer that the host writes to sequentially.
+ * @param allocator to allocate the memory with
+ * @param size of the buffer in bytes
+ * @param flags usage flags of the buffer
+ * @param requiredMemoryFlags the memory must have on top of host visibility, e.g. VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+ * @return MappedBuffer
+ */
+MappedBuffer createMappedBuffer(VmaAllocator& allocator, VkDeviceSize size, VkBufferUsageFlags flags, VkMemoryPropertyFlags requiredMemoryFlags = 0);
+
+void destroyBuffer(VmaAllocator& allocator, Buffer& buffer);
+
 Image createImage(VmaAllocator& allocator, uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags flags);
+
+/**
+ * @brief Destroys the view and the image of createImage.
+ */
+void destroyImage(VmaAllocator& allocator, Image& image);
@@ -3,53 +3,67 @@
 #include <vulkan/vulkan.hpp>
 #include "BasicAttributes.hpp"
 
+#include <stdexcept>
 
-void CharacterData::advanceAnimation(float dt)
-{
-	// todo perhaps this should fill up a list of transformations. The current bone transformations list is a bit hacky.
-	// that way stuff like IK could be just plugged in.
-	Animation animation = animationData.animations[animationData.currentAnimationIndex];
-	// If no animation is set, do nothing.
-	if (animation.animationNodes.empty())
-		return;
 
-	animationData.currentTicks += dt * animation.ticksPerSecond;
-	double trueAnimationtime = fmod(animationData.currentTicks, animation.totalTicks); // loops over the animation
-	animationData.currentTicks = trueAnimationtime;
+void sampleAnimation(const Animation& animation, const Skeleton& skeleton, const glm::mat4& inverseGlobalTransformation, double ticks, glm::mat4* transformationsToFill)
+{
+	double trueAnimationtime = fmod(ticks, animation.totalTicks); // loops over the animation
 	size_t animationNodeIndex = 0;
 	while (animationNodeIndex < animation.animationNodes.size() - 1 && animation.animationNodes[animationNodeIndex + 1].time < trueAnimationtime)
 	{
 		animationNodeIndex++;
 	}
 
-	AnimationNode firstNode = animation.animationNodes[animationNodeIndex];
-	AnimationNode secondNode = animation.animationNodes[(animationNodeIndex + 1) % animation.animationNodes.size()];
+	const AnimationNode& firstNode = animation.animationNodes[animationNodeIndex];
+	const AnimationNode& secondNode = animation.animationNodes[(animationNodeIndex + 1) % animation.animationNodes.size()];
 
 	double timeDiff = secondNode.time - firstNode.time;
 	if (timeDiff < 0.0) // looping
 		timeDiff += animation.totalTicks;
 
-	double factor = (trueAnimationtime - firstNode.time) / timeDiff;
+	double factor = (0.0 < timeDiff) ? (trueAnimationtime - firstNode.time) / timeDiff : 0.0;
 
-	size_t bonesToUpdate = skeleton.bones.size();
-	uint32_t boneIndex = 0; // The root bone is always the first bone in the array.
-	while (0 < bonesToUpdate)
+	// batch kernels interpolate and compose every bone before the hierarchy is walked
+	size_t boneCount = skeleton.bones.size();
+	if (firstNode.bones.size() < boneCount || secondNode.bones.size() < boneCount)
+		throw std::invalid_argument("Animation has fewer bone poses than the skeleton has bones");
+	thread_local std::vector<Pose> interpolatedPoses;
+	thread_local std::vector<AffineTransform> localTransformations;
+	interpolatedPoses.resize(boneCount);
+	localTransformations.resize(boneCount);
+	Pose::interpolatePoses(firstNode.bones.data(), secondNode.bones.data(), static_cast<float>(factor), boneCount, interpolatedPoses.data());
+	Pose::composeAffineTransforms(interpolatedPoses.data(), boneCount, localTransformations.data());
+
+	// The root bone is always the first bone in the array.
+	for (uint32_t boneIndex = 0; boneIndex < boneCount; boneIndex++)
 	{
-		BoneNode bone = skeleton.bones[boneIndex];
-		glm::mat4 parentTransformation = glm::mat4(1.0f);
+		const BoneNode& bone = skeleton.bones[boneIndex];
+		glm::mat4 localTransformation = localTransformations[boneIndex].toMat4();
 		if (-1 < bone.parent) // we assume parents are always updated before children
-			parentTransformation = skeleton.boneTransformations[bone.parent];
-
-		glm::mat4 interPolatedTransformation = Pose::interpolate(firstNode.bones[boneIndex], secondNode.bones[boneIndex], factor).getTransformationMatrix();
-		skeleton.boneTransformations[boneIndex] = parentTransformation * interPolatedTransformation;
-
-		boneIndex++;
-		bonesToUpdate--;
+			transformationsToFill[boneIndex] = transformationsToFill[bone.parent] * localTransformation;
+		else
+			transformationsToFill[boneIndex] = localTransformation;
 	}
 	// TODO make this more efficient
 	for (size_t i = 0; i < skeleton.bones.size(); i++)
 	{
-		skeleton.boneTransformations[i] = inverseGlobalTransformation * skeleton.boneTransformations[i] * skeleton.bones[i].boneOffset;
+		transformationsToFill[i] = inverseGlobalTransformation * transformationsToFill[i] * skeleton.bones[i].boneOffset;
 	}
 }
 
+void CharacterData::advanceAnimation(float dt)
+{
+	// todo perhaps this should fill up a list of transformations. The current bone transformations list is a bit hacky.
+	// that way stuff like IK could be just plugged in.
+	const Animation& animation = animationData.animations[animationData.currentAnimationIndex];
+	// If no animation is set, do nothing.
+	if (animation.animationNodes.empty())
+		return;
+
+	animationData.currentTicks += dt * animation.ticksPerSecond;
+	animationData.currentTicks = fmod(animationData.currentTicks, animation.totalTicks); // loops over the animation
+
+	sampleAnimation(animation, skeleton, inverseGlobalTransformation, animationData.currentTicks, skeleton.boneTransformations.data());
+}
+
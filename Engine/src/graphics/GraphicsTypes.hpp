@@ -4,16 +4,21 @@
 #include <array>
 #include <vector>
 #include "BasicAttributes.hpp"
+#include "Vertex.hpp"
 
-constexpr size_t MAX_BONES = 50;
 constexpr size_t MAX_ANIMATIONS = 10; // Redo with component system?
 
+/**
+ * @brief Mesh drawn from the shared geometry buffers. The layout selects the vertex buffer to bind.
+ */
 struct IndexedDrawable
 {
-	VkBuffer vertexBuffer;
-	VkBuffer indexBuffer;
+	VertexAttributeFlags layout; ///< vertex layout of the mesh
+	uint32_t firstIndex;         ///< first index of the mesh in the shared index buffer
+	int32_t vertexOffset;        ///< added to every index of the mesh
 	uint32_t indexCount;
-	VkDescriptorSet descriptorSet;
+	VkDescriptorSet descriptorSet; ///< VK_NULL_HANDLE in bindless mode
+	uint32_t textureSlot;          ///< bindless mode: slot of the texture in the BindlessDescriptorTable
 };
 
 struct TriangleFanDrawable
@@ -29,7 +34,7 @@ struct TriangleFanDrawable
 struct AnimationNode
 {
 	double time;                                 ///< time of this animation node in ticks
-	std::array<Pose, MAX_BONES> bones;			 ///< bone orientations
+	std::vector<Pose> bones;                     ///< bone orientations, one per bone of the skeleton
 };
 
 /**
@@ -63,6 +68,16 @@ struct Skeleton
 	const std::vector<BoneNode> bones;
 };
 
+/**
+ * @brief Samples the animation at the given time and writes the final skinning matrices of the skeleton.
+ * @param animation to sample.
+ * @param skeleton whose bone hierarchy is used.
+ * @param inverseGlobalTransformation of the character.
+ * @param ticks is the animation time in ticks. It is wrapped to the length of the animation.
+ * @param transformationsToFill must hold at least skeleton.bones.size() matrices.
+ */
+void sampleAnimation(const Animation& animation, const Skeleton& skeleton, const glm::mat4& inverseGlobalTransformation, double ticks, glm::mat4* transformationsToFill);
+
 struct CharacterData
 {
 	Pose characterOrientation;						///< orientation of the character
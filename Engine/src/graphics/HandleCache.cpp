@@ -0,0 +1,11 @@
+#include "HandleCache.hpp"
+
+#include <algorithm>
+
+bool HandleCacheKey::operator==(const HandleCacheKey& other) const
+{
+	if (hash != other.hash || size != other.size)
+		return false;
+	uint32_t inlineSize = std::min(size, HANDLE_CACHE_KEY_INLINE_WORDS);
+	return std::equal(words.begin(), words.begin() + inlineSize, other.words.begin()) && overflow == other.overflow;
+}
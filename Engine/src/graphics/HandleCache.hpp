@@ -0,0 +1,145 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+/*
+* Vulkan objects that are fully described by their create info, such as descriptor set layouts, pipeline layouts and samplers,
+* are interned: equal create infos return the same handle. The create info is flattened into a key of 32 bit words that is
+* hashed as it is built. Keys live on the stack, so a lookup that hits allocates nothing. The handles are spread over
+* shards by hash, each behind a reader writer lock, so threads compiling pipelines in parallel only contend on a miss
+* in the same shard.
+*/
+
+constexpr uint32_t HANDLE_CACHE_KEY_INLINE_WORDS = 64; ///< e.g. 15 descriptor bindings, more spill to the heap
+constexpr uint32_t HANDLE_CACHE_SHARD_COUNT = 16;
+
+/**
+ * @brief Create info of a Vulkan object flattened into words, with its hash.
+ */
+class HandleCacheKey
+{
+public:
+	HandleCacheKey() = default;
+
+	void push(uint32_t word)
+	{
+		if (size < HANDLE_CACHE_KEY_INLINE_WORDS)
+			words[size] = word;
+		else
+			overflow.push_back(word);
+		size++;
+		hash = (hash ^ word) * 0x100000001b3ull;
+	}
+
+	void push64(uint64_t value)
+	{
+		push(static_cast<uint32_t>(value));
+		push(static_cast<uint32_t>(value >> 32));
+	}
+
+	void pushFloat(float value) { push(std::bit_cast<uint32_t>(value)); }
+
+	template <typename Handle>
+	void pushHandle(Handle handle) { push64(reinterpret_cast<uint64_t>(handle)); }
+
+	uint64_t getHash() const { return hash; }
+	uint32_t getSize() const { return size; }
+
+	bool operator==(const HandleCacheKey& other) const;
+
+private:
+	std::array<uint32_t, HANDLE_CACHE_KEY_INLINE_WORDS> words;
+	uint32_t size = 0;
+	std::vector<uint32_t> overflow; ///< words past the inline ones
+	uint64_t hash = 0xcbf29ce484222325ull;
+};
+
+struct HandleCacheKeyHasher
+{
+	size_t operator()(const HandleCacheKey& key) const { return static_cast<size_t>(key.getHash()); }
+};
+
+/**
+ * @brief Thread safe map from keys to interned handles.
+ * @tparam Handle of the interned objects.
+ */
+template <typename Handle>
+class ShardedHandleCache
+{
+public:
+	/**
+	 * @brief Returns the handle of the key, creating it on a miss.
+	 * Creation runs outside the lock. When two threads miss on the same key at once, the first insert wins and the
+	 * other handle is destroyed, so every caller gets the same handle.
+	 * @param key of the object.
+	 * @param create returns a new handle for the key.
+	 * @param destroy destroys a handle that lost the race.
+	 */
+	template <typename Create, typename Destroy>
+	Handle getOrCreate(const HandleCacheKey& key, Create&& create, Destroy&& destroy)
+	{
+		Shard& shard = getShard(key);
+		{
+			std::shared_lock<std::shared_mutex> lock(shard.mutex);
+			auto found = shard.handles.find(key);
+			if (found != shard.handles.end())
+				return found->second;
+		}
+
+		Handle created = create();
+		std::unique_lock<std::shared_mutex> lock(shard.mutex);
+		auto [entry, inserted] = shard.handles.emplace(key, created);
+		if (!inserted)
+		{
+			lock.unlock();
+			destroy(created);
+			return entry->second;
+		}
+		createdCount.fetch_add(1, std::memory_order_relaxed);
+		return created;
+	}
+
+	/**
+	 * @brief Destroys and forgets every handle. No thread may use the cache meanwhile.
+	 */
+	template <typename Destroy>
+	void clear(Destroy&& destroy)
+	{
+		for (Shard& shard : shards)
+		{
+			std::unique_lock<std::shared_mutex> lock(shard.mutex);
+			for (auto& [key, handle] : shard.handles)
+				destroy(handle);
+			shard.handles.clear();
+		}
+		createdCount = 0;
+	}
+
+	/**
+	 * @return the number of interned handles.
+	 */
+	uint32_t size() const { return createdCount.load(std::memory_order_relaxed); }
+
+private:
+	struct alignas(64) Shard
+	{
+		std::shared_mutex mutex;
+		std::unordered_map<HandleCacheKey, Handle, HandleCacheKeyHasher> handles;
+	};
+
+	Shard& getShard(const HandleCacheKey& key)
+	{
+		// the low bits go to the buckets of the shard's map
+		return shards[(key.getHash() >> 32) % HANDLE_CACHE_SHARD_COUNT];
+	}
+
+	std::array<Shard, HANDLE_CACHE_SHARD_COUNT> shards;
+	std::atomic<uint32_t> createdCount = 0;
+};
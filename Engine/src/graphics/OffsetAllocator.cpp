@@ -0,0 +1,281 @@
+#include "OffsetAllocator.hpp"
+
+#include <bit>
+
+constexpr uint32_t MANTISSA_BITS = 3;
+constexpr uint32_t MANTISSA_VALUE = 1 << MANTISSA_BITS;
+constexpr uint32_t MANTISSA_MASK = MANTISSA_VALUE - 1;
+
+/**
+ * @brief Returns the index of the lowest set bit at or after the start bit, or OFFSET_ALLOCATOR_NO_SPACE.
+ */
+inline uint32_t findLowestSetBitAfter(uint32_t bitMask, uint32_t startBitIndex)
+{
+	if (32 <= startBitIndex)
+		return OFFSET_ALLOCATOR_NO_SPACE;
+	uint32_t bitsAfter = bitMask & ~((1u << startBitIndex) - 1u);
+	if (bitsAfter == 0)
+		return OFFSET_ALLOCATOR_NO_SPACE;
+	return static_cast<uint32_t>(std::countr_zero(bitsAfter));
+}
+
+OffsetAllocator::OffsetAllocator()
+{
+	reset(0);
+}
+
+OffsetAllocator::OffsetAllocator(uint32_t size)
+{
+	reset(size);
+}
+
+void OffsetAllocator::reset(uint32_t size)
+{
+	this->size = size;
+	freeStorage = 0;
+	usedBinsTop = 0;
+	for (uint32_t i = 0; i < OFFSET_ALLOCATOR_TOP_BINS; i++)
+		usedBins[i] = 0;
+	for (uint32_t i = 0; i < OFFSET_ALLOCATOR_LEAF_BINS; i++)
+		binIndices[i] = OFFSET_ALLOCATOR_NO_SPACE;
+	nodes.clear();
+	freeNodes.clear();
+
+	if (0 < size)
+		insertNodeIntoBin(size, 0);
+}
+
+OffsetAllocation OffsetAllocator::allocate(uint32_t size)
+{
+	if (size == 0 || freeStorage < size)
+		return {};
+
+	// Rounding up guarantees every node in the found bin is large enough.
+	uint32_t minBinIndex = sizeToBinRoundUp(size);
+	if (OFFSET_ALLOCATOR_LEAF_BINS <= minBinIndex)
+		return {};
+	uint32_t minTopBinIndex = minBinIndex / OFFSET_ALLOCATOR_BINS_PER_LEAF;
+	uint32_t minLeafBinIndex = minBinIndex % OFFSET_ALLOCATOR_BINS_PER_LEAF;
+
+	uint32_t topBinIndex = minTopBinIndex;
+	uint32_t leafBinIndex = OFFSET_ALLOCATOR_NO_SPACE;
+	if (usedBinsTop & (1u << topBinIndex))
+		leafBinIndex = findLowestSetBitAfter(usedBins[topBinIndex], minLeafBinIndex);
+
+	if (leafBinIndex == OFFSET_ALLOCATOR_NO_SPACE)
+	{
+		topBinIndex = findLowestSetBitAfter(usedBinsTop, minTopBinIndex + 1);
+		if (topBinIndex == OFFSET_ALLOCATOR_NO_SPACE)
+			return {};
+		// any leaf of a larger top bin fits
+		leafBinIndex = static_cast<uint32_t>(std::countr_zero(static_cast<uint32_t>(usedBins[topBinIndex])));
+	}
+
+	uint32_t binIndex = topBinIndex * OFFSET_ALLOCATOR_BINS_PER_LEAF + leafBinIndex;
+	uint32_t nodeIndex = binIndices[binIndex];
+	Node& node = nodes[nodeIndex];
+	uint32_t nodeTotalSize = node.dataSize;
+	node.dataSize = size;
+	node.used = true;
+
+	binIndices[binIndex] = node.binListNext;
+	if (node.binListNext != OFFSET_ALLOCATOR_NO_SPACE)
+		nodes[node.binListNext].binListPrevious = OFFSET_ALLOCATOR_NO_SPACE;
+	freeStorage -= nodeTotalSize;
+
+	if (binIndices[binIndex] == OFFSET_ALLOCATOR_NO_SPACE)
+	{
+		usedBins[topBinIndex] &= ~(1u << leafBinIndex);
+		if (usedBins[topBinIndex] == 0)
+			usedBinsTop &= ~(1u << topBinIndex);
+	}
+
+	// the rest of the node goes back to the bins
+	uint32_t remainder = nodeTotalSize - size;
+	if (0 < remainder)
+	{
+		uint32_t dataOffset = nodes[nodeIndex].dataOffset;
+		uint32_t newNodeIndex = insertNodeIntoBin(remainder, dataOffset + size);
+		// insertNodeIntoBin may grow the node array, so index again
+		Node& allocated = nodes[nodeIndex];
+		if (allocated.neighbourNext != OFFSET_ALLOCATOR_NO_SPACE)
+			nodes[allocated.neighbourNext].neighbourPrevious = newNodeIndex;
+		nodes[newNodeIndex].neighbourPrevious = nodeIndex;
+		nodes[newNodeIndex].neighbourNext = allocated.neighbourNext;
+		allocated.neighbourNext = newNodeIndex;
+	}
+
+	return OffsetAllocation{ nodes[nodeIndex].dataOffset, nodeIndex };
+}
+
+void OffsetAllocator::free(OffsetAllocation allocation)
+{
+	if (!allocation.isValid() || nodes.size() <= allocation.nodeIndex || !nodes[allocation.nodeIndex].used)
+		return;
+
+	Node& node = nodes[allocation.nodeIndex];
+	uint32_t offset = node.dataOffset;
+	uint32_t size = node.dataSize;
+
+	if (node.neighbourPrevious != OFFSET_ALLOCATOR_NO_SPACE && !nodes[node.neighbourPrevious].used)
+	{
+		Node& previous = nodes[node.neighbourPrevious];
+		offset = previous.dataOffset;
+		size += previous.dataSize;
+		uint32_t previousIndex = node.neighbourPrevious;
+		node.neighbourPrevious = previous.neighbourPrevious;
+		removeNodeFromBin(previousIndex);
+	}
+
+	if (node.neighbourNext != OFFSET_ALLOCATOR_NO_SPACE && !nodes[node.neighbourNext].used)
+	{
+		Node& next = nodes[node.neighbourNext];
+		size += next.dataSize;
+		uint32_t nextIndex = node.neighbourNext;
+		node.neighbourNext = next.neighbourNext;
+		removeNodeFromBin(nextIndex);
+	}
+
+	uint32_t neighbourNext = node.neighbourNext;
+	uint32_t neighbourPrevious = node.neighbourPrevious;
+
+	node.used = false;
+	freeNodes.push_back(allocation.nodeIndex);
+
+	uint32_t combinedNodeIndex = insertNodeIntoBin(size, offset);
+	if (neighbourNext != OFFSET_ALLOCATOR_NO_SPACE)
+	{
+		nodes[combinedNodeIndex].neighbourNext = neighbourNext;
+		nodes[neighbourNext].neighbourPrevious = combinedNodeIndex;
+	}
+	if (neighbourPrevious != OFFSET_ALLOCATOR_NO_SPACE)
+	{
+		nodes[combinedNodeIndex].neighbourPrevious = neighbourPrevious;
+		nodes[neighbourPrevious].neighbourNext = combinedNodeIndex;
+	}
+}
+
+uint32_t OffsetAllocator::getAllocationSize(OffsetAllocation allocation) const
+{
+	if (!allocation.isValid() || nodes.size() <= allocation.nodeIndex)
+		return 0;
+	return nodes[allocation.nodeIndex].dataSize;
+}
+
+uint32_t OffsetAllocator::getLargestFreeRegion() const
+{
+	if (usedBinsTop == 0)
+		return 0;
+	uint32_t topBinIndex = 31 - static_cast<uint32_t>(std::countl_zero(usedBinsTop));
+	uint32_t leafBinIndex = 31 - static_cast<uint32_t>(std::countl_zero(static_cast<uint32_t>(usedBins[topBinIndex])));
+	return binToSize(topBinIndex * OFFSET_ALLOCATOR_BINS_PER_LEAF + leafBinIndex);
+}
+
+uint32_t OffsetAllocator::sizeToBinRoundUp(uint32_t size)
+{
+	if (size < MANTISSA_VALUE)
+		return size;
+
+	uint32_t highestSetBit = 31 - static_cast<uint32_t>(std::countl_zero(size));
+	uint32_t mantissaStartBit = highestSetBit - MANTISSA_BITS;
+	uint32_t exponent = mantissaStartBit + 1;
+	uint32_t mantissa = (size >> mantissaStartBit) & MANTISSA_MASK;
+	if (size & ((1u << mantissaStartBit) - 1u))
+		mantissa++;
+	// a mantissa overflow carries into the exponent
+	return (exponent << MANTISSA_BITS) + mantissa;
+}
+
+uint32_t OffsetAllocator::sizeToBinRoundDown(uint32_t size)
+{
+	if (size < MANTISSA_VALUE)
+		return size;
+
+	uint32_t highestSetBit = 31 - static_cast<uint32_t>(std::countl_zero(size));
+	uint32_t mantissaStartBit = highestSetBit - MANTISSA_BITS;
+	uint32_t exponent = mantissaStartBit + 1;
+	uint32_t mantissa = (size >> mantissaStartBit) & MANTISSA_MASK;
+	return (exponent << MANTISSA_BITS) | mantissa;
+}
+
+uint32_t OffsetAllocator::binToSize(uint32_t bin)
+{
+	uint32_t exponent = bin >> MANTISSA_BITS;
+	uint32_t mantissa = bin & MANTISSA_MASK;
+	if (exponent == 0)
+		return mantissa;
+	return (mantissa | MANTISSA_VALUE) << (exponent - 1);
+}
+
+uint32_t OffsetAllocator::insertNodeIntoBin(uint32_t size, uint32_t offset)
+{
+	// Rounding down keeps the bin's promise that every node in it is at least the bin size.
+	uint32_t binIndex = sizeToBinRoundDown(size);
+	uint32_t topBinIndex = binIndex / OFFSET_ALLOCATOR_BINS_PER_LEAF;
+	uint32_t leafBinIndex = binIndex % OFFSET_ALLOCATOR_BINS_PER_LEAF;
+
+	if (binIndices[binIndex] == OFFSET_ALLOCATOR_NO_SPACE)
+	{
+		usedBins[topBinIndex] |= static_cast<uint8_t>(1u << leafBinIndex);
+		usedBinsTop |= 1u << topBinIndex;
+	}
+
+	uint32_t topNodeIndex = binIndices[binIndex];
+	uint32_t nodeIndex = takeNode();
+	Node& node = nodes[nodeIndex];
+	node = Node{};
+	node.dataOffset = offset;
+	node.dataSize = size;
+	node.binListNext = topNodeIndex;
+	if (topNodeIndex != OFFSET_ALLOCATOR_NO_SPACE)
+		nodes[topNodeIndex].binListPrevious = nodeIndex;
+	binIndices[binIndex] = nodeIndex;
+
+	freeStorage += size;
+	return nodeIndex;
+}
+
+void OffsetAllocator::removeNodeFromBin(uint32_t nodeIndex)
+{
+	Node& node = nodes[nodeIndex];
+
+	if (node.binListPrevious != OFFSET_ALLOCATOR_NO_SPACE)
+	{
+		nodes[node.binListPrevious].binListNext = node.binListNext;
+		if (node.binListNext != OFFSET_ALLOCATOR_NO_SPACE)
+			nodes[node.binListNext].binListPrevious = node.binListPrevious;
+	}
+	else
+	{
+		// the node is the head of its bin
+		uint32_t binIndex = sizeToBinRoundDown(node.dataSize);
+		uint32_t topBinIndex = binIndex / OFFSET_ALLOCATOR_BINS_PER_LEAF;
+		uint32_t leafBinIndex = binIndex % OFFSET_ALLOCATOR_BINS_PER_LEAF;
+
+		binIndices[binIndex] = node.binListNext;
+		if (node.binListNext != OFFSET_ALLOCATOR_NO_SPACE)
+			nodes[node.binListNext].binListPrevious = OFFSET_ALLOCATOR_NO_SPACE;
+
+		if (binIndices[binIndex] == OFFSET_ALLOCATOR_NO_SPACE)
+		{
+			usedBins[topBinIndex] &= ~(1u << leafBinIndex);
+			if (usedBins[topBinIndex] == 0)
+				usedBinsTop &= ~(1u << topBinIndex);
+		}
+	}
+
+	freeNodes.push_back(nodeIndex);
+	freeStorage -= node.dataSize;
+}
+
+uint32_t OffsetAllocator::takeNode()
+{
+	if (freeNodes.empty())
+	{
+		nodes.emplace_back();
+		return static_cast<uint32_t>(nodes.size() - 1);
+	}
+	uint32_t nodeIndex = freeNodes.back();
+	freeNodes.pop_back();
+	return nodeIndex;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+/*
+* Two level segregated fit allocator for ranges of a larger resource.
+* It only hands out offsets, so the same allocator works for vertices, indices or bytes.
+* Free ranges are binned by a small float of their size, which makes both allocate and free O(1).
+*/
+
+constexpr uint32_t OFFSET_ALLOCATOR_TOP_BINS = 32;
+constexpr uint32_t OFFSET_ALLOCATOR_BINS_PER_LEAF = 8;
+constexpr uint32_t OFFSET_ALLOCATOR_LEAF_BINS = OFFSET_ALLOCATOR_TOP_BINS * OFFSET_ALLOCATOR_BINS_PER_LEAF;
+constexpr uint32_t OFFSET_ALLOCATOR_NO_SPACE = 0xffffffff;
+
+/**
+ * @brief A range handed out by the OffsetAllocator. Keep it around to free the range.
+ */
+struct OffsetAllocation
+{
+	uint32_t offset = OFFSET_ALLOCATOR_NO_SPACE; ///< first unit of the range
+	uint32_t nodeIndex = OFFSET_ALLOCATOR_NO_SPACE; ///< internal node of the range
+
+	bool isValid() const { return offset != OFFSET_ALLOCATOR_NO_SPACE; }
+};
+
+class OffsetAllocator
+{
+
+public:
+	OffsetAllocator();
+
+	/**
+	 * @brief Creates an allocator for the range [0, size).
+	 */
+	explicit OffsetAllocator(uint32_t size);
+
+	/**
+	 * @brief Forgets every allocation and starts over with the given size.
+	 */
+	void reset(uint32_t size);
+
+	/**
+	 * @brief Allocates a range of the given size.
+	 * @return the allocation, which is not valid if no free range was large enough.
+	 */
+	OffsetAllocation allocate(uint32_t size);
+
+	/**
+	 * @brief Returns the range to the allocator and merges it with free neighbours.
+	 */
+	void free(OffsetAllocation allocation);
+
+	/**
+	 * @brief Returns the size of an allocation.
+	 */
+	uint32_t getAllocationSize(OffsetAllocation allocation) const;
+
+	uint32_t getSize() const { return size; }
+	uint32_t getFreeStorage() const { return freeStorage; }
+
+	/**
+	 * @brief Returns a lower bound of the largest range that is guaranteed to be allocatable.
+	 */
+	uint32_t getLargestFreeRegion() const;
+
+	/**
+	 * @brief Converts a size to a bin, rounding up or down. Exposed for testing.
+	 */
+	static uint32_t sizeToBinRoundUp(uint32_t size);
+	static uint32_t sizeToBinRoundDown(uint32_t size);
+	static uint32_t binToSize(uint32_t bin);
+
+private:
+	struct Node
+	{
+		uint32_t dataOffset = 0;
+		uint32_t dataSize = 0;
+		uint32_t binListPrevious = OFFSET_ALLOCATOR_NO_SPACE;
+		uint32_t binListNext = OFFSET_ALLOCATOR_NO_SPACE;
+		uint32_t neighbourPrevious = OFFSET_ALLOCATOR_NO_SPACE; ///< node right before in memory
+		uint32_t neighbourNext = OFFSET_ALLOCATOR_NO_SPACE;     ///< node right after in memory
+		bool used = false;
+	};
+
+	uint32_t insertNodeIntoBin(uint32_t size, uint32_t offset);
+	void removeNodeFromBin(uint32_t nodeIndex);
+	uint32_t takeNode();
+
+	uint32_t size;
+	uint32_t freeStorage;
+	uint32_t usedBinsTop;                                  ///< bit per top bin with any free node
+	uint8_t usedBins[OFFSET_ALLOCATOR_TOP_BINS];            ///< bit per leaf bin with any free node
+	uint32_t binIndices[OFFSET_ALLOCATOR_LEAF_BINS];        ///< first free node of each bin
+	std::vector<Node> nodes;
+	std::vector<uint32_t> freeNodes;                       ///< unused entries of nodes
+};
@@ -0,0 +1,243 @@
+#include "PipelineCache.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+
+#define VK_CHECK(x, msg) if (x != VK_SUCCESS) { throw std::runtime_error(msg); }
+
+namespace
+{
+	uint64_t hashBytes(const uint8_t* data, size_t size)
+	{
+		uint64_t hash = 0xcbf29ce484222325ull;
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= data[i];
+			hash *= 0x100000001b3ull;
+		}
+		return hash;
+	}
+
+	/**
+	 * @brief Checks the header the driver writes at the start of its own data.
+	 */
+	bool isDriverHeaderValid(const std::vector<uint8_t>& data, const VkPhysicalDeviceProperties& properties)
+	{
+		VkPipelineCacheHeaderVersionOne header;
+		if (data.size() < sizeof(header))
+			return false;
+		std::memcpy(&header, data.data(), sizeof(header));
+		return header.headerSize >= sizeof(header) && header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+			&& header.vendorID == properties.vendorID && header.deviceID == properties.deviceID
+			&& std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+	}
+} // namespace
+
+std::vector<uint8_t> packPipelineCacheFile(const VkPhysicalDeviceProperties& properties, const std::vector<uint8_t>& data)
+{
+	PipelineCacheFileHeader header{};
+	header.magic = PIPELINE_CACHE_FILE_MAGIC;
+	header.version = PIPELINE_CACHE_FILE_VERSION;
+	header.vendorID = properties.vendorID;
+	header.deviceID = properties.deviceID;
+	header.driverVersion = properties.driverVersion;
+	std::memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+	header.dataSize = data.size();
+	header.checksum = hashBytes(data.data(), data.size());
+
+	std::vector<uint8_t> file(sizeof(header) + data.size());
+	std::memcpy(file.data(), &header, sizeof(header));
+	if (!data.empty())
+		std::memcpy(file.data() + sizeof(header), data.data(), data.size());
+	return file;
+}
+
+bool unpackPipelineCacheFile(const std::vector<uint8_t>& file, const VkPhysicalDeviceProperties& properties, std::vector<uint8_t>& data)
+{
+	PipelineCacheFileHeader header;
+	if (file.size() < sizeof(header))
+		return false;
+	std::memcpy(&header, file.data(), sizeof(header));
+	if (header.magic != PIPELINE_CACHE_FILE_MAGIC || header.version != PIPELINE_CACHE_FILE_VERSION)
+		return false;
+	if (header.vendorID != properties.vendorID || header.deviceID != properties.deviceID || header.driverVersion != properties.driverVersion
+		|| std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+		return false;
+	if (header.dataSize != file.size() - sizeof(header))
+		return false;
+	const uint8_t* payload = file.data() + sizeof(header);
+	if (hashBytes(payload, header.dataSize) != header.checksum)
+		return false;
+
+	std::vector<uint8_t> candidate(payload, payload + header.dataSize);
+	if (!isDriverHeaderValid(candidate, properties))
+		return false;
+	data = std::move(candidate);
+	return true;
+}
+
+VkPipelineCache PipelineThreadCachePool::acquire(const std::function<VkPipelineCache()>& create)
+{
+	if (!idle.empty())
+	{
+		VkPipelineCache threadCache = idle.back();
+		idle.pop_back();
+		return threadCache;
+	}
+	VkPipelineCache threadCache = create();
+	all.push_back(threadCache);
+	return threadCache;
+}
+
+void PipelineThreadCachePool::release(VkPipelineCache threadCache)
+{
+	idle.push_back(threadCache);
+	if (std::find(unmerged.begin(), unmerged.end(), threadCache) == unmerged.end())
+		unmerged.push_back(threadCache);
+}
+
+std::vector<VkPipelineCache> PipelineThreadCachePool::takeUnmerged()
+{
+	std::vector<VkPipelineCache> taken;
+	taken.swap(unmerged);
+	return taken;
+}
+
+void PipelineThreadCachePool::clear()
+{
+	all.clear();
+	idle.clear();
+	unmerged.clear();
+}
+
+PipelineCache::PipelineCache()
+	: device(VK_NULL_HANDLE), properties{}, cache(VK_NULL_HANDLE), externallySynchronized(false), warm(false)
+{
+}
+
+PipelineCache::~PipelineCache()
+{
+	cleanup();
+}
+
+void PipelineCache::initialize(VkPhysicalDevice physicalDevice, VkDevice device, const std::string& path, bool externallySynchronized)
+{
+	this->device = device;
+	this->path = path;
+	this->externallySynchronized = externallySynchronized;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	std::vector<uint8_t> data;
+	std::ifstream file(path, std::ios::binary);
+	if (file)
+	{
+		std::vector<uint8_t> contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		warm = unpackPipelineCacheFile(contents, properties, data);
+		if (!warm)
+			std::cerr << "Discarding pipeline cache " << path << ", it is corrupt or from another device or driver" << std::endl;
+	}
+
+	VkPipelineCacheCreateInfo cacheInfo{};
+	cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cacheInfo.initialDataSize = data.size();
+	cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+	VK_CHECK(vkCreatePipelineCache(device, &cacheInfo, nullptr, &cache), "Failed to create the pipeline cache");
+}
+
+void PipelineCache::cleanup()
+{
+	if (device == VK_NULL_HANDLE)
+		return;
+	save();
+	for (VkPipelineCache threadCache : threadCaches.getAll())
+		vkDestroyPipelineCache(device, threadCache, nullptr);
+	threadCaches.clear();
+	vkDestroyPipelineCache(device, cache, nullptr);
+	cache = VK_NULL_HANDLE;
+	device = VK_NULL_HANDLE;
+}
+
+bool PipelineCache::save()
+{
+	mergeThreadCaches();
+
+	size_t size = 0;
+	if (vkGetPipelineCacheData(device, cache, &size, nullptr) != VK_SUCCESS)
+		return false;
+	std::vector<uint8_t> data(size);
+	if (vkGetPipelineCacheData(device, cache, &size, data.data()) != VK_SUCCESS)
+		return false;
+	data.resize(size);
+	std::vector<uint8_t> file = packPipelineCacheFile(properties, data);
+
+	std::string temporaryPath = path + ".tmp";
+	{
+		std::ofstream output(temporaryPath, std::ios::binary | std::ios::trunc);
+		output.write(reinterpret_cast<const char*>(file.data()), static_cast<std::streamsize>(file.size()));
+		output.flush();
+		if (!output)
+		{
+			std::cerr << "Failed to write the pipeline cache to " << temporaryPath << std::endl;
+			return false;
+		}
+	}
+	std::error_code error;
+	std::filesystem::rename(temporaryPath, path, error);
+	if (error)
+	{
+		std::cerr << "Failed to replace the pipeline cache " << path << ": " << error.message() << std::endl;
+		std::filesystem::remove(temporaryPath, error);
+		return false;
+	}
+	return true;
+}
+
+VkPipelineCache PipelineCache::createThreadCache()
+{
+	// seeded from the main cache, so warm starts hit on every thread
+	size_t size = 0;
+	std::vector<uint8_t> data;
+	if (vkGetPipelineCacheData(device, cache, &size, nullptr) == VK_SUCCESS)
+	{
+		data.resize(size);
+		if (vkGetPipelineCacheData(device, cache, &size, data.data()) != VK_SUCCESS)
+			size = 0;
+		data.resize(size);
+	}
+
+	VkPipelineCacheCreateInfo cacheInfo{};
+	cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	// the flag is only valid with pipelineCreationCacheControl
+	cacheInfo.flags = externallySynchronized ? VK_PIPELINE_CACHE_CREATE_EXTERNALLY_SYNCHRONIZED_BIT : 0;
+	cacheInfo.initialDataSize = data.size();
+	cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+	VkPipelineCache threadCache;
+	VK_CHECK(vkCreatePipelineCache(device, &cacheInfo, nullptr, &threadCache), "Failed to create a thread pipeline cache");
+	return threadCache;
+}
+
+VkPipelineCache PipelineCache::acquireThreadCache()
+{
+	std::lock_guard<std::mutex> lock(threadCacheMutex);
+	return threadCaches.acquire([this]() { return createThreadCache(); });
+}
+
+void PipelineCache::releaseThreadCache(VkPipelineCache threadCache)
+{
+	std::lock_guard<std::mutex> lock(threadCacheMutex);
+	threadCaches.release(threadCache);
+}
+
+void PipelineCache::mergeThreadCaches()
+{
+	// caches in use are not taken, they are merged after their job releases them
+	std::lock_guard<std::mutex> lock(threadCacheMutex);
+	std::vector<VkPipelineCache> unmerged = threadCaches.takeUnmerged();
+	if (!unmerged.empty() && vkMergePipelineCaches(device, cache, static_cast<uint32_t>(unmerged.size()), unmerged.data()) != VK_SUCCESS)
+		std::cerr << "Failed to merge the thread pipeline caches" << std::endl;
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+* The pipeline cache is stored between runs in a file with a small header in front of the driver's data.
+* The header ties the data to the vendor, device, driver version and pipeline cache UUID of the GPU and holds a checksum,
+* so a cache from another GPU or driver, or a truncated file, is discarded instead of handed to the driver.
+*/
+
+constexpr uint32_t PIPELINE_CACHE_FILE_MAGIC = 0x43505852; ///< "RXPC"
+constexpr uint32_t PIPELINE_CACHE_FILE_VERSION = 1;
+
+struct PipelineCacheFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vendorID;
+	uint32_t deviceID;
+	uint32_t driverVersion;
+	uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+	uint64_t dataSize;
+	uint64_t checksum; ///< FNV-1a of the data
+};
+
+/**
+ * @brief Wraps the driver's cache data in a file header for the device.
+ * @param properties of the device the data came from.
+ * @param data from vkGetPipelineCacheData.
+ * @return the contents of the cache file.
+ */
+std::vector<uint8_t> packPipelineCacheFile(const VkPhysicalDeviceProperties& properties, const std::vector<uint8_t>& data);
+
+/**
+ * @brief Checks a cache file against the device and extracts the driver's data.
+ * @param file contents.
+ * @param properties of the current device.
+ * @param data receives the driver's data if the file is valid.
+ * @return false if the file is corrupt, truncated or made by another device or driver.
+ */
+bool unpackPipelineCacheFile(const std::vector<uint8_t>& file, const VkPhysicalDeviceProperties& properties, std::vector<uint8_t>& data);
+
+/**
+ * @brief Hands each compile job a thread cache of its own and tracks which ones compiled since the last merge.
+ * Only does the bookkeeping, creating and merging the caches is up to the owner. Not thread safe.
+ */
+class PipelineThreadCachePool
+{
+public:
+	/**
+	 * @brief Returns an idle cache, or a new one from create if every cache is in use.
+	 */
+	VkPipelineCache acquire(const std::function<VkPipelineCache()>& create);
+
+	/**
+	 * @brief Returns a cache after compiling with it. It holds pipelines the main cache lacks until taken for a merge.
+	 */
+	void release(VkPipelineCache threadCache);
+
+	/**
+	 * @brief Returns the released caches that were used since the last call, to be merged into the main cache.
+	 */
+	std::vector<VkPipelineCache> takeUnmerged();
+
+	/**
+	 * @brief Returns every cache created, in use or not.
+	 */
+	const std::vector<VkPipelineCache>& getAll() const { return all; }
+
+	void clear();
+
+private:
+	std::vector<VkPipelineCache> all;
+	std::vector<VkPipelineCache> idle;
+	std::vector<VkPipelineCache> unmerged;
+};
+
+/**
+ * @brief VkPipelineCache that persists between runs.
+ */
+class PipelineCache
+{
+
+public:
+	PipelineCache();
+	~PipelineCache();
+
+	/**
+	 * @brief Creates the cache, seeded from the file if it is valid for the device.
+	 * @param physicalDevice whose properties the file is checked against.
+	 * @param device to create the cache on.
+	 * @param path of the cache file.
+	 * @param externallySynchronized whether pipelineCreationCacheControl is enabled, so thread caches may skip the driver's locking.
+	 */
+	void initialize(VkPhysicalDevice physicalDevice, VkDevice device, const std::string& path, bool externallySynchronized = false);
+
+	/**
+	 * @brief Saves the cache and destroys it. Pipelines must not be created anymore.
+	 */
+	void cleanup();
+
+	/**
+	 * @brief Merges the released thread caches into the main cache and writes it to a temporary file that then replaces
+	 * the cache file, so a crash while saving never leaves a partial file behind.
+	 * @return false if the file could not be written.
+	 */
+	bool save();
+
+	/**
+	 * @brief Returns the main cache. It may be used from several threads, which the driver synchronizes, but not while
+	 * thread caches are merged into it. Compilations that overlap merges use acquireThreadCache instead.
+	 */
+	VkPipelineCache get() const { return cache; }
+
+	/**
+	 * @brief Returns a cache for a single compile job, used by nobody else until released. It is externally synchronized
+	 * when the device allows it, which avoids the driver's locking. It is owned by the PipelineCache.
+	 */
+	VkPipelineCache acquireThreadCache();
+
+	/**
+	 * @brief Returns a cache from acquireThreadCache once the job is done compiling with it.
+	 */
+	void releaseThreadCache(VkPipelineCache threadCache);
+
+	/**
+	 * @brief Merges the thread caches released since the last merge into the main cache, e.g. when a batch of compilations finishes.
+	 */
+	void mergeThreadCaches();
+
+	/**
+	 * @brief Returns whether the cache was seeded from a valid file.
+	 */
+	bool isWarm() const { return warm; }
+
+private:
+	/**
+	 * @brief Creates a thread cache that starts with the contents of the main cache.
+	 */
+	VkPipelineCache createThreadCache();
+
+	VkDevice device;
+	VkPhysicalDeviceProperties properties;
+	std::string path;
+	VkPipelineCache cache;
+	PipelineThreadCachePool threadCaches;
+	std::mutex threadCacheMutex; ///< guards the thread caches and merges into the main cache
+	bool externallySynchronized;
+	bool warm;
+};
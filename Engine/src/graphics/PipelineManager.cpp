@@ -1,4 +1,10 @@
 #include "PipelineManager.hpp"
+#include "DescriptorBuilder.hpp"
+#include "JobSystem.hpp"
+#include "PipelineCache.hpp"
+
+#include <chrono>
+#include <iterator>
 
 std::vector<VkVertexInputAttributeDescription> PipelineShaderInfo::getVertexAttributes(uint32_t binding) const
 {
@@ -8,20 +14,21 @@ std::vector<VkVertexInputAttributeDescription> PipelineShaderInfo::getVertexAttr
 		return {};
 	}
 
+	// the inputs are indexed by location, the vertex holds the attributes in enum order
+	VertexAttributeFlags attributes = getAttributes();
+	const std::vector<ShaderInterfaceVariable>& inputs = vertexShaderData.value().inputAttributes;
 	std::vector<VkVertexInputAttributeDescription> result;
-	uint32_t offset = 0;
-	uint32_t location = 0;
-	for (const auto& [attribute, format] : vertexShaderData.value().inputAttributes)
+	for (uint32_t location = 0; location < inputs.size(); location++)
 	{
+		const auto& [attribute, format] = inputs[location];
+		if (attribute == VertexAttributeEnum::UNDEFINED)
+			continue;
 		VkVertexInputAttributeDescription desc{};
 		desc.binding = binding;
 		desc.location = location;
 		desc.format = format;
-		desc.offset = offset;
-		VertexAttributeInfo info = getAttributeInfo(attribute);
-		offset += info.size;
+		desc.offset = getAttributeOffset(attribute, attributes);
 		result.push_back(desc);
-		location++;
 	}
 	return result;
 }
@@ -104,6 +111,31 @@ std::vector<VkPushConstantRange> PipelineShaderInfo::getPushConstantRanges() con
 	return ranges;
 }
 
+std::vector<std::string> PipelineShaderInfo::getSourcePaths() const
+{
+	std::vector<std::string> paths;
+	for (const std::optional<CompiledShaderData>* stage : { &vertexShaderData, &tessControlShaderData, &tessEvalShaderData, &geometryShaderData, &fragmentShaderData })
+	{
+		if (stage->has_value() && !(*stage)->sourcePath.empty())
+			paths.push_back((*stage)->sourcePath);
+	}
+	return paths;
+}
+
+bool PipelineShaderInfo::replaceShader(const CompiledShaderData& shader)
+{
+	bool replaced = false;
+	for (std::optional<CompiledShaderData>* stage : { &vertexShaderData, &tessControlShaderData, &tessEvalShaderData, &geometryShaderData, &fragmentShaderData })
+	{
+		if (stage->has_value() && (*stage)->sourcePath == shader.sourcePath)
+		{
+			*stage = shader;
+			replaced = true;
+		}
+	}
+	return replaced;
+}
+
 std::vector<VkPipelineShaderStageCreateInfo> PipelineShaderInfo::getShaderStageInfos() const
 {
 	std::vector<VkPipelineShaderStageCreateInfo> stages;
@@ -138,13 +170,7 @@ uint32_t PipelineShaderInfo::getStride() const
 		std::cerr << "Error: No vertex shader currently set!" << std::endl;
 		return {};
 	}
-	uint32_t stride = 0;
-	for (const auto& [attribute, format] : vertexShaderData.value().inputAttributes)
-	{
-		VertexAttributeInfo info = getAttributeInfo(attribute);
-		stride += info.size;
-	}
-	return stride;
+	return getVertexStride(getAttributes());
 }
 
 VertexAttributeFlags PipelineShaderInfo::getAttributes() const
@@ -157,25 +183,249 @@ VertexAttributeFlags PipelineShaderInfo::getAttributes() const
 	uint16_t flags = 0;
 	for (const auto& [attribute, format] : vertexShaderData.value().inputAttributes)
 	{
-		flags |= static_cast<uint16_t>(1 << attribute);
+		if (attribute != VertexAttributeEnum::UNDEFINED)
+			flags |= static_cast<uint16_t>(1 << attribute);
 	}
 	return static_cast<VertexAttributeFlags>(flags);
 }
 
-PipelineManager::PipelineManager(VkDevice& logDevice, VkExtent2D& currentExtent)
-	: logDevice(logDevice), swapChainExtent(currentExtent)
+void setDefaultDynamicState(VkCommandBuffer commandBuffer, VkExtent2D extent)
+{
+	VkViewport viewPort{};
+	viewPort.x = 0.f;
+	viewPort.y = 0.f;
+	viewPort.width = static_cast<float>(extent.width);
+	viewPort.height = static_cast<float>(extent.height);
+	viewPort.minDepth = 0.f;
+	viewPort.maxDepth = 1.f;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewPort);
+
+	VkRect2D scissor{};
+	scissor.offset = { 0, 0 };
+	scissor.extent = extent;
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+	vkCmdSetCullMode(commandBuffer, VK_CULL_MODE_BACK_BIT);
+	vkCmdSetFrontFace(commandBuffer, VK_FRONT_FACE_CLOCKWISE); // This is because y is flipped in perspective matrix
+	vkCmdSetDepthTestEnable(commandBuffer, VK_TRUE);
+	vkCmdSetDepthWriteEnable(commandBuffer, VK_TRUE);
+	vkCmdSetDepthCompareOp(commandBuffer, VK_COMPARE_OP_LESS);
+}
+
+PipelineManager::PipelineManager(VkDevice& logDevice, PipelineCache* pipelineCache)
+	: logDevice(logDevice), pipelineCache(pipelineCache), pLayoutCache(std::make_unique<DescriptorSetLayoutCache>(logDevice))
 {
+	for (uint32_t slot = 0; slot < PIPELINE_SLOT_COUNT; slot++)
+	{
+		pipelines[slot] = VK_NULL_HANDLE;
+		fallbacks[slot] = VK_NULL_HANDLE;
+		requestGenerations[slot] = 0;
+	}
 }
 
-void PipelineManager::createBasicPipeline(const VkRenderPass& renderPass, const CompiledShaderData& vShaderData, const CompiledShaderData& fShaderData)
+PipelineManager::~PipelineManager()
+{
+	waitIdle();
+}
+
+void PipelineManager::createBasicPipeline(const PipelineRenderTarget& target, const CompiledShaderData& vShaderData, const CompiledShaderData& fShaderData)
 {
 	PipelineShaderInfo shaderInfo{};
 	shaderInfo.vertexShaderData = vShaderData;
 	shaderInfo.fragmentShaderData = fShaderData;
-	createPipeline(renderPass, shaderInfo);
+	createPipeline(target, shaderInfo);
+}
+
+void PipelineManager::createPipeline(const PipelineRenderTarget& target, const PipelineShaderInfo& compiledShaders)
+{
+	VkPipeline newPipeline = compileWithThreadCache(target, compiledShaders);
+	if (newPipeline == VK_NULL_HANDLE)
+		return;
+	uint32_t slot = compiledShaders.getAttributes();
+	recordSource(slot, target, compiledShaders);
+	// supersede any compilation of the slot in flight
+	publish(slot, newPipeline, requestGenerations[slot].fetch_add(1) + 1);
+	std::lock_guard<std::mutex> lock(compileMutex);
+	mergeThreadCachesIfIdle();
+}
+
+void PipelineManager::requestPipeline(const PipelineRenderTarget& target, const PipelineShaderInfo& compiledShaders)
+{
+	uint32_t slot = compiledShaders.getAttributes();
+	recordSource(slot, target, compiledShaders);
+	uint32_t generation = requestGenerations[slot].fetch_add(1) + 1;
+	{
+		std::lock_guard<std::mutex> lock(compileMutex);
+		stats.queueDepth++;
+		stats.maxQueueDepth = std::max(stats.maxQueueDepth, stats.queueDepth);
+	}
+
+	JobSystem::getInstance().submit([this, target, compiledShaders, slot, generation]() {
+		auto start = std::chrono::steady_clock::now();
+		VkPipeline newPipeline = VK_NULL_HANDLE;
+		try
+		{
+			newPipeline = compileWithThreadCache(target, compiledShaders);
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "Background pipeline compilation failed: " << e.what() << std::endl;
+		}
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+		if (newPipeline != VK_NULL_HANDLE)
+			publish(slot, newPipeline, generation);
+
+		std::lock_guard<std::mutex> lock(compileMutex);
+		if (newPipeline == VK_NULL_HANDLE)
+			stats.failed++;
+		else
+			stats.compiled++;
+		stats.totalCompileMilliseconds += elapsed.count();
+		stats.maxCompileMilliseconds = std::max(stats.maxCompileMilliseconds, elapsed.count());
+		stats.queueDepth--;
+		if (stats.queueDepth == 0)
+		{
+			// the batch is done, later runs and new thread caches start from everything it compiled
+			mergeThreadCachesIfIdle();
+			idleCondition.notify_all();
+		}
+	});
+}
+
+void PipelineManager::setFallbackPipeline(VertexAttributeFlags attributes, VkPipeline fallback)
+{
+	fallbacks[attributes].store(fallback, std::memory_order_release);
+}
+
+VkPipeline PipelineManager::getPipeline(VertexAttributeFlags attributes) const
+{
+	VkPipeline pipeline = pipelines[attributes].load(std::memory_order_acquire);
+	return pipeline != VK_NULL_HANDLE ? pipeline : fallbacks[attributes].load(std::memory_order_acquire);
+}
+
+bool PipelineManager::isReady(VertexAttributeFlags attributes) const
+{
+	return pipelines[attributes].load(std::memory_order_acquire) != VK_NULL_HANDLE;
+}
+
+void PipelineManager::destroyRetiredPipelines()
+{
+	std::lock_guard<std::mutex> lock(compileMutex);
+	for (VkPipeline pipeline : retiredPipelines)
+		vkDestroyPipeline(logDevice, pipeline, nullptr);
+	retiredPipelines.clear();
 }
 
-void PipelineManager::createPipeline(const VkRenderPass& renderPass, const PipelineShaderInfo& compiledShaders)
+void PipelineManager::waitIdle()
+{
+	std::unique_lock<std::mutex> lock(compileMutex);
+	idleCondition.wait(lock, [this]() { return stats.queueDepth == 0; });
+}
+
+PipelineCompileStats PipelineManager::getCompileStats() const
+{
+	std::lock_guard<std::mutex> lock(compileMutex);
+	return stats;
+}
+
+size_t PipelineManager::rebuildPipelinesUsing(const CompiledShaderData& reloaded)
+{
+	std::vector<PipelineSource> rebuilds;
+	{
+		std::lock_guard<std::mutex> lock(compileMutex);
+		auto dependents = shaderDependents.find(reloaded.sourcePath);
+		if (dependents == shaderDependents.end())
+			return 0;
+		for (uint32_t slot : dependents->second)
+		{
+			PipelineSource source = sources.at(slot);
+			if (source.shaders.replaceShader(reloaded))
+				rebuilds.push_back(std::move(source));
+		}
+	}
+	// requested outside the lock, requestPipeline takes it to record the new sources
+	for (const PipelineSource& source : rebuilds)
+		requestPipeline(source.target, source.shaders);
+	return rebuilds.size();
+}
+
+std::vector<VertexAttributeFlags> PipelineManager::getDependentPipelines(const std::string& sourcePath) const
+{
+	std::lock_guard<std::mutex> lock(compileMutex);
+	std::vector<VertexAttributeFlags> slots;
+	auto dependents = shaderDependents.find(sourcePath);
+	if (dependents != shaderDependents.end())
+	{
+		for (uint32_t slot : dependents->second)
+			slots.push_back(static_cast<VertexAttributeFlags>(slot));
+	}
+	return slots;
+}
+
+void PipelineManager::recordSource(uint32_t slot, const PipelineRenderTarget& target, const PipelineShaderInfo& compiledShaders)
+{
+	std::lock_guard<std::mutex> lock(compileMutex);
+	auto previous = sources.find(slot);
+	if (previous != sources.end())
+	{
+		for (const std::string& path : previous->second.shaders.getSourcePaths())
+		{
+			std::vector<uint32_t>& slots = shaderDependents[path];
+			slots.erase(std::remove(slots.begin(), slots.end(), slot), slots.end());
+		}
+	}
+	for (const std::string& path : compiledShaders.getSourcePaths())
+	{
+		std::vector<uint32_t>& slots = shaderDependents[path];
+		if (std::find(slots.begin(), slots.end(), slot) == slots.end())
+			slots.push_back(slot);
+	}
+	sources[slot] = { target, compiledShaders };
+}
+
+void PipelineManager::publish(uint32_t slot, VkPipeline pipeline, uint32_t generation)
+{
+	// checked and swapped under the lock, so an outdated result never replaces a newer one
+	std::lock_guard<std::mutex> lock(compileMutex);
+	if (requestGenerations[slot].load() != generation)
+	{
+		// the newer request publishes its own
+		retiredPipelines.push_back(pipeline);
+		return;
+	}
+	VkPipeline replaced = pipelines[slot].exchange(pipeline, std::memory_order_acq_rel);
+	// frames in flight may still draw with it
+	if (replaced != VK_NULL_HANDLE)
+		retiredPipelines.push_back(replaced);
+}
+
+VkPipeline PipelineManager::compileWithThreadCache(const PipelineRenderTarget& target, const PipelineShaderInfo& compiledShaders) const
+{
+	if (pipelineCache == nullptr)
+		return compilePipeline(target, compiledShaders, VK_NULL_HANDLE);
+	VkPipelineCache threadCache = pipelineCache->acquireThreadCache();
+	VkPipeline newPipeline = VK_NULL_HANDLE;
+	try
+	{
+		newPipeline = compilePipeline(target, compiledShaders, threadCache);
+	}
+	catch (...)
+	{
+		pipelineCache->releaseThreadCache(threadCache);
+		throw;
+	}
+	pipelineCache->releaseThreadCache(threadCache);
+	return newPipeline;
+}
+
+void PipelineManager::mergeThreadCachesIfIdle()
+{
+	if (pipelineCache != nullptr && stats.queueDepth == 0)
+		pipelineCache->mergeThreadCaches();
+}
+
+VkPipeline PipelineManager::compilePipeline(const PipelineRenderTarget& target, const PipelineShaderInfo& compiledShaders, VkPipelineCache cache) const
 {
 	if (!compiledShaders.isComplete())
 	{
@@ -185,7 +435,7 @@ void PipelineManager::createPipeline(const VkRenderPass& renderPass, const Pipel
 		if (!compiledShaders.fragmentShaderData.has_value())
 			std::cerr << " Fragment shader missing\n";
 		std::cerr << std::endl;
-		return;
+		return VK_NULL_HANDLE;
 	}
 
 	VkVertexInputBindingDescription bindingDesc{};
@@ -207,24 +457,16 @@ void PipelineManager::createPipeline(const VkRenderPass& renderPass, const Pipel
 	inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 	inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
 
-	VkViewport viewPort{};
-	viewPort.x = 0.f;
-	viewPort.y = 0.f;
-	viewPort.width = swapChainExtent.width;
-	viewPort.height = swapChainExtent.height;
-	viewPort.minDepth = 0.f;
-	viewPort.maxDepth = 1.f;
-
-	VkRect2D scissor{};
-	scissor.offset = { 0, 0 };
-	scissor.extent = swapChainExtent;
-
+	// viewport and scissor are dynamic, only their count is part of the pipeline
 	VkPipelineViewportStateCreateInfo viewportInfo{};
 	viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 	viewportInfo.viewportCount = 1;
-	viewportInfo.pViewports = &viewPort;
 	viewportInfo.scissorCount = 1;
-	viewportInfo.pScissors = &scissor;
+
+	VkPipelineDynamicStateCreateInfo dynamicInfo{};
+	dynamicInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicInfo.dynamicStateCount = static_cast<uint32_t>(std::size(PIPELINE_DYNAMIC_STATES));
+	dynamicInfo.pDynamicStates = PIPELINE_DYNAMIC_STATES;
 
 	VkPipelineRasterizationStateCreateInfo rasterInfo{};
 	rasterInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -232,8 +474,8 @@ void PipelineManager::createPipeline(const VkRenderPass& renderPass, const Pipel
 	rasterInfo.rasterizerDiscardEnable = VK_FALSE;
 	rasterInfo.polygonMode = VK_POLYGON_MODE_FILL;
 	rasterInfo.lineWidth = 1.0f;
-	rasterInfo.cullMode = VK_CULL_MODE_BACK_BIT;
-	rasterInfo.frontFace = VK_FRONT_FACE_CLOCKWISE; // This is because y is flipped in perspective matrix
+	rasterInfo.cullMode = VK_CULL_MODE_BACK_BIT;           // dynamic, see setDefaultDynamicState
+	rasterInfo.frontFace = VK_FRONT_FACE_CLOCKWISE;        // dynamic
 	rasterInfo.depthBiasEnable = VK_FALSE;
 	rasterInfo.depthBiasConstantFactor = 0.f;
 	rasterInfo.depthBiasClamp = 0.f;
@@ -260,7 +502,8 @@ void PipelineManager::createPipeline(const VkRenderPass& renderPass, const Pipel
 	colorBlendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
 	colorBlendInfo.logicOpEnable = VK_FALSE;
 	colorBlendInfo.logicOp = VK_LOGIC_OP_COPY; // optional
-	colorBlendInfo.attachmentCount = 1;
+	// depth only passes of dynamic rendering have no color attachment to blend
+	colorBlendInfo.attachmentCount = target.renderPass == VK_NULL_HANDLE && target.colorFormat == VK_FORMAT_UNDEFINED ? 0 : 1;
 	colorBlendInfo.pAttachments = &colorBlendState;
 	// Constants optional
 
@@ -274,16 +517,14 @@ void PipelineManager::createPipeline(const VkRenderPass& renderPass, const Pipel
 	pipelinelayoutInfo.pushConstantRangeCount = pushConstants.size();
 	pipelinelayoutInfo.pPushConstantRanges = pushConstants.data();
 
-	// Create pipelinelayout for the given object
-	VkPipelineLayout newLayout;
-	if (vkCreatePipelineLayout(logDevice, &pipelinelayoutInfo, nullptr, &newLayout))
-		throw std::runtime_error("Pipeline layout creation failed");
+	// pipelines of equal interfaces share a layout, so their descriptor sets stay bound across them
+	VkPipelineLayout newLayout = pLayoutCache->createPipelineLayout(pipelinelayoutInfo);
 
 	VkPipelineDepthStencilStateCreateInfo depthStencilInfo{};
 	depthStencilInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-	depthStencilInfo.depthTestEnable = VK_TRUE;
-	depthStencilInfo.depthWriteEnable = VK_TRUE;
-	depthStencilInfo.depthCompareOp = VK_COMPARE_OP_LESS;
+	depthStencilInfo.depthTestEnable = VK_TRUE;            // dynamic
+	depthStencilInfo.depthWriteEnable = VK_TRUE;           // dynamic
+	depthStencilInfo.depthCompareOp = VK_COMPARE_OP_LESS;  // dynamic
 	depthStencilInfo.depthBoundsTestEnable = VK_FALSE;
 	depthStencilInfo.minDepthBounds = 0.f; // Optional
 	depthStencilInfo.maxDepthBounds = 1.f;
@@ -299,7 +540,7 @@ void PipelineManager::createPipeline(const VkRenderPass& renderPass, const Pipel
 	pipelineInfo.pStages = shaderStages.data();
 
 	pipelineInfo.pVertexInputState = &vertInputInfo;
-	pipelineInfo.pDynamicState = nullptr; // Optional
+	pipelineInfo.pDynamicState = &dynamicInfo;
 	pipelineInfo.pInputAssemblyState = &inputAssemblyInfo;
 	pipelineInfo.pViewportState = &viewportInfo;
 	pipelineInfo.pRasterizationState = &rasterInfo;
@@ -307,21 +548,25 @@ void PipelineManager::createPipeline(const VkRenderPass& renderPass, const Pipel
 	pipelineInfo.pColorBlendState = &colorBlendInfo;
 	pipelineInfo.pDepthStencilState = &depthStencilInfo;
 	pipelineInfo.layout = newLayout;
-	pipelineInfo.renderPass = renderPass;
+	pipelineInfo.renderPass = target.renderPass;
 	pipelineInfo.subpass = 0;
+
+	// without a render pass the attachment formats are given directly
+	VkPipelineRenderingCreateInfo renderingInfo{};
+	renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+	renderingInfo.colorAttachmentCount = target.colorFormat != VK_FORMAT_UNDEFINED ? 1 : 0;
+	renderingInfo.pColorAttachmentFormats = &target.colorFormat;
+	renderingInfo.depthAttachmentFormat = target.depthFormat;
+	renderingInfo.stencilAttachmentFormat = VK_FORMAT_UNDEFINED;
+	if (target.renderPass == VK_NULL_HANDLE)
+		pipelineInfo.pNext = &renderingInfo;
 	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 	pipelineInfo.basePipelineIndex = -1;
 
 	// Create the actual pipeline
 	VkPipeline newPipeline;
-	if (vkCreateGraphicsPipelines(logDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &newPipeline) != VK_SUCCESS)
+	if (vkCreateGraphicsPipelines(logDevice, cache, 1, &pipelineInfo, nullptr, &newPipeline) != VK_SUCCESS)
 		throw std::runtime_error("Pipeline layout creation failed");
 
-	// Add the pipeline to the map
-	this->pipelines[compiledShaders.getAttributes()] = newPipeline;
-}
-
-VkPipeline PipelineManager::getPipeline(VertexAttributeFlags attributes)
-{
-	return this->pipelines[attributes];
+	return newPipeline;
 }
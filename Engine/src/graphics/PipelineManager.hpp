@@ -4,7 +4,16 @@
 #include <stdexcept>
 #include <iostream>
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <memory>
 #include <optional>
+#include <unordered_map>
+
+class DescriptorSetLayoutCache;
+class PipelineCache;
 
 struct PipelineShaderInfo
 {
@@ -39,7 +48,7 @@ struct PipelineShaderInfo
 
 	/**
 	 * @brief Returns the stride of the vertex for vertex shader.
-	 * @returns the combined calculated size of the input variables of the vertex shader.
+	 * @returns the size of an interleaved vertex holding the attributes the vertex shader reads.
 	 */
 	uint32_t getStride() const;
 
@@ -49,33 +58,183 @@ struct PipelineShaderInfo
 	 */
 	VertexAttributeFlags getAttributes() const;
 
+	/**
+	 * @brief Returns the source paths of the stages, see CompiledShaderData::sourcePath.
+	 */
+	std::vector<std::string> getSourcePaths() const;
+
+	/**
+	 * @brief Replaces every stage loaded from the source path of the shader with the shader.
+	 * @return false if no stage was loaded from it.
+	 */
+	bool replaceShader(const CompiledShaderData& shader);
+
 }; // END OF PipelineShaderInfo
 
+/**
+ * @brief State set while recording instead of baked into the pipelines, so resizing the window never rebuilds them.
+ */
+constexpr VkDynamicState PIPELINE_DYNAMIC_STATES[] = {
+	VK_DYNAMIC_STATE_VIEWPORT,
+	VK_DYNAMIC_STATE_SCISSOR,
+	VK_DYNAMIC_STATE_CULL_MODE,
+	VK_DYNAMIC_STATE_FRONT_FACE,
+	VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE,
+	VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE,
+	VK_DYNAMIC_STATE_DEPTH_COMPARE_OP,
+};
+
+/**
+ * @brief Records every state of PIPELINE_DYNAMIC_STATES: a viewport and scissor covering the extent, back face culling and depth testing.
+ * Must be recorded before the first draw of a command buffer, e.g. as the setup of CommandRecorder::recordDrawList.
+ * @param commandBuffer to record into.
+ * @param extent of the render target.
+ */
+void setDefaultDynamicState(VkCommandBuffer commandBuffer, VkExtent2D extent);
+
+/**
+ * @brief Attachments a pipeline renders to. A render pass describes them itself, dynamic rendering needs their formats.
+ */
+struct PipelineRenderTarget
+{
+	VkRenderPass renderPass = VK_NULL_HANDLE;   ///< VK_NULL_HANDLE for dynamic rendering
+	VkFormat colorFormat = VK_FORMAT_UNDEFINED; ///< dynamic rendering only, VK_FORMAT_UNDEFINED for depth only passes such as shadows
+	VkFormat depthFormat = VK_FORMAT_UNDEFINED; ///< dynamic rendering only, VK_FORMAT_UNDEFINED without depth
+};
+
+constexpr uint32_t PIPELINE_SLOT_COUNT = 1u << VertexAttributeEnum::UNDEFINED; ///< one slot per combination of vertex attributes
+
+/**
+ * @brief Counters of the background pipeline compiler.
+ */
+struct PipelineCompileStats
+{
+	uint32_t queueDepth = 0;    ///< requests waiting or compiling
+	uint32_t maxQueueDepth = 0;
+	uint32_t compiled = 0;
+	uint32_t failed = 0;
+	double totalCompileMilliseconds = 0.0;
+	double maxCompileMilliseconds = 0.0;
+};
+
 /**
  * @brief Class for holding and managing pipelines
+ * Pipelines are kept in a fixed table indexed by vertex attributes. Entries are atomic, so the render thread reads them
+ * without locking while compile jobs publish new pipelines.
  */
 class PipelineManager
 {
 public:
 
-	PipelineManager(VkDevice& logDevice, VkExtent2D& currentExtent);
+	/**
+	 * @param logDevice to create the pipelines on.
+	 * @param pipelineCache to create the pipelines with. Every compilation uses a thread cache of its own, which are merged
+	 * into the main cache when the compile queue runs empty. Pipelines are compiled from scratch without one.
+	 */
+	PipelineManager(VkDevice& logDevice, PipelineCache* pipelineCache = nullptr);
+
+	/**
+	 * @brief Waits for the compile jobs in flight.
+	 */
+	~PipelineManager();
 
 	/**
 	 * @brief Creates a basic pipeline with the given vertex and fragment shaders.
-	 * @param renderPass to associate with the pipeline
+	 * @param target to render to, either a render pass or the attachment formats of dynamic rendering
 	 * @param vShaderData compiled vertex shader
 	 * @param fShaderData compiled fragment shader
 	 */
-	void createBasicPipeline(const VkRenderPass& renderPass, const CompiledShaderData& vShaderData, const CompiledShaderData& fShaderData);
+	void createBasicPipeline(const PipelineRenderTarget& target, const CompiledShaderData& vShaderData, const CompiledShaderData& fShaderData);
+
+
+	/**
+	 * @brief Compiles a pipeline on the calling thread, e.g. during loading.
+	 */
+	void createPipeline(const PipelineRenderTarget& target, const PipelineShaderInfo& compiledShaders);
+
+	/**
+	 * @brief Compiles a pipeline on the job system. getPipeline serves the fallback until it is ready.
+	 * A later request for the same vertex attributes wins over an earlier one that is still compiling.
+	 * @param target to render to. A render pass in it must outlive the compilation.
+	 * @param compiledShaders are copied.
+	 */
+	void requestPipeline(const PipelineRenderTarget& target, const PipelineShaderInfo& compiledShaders);
+
+	/**
+	 * @brief Sets the pipeline drawn with while the pipeline of the attributes compiles, e.g. a simple shader for the same vertex layout.
+	 */
+	void setFallbackPipeline(VertexAttributeFlags attributes, VkPipeline fallback);
+
+	/**
+	 * @brief Returns the pipeline of the attributes without blocking.
+	 * @return the compiled pipeline, the fallback if it is not ready yet or VK_NULL_HANDLE, in which case the draw should be skipped.
+	 */
+	VkPipeline getPipeline(VertexAttributeFlags attributes) const;
+
+	/**
+	 * @brief Returns whether the pipeline of the attributes has been compiled.
+	 */
+	bool isReady(VertexAttributeFlags attributes) const;
+
+	/**
+	 * @brief Destroys the pipelines replaced by newer compilations. Call when the GPU is done with the frames that used them.
+	 */
+	void destroyRetiredPipelines();
+
+	/**
+	 * @brief Blocks until every requested pipeline has been compiled.
+	 */
+	void waitIdle();
 
+	PipelineCompileStats getCompileStats() const;
 
-	void createPipeline(const VkRenderPass& renderPass, const PipelineShaderInfo& compiledShaders);
+	/**
+	 * @brief Requests the pipelines built with a stage from the source path of the shader again, with the shader swapped in.
+	 * The other pipelines are left alone. The current pipelines keep drawing until their replacements are published.
+	 * @param reloaded shader, e.g. from ShaderTools::getShader after reloading its file.
+	 * @return the number of pipelines requested.
+	 */
+	size_t rebuildPipelinesUsing(const CompiledShaderData& reloaded);
 
-	VkPipeline getPipeline(VertexAttributeFlags attributes);
+	/**
+	 * @brief Returns the slots, i.e. vertex attributes, of the pipelines last built with a stage from the source path.
+	 */
+	std::vector<VertexAttributeFlags> getDependentPipelines(const std::string& sourcePath) const;
 
 private:
-	// map of vertex attributes to pipelines
-	std::unordered_map<VertexAttributeFlags, VkPipeline> pipelines;
+	struct PipelineSource
+	{
+		PipelineRenderTarget target;
+		PipelineShaderInfo shaders;
+	};
+
+	VkPipeline compilePipeline(const PipelineRenderTarget& target, const PipelineShaderInfo& compiledShaders, VkPipelineCache cache) const;
+	/**
+	 * @brief Compiles with a thread cache of the pipeline cache, so compilations on other threads never wait on each other's cache.
+	 */
+	VkPipeline compileWithThreadCache(const PipelineRenderTarget& target, const PipelineShaderInfo& compiledShaders) const;
+	/**
+	 * @brief Merges the thread caches into the main cache once no compilation is queued. Call with compileMutex held.
+	 */
+	void mergeThreadCachesIfIdle();
+	/**
+	 * @brief Publishes the pipeline if generation is still the latest request of the slot, otherwise retires it.
+	 */
+	void publish(uint32_t slot, VkPipeline pipeline, uint32_t generation);
+	void recordSource(uint32_t slot, const PipelineRenderTarget& target, const PipelineShaderInfo& compiledShaders);
+
+	std::array<std::atomic<VkPipeline>, PIPELINE_SLOT_COUNT> pipelines;
+	std::array<std::atomic<VkPipeline>, PIPELINE_SLOT_COUNT> fallbacks;
+	std::array<std::atomic<uint32_t>, PIPELINE_SLOT_COUNT> requestGenerations; ///< latest request of each slot
+	std::vector<VkPipeline> retiredPipelines;
 	VkDevice logDevice;
-	VkExtent2D swapChainExtent;
+	PipelineCache* pipelineCache;
+	std::unique_ptr<DescriptorSetLayoutCache> pLayoutCache; ///< interns the pipeline layouts, shared by the compile jobs
+
+	std::unordered_map<uint32_t, PipelineSource> sources;                    ///< latest build of each slot
+	std::unordered_map<std::string, std::vector<uint32_t>> shaderDependents; ///< slots built with each shader source path
+
+	mutable std::mutex compileMutex; ///< guards the stats, the retired pipelines and the sources
+	std::condition_variable idleCondition;
+	PipelineCompileStats stats;
 };
\ No newline at end of file
@@ -0,0 +1,238 @@
+#include "ShaderCache.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <thread>
+
+namespace
+{
+	constexpr uint64_t FNV_OFFSET = 0xcbf29ce484222325ull;
+	std::atomic<uint64_t> tempFileCounter = 0;
+
+	uint64_t hashBytes(const void* data, size_t size, uint64_t hash = FNV_OFFSET)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= 0x100000001b3ull;
+		}
+		return hash;
+	}
+
+	uint64_t hashString(const std::string& text, uint64_t hash)
+	{
+		// the length keeps "ab" + "c" apart from "a" + "bc"
+		uint64_t length = text.size();
+		hash = hashBytes(&length, sizeof(length), hash);
+		return hashBytes(text.data(), text.size(), hash);
+	}
+
+	template <typename T>
+	void appendArray(std::vector<uint8_t>& file, const std::vector<T>& values)
+	{
+		size_t offset = file.size();
+		file.resize(offset + values.size() * sizeof(T));
+		if (!values.empty())
+			std::memcpy(file.data() + offset, values.data(), values.size() * sizeof(T));
+	}
+
+	template <typename T>
+	bool readArray(const std::vector<uint8_t>& file, size_t& offset, uint32_t count, std::vector<T>& values)
+	{
+		size_t size = static_cast<size_t>(count) * sizeof(T);
+		if (file.size() - offset < size)
+			return false;
+		values.resize(count);
+		if (count != 0)
+			std::memcpy(values.data(), file.data() + offset, size);
+		offset += size;
+		return true;
+	}
+} // namespace
+
+uint64_t makeShaderCacheKey(const std::string& preprocessedSource, uint32_t shaderKind, const ShaderCompileSettings& settings, uint64_t compilerVersion)
+{
+	uint64_t hash = hashString(preprocessedSource, FNV_OFFSET);
+	hash = hashBytes(&shaderKind, sizeof(shaderKind), hash);
+	for (const auto& [name, value] : settings.defines)
+	{
+		hash = hashString(name, hash);
+		hash = hashString(value, hash);
+	}
+	uint8_t flags = (settings.optimize ? 1 : 0) | (settings.generateDebugInfo ? 2 : 0);
+	hash = hashBytes(&flags, sizeof(flags), hash);
+	hash = hashBytes(&compilerVersion, sizeof(compilerVersion), hash);
+	return hash;
+}
+
+std::vector<uint8_t> packShaderCacheEntry(uint64_t key, const ShaderCacheEntry& entry)
+{
+	const ShaderReflection& reflection = entry.reflection;
+	ShaderCacheFileHeader header{};
+	header.magic = SHADER_CACHE_FILE_MAGIC;
+	header.version = SHADER_CACHE_FILE_VERSION;
+	header.key = key;
+	header.stage = static_cast<uint32_t>(reflection.stage);
+	header.codeWords = static_cast<uint32_t>(entry.code.size());
+	header.bindingCount = static_cast<uint32_t>(reflection.bindings.size());
+	header.pushConstantCount = static_cast<uint32_t>(reflection.pushConstantRanges.size());
+	header.inputCount = static_cast<uint32_t>(reflection.inputs.size());
+	header.outputCount = static_cast<uint32_t>(reflection.outputs.size());
+
+	std::vector<uint8_t> file(sizeof(header));
+	appendArray(file, entry.code);
+	appendArray(file, reflection.bindings);
+	appendArray(file, reflection.pushConstantRanges);
+	appendArray(file, reflection.inputs);
+	appendArray(file, reflection.outputs);
+	header.checksum = hashBytes(file.data() + sizeof(header), file.size() - sizeof(header));
+	std::memcpy(file.data(), &header, sizeof(header));
+	return file;
+}
+
+bool unpackShaderCacheEntry(const std::vector<uint8_t>& file, uint64_t key, ShaderCacheEntry& entry)
+{
+	ShaderCacheFileHeader header;
+	if (file.size() < sizeof(header))
+		return false;
+	std::memcpy(&header, file.data(), sizeof(header));
+	if (header.magic != SHADER_CACHE_FILE_MAGIC || header.version != SHADER_CACHE_FILE_VERSION || header.key != key)
+		return false;
+	if (hashBytes(file.data() + sizeof(header), file.size() - sizeof(header)) != header.checksum)
+		return false;
+
+	ShaderCacheEntry candidate;
+	candidate.reflection.stage = static_cast<VkShaderStageFlagBits>(header.stage);
+	size_t offset = sizeof(header);
+	bool complete = readArray(file, offset, header.codeWords, candidate.code)
+		&& readArray(file, offset, header.bindingCount, candidate.reflection.bindings)
+		&& readArray(file, offset, header.pushConstantCount, candidate.reflection.pushConstantRanges)
+		&& readArray(file, offset, header.inputCount, candidate.reflection.inputs)
+		&& readArray(file, offset, header.outputCount, candidate.reflection.outputs);
+	if (!complete || offset != file.size() || candidate.code.empty())
+		return false;
+	entry = std::move(candidate);
+	return true;
+}
+
+ShaderCache::ShaderCache()
+{
+}
+
+ShaderCache::~ShaderCache()
+{
+}
+
+void ShaderCache::initialize(const std::string& directory)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	this->directory = directory;
+	if (directory.empty())
+		return;
+	std::error_code error;
+	std::filesystem::create_directories(directory, error);
+	if (error)
+	{
+		std::cerr << "Could not create the shader cache directory " << directory << ": " << error.message() << std::endl;
+		this->directory.clear();
+	}
+}
+
+bool ShaderCache::find(uint64_t key, ShaderCacheEntry& entry)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto found = entries.find(key);
+		if (found != entries.end())
+		{
+			entry = found->second;
+			stats.memoryHits++;
+			return true;
+		}
+		if (directory.empty())
+		{
+			stats.misses++;
+			return false;
+		}
+	}
+
+	// read outside the lock, other threads keep hitting memory meanwhile
+	std::ifstream file(getFilePath(key), std::ios::binary);
+	bool valid = false;
+	if (file)
+	{
+		std::vector<uint8_t> contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		valid = unpackShaderCacheEntry(contents, key, entry);
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!valid)
+	{
+		stats.misses++;
+		return false;
+	}
+	stats.diskHits++;
+	entries[key] = entry;
+	return true;
+}
+
+void ShaderCache::store(uint64_t key, const ShaderCacheEntry& entry)
+{
+	std::string path;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		entries[key] = entry;
+		if (directory.empty())
+			return;
+		path = getFilePath(key);
+	}
+
+	std::vector<uint8_t> contents = packShaderCacheEntry(key, entry);
+	// stores of the same key may race, e.g. a hot reload and a pipeline job, so each writes its own file before the rename
+	std::string tempPath = path + "." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()))
+		+ "." + std::to_string(tempFileCounter.fetch_add(1)) + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(contents.data()), contents.size());
+		if (!file)
+		{
+			std::cerr << "Failed to write shader cache file " << tempPath << std::endl;
+			file.close();
+			std::error_code ignored;
+			std::filesystem::remove(tempPath, ignored);
+			return;
+		}
+	}
+	std::error_code error;
+	std::filesystem::rename(tempPath, path, error);
+	if (error)
+	{
+		std::cerr << "Failed to replace shader cache file " << path << ": " << error.message() << std::endl;
+		std::filesystem::remove(tempPath, error);
+	}
+}
+
+void ShaderCache::clear()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	entries.clear();
+}
+
+ShaderCacheStats ShaderCache::getStats() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
+
+std::string ShaderCache::getFilePath(uint64_t key) const
+{
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016llx.spvc", static_cast<unsigned long long>(key));
+	return (std::filesystem::path(directory) / name).string();
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*
+* Compiled shaders are cached by a key hashed from the preprocessed source, the shader kind, the compile settings and the
+* compiler version, so any change that could change the SPIR-V changes the key. An entry holds the SPIR-V together with the
+* reflected interface of the shader, which makes loading a cached shader a file read with neither compiling nor reflecting.
+* Entries live in memory and in one file per key, each with a header and a checksum so a stale or damaged file is recompiled.
+*/
+
+constexpr uint32_t SHADER_CACHE_FILE_MAGIC = 0x43535852; ///< "RXSC"
+constexpr uint32_t SHADER_CACHE_FILE_VERSION = 1;
+
+/**
+ * @brief Settings that change the compiled code, and therefore the cache key.
+ */
+struct ShaderCompileSettings
+{
+	std::vector<std::pair<std::string, std::string>> defines; ///< name and value of each macro
+	bool optimize = false;
+	bool generateDebugInfo = false;
+};
+
+struct ShaderBindingReflection
+{
+	uint32_t set;
+	uint32_t binding;
+	VkDescriptorType descriptorType;
+	uint32_t descriptorCount;
+};
+
+struct ShaderInterfaceReflection
+{
+	uint32_t location;
+	VkFormat format;
+};
+
+/**
+ * @brief Interface of a shader as plain data, so that it can be cached with the SPIR-V.
+ */
+struct ShaderReflection
+{
+	VkShaderStageFlagBits stage = VK_SHADER_STAGE_ALL;
+	std::vector<ShaderBindingReflection> bindings;
+	std::vector<VkPushConstantRange> pushConstantRanges;
+	std::vector<ShaderInterfaceReflection> inputs;  ///< built-in variables excluded
+	std::vector<ShaderInterfaceReflection> outputs; ///< built-in variables excluded
+};
+
+struct ShaderCacheEntry
+{
+	std::vector<uint32_t> code;
+	ShaderReflection reflection;
+};
+
+struct ShaderCacheFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;
+	uint32_t stage;
+	uint32_t codeWords;
+	uint32_t bindingCount;
+	uint32_t pushConstantCount;
+	uint32_t inputCount;
+	uint32_t outputCount;
+	uint64_t checksum; ///< FNV-1a of everything after the header
+};
+
+struct ShaderCacheStats
+{
+	uint64_t memoryHits = 0;
+	uint64_t diskHits = 0;
+	uint64_t misses = 0;
+};
+
+/**
+ * @brief Hashes the inputs of a compilation into a cache key.
+ * @param preprocessedSource with includes and macros resolved.
+ * @param shaderKind of the compiler, e.g. shaderc_vertex_shader.
+ * @param settings the shader is compiled with.
+ * @param compilerVersion identifies the compiler, so that an update invalidates the cache.
+ * @return the key.
+ */
+uint64_t makeShaderCacheKey(const std::string& preprocessedSource, uint32_t shaderKind, const ShaderCompileSettings& settings, uint64_t compilerVersion);
+
+/**
+ * @brief Serializes an entry into the contents of its cache file.
+ */
+std::vector<uint8_t> packShaderCacheEntry(uint64_t key, const ShaderCacheEntry& entry);
+
+/**
+ * @brief Reads an entry back from the contents of a cache file.
+ * @param file contents.
+ * @param key the file is expected to hold.
+ * @param entry receives the entry if the file is valid.
+ * @return false if the file is corrupt, truncated, of another format version or of another key.
+ */
+bool unpackShaderCacheEntry(const std::vector<uint8_t>& file, uint64_t key, ShaderCacheEntry& entry);
+
+/**
+ * @brief Compiled shaders in memory, backed by a directory of cache files. Thread safe.
+ */
+class ShaderCache
+{
+
+public:
+	ShaderCache();
+	~ShaderCache();
+
+	/**
+	 * @brief Sets the directory of the cache files, creating it if needed.
+	 * @param directory of the files. Empty keeps the cache in memory only.
+	 */
+	void initialize(const std::string& directory);
+
+	/**
+	 * @brief Looks the key up in memory, then on disk. An entry read from disk stays in memory.
+	 * @param key from makeShaderCacheKey.
+	 * @param entry receives the cached entry.
+	 * @return false on a miss.
+	 */
+	bool find(uint64_t key, ShaderCacheEntry& entry);
+
+	/**
+	 * @brief Stores an entry in memory and writes its file through a temporary file, so readers never see a partial file.
+	 */
+	void store(uint64_t key, const ShaderCacheEntry& entry);
+
+	/**
+	 * @brief Drops the entries held in memory. The files stay.
+	 */
+	void clear();
+
+	ShaderCacheStats getStats() const;
+
+private:
+	std::string getFilePath(uint64_t key) const;
+
+	std::string directory;
+	std::unordered_map<uint64_t, ShaderCacheEntry> entries;
+	ShaderCacheStats stats;
+	mutable std::mutex mutex;
+};
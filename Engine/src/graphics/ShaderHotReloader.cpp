@@ -0,0 +1,113 @@
+#include "ShaderHotReloader.hpp"
+#include "JobSystem.hpp"
+#include "PipelineManager.hpp"
+#include "ShaderTools.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+ShaderHotReloader::ShaderHotReloader(ShaderTools& shaderTools, PipelineManager& pipelineManager)
+	: shaderTools(shaderTools), pipelineManager(pipelineManager), jobsInFlight(0)
+{
+}
+
+ShaderHotReloader::~ShaderHotReloader()
+{
+	cleanup();
+}
+
+bool ShaderHotReloader::initialize(const std::string& shaderDirectory, const ShaderCompileSettings& settings)
+{
+	cleanup();
+	this->settings = settings;
+	return watcher.initialize(shaderDirectory);
+}
+
+void ShaderHotReloader::cleanup()
+{
+	watcher.cleanup();
+	waitForJobs();
+	std::lock_guard<std::mutex> lock(mutex);
+	finished.clear();
+	compiling.clear();
+	pendingPaths.clear();
+}
+
+size_t ShaderHotReloader::update()
+{
+	std::vector<std::string> changed = watcher.poll();
+	changed.insert(changed.end(), pendingPaths.begin(), pendingPaths.end());
+	pendingPaths.clear();
+	for (const std::string& path : changed)
+	{
+		// unrelated files and shaders never loaded have no pipelines to rebuild
+		if (shaderTools.getShader(path) == nullptr)
+			continue;
+		if (compiling.count(path) != 0)
+		{
+			// compile the newest contents once the job in flight is done
+			if (std::find(pendingPaths.begin(), pendingPaths.end(), path) == pendingPaths.end())
+				pendingPaths.push_back(path);
+			continue;
+		}
+		compiling.insert(path);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jobsInFlight++;
+		}
+		JobSystem::getInstance().submit([this, path]() {
+			CompiledReload reload{ path, false, {} };
+			reload.succeeded = shaderTools.compileFile(path, settings, reload.compiled);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			finished.push_back(std::move(reload));
+			jobsInFlight--;
+			if (jobsInFlight == 0)
+				idleCondition.notify_all();
+		});
+	}
+
+	std::vector<CompiledReload> reloads;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		reloads.swap(finished);
+	}
+
+	size_t rebuilt = 0;
+	uint32_t reloaded = 0;
+	uint32_t failed = 0;
+	for (CompiledReload& reload : reloads)
+	{
+		compiling.erase(reload.path);
+		if (!reload.succeeded || !shaderTools.addShader(reload.path, reload.compiled))
+		{
+			std::cerr << "Keeping the previous version of " << reload.path << std::endl;
+			failed++;
+			continue;
+		}
+		reloaded++;
+		rebuilt += pipelineManager.rebuildPipelinesUsing(*shaderTools.getShader(reload.path));
+	}
+
+	// the replaced modules are only read while creating pipelines
+	if (pipelineManager.getCompileStats().queueDepth == 0)
+		shaderTools.destroyRetiredModules();
+
+	std::lock_guard<std::mutex> lock(mutex);
+	stats.reloaded += reloaded;
+	stats.failed += failed;
+	stats.pipelinesRebuilt += static_cast<uint32_t>(rebuilt);
+	return rebuilt;
+}
+
+ShaderReloadStats ShaderHotReloader::getStats() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
+
+void ShaderHotReloader::waitForJobs()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	idleCondition.wait(lock, [this]() { return jobsInFlight == 0; });
+}
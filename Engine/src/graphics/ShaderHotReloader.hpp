@@ -0,0 +1,90 @@
+#pragma once
+
+#include "FileWatcher.hpp"
+#include "ShaderCache.hpp"
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+class ShaderTools;
+class PipelineManager;
+
+/**
+ * @brief Counters of the hot reloader.
+ */
+struct ShaderReloadStats
+{
+	uint32_t reloaded = 0;           ///< shaders swapped in
+	uint32_t failed = 0;             ///< edits that did not compile, the previous shader stays
+	uint32_t pipelinesRebuilt = 0;
+};
+
+/**
+ * @brief Reloads the shaders of a directory when their files change and rebuilds only the pipelines that use them.
+ * Changed files are compiled on the job system. Finished shaders are swapped in by update, which the render thread calls
+ * between frames, and their pipelines are requested again from the PipelineManager, so the old pipelines keep drawing
+ * until the new ones are compiled. A shader that fails to compile is reported and the previous version stays in use.
+ * Only files already loaded through ShaderTools, under the same directory string, are reloaded.
+ */
+class ShaderHotReloader
+{
+
+public:
+	ShaderHotReloader(ShaderTools& shaderTools, PipelineManager& pipelineManager);
+
+	/**
+	 * @brief Waits for the compile jobs in flight.
+	 */
+	~ShaderHotReloader();
+
+	ShaderHotReloader(const ShaderHotReloader&) = delete;
+	ShaderHotReloader& operator=(const ShaderHotReloader&) = delete;
+
+	/**
+	 * @brief Starts watching the directory.
+	 * @param shaderDirectory the shaders were loaded from, e.g. "resources/shaders".
+	 * @param settings to compile the changed shaders with.
+	 * @return false if the directory cannot be watched.
+	 */
+	bool initialize(const std::string& shaderDirectory, const ShaderCompileSettings& settings = {});
+
+	/**
+	 * @brief Stops watching and waits for the compile jobs in flight. Their results are dropped.
+	 */
+	void cleanup();
+
+	/**
+	 * @brief Starts compiling the changed shaders and swaps in the ones that finished. Call between frames.
+	 * @return the number of pipelines requested again.
+	 */
+	size_t update();
+
+	ShaderReloadStats getStats() const;
+
+private:
+	struct CompiledReload
+	{
+		std::string path;
+		bool succeeded;
+		ShaderCacheEntry compiled;
+	};
+
+	void waitForJobs();
+
+	ShaderTools& shaderTools;
+	PipelineManager& pipelineManager;
+	FileWatcher watcher;
+	ShaderCompileSettings settings;
+
+	std::unordered_set<std::string> compiling; ///< paths with a job in flight, render thread only
+	std::vector<std::string> pendingPaths;     ///< changed again while compiling, render thread only
+
+	mutable std::mutex mutex; ///< guards the finished reloads, the job count and the stats
+	std::condition_variable idleCondition;
+	std::vector<CompiledReload> finished;
+	uint32_t jobsInFlight;
+	ShaderReloadStats stats;
+};
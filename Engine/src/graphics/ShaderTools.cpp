@@ -3,16 +3,20 @@
 #include <Vertex.hpp>
 
 #include <DescriptorBuilder.hpp>
+#include "EmbeddedShaders.hpp"
 
 // 3rd party
 #include <spirv-reflect/spirv_reflect.h>
 
 // stl
+#include <cassert>
+#include <cstdint>
 #include <iostream>
 #include <filesystem>
 #include <fstream>
 #include <iterator>
 #include <string>
+#include <string_view>
 #include <set>
 #include <array>
 #include <utility>
@@ -23,6 +27,64 @@ int createShaderModules(const VkDevice& device, std::set<VertexAttributeEnum> at
 int createPipelineShaderInfo(const VkDevice& device, std::set<VertexAttributeEnum> attributes, VkPipelineShaderStageCreateInfo& vertShaderStageInfo, VkPipelineShaderStageCreateInfo& fragShaderStageInfo);
 
 
+const EmbeddedShader* findEmbeddedShader(std::string_view name, VertexAttributeFlags attributes)
+{
+	for (const EmbeddedShader& shader : ShaderEmbedder::shaders)
+	{
+		if (shader.name == name && shader.attributes == attributes)
+			return &shader;
+	}
+	return nullptr;
+}
+
+/**
+ * @brief Returns the compiler of the calling thread. Creating a compiler is expensive, so each thread keeps one.
+ */
+shaderc::Compiler& getThreadCompiler()
+{
+	thread_local shaderc::Compiler compiler;
+	return compiler;
+}
+
+// set by the build from the versions of the shaderc and glslang packages
+#ifndef SHADERC_VERSION
+#define SHADERC_VERSION "unknown"
+#endif
+
+/**
+ * @brief Identifies the compiler in shader cache keys, so that cached code is recompiled after a compiler update.
+ * The SPIR-V version alone stays the same across most updates, so the library versions are hashed in as well.
+ */
+uint64_t getCompilerVersion()
+{
+	unsigned int version = 0;
+	unsigned int revision = 0;
+	shaderc_get_spv_version(&version, &revision);
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (char c : std::string_view(SHADERC_VERSION))
+	{
+		hash ^= static_cast<uint8_t>(c);
+		hash *= 0x100000001b3ull;
+	}
+	return hash ^ ((static_cast<uint64_t>(version) << 32) | revision);
+}
+
+std::vector<ShaderInterfaceVariable> toShaderInterfaceVariables(const std::vector<ShaderInterfaceReflection>& variables, bool vertexInputs)
+{
+	// interface variables are indexed by their location
+	std::vector<ShaderInterfaceVariable> result;
+	for (const ShaderInterfaceReflection& variable : variables)
+	{
+		if (result.size() <= variable.location)
+			result.resize(variable.location + 1, { VertexAttributeEnum::UNDEFINED, VK_FORMAT_UNDEFINED });
+		VertexAttributeEnum attribute = vertexInputs ? getAttributeAtLocation(variable.location) : VertexAttributeEnum::UNDEFINED;
+		if (vertexInputs && attribute == VertexAttributeEnum::UNDEFINED)
+			std::cerr << "Error: vertex input location " << variable.location << " has no vertex attribute" << std::endl;
+		result[variable.location] = { attribute, variable.format };
+	}
+	return result;
+}
+
 /**
  * @brief Checks whether file is already compiled based on the extension.
  * @param filePath
@@ -82,6 +144,7 @@ int readSpvToShaderData(const std::filesystem::path& filePath, CompiledShaderDat
 	file.read(reinterpret_cast<char*>(code.data()), fileSize);
 
 	file.close();
+	shaderData.code = std::move(code);
 	return 0;
 }
 
@@ -95,7 +158,7 @@ std::string chooseSourceCode(std::set<VertexAttributeEnum> attributes, std::stri
 
 int createShaderModules(const VkDevice& device, std::set<VertexAttributeEnum> attributes, VkShaderModule* vertShaderModule, VkShaderModule* fragShaderModule)
 {
-	shaderc::Compiler compiler;
+	shaderc::Compiler& compiler = getThreadCompiler();
 	shaderc::CompileOptions options;
 
 	std::string vertexSource;
@@ -160,32 +223,32 @@ int createPipelineShaderInfo(const VkDevice& device, std::set<VertexAttributeEnu
 	return 1;
 }
 
-ShaderTools::ShaderTools(VkDevice device)
+ShaderTools::ShaderTools(VkDevice device, const std::string& cacheDirectory)
+	: device(device)
 {
 
 	this->pDescriptorBuilder = std::make_unique<DescriptorBuilder>(device);
+	shaderCache.initialize(cacheDirectory);
 }
 
 ShaderTools::~ShaderTools()
 {
+	clear();
 }
 
-void ShaderTools::reflectShaderCode(const uint32_t* pCode, const size_t codeSize, SpvReflectShaderModule& module, CompiledShaderData& shaderModule)
+bool ShaderTools::reflectShaderCode(const uint32_t* pCode, const size_t codeSize, ShaderReflection& reflection)
 {
+	SpvReflectShaderModule module{};
 	SpvReflectResult reflectionRes = spvReflectCreateShaderModule(codeSize, pCode, &module);
 	if (reflectionRes != SPV_REFLECT_RESULT_SUCCESS)
 	{
 		std::cerr << "Failed to reflect shader module!" << std::endl;
+		return false;
 	}
-	shaderModule.stageFlag = static_cast<VkShaderStageFlagBits>(module.shader_stage);
+	reflection.stage = static_cast<VkShaderStageFlagBits>(module.shader_stage);
 
 	uint32_t count = 0; // count for each reflectable variable.
 
-	// desc sets
-	spvReflectEnumerateDescriptorSets(&module, &count, nullptr);
-	std::vector<SpvReflectDescriptorSet*> sets(count);
-	spvReflectEnumerateDescriptorSets(&module, &count, sets.data());
-
 	// desc bindings
 	spvReflectEnumerateDescriptorBindings(&module, &count, nullptr);
 	std::vector<SpvReflectDescriptorBinding*> reflectedBindings(count);
@@ -207,128 +270,225 @@ void ShaderTools::reflectShaderCode(const uint32_t* pCode, const size_t codeSize
 	spvReflectEnumerateOutputVariables(&module, &count, outputVariables.data());
 
 	// convert to our own data structures
-	uint32_t setIndex = 0;
-	for (auto& set : sets)
+	for (auto& binding : reflectedBindings)
 	{
-		VkDescriptorSetLayoutCreateInfo createInfo{};
-		createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-		createInfo.bindingCount = set->binding_count;
-		createInfo.flags = 0;
-		std::vector<VkDescriptorSetLayoutBinding> goalBindings;
-		for (auto& binding : reflectedBindings)
-		{
-			if (binding->set == set->set)
-			{
-				VkDescriptorSetLayoutBinding layoutBinding{};
-				layoutBinding.binding = binding->binding;
-				layoutBinding.descriptorType = static_cast<VkDescriptorType>(binding->descriptor_type); // should be 1 to 1
-				layoutBinding.descriptorCount = binding->count;
-				// binding->name; // unused name param
-				goalBindings.push_back(layoutBinding);
-			}
-		}
-		if (goalBindings.size() != set->binding_count)
-		{
-			std::cerr << "Error: binding count mismatch in shader " << module.source_file << ":\n" <<
-				"expected " << set->binding_count << " got " << goalBindings.size() << std::endl;
-		}
-		createInfo.bindingCount = goalBindings.size();
-		createInfo.pBindings = goalBindings.data();
-		if (setIndex < MAX_DESCRIPTOR_SETS)
-		{
-			shaderModule.descriptorSetLayouts[setIndex] = this->pDescriptorBuilder->createDescriptorSetLayout(createInfo);
-			setIndex++;
-		}
-		else
-		{
-			std::cerr << "Error: too many descriptor sets in shader " << module.source_file << std::endl;
-		}
+		ShaderBindingReflection layoutBinding{};
+		layoutBinding.set = binding->set;
+		layoutBinding.binding = binding->binding;
+		layoutBinding.descriptorType = static_cast<VkDescriptorType>(binding->descriptor_type); // should be 1 to 1
+		layoutBinding.descriptorCount = binding->count;
+		reflection.bindings.push_back(layoutBinding);
 	}
-	// push constants
 	for (auto& pushConstant : pushConstants)
 	{
 		VkPushConstantRange range{};
 		range.offset = pushConstant->offset;
 		range.size = pushConstant->size;
 		range.stageFlags = static_cast<VkShaderStageFlags>(module.shader_stage);
-		shaderModule.pushConstantRanges.push_back(range);
+		reflection.pushConstantRanges.push_back(range);
 	}
-
-	// input variables
-	shaderModule.inputAttributes.reserve(inputVariables.size());
+	// built-ins such as gl_Position have no location
 	for (auto& input : inputVariables)
 	{
-		ShaderInterfaceVariable var{};
-		var.second = static_cast<VkFormat>(input->format);
-		shaderModule.inputAttributes[input->location] = var;
+		if ((input->decoration_flags & SPV_REFLECT_DECORATION_BUILT_IN) == 0)
+			reflection.inputs.push_back({ input->location, static_cast<VkFormat>(input->format) });
 	}
-
-	// output variables
-	shaderModule.outputAttributes.reserve(outputVariables.size());
 	for (auto& output : outputVariables)
 	{
-		ShaderInterfaceVariable var{};
-		var.second = static_cast<VkFormat>(output->format);
-		shaderModule.outputAttributes[output->location] = var;
+		if ((output->decoration_flags & SPV_REFLECT_DECORATION_BUILT_IN) == 0)
+			reflection.outputs.push_back({ output->location, static_cast<VkFormat>(output->format) });
 	}
 
 	// cleanup
 	spvReflectDestroyShaderModule(&module);
+	return true;
+}
+
+void ShaderTools::applyReflection(const ShaderReflection& reflection, CompiledShaderData& shaderModule)
+{
+	shaderModule.stageFlag = reflection.stage;
+
+	for (uint32_t set = 0; set < MAX_DESCRIPTOR_SETS; set++)
+	{
+		std::vector<VkDescriptorSetLayoutBinding> goalBindings;
+		for (const ShaderBindingReflection& binding : reflection.bindings)
+		{
+			if (binding.set == set)
+			{
+				VkDescriptorSetLayoutBinding layoutBinding{};
+				layoutBinding.binding = binding.binding;
+				layoutBinding.descriptorType = binding.descriptorType;
+				layoutBinding.descriptorCount = binding.descriptorCount;
+				layoutBinding.stageFlags = reflection.stage;
+				goalBindings.push_back(layoutBinding);
+			}
+		}
+		if (goalBindings.empty())
+			continue;
+		VkDescriptorSetLayoutCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		createInfo.flags = 0;
+		createInfo.bindingCount = static_cast<uint32_t>(goalBindings.size());
+		createInfo.pBindings = goalBindings.data();
+		shaderModule.descriptorSetLayouts[set] = this->pDescriptorBuilder->createDescriptorSetLayout(createInfo);
+	}
+	for (const ShaderBindingReflection& binding : reflection.bindings)
+	{
+		if (MAX_DESCRIPTOR_SETS <= binding.set)
+		{
+			std::cerr << "Error: too many descriptor sets in shader, set " << binding.set << " is ignored" << std::endl;
+			break;
+		}
+	}
 
+	shaderModule.pushConstantRanges = reflection.pushConstantRanges;
+
+	shaderModule.inputAttributes = toShaderInterfaceVariables(reflection.inputs, reflection.stage == VK_SHADER_STAGE_VERTEX_BIT);
+	shaderModule.outputAttributes = toShaderInterfaceVariables(reflection.outputs, false);
 }
 
-int ShaderTools::compileShader(const std::string& code, const std::string& shaderName, const ShaderType type, CompiledShaderData& shaderModule)
+int ShaderTools::compileShader(const std::string& code, const std::string& shaderName, const ShaderType type, const ShaderCompileSettings& settings, ShaderCacheEntry& compiled)
 {
-	shaderc::Compiler compiler;
+	shaderc::Compiler& compiler = getThreadCompiler();
 	shaderc::CompileOptions options;
-
-	shaderc::SpvCompilationResult result = compiler.CompileGlslToSpv(code, type.shaderKind, shaderName.c_str(), options);
-	if (result.GetCompilationStatus() != shaderc_compilation_status_success)
+	for (const auto& [name, value] : settings.defines)
+		options.AddMacroDefinition(name, value);
+	if (settings.optimize)
+		options.SetOptimizationLevel(shaderc_optimization_level_performance);
+	if (settings.generateDebugInfo)
+		options.SetGenerateDebugInfo();
+
+	// the key covers everything the code depends on, so includes and macros are resolved first
+	shaderc::PreprocessedSourceCompilationResult preprocessed = compiler.PreprocessGlsl(code, type.shaderKind, shaderName.c_str(), options);
+	if (preprocessed.GetCompilationStatus() != shaderc_compilation_status_success)
 	{
-		std::cerr << result.GetErrorMessage();
+		std::cerr << preprocessed.GetErrorMessage();
 		return 1;
 	}
+	std::string preprocessedSource(preprocessed.cbegin(), preprocessed.cend());
+	uint64_t key = makeShaderCacheKey(preprocessedSource, static_cast<uint32_t>(type.shaderKind), settings, getCompilerVersion());
+	if (shaderCache.find(key, compiled))
+		return 0;
 
-	VkShaderModuleCreateInfo info{};
-	info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	info.codeSize = result.cend() - result.cbegin();
-	shaderModule.code = std::vector(result.cbegin(), result.cend());
-	if (vkCreateShaderModule(device, &info, nullptr, &shaderModule.module) != VK_SUCCESS)
+	shaderc::SpvCompilationResult result = compiler.CompileGlslToSpv(preprocessedSource, type.shaderKind, shaderName.c_str(), options);
+	if (result.GetCompilationStatus() != shaderc_compilation_status_success)
 	{
-		std::cerr << "Failed to create a shader module!" << std::endl;
+		std::cerr << result.GetErrorMessage();
 		return 1;
 	}
+	compiled.code = std::vector<uint32_t>(result.cbegin(), result.cend());
+	if (!reflectShaderCode(compiled.code.data(), compiled.code.size() * sizeof(uint32_t), compiled.reflection))
+		return 1;
+	shaderCache.store(key, compiled);
 	return 0;
 }
 
-void ShaderTools::loadShader(const std::string& shaderPath)
+void ShaderTools::loadShader(const std::string& shaderPath, const ShaderCompileSettings& settings)
+{
+	ShaderCacheEntry compiled;
+	if (compileFile(shaderPath, settings, compiled))
+		addShader(shaderPath, compiled);
+}
+
+bool ShaderTools::compileFile(const std::string& shaderPath, const ShaderCompileSettings& settings, ShaderCacheEntry& compiled)
 {
 	std::filesystem::path path = shaderPath;
-	CompiledShaderData data{};
 	if (isCompiled(path))
 	{
-		if (readSpvToShaderData(path, data) != 0)
+		CompiledShaderData spirv{};
+		if (readSpvToShaderData(path, spirv) != 0)
 		{
 			std::cerr << "Failed to read compiled shader: " << path.string() << std::endl;
-			return;
+			return false;
 		};
-	}
-	else
-	{
-		std::ifstream ifs(path);
-		ShaderType type = getShaderTypeFromFileExtension(path);
-		std::string sourceCode(std::istreambuf_iterator<char>{ifs}, {});
-		if (compileShader(sourceCode, path.string(), type, data) != 0)
+		// precompiled code is keyed by the code itself, which saves reflecting it again
+		std::string codeBytes(reinterpret_cast<const char*>(spirv.code.data()), spirv.code.size() * sizeof(uint32_t));
+		uint64_t key = makeShaderCacheKey(codeBytes, UINT32_MAX, {}, 0);
+		if (!shaderCache.find(key, compiled))
 		{
-			std::cerr << "Failed to compile shader: " << path.string() << std::endl;
-			return;
+			compiled.code = std::move(spirv.code);
+			if (!reflectShaderCode(compiled.code.data(), compiled.code.size() * sizeof(uint32_t), compiled.reflection))
+				return false;
+			shaderCache.store(key, compiled);
 		}
+		return true;
+	}
+
+	std::ifstream ifs(path);
+	if (!ifs)
+	{
+		std::cerr << "Failed to open shader: " << path.string() << std::endl;
+		return false;
+	}
+	ShaderType type = getShaderTypeFromFileExtension(path);
+	std::string sourceCode(std::istreambuf_iterator<char>{ifs}, {});
+	if (compileShader(sourceCode, path.string(), type, settings, compiled) != 0)
+	{
+		std::cerr << "Failed to compile shader: " << path.string() << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool ShaderTools::loadEmbeddedShader(std::string_view name, VertexAttributeFlags attributes)
+{
+	const EmbeddedShader* shader = findEmbeddedShader(name, attributes);
+	if (shader == nullptr)
+	{
+		std::cerr << "Shader " << name << " with attributes " << attributes << " was not embedded" << std::endl;
+		return false;
+	}
+	ShaderCacheEntry compiled = shader->toCacheEntry();
+	std::string key(name);
+	if (attributes != 0)
+		key += ":" + std::to_string(attributes);
+	return addShader(key, compiled);
+}
+
+bool ShaderTools::addShader(const std::string& name, ShaderCacheEntry& compiled)
+{
+	CompiledShaderData data{};
+	data.code = std::move(compiled.code);
+	VkShaderModuleCreateInfo info{};
+	info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	info.codeSize = data.code.size() * sizeof(uint32_t);
+	info.pCode = data.code.data();
+	if (vkCreateShaderModule(device, &info, nullptr, &data.module) != VK_SUCCESS)
+	{
+		std::cerr << "Failed to create a shader module!" << std::endl;
+		return false;
 	}
+	applyReflection(compiled.reflection, data);
+	data.sourcePath = name;
+
+	// set shader module to the map, replacing an older version of the shader
+	auto previous = this->compiledShaders.find(name);
+	if (previous != this->compiledShaders.end())
+		retiredModules.push_back(previous->second.module);
+	this->compiledShaders[name] = std::move(data);
+	return true;
+}
 
-	SpvReflectShaderModule reflectModule{};
-	reflectShaderCode(data.code.data(), data.code.size(), reflectModule, data);
-	// set shader module to the map
-	this->compiledShaders[path.string()] = data;
+const CompiledShaderData* ShaderTools::getShader(const std::string& name) const
+{
+	auto found = compiledShaders.find(name);
+	return found != compiledShaders.end() ? &found->second : nullptr;
+}
+
+void ShaderTools::destroyRetiredModules()
+{
+	for (VkShaderModule module : retiredModules)
+		vkDestroyShaderModule(device, module, nullptr);
+	retiredModules.clear();
+}
+
+void ShaderTools::clear()
+{
+	for (auto& [path, shader] : compiledShaders)
+		vkDestroyShaderModule(device, shader.module, nullptr);
+	compiledShaders.clear();
+	destroyRetiredModules();
+	shaderCache.clear();
 }
 
 bool ShaderTools::validate(const CompiledShaderData& shaderModule)
@@ -1,9 +1,13 @@
 #pragma once
 
 #include <Vertex.hpp>
+#include "EmbeddedShader.hpp"
+#include "ShaderCache.hpp"
 #include <shaderc/shaderc.hpp>
 #include <unordered_map>
 #include <array>
+#include <memory>
+#include <string_view>
 
 // Forward declarations
 class DescriptorBuilder;
@@ -14,11 +18,17 @@ class DescriptorBuilder;
  */
 using ShaderInterfaceVariable = std::pair<VertexAttributeEnum, VkFormat>;
 
-// forward declarations
-class SpvReflectShaderModule;
+/**
+ * @brief Converts reflected interface variables into a vector indexed by location. Locations without a variable hold UNDEFINED.
+ * @param variables of the shader.
+ * @param vertexInputs names the attribute of each variable after VERTEX_INPUT_LOCATIONS. Other interfaces are not vertex attributes
+ * and get UNDEFINED.
+ */
+std::vector<ShaderInterfaceVariable> toShaderInterfaceVariables(const std::vector<ShaderInterfaceReflection>& variables, bool vertexInputs);
 
 // constants
 constexpr uint32_t MAX_DESCRIPTOR_SETS = 4;
+constexpr const char* DEFAULT_SHADER_CACHE_DIRECTORY = "shader_cache";
 
 struct ShaderType
 {
@@ -42,40 +52,100 @@ struct CompiledShaderData
 	std::vector<uint32_t> code;
 	VkShaderModule module;
 	VkShaderStageFlagBits stageFlag;
+	std::string sourcePath; ///< name the shader is stored under, the file path for shaders loaded from disk
 
 	VkPipelineShaderStageCreateInfo getShaderStageInfo() const;
 };
 
+/**
+ * @brief Loads shaders into modules with their reflected interface.
+ * GLSL is compiled through a ShaderCache, so a shader that has been compiled before with the same source, settings and
+ * compiler is read from the cache instead. Each thread compiles with its own reused compiler.
+ */
 class ShaderTools
 {
 
 public:
-	ShaderTools(VkDevice device);
+	/**
+	 * @param device to create the shader modules and descriptor set layouts on.
+	 * @param cacheDirectory of the compiled shaders. Empty keeps them in memory only.
+	 */
+	ShaderTools(VkDevice device, const std::string& cacheDirectory = DEFAULT_SHADER_CACHE_DIRECTORY);
 	~ShaderTools();
 
 	/**
-	 * @brief
+	 * @brief Loads a GLSL or SPIR-V shader, the latter recognized by the .spv extension.
 	 * @param shaderPath is the path to the shader file.
+	 * @param settings to compile GLSL with. Ignored for SPIR-V.
+	 */
+	void loadShader(const std::string& shaderPath, const ShaderCompileSettings& settings = {});
+
+	/**
+	 * @brief Loads a shader that was compiled and reflected at build time, without touching the compiler or the cache.
+	 * @param name of the shader file, e.g. "test.vert".
+	 * @param attributes of the permutation. Permutations are stored under the name followed by ":" and the attributes.
+	 * @return false if the shader was not embedded.
+	 */
+	bool loadEmbeddedShader(std::string_view name, VertexAttributeFlags attributes = static_cast<VertexAttributeFlags>(0));
+
+	/**
+	 * @brief Compiles or reads a shader file without creating its module. Safe to call from worker threads.
+	 * @param shaderPath is the path to the shader file.
+	 * @param settings to compile GLSL with. Ignored for SPIR-V.
+	 * @param compiled receives the code and reflection.
+	 * @return false if the file could not be read or compiled.
+	 */
+	bool compileFile(const std::string& shaderPath, const ShaderCompileSettings& settings, ShaderCacheEntry& compiled);
+
+	/**
+	 * @brief Creates the module of compiled code and stores it under the name. Call from the thread that owns the tools.
+	 * A shader stored under the same name is replaced. Its module is retired rather than destroyed, since pipelines
+	 * may still be created from it, until destroyRetiredModules.
+	 * @return false if the module could not be created.
+	 */
+	bool addShader(const std::string& name, ShaderCacheEntry& compiled);
+
+	/**
+	 * @return the shader stored under the name, or nullptr.
 	 */
-	void loadShader(const std::string& shaderPath);
+	const CompiledShaderData* getShader(const std::string& name) const;
+
+	/**
+	 * @brief Destroys the modules of replaced shaders. Call once no pipeline creation can still read them.
+	 */
+	void destroyRetiredModules();
 
 	/**
 	 * @brief clears all the compiled shaders.
 	 */
 	void clear();
 
+	ShaderCacheStats getCacheStats() const { return shaderCache.getStats(); }
+
 private:
 	/**
 	 * @brief Reflects the given spirv shader code
 	 * @param pCode
-	 * @param codeSize
-	 * @param module
-	 * @param shaderModule
+	 * @param codeSize in bytes
+	 * @param reflection receives the interface of the shader
+	 * @return false if the code could not be reflected
 	 */
-	void reflectShaderCode(const uint32_t* pCode, const size_t codeSize, SpvReflectShaderModule& module, CompiledShaderData& shaderModule);
-	int compileShader(const std::string& code, const std::string& shaderName, const ShaderType type, CompiledShaderData& shaderModule);
+	bool reflectShaderCode(const uint32_t* pCode, const size_t codeSize, ShaderReflection& reflection);
+
+	/**
+	 * @brief Creates the descriptor set layouts of the reflected interface and fills the rest of the shader data from it.
+	 */
+	void applyReflection(const ShaderReflection& reflection, CompiledShaderData& shaderModule);
+
+	/**
+	 * @brief Returns the code and reflection of GLSL source, from the cache or by compiling it.
+	 * @return 0 on success.
+	 */
+	int compileShader(const std::string& code, const std::string& shaderName, const ShaderType type, const ShaderCompileSettings& settings, ShaderCacheEntry& compiled);
 	bool validate(const CompiledShaderData& shaderModule);
 	VkDevice device;
 	std::unique_ptr<DescriptorBuilder> pDescriptorBuilder;
 	std::unordered_map<std::string, CompiledShaderData> compiledShaders;
-};
\ No newline at end of file
+	std::vector<VkShaderModule> retiredModules;
+	ShaderCache shaderCache;
+};
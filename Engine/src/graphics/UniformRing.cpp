@@ -0,0 +1,148 @@
+#include "UniformRing.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#define VK_CHECK(x, msg) if (x != VK_SUCCESS) { throw std::runtime_error(msg); }
+
+UniformRingAllocator::UniformRingAllocator(VkDeviceSize capacity, VkDeviceSize alignment)
+	: capacity(capacity), alignment(alignment), head(0)
+{
+}
+
+void UniformRingAllocator::reset(VkDeviceSize capacity, VkDeviceSize alignment)
+{
+	this->capacity = capacity;
+	this->alignment = alignment;
+	head.store(0, std::memory_order_relaxed);
+}
+
+uint32_t UniformRingAllocator::allocate(VkDeviceSize size)
+{
+	VkDeviceSize alignedSize = (size + alignment - 1) & ~(alignment - 1);
+	VkDeviceSize offset = head.fetch_add(alignedSize, std::memory_order_relaxed);
+	// dynamic offsets are 32 bit
+	if (capacity < offset + alignedSize || UINT32_MAX <= offset)
+		return INVALID_UNIFORM_OFFSET;
+	return static_cast<uint32_t>(offset);
+}
+
+VkDeviceSize UniformRingAllocator::getUsed() const
+{
+	return std::min(head.load(std::memory_order_relaxed), capacity);
+}
+
+FrameUniformRing::FrameUniformRing()
+	: device(VK_NULL_HANDLE), allocator(VK_NULL_HANDLE), layout(VK_NULL_HANDLE), pool(VK_NULL_HANDLE), bindingRange(0), frameCount(0), currentFrame(0)
+{
+}
+
+FrameUniformRing::~FrameUniformRing()
+{
+	cleanup();
+}
+
+void FrameUniformRing::initialize(VkPhysicalDevice physDevice, VkDevice device, VmaAllocator allocator, uint32_t frameCount,
+	VkDeviceSize bytesPerFrame, uint32_t bindingRange)
+{
+	this->device = device;
+	this->allocator = allocator;
+	this->frameCount = frameCount;
+	currentFrame = 0;
+
+	VkPhysicalDeviceProperties properties{};
+	vkGetPhysicalDeviceProperties(physDevice, &properties);
+	VkDeviceSize alignment = std::max<VkDeviceSize>(properties.limits.minUniformBufferOffsetAlignment, 1);
+	this->bindingRange = std::min(bindingRange, properties.limits.maxUniformBufferRange);
+
+	VkDescriptorSetLayoutBinding binding{};
+	binding.binding = 0;
+	binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	binding.descriptorCount = 1;
+	binding.stageFlags = VK_SHADER_STAGE_ALL;
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = 1;
+	layoutInfo.pBindings = &binding;
+	VK_CHECK(vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &layout), "Failed to create the uniform ring descriptor set layout");
+
+	VkDescriptorPoolSize poolSize{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, frameCount };
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = frameCount;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+	VK_CHECK(vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool), "Failed to create the uniform ring descriptor pool");
+
+	frames = std::make_unique<Frame[]>(frameCount);
+	for (uint32_t i = 0; i < frameCount; i++)
+	{
+		Frame& frame = frames[i];
+		// an allocation ending at bytesPerFrame is still read a whole binding range from its offset
+		frame.buffer = createMappedBuffer(this->allocator, bytesPerFrame + this->bindingRange, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		if (frame.buffer.buffer.buffer == VK_NULL_HANDLE || frame.buffer.data == nullptr)
+			throw std::runtime_error("Failed to create a uniform ring buffer");
+		frame.offsets.reset(bytesPerFrame, alignment);
+
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = pool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &layout;
+		VK_CHECK(vkAllocateDescriptorSets(device, &allocInfo, &frame.set), "Failed to allocate a uniform ring descriptor set");
+
+		// written once, the offsets move with every bind instead
+		VkDescriptorBufferInfo bufferInfo{};
+		bufferInfo.buffer = frame.buffer.buffer.buffer;
+		bufferInfo.offset = 0;
+		bufferInfo.range = this->bindingRange;
+		VkWriteDescriptorSet write{};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = frame.set;
+		write.dstBinding = 0;
+		write.descriptorCount = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		write.pBufferInfo = &bufferInfo;
+		vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+	}
+}
+
+void FrameUniformRing::cleanup()
+{
+	if (device == VK_NULL_HANDLE)
+		return;
+	for (uint32_t i = 0; i < frameCount; i++)
+		destroyBuffer(allocator, frames[i].buffer.buffer);
+	frames.reset();
+	// the sets are freed with their pool
+	vkDestroyDescriptorPool(device, pool, nullptr);
+	vkDestroyDescriptorSetLayout(device, layout, nullptr);
+	pool = VK_NULL_HANDLE;
+	layout = VK_NULL_HANDLE;
+	frameCount = 0;
+	currentFrame = 0;
+	device = VK_NULL_HANDLE;
+}
+
+void FrameUniformRing::beginFrame(uint32_t frameIndex)
+{
+	currentFrame = frameIndex % frameCount;
+	frames[currentFrame].offsets.clear();
+}
+
+UniformAllocation FrameUniformRing::allocate(VkDeviceSize size)
+{
+	UniformAllocation allocation;
+	if (bindingRange < size)
+		throw std::runtime_error("Uniform data does not fit in the binding range of the uniform ring");
+	Frame& frame = frames[currentFrame];
+	allocation.offset = frame.offsets.allocate(size);
+	if (allocation.offset != INVALID_UNIFORM_OFFSET)
+		allocation.data = static_cast<uint8_t*>(frame.buffer.data) + allocation.offset;
+	return allocation;
+}
+
+void FrameUniformRing::bind(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout pipelineLayout, uint32_t setIndex, uint32_t offset) const
+{
+	vkCmdBindDescriptorSets(commandBuffer, bindPoint, pipelineLayout, setIndex, 1, &frames[currentFrame].set, 1, &offset);
+}
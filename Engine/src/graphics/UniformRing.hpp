@@ -0,0 +1,161 @@
+#pragma once
+
+#include "GraphicsResources.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+/*
+* Uniform data of a frame, such as the constants of a view or of an object, is written into one persistently mapped,
+* host coherent buffer per frame in flight. Allocations bump a head that is reset when the frame begins again, so writing
+* constants takes no buffers, descriptor sets or map calls of its own. The buffer of each frame is bound once through a
+* UNIFORM_BUFFER_DYNAMIC descriptor, and every draw selects its constants with the dynamic offset of the bind.
+*
+* Shaders declare the constants at binding 0 of the set the ring is bound at, e.g.
+*     layout(set = S, binding = 0) uniform ViewConstants { mat4 worldToScreen; } view;
+* Each binding sees getBindingRange bytes from its offset, so the constants of one draw must fit in it.
+*/
+
+constexpr VkDeviceSize DEFAULT_UNIFORM_RING_SIZE = 4ull * 1024ull * 1024ull; ///< per frame in flight
+constexpr uint32_t DEFAULT_UNIFORM_BINDING_RANGE = 256;
+constexpr uint32_t INVALID_UNIFORM_OFFSET = 0xffffffff;
+
+/**
+ * @brief Bump allocator of the offsets in the buffer of one frame. Allocating is thread safe and lock free.
+ * Every allocation is rounded up to the alignment, so each offset is aligned as well.
+ */
+class UniformRingAllocator
+{
+public:
+	explicit UniformRingAllocator(VkDeviceSize capacity = 0, VkDeviceSize alignment = 1);
+
+	/**
+	 * @brief Frees every allocation and sets the size and alignment of the buffer.
+	 * @param alignment must be a power of two, e.g. minUniformBufferOffsetAlignment.
+	 */
+	void reset(VkDeviceSize capacity, VkDeviceSize alignment);
+
+	/**
+	 * @brief Frees every allocation. Call when the GPU is done with the frame that used them.
+	 */
+	void clear() { head.store(0, std::memory_order_relaxed); }
+
+	/**
+	 * @return the offset of size bytes, or INVALID_UNIFORM_OFFSET if the buffer is full.
+	 */
+	uint32_t allocate(VkDeviceSize size);
+
+	VkDeviceSize getCapacity() const { return capacity; }
+	VkDeviceSize getAlignment() const { return alignment; }
+	/**
+	 * @return the bytes allocated since the last clear, including alignment padding.
+	 */
+	VkDeviceSize getUsed() const;
+
+private:
+	VkDeviceSize capacity;
+	VkDeviceSize alignment;
+	std::atomic<VkDeviceSize> head; ///< may pass the capacity when the buffer is full
+};
+
+/**
+ * @brief Uniform data written this frame.
+ */
+struct UniformAllocation
+{
+	void* data = nullptr;                   ///< mapped memory to write the constants to
+	uint32_t offset = INVALID_UNIFORM_OFFSET; ///< dynamic offset of the bind
+};
+
+/**
+ * @brief Ring of per frame uniform buffers bound through dynamic offsets. Allocating is thread safe,
+ * so recording jobs write the constants of their draws in parallel.
+ */
+class FrameUniformRing
+{
+public:
+	FrameUniformRing();
+	~FrameUniformRing();
+
+	FrameUniformRing(const FrameUniformRing&) = delete;
+	FrameUniformRing& operator=(const FrameUniformRing&) = delete;
+
+	/**
+	 * @brief Creates a buffer, a descriptor set and its layout per frame.
+	 * @param physDevice whose limits give the offset alignment and the largest binding range.
+	 * @param device to create the objects on.
+	 * @param allocator to allocate the buffers with.
+	 * @param frameCount is the number of frames in flight.
+	 * @param bytesPerFrame is the size of the buffer of each frame.
+	 * @param bindingRange is the number of bytes a draw sees from its offset.
+	 */
+	void initialize(VkPhysicalDevice physDevice, VkDevice device, VmaAllocator allocator, uint32_t frameCount,
+		VkDeviceSize bytesPerFrame = DEFAULT_UNIFORM_RING_SIZE, uint32_t bindingRange = DEFAULT_UNIFORM_BINDING_RANGE);
+
+	void cleanup();
+
+	/**
+	 * @brief Starts allocating from the buffer of a frame and frees what it held.
+	 * Call after waiting for the fence of the frame, before recording it.
+	 */
+	void beginFrame(uint32_t frameIndex);
+
+	/**
+	 * @brief Allocates uniform data in the buffer of the current frame.
+	 * @param size in bytes, at most getBindingRange.
+	 * @return the allocation, whose offset is INVALID_UNIFORM_OFFSET if the buffer is full.
+	 */
+	UniformAllocation allocate(VkDeviceSize size);
+
+	/**
+	 * @brief Copies constants into the buffer of the current frame.
+	 * @return the dynamic offset of the constants, or INVALID_UNIFORM_OFFSET if the buffer is full.
+	 */
+	template <typename T>
+	uint32_t push(const T& constants)
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "uniform data is copied as bytes");
+		UniformAllocation allocation = allocate(sizeof(T));
+		if (allocation.offset != INVALID_UNIFORM_OFFSET)
+			std::memcpy(allocation.data, &constants, sizeof(T));
+		return allocation.offset;
+	}
+
+	/**
+	 * @brief Binds the set of the current frame with the constants at offset.
+	 * Binding again with another offset only changes the offset, the descriptor set stays the same.
+	 */
+	void bind(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout pipelineLayout, uint32_t setIndex, uint32_t offset) const;
+
+	/**
+	 * @brief Returns the layout to build the pipeline layouts of the shaders reading the ring with.
+	 */
+	VkDescriptorSetLayout getLayout() const { return layout; }
+	/**
+	 * @brief Returns the set of the current frame, e.g. for DrawStateTable::frameSet.
+	 */
+	VkDescriptorSet getSet() const { return frames[currentFrame].set; }
+	uint32_t getBindingRange() const { return bindingRange; }
+	VkDeviceSize getAlignment() const { return frames[currentFrame].offsets.getAlignment(); }
+	VkDeviceSize getUsedBytes() const { return frames[currentFrame].offsets.getUsed(); }
+
+private:
+	struct Frame
+	{
+		MappedBuffer buffer{};
+		VkDescriptorSet set = VK_NULL_HANDLE;
+		UniformRingAllocator offsets;
+	};
+
+	VkDevice device;
+	VmaAllocator allocator;
+	VkDescriptorSetLayout layout;
+	VkDescriptorPool pool;
+	uint32_t bindingRange;
+	uint32_t frameCount;
+	uint32_t currentFrame;
+	std::unique_ptr<Frame[]> frames; ///< not a vector, the allocators cannot move
+};
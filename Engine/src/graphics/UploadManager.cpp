@@ -0,0 +1,329 @@
+#include "UploadManager.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#define VK_CHECK(x, msg) if (x != VK_SUCCESS) { throw std::runtime_error(msg); }
+
+UploadManager::UploadManager()
+	: device(VK_NULL_HANDLE), allocator(VK_NULL_HANDLE), queues{}, stagingRing{}, commandPool(VK_NULL_HANDLE), timelineSemaphore(VK_NULL_HANDLE)
+{
+}
+
+UploadManager::~UploadManager()
+{
+	cleanup();
+}
+
+void UploadManager::initialize(VkDevice device, VmaAllocator allocator, const UploadQueues& queues, VkDeviceSize stagingSize)
+{
+	this->device = device;
+	this->allocator = allocator;
+	this->queues = queues;
+
+	stagingRing = createMappedBuffer(this->allocator, stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+	if (stagingRing.buffer.buffer == VK_NULL_HANDLE || stagingRing.data == nullptr)
+		throw std::runtime_error("Failed to create the staging ring");
+
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.queueFamilyIndex = queues.transferFamily;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	VK_CHECK(vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool), "Failed to create the transfer command pool");
+
+	freeCommandBuffers.resize(MAX_UPLOAD_BATCHES);
+	VkCommandBufferAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = commandPool;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = MAX_UPLOAD_BATCHES;
+	VK_CHECK(vkAllocateCommandBuffers(device, &allocInfo, freeCommandBuffers.data()), "Failed to allocate transfer command buffers");
+
+	VkSemaphoreTypeCreateInfo typeInfo{};
+	typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	typeInfo.initialValue = 0;
+	VkSemaphoreCreateInfo semaphoreInfo{};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreInfo.pNext = &typeInfo;
+	VK_CHECK(vkCreateSemaphore(device, &semaphoreInfo, nullptr, &timelineSemaphore), "Failed to create the upload timeline semaphore");
+}
+
+void UploadManager::cleanup()
+{
+	if (device == VK_NULL_HANDLE)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(uploadMutex);
+		if (!inFlight.empty())
+			waitForValue(inFlight.back().ticket);
+		inFlight.clear();
+		finished.clear();
+		pendingBatch = UploadBatch{};
+	}
+	vkDestroySemaphore(device, timelineSemaphore, nullptr);
+	vkDestroyCommandPool(device, commandPool, nullptr);
+	destroyBuffer(allocator, stagingRing.buffer);
+	freeCommandBuffers.clear();
+	stagingHead = 0;
+	stagingUsed = 0;
+	device = VK_NULL_HANDLE;
+}
+
+UploadTicket UploadManager::uploadBuffer(VkBuffer destination, VkDeviceSize destinationOffset, const void* data, VkDeviceSize size)
+{
+	std::lock_guard<std::mutex> lock(uploadMutex);
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	// half the ring per chunk, so a chunk always fits once the older batches retire
+	VkDeviceSize maxChunk = (stagingRing.size / 2) & ~(STAGING_ALIGNMENT - 1);
+
+	while (0 < size)
+	{
+		VkDeviceSize chunk = std::min(size, maxChunk);
+		VkDeviceSize stagingOffset = allocateStaging(chunk);
+		std::memcpy(static_cast<uint8_t*>(stagingRing.data) + stagingOffset, bytes, chunk);
+
+		pendingBatch.copies.push_back(VkBufferCopy{ stagingOffset, destinationOffset, chunk });
+		pendingBatch.destinations.push_back(destination);
+
+		bytes += chunk;
+		destinationOffset += chunk;
+		size -= chunk;
+	}
+	// the pending batch gets the next value when it is flushed
+	return nextTimelineValue;
+}
+
+UploadTicket UploadManager::flush()
+{
+	std::lock_guard<std::mutex> lock(uploadMutex);
+	return flushLocked();
+}
+
+UploadTicket UploadManager::flushLocked()
+{
+	if (pendingBatch.copies.empty())
+		return nextTimelineValue - 1;
+
+	reclaimFinishedBatches(getCompletedValue());
+	if (freeCommandBuffers.empty() && !inFlight.empty())
+	{
+		waitForValue(inFlight.front().ticket);
+		reclaimFinishedBatches(getCompletedValue());
+	}
+
+	UploadBatch& batch = pendingBatch;
+	batch.commandBuffer = freeCommandBuffers.back();
+	freeCommandBuffers.pop_back();
+	batch.ticket = nextTimelineValue++;
+	vmaFlushAllocation(allocator, stagingRing.buffer.allocation, 0, VK_WHOLE_SIZE);
+	recordBatch(batch);
+
+	VkCommandBufferSubmitInfo commandInfo{};
+	commandInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+	commandInfo.commandBuffer = batch.commandBuffer;
+
+	VkSemaphoreSubmitInfo signalInfo{};
+	signalInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+	signalInfo.semaphore = timelineSemaphore;
+	signalInfo.value = batch.ticket;
+	signalInfo.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+
+	VkSubmitInfo2 submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+	submitInfo.commandBufferInfoCount = 1;
+	submitInfo.pCommandBufferInfos = &commandInfo;
+	submitInfo.signalSemaphoreInfoCount = 1;
+	submitInfo.pSignalSemaphoreInfos = &signalInfo;
+	{
+		// queues must be externally synchronized, and without a dedicated transfer family the renderer submits here too
+		std::unique_lock<std::mutex> queueLock;
+		if (queues.queueMutex != nullptr)
+			queueLock = std::unique_lock<std::mutex>(*queues.queueMutex);
+		VK_CHECK(vkQueueSubmit2(queues.transferQueue, 1, &submitInfo, VK_NULL_HANDLE), "Failed to submit uploads");
+	}
+
+	UploadTicket ticket = batch.ticket;
+	inFlight.push_back(std::move(pendingBatch));
+	pendingBatch = UploadBatch{};
+	return ticket;
+}
+
+bool UploadManager::isComplete(UploadTicket ticket)
+{
+	std::lock_guard<std::mutex> lock(uploadMutex);
+	return ticket < nextTimelineValue && ticket <= getCompletedValue();
+}
+
+void UploadManager::waitFor(UploadTicket ticket)
+{
+	std::lock_guard<std::mutex> lock(uploadMutex);
+	if (nextTimelineValue <= ticket)
+		flushLocked();
+	waitForValue(ticket);
+}
+
+UploadTicket UploadManager::recordAcquires(VkCommandBuffer commandBuffer, VkSemaphoreSubmitInfo& waitInfo)
+{
+	std::lock_guard<std::mutex> lock(uploadMutex);
+	waitInfo = VkSemaphoreSubmitInfo{};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+
+	reclaimFinishedBatches(getCompletedValue());
+	UploadTicket newestTicket = 0;
+	std::vector<VkBufferMemoryBarrier2> barriers;
+	for (const UploadBatch& batch : finished)
+	{
+		newestTicket = std::max(newestTicket, batch.ticket);
+		if (!needsOwnershipTransfer())
+			continue;
+		for (size_t i = 0; i < batch.copies.size(); i++)
+		{
+			VkBufferMemoryBarrier2 barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+			// the source half of an acquire is ignored
+			barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+			barrier.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT;
+			barrier.srcQueueFamilyIndex = queues.transferFamily;
+			barrier.dstQueueFamilyIndex = queues.graphicsFamily;
+			barrier.buffer = batch.destinations[i];
+			barrier.offset = batch.copies[i].dstOffset;
+			barrier.size = batch.copies[i].size;
+			barriers.push_back(barrier);
+		}
+	}
+	finished.clear();
+
+	if (!barriers.empty())
+	{
+		VkDependencyInfo dependencyInfo{};
+		dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+		dependencyInfo.bufferMemoryBarrierCount = static_cast<uint32_t>(barriers.size());
+		dependencyInfo.pBufferMemoryBarriers = barriers.data();
+		vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+	}
+
+	if (newestTicket != 0)
+	{
+		// already signaled, so the wait only orders the acquire after the release
+		waitInfo.semaphore = timelineSemaphore;
+		waitInfo.value = newestTicket;
+		waitInfo.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+		// batches finish in submission order, so everything up to the newest is acquired
+		acquiredTicket.store(newestTicket, std::memory_order_release);
+	}
+	return newestTicket;
+}
+
+VkDeviceSize UploadManager::allocateStaging(VkDeviceSize size)
+{
+	VkDeviceSize alignedSize = (size + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+	if (stagingRing.size < alignedSize)
+		throw std::runtime_error("Upload chunk is larger than the staging ring");
+	for (;;)
+	{
+		VkDeviceSize offset = stagingHead;
+		VkDeviceSize padding = 0;
+		if (stagingRing.size < offset + alignedSize)
+		{
+			// skip the tail of the ring and start over from the beginning
+			padding = stagingRing.size - offset;
+			offset = 0;
+		}
+		if (stagingUsed + padding + alignedSize <= stagingRing.size)
+		{
+			stagingHead = offset + alignedSize;
+			stagingUsed += padding + alignedSize;
+			pendingBatch.stagingBytes += padding + alignedSize;
+			return offset;
+		}
+
+		// The ring is full. Stall the uploading thread, never the render queue.
+		if (inFlight.empty())
+			flushLocked();
+		// nothing pending and nothing in flight, so waiting frees nothing
+		if (inFlight.empty())
+			throw std::runtime_error("Staging ring is full with nothing in flight to wait for");
+		waitForValue(inFlight.front().ticket);
+		reclaimFinishedBatches(getCompletedValue());
+	}
+}
+
+void UploadManager::reclaimFinishedBatches(uint64_t completedValue)
+{
+	while (!inFlight.empty() && inFlight.front().ticket <= completedValue)
+	{
+		UploadBatch& batch = inFlight.front();
+		stagingUsed -= batch.stagingBytes;
+		freeCommandBuffers.push_back(batch.commandBuffer);
+		batch.commandBuffer = VK_NULL_HANDLE;
+		// the copies stay around for the acquire barriers
+		finished.push_back(std::move(batch));
+		inFlight.pop_front();
+	}
+	if (stagingUsed == 0 && pendingBatch.copies.empty())
+		stagingHead = 0;
+}
+
+void UploadManager::waitForValue(uint64_t value)
+{
+	VkSemaphoreWaitInfo waitInfo{};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &timelineSemaphore;
+	waitInfo.pValues = &value;
+	VK_CHECK(vkWaitSemaphores(device, &waitInfo, UINT64_MAX), "Failed to wait for uploads");
+}
+
+uint64_t UploadManager::getCompletedValue()
+{
+	uint64_t value = 0;
+	vkGetSemaphoreCounterValue(device, timelineSemaphore, &value);
+	return value;
+}
+
+void UploadManager::recordBatch(UploadBatch& batch)
+{
+	vkResetCommandBuffer(batch.commandBuffer, 0);
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	VK_CHECK(vkBeginCommandBuffer(batch.commandBuffer, &beginInfo), "Failed to begin an upload batch");
+
+	// consecutive copies to the same buffer go in one command
+	size_t first = 0;
+	for (size_t i = 1; i <= batch.copies.size(); i++)
+	{
+		if (i == batch.copies.size() || batch.destinations[i] != batch.destinations[first])
+		{
+			vkCmdCopyBuffer(batch.commandBuffer, stagingRing.buffer.buffer, batch.destinations[first], static_cast<uint32_t>(i - first), batch.copies.data() + first);
+			first = i;
+		}
+	}
+
+	if (needsOwnershipTransfer())
+	{
+		// release half of the ownership transfer, the destination half is ignored
+		std::vector<VkBufferMemoryBarrier2> barriers(batch.copies.size());
+		for (size_t i = 0; i < batch.copies.size(); i++)
+		{
+			VkBufferMemoryBarrier2& barrier = barriers[i];
+			barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+			barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+			barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+			barrier.srcQueueFamilyIndex = queues.transferFamily;
+			barrier.dstQueueFamilyIndex = queues.graphicsFamily;
+			barrier.buffer = batch.destinations[i];
+			barrier.offset = batch.copies[i].dstOffset;
+			barrier.size = batch.copies[i].size;
+		}
+		VkDependencyInfo dependencyInfo{};
+		dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+		dependencyInfo.bufferMemoryBarrierCount = static_cast<uint32_t>(barriers.size());
+		dependencyInfo.pBufferMemoryBarriers = barriers.data();
+		vkCmdPipelineBarrier2(batch.commandBuffer, &dependencyInfo);
+	}
+
+	VK_CHECK(vkEndCommandBuffer(batch.commandBuffer), "Failed to end an upload batch");
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "GraphicsResources.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+/*
+* Uploads go through a persistently mapped staging ring and are copied on the transfer queue.
+* Each flushed batch signals a timeline semaphore value, which doubles as the ticket of every upload in the batch.
+* The render queue only acquires batches that have already finished, so streaming never stalls it.
+*/
+
+constexpr VkDeviceSize DEFAULT_STAGING_SIZE = 64ull * 1024ull * 1024ull;
+constexpr uint32_t MAX_UPLOAD_BATCHES = 8; ///< batches that may be in flight on the transfer queue
+constexpr VkDeviceSize STAGING_ALIGNMENT = 16;
+
+/**
+ * @brief Timeline value an upload completes at. Zero means already complete.
+ */
+using UploadTicket = uint64_t;
+
+/**
+ * @brief Queues and families the uploads are submitted to and consumed on.
+ */
+struct UploadQueues
+{
+	VkQueue transferQueue;
+	uint32_t transferFamily;
+	uint32_t graphicsFamily; ///< family that will use the uploaded buffers
+	std::mutex* queueMutex = nullptr; ///< held while submitting when the transfer queue is also used by the renderer, nullptr if it is not
+};
+
+class UploadManager
+{
+
+public:
+	UploadManager();
+	~UploadManager();
+
+	/**
+	 * @brief Creates the staging ring, the timeline semaphore and the transfer command buffers.
+	 * @param device to create the objects on.
+	 * @param allocator to allocate the staging ring with.
+	 * @param queues to submit on.
+	 * @param stagingSize is the size of the staging ring in bytes.
+	 */
+	void initialize(VkDevice device, VmaAllocator allocator, const UploadQueues& queues, VkDeviceSize stagingSize = DEFAULT_STAGING_SIZE);
+
+	/**
+	 * @brief Waits for the uploads in flight and destroys everything.
+	 */
+	void cleanup();
+
+	/**
+	 * @brief Copies data to a buffer. The buffer must have been created with transfer destination usage.
+	 * Data larger than the staging ring is split into several copies.
+	 * @param destination buffer.
+	 * @param destinationOffset in bytes.
+	 * @param data to copy. Can be released when the call returns.
+	 * @param size in bytes.
+	 * @return ticket of the upload. It becomes valid after the next flush.
+	 */
+	UploadTicket uploadBuffer(VkBuffer destination, VkDeviceSize destinationOffset, const void* data, VkDeviceSize size);
+
+	/**
+	 * @brief Submits the queued copies to the transfer queue.
+	 * @return the ticket of the submitted batch, or the latest ticket if nothing was queued.
+	 */
+	UploadTicket flush();
+
+	/**
+	 * @brief Returns whether the upload has finished on the transfer queue.
+	 */
+	bool isComplete(UploadTicket ticket);
+
+	/**
+	 * @brief Returns whether the upload has been acquired by the graphics queue and may be used in draws.
+	 */
+	bool isReady(UploadTicket ticket) const { return ticket <= acquiredTicket.load(std::memory_order_acquire); }
+
+	/**
+	 * @brief Blocks the calling thread until the upload has finished. Flushes first if needed.
+	 */
+	void waitFor(UploadTicket ticket);
+
+	/**
+	 * @brief Records the ownership acquire of every finished batch into a graphics command buffer.
+	 * Call at the start of the frame, before recording draws that use uploaded data.
+	 * The submission of the command buffer must wait on the returned semaphore info, which is already signaled
+	 * so it never stalls, but orders the release and the acquire as the specification requires.
+	 * @param commandBuffer of the graphics queue.
+	 * @param waitInfo is filled with the wait of the submission. Its semaphore is VK_NULL_HANDLE if nothing was acquired.
+	 * @return the highest acquired ticket.
+	 */
+	UploadTicket recordAcquires(VkCommandBuffer commandBuffer, VkSemaphoreSubmitInfo& waitInfo);
+
+	/**
+	 * @brief Returns whether uploads change queue family and thus need the acquire on the graphics queue.
+	 */
+	bool needsOwnershipTransfer() const { return queues.transferFamily != queues.graphicsFamily; }
+
+	VkSemaphore getTimelineSemaphore() const { return timelineSemaphore; }
+
+private:
+	struct UploadBatch
+	{
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		UploadTicket ticket = 0;
+		VkDeviceSize stagingBytes = 0; ///< bytes of the ring the batch holds, including wrap padding
+		std::vector<VkBufferCopy> copies;
+		std::vector<VkBuffer> destinations; ///< destination of each copy
+	};
+
+	/**
+	 * @brief Reserves staging memory, flushing and waiting for old batches if the ring is full.
+	 * @return offset into the staging ring.
+	 */
+	VkDeviceSize allocateStaging(VkDeviceSize size);
+	/**
+	 * @brief Frees the staging memory and command buffers of finished batches and queues them for the acquire.
+	 */
+	void reclaimFinishedBatches(uint64_t completedValue);
+	UploadTicket flushLocked();
+	void waitForValue(uint64_t value);
+	uint64_t getCompletedValue();
+	void recordBatch(UploadBatch& batch);
+
+	VkDevice device;
+	VmaAllocator allocator;
+	UploadQueues queues;
+	MappedBuffer stagingRing;
+	VkDeviceSize stagingHead = 0; ///< next free byte
+	VkDeviceSize stagingUsed = 0; ///< bytes held by pending and in flight batches
+	VkCommandPool commandPool;
+	VkSemaphore timelineSemaphore;
+	uint64_t nextTimelineValue = 1;
+	std::atomic<uint64_t> acquiredTicket = 0; ///< every upload up to this is owned by the graphics queue
+	std::vector<VkCommandBuffer> freeCommandBuffers;
+	UploadBatch pendingBatch;           ///< collects copies until the next flush
+	std::deque<UploadBatch> inFlight;   ///< submitted, oldest first
+	std::vector<UploadBatch> finished;  ///< done on the transfer queue, not yet acquired by the graphics queue
+	std::mutex uploadMutex;
+};
@@ -1,6 +1,9 @@
 #include "Vertex.hpp"
 
 #include <vulkan/vulkan.h>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
 
 VkFormat getFormatFromEnum(VertexAttributeEnum attribute)
 {
@@ -61,6 +64,8 @@ VertexAttributeInfo getAttributeInfo(VertexAttributeEnum attribute)
 			return { VK_FORMAT_R32G32_SFLOAT, sizeof(glm::vec2) };
 		case VertexAttributeEnum::TANGENT:
 			return { VK_FORMAT_R32G32B32_SFLOAT, sizeof(glm::vec3) };
+		case VertexAttributeEnum::BITANGENT:
+			return { VK_FORMAT_R32G32B32_SFLOAT, sizeof(glm::vec3) };
 		case VertexAttributeEnum::JOINTS:
 			return { VK_FORMAT_R32G32B32A32_UINT, sizeof(glm::uvec4) };
 		case VertexAttributeEnum::WEIGHTS:
@@ -79,4 +84,79 @@ uint32_t calculateOffset(VertexAttributeEnum attribute)
 		offset += attributeEnumToSize((VertexAttributeEnum)e);
 	}
 	return offset;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Returns where the attribute lives in FullVertex.
+ */
+size_t getFullVertexOffset(VertexAttributeEnum attribute)
+{
+	switch (attribute)
+	{
+		case VertexAttributeEnum::POSITION:
+			return offsetof(FullVertex, position);
+		case VertexAttributeEnum::NORMAL:
+			return offsetof(FullVertex, normal);
+		case VertexAttributeEnum::COLOR:
+			return offsetof(FullVertex, color);
+		case VertexAttributeEnum::TEXCOORD:
+			return offsetof(FullVertex, texCoord);
+		case VertexAttributeEnum::TANGENT:
+			return offsetof(FullVertex, tangent);
+		case VertexAttributeEnum::BITANGENT:
+			return offsetof(FullVertex, bitangent);
+		case VertexAttributeEnum::JOINTS:
+			return offsetof(FullVertex, joints);
+		case VertexAttributeEnum::WEIGHTS:
+			return offsetof(FullVertex, weights);
+		default:
+			return 0;
+	}
+}
+
+VertexAttributeEnum getAttributeAtLocation(uint32_t location)
+{
+	if (std::size(VERTEX_INPUT_LOCATIONS) <= location)
+		return VertexAttributeEnum::UNDEFINED;
+	return VERTEX_INPUT_LOCATIONS[location];
+}
+
+uint32_t getAttributeOffset(VertexAttributeEnum attribute, VertexAttributeFlags attributes)
+{
+	uint32_t offset = 0;
+	for (uint16_t e = VertexAttributeEnum::POSITION; e < attribute; e++)
+	{
+		if (attributes & (1 << e))
+			offset += static_cast<uint32_t>(getAttributeInfo(static_cast<VertexAttributeEnum>(e)).size);
+	}
+	return offset;
+}
+
+uint32_t getVertexStride(VertexAttributeFlags attributes)
+{
+	uint32_t stride = 0;
+	for (uint16_t e = VertexAttributeEnum::POSITION; e < VertexAttributeEnum::UNDEFINED; e++)
+	{
+		if (attributes & (1 << e))
+			stride += static_cast<uint32_t>(getAttributeInfo(static_cast<VertexAttributeEnum>(e)).size);
+	}
+	return stride;
+}
+
+void packVertices(const FullVertex* vertices, size_t count, VertexAttributeFlags attributes, void* destination)
+{
+	uint8_t* out = static_cast<uint8_t*>(destination);
+	for (size_t i = 0; i < count; i++)
+	{
+		const uint8_t* vertex = reinterpret_cast<const uint8_t*>(vertices + i);
+		for (uint16_t e = VertexAttributeEnum::POSITION; e < VertexAttributeEnum::UNDEFINED; e++)
+		{
+			if (!(attributes & (1 << e)))
+				continue;
+			VertexAttributeEnum attribute = static_cast<VertexAttributeEnum>(e);
+			size_t attributeSize = getAttributeInfo(attribute).size;
+			std::memcpy(out, vertex + getFullVertexOffset(attribute), attributeSize);
+			out += attributeSize;
+		}
+	}
+}
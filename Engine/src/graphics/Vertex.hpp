@@ -142,6 +142,23 @@ struct VertexAttributeInfo
 
 VertexAttributeInfo getAttributeInfo(VertexAttributeEnum attribute);
 
+/**
+ * @brief Vertex shader input location of each attribute, e.g. layout(location = 2) in vec2 inTexCoord.
+ * A location means the same attribute in every shader, whatever else the shader reads. The vertex buffers hold the attributes
+ * in enum order all the same, so the location says nothing about the offset.
+ */
+constexpr VertexAttributeEnum VERTEX_INPUT_LOCATIONS[] = { POSITION, NORMAL, TEXCOORD, JOINTS, WEIGHTS, COLOR, TANGENT, BITANGENT };
+
+/**
+ * @brief Returns the attribute read at a vertex shader input location, or UNDEFINED if the location has none.
+ */
+VertexAttributeEnum getAttributeAtLocation(uint32_t location);
+
+/**
+ * @brief Returns the offset of an attribute in an interleaved vertex holding the given attributes, in enum order.
+ */
+uint32_t getAttributeOffset(VertexAttributeEnum attribute, VertexAttributeFlags attributes);
+
 // some predefined vertex types
 
 struct BasicVertex
@@ -176,4 +193,18 @@ struct FullVertex
 	glm::vec3 bitangent;
 	glm::uvec4 joints;
 	glm::vec4 weights;
-};
\ No newline at end of file
+};
+
+/**
+ * @brief Returns the size of an interleaved vertex holding only the given attributes, in enum order.
+ */
+uint32_t getVertexStride(VertexAttributeFlags attributes);
+
+/**
+ * @brief Packs full vertices into interleaved vertices holding only the given attributes.
+ * @param vertices to pack.
+ * @param count of vertices.
+ * @param attributes to keep.
+ * @param destination must hold count * getVertexStride(attributes) bytes.
+ */
+void packVertices(const FullVertex* vertices, size_t count, VertexAttributeFlags attributes, void* destination);
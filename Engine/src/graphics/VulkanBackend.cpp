@@ -6,6 +6,7 @@
 
 #include "ShaderTools.hpp"
 #include "Camera.hpp"
+#include "JobSystem.hpp"
 #include "PipelineManager.hpp"
 
 #include <algorithm>
@@ -59,28 +60,37 @@ QueueFamilyIndices findQueueFamilies(VkPhysicalDevice physDevice, VkSurfaceKHR s
 	vkGetPhysicalDeviceQueueFamilyProperties(physDevice, &queueFamilyCount, nullptr);
 	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
 	vkGetPhysicalDeviceQueueFamilyProperties(physDevice, &queueFamilyCount, queueFamilies.data());
-	int i = 0;
-	for (const auto& queueFamily : queueFamilies)
+	// Transfer family preference: transfer only, then anything without graphics, then whatever has transfer.
+	// A dedicated family is usually backed by the copy engine and runs alongside rendering.
+	int transferScore = -1;
+	for (uint32_t i = 0; i < queueFamilyCount; i++)
 	{
-		if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+		const VkQueueFamilyProperties& queueFamily = queueFamilies[i];
+		if ((queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) && !indices.graphicsFamily.has_value())
 		{
 			indices.graphicsFamily = i;
 		}
 		VkBool32 presentSupport = false;
 		vkGetPhysicalDeviceSurfaceSupportKHR(physDevice, i, surface, &presentSupport);
-		if (presentSupport)
+		// prefer presenting from the graphics family
+		if (presentSupport && (!indices.presentFamily.has_value() || indices.graphicsFamily == i))
 		{
 			indices.presentFamily = i;
 		}
-		if (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT)
+		// graphics and compute families support transfers even when they do not report it
+		if (queueFamily.queueFlags & (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))
 		{
-			indices.transferFamily = i;
-		}
-		if (indices.hasAll() || indices.isComplete()) // todo make this configurable
-		{
-			break;
+			int score = 0;
+			if (!(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT))
+				score++;
+			if (!(queueFamily.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+				score++;
+			if (transferScore < score)
+			{
+				transferScore = score;
+				indices.transferFamily = i;
+			}
 		}
-		i++;
 	}
 	return indices;
 }
@@ -274,14 +284,21 @@ void VulkanBackend::eventLoop()
 	bool quit = false;
 	while (!quit)
 	{
-		while (SDL_PollEvent(&event))
+		// a minimized window draws nothing, so block until the next event instead of spinning
+		bool minimized = (SDL_GetWindowFlags(window) & SDL_WINDOW_MINIMIZED) != 0;
+		bool hasEvent = minimized ? SDL_WaitEvent(&event) : SDL_PollEvent(&event);
+		while (hasEvent)
 		{
 			if (event.type == SDL_EVENT_QUIT)
 			{
 				quit = true;
 			}
+			hasEvent = SDL_PollEvent(&event);
 		}
+		if (!quit && swapChain != VK_NULL_HANDLE)
+			drawFrame();
 	}
+	vkDeviceWaitIdle(logDevice);
 }
 
 
@@ -417,12 +434,80 @@ void VulkanBackend::createLogicalDevice()
 		queueCreateInfos.push_back(queueCreateInfo);
 	}
 
-	// Check for anisotropy support
+	// ask the device what it supports before enabling anything
+	VkPhysicalDeviceVulkan13Features supported13{};
+	supported13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+	VkPhysicalDeviceVulkan12Features supported12{};
+	supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	supported12.pNext = &supported13;
+	VkPhysicalDeviceFeatures2 supported{};
+	supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	supported.pNext = &supported12;
+	vkGetPhysicalDeviceFeatures2(physDevice, &supported);
+
+	std::string missingFeatures;
+	auto require = [&missingFeatures](VkBool32 isSupported, const char* name) {
+		if (!isSupported)
+			missingFeatures += std::string(missingFeatures.empty() ? "" : ", ") + name;
+	};
+	require(supported.features.multiDrawIndirect, "multiDrawIndirect");
+	require(supported.features.drawIndirectFirstInstance, "drawIndirectFirstInstance");
+	require(supported12.timelineSemaphore, "timelineSemaphore");
+	require(supported12.drawIndirectCount, "drawIndirectCount");
+	require(supported13.synchronization2, "synchronization2");
+	if (!missingFeatures.empty())
+		throw std::runtime_error("The device does not support the required features: " + missingFeatures);
+
+	// optional features fall back to the paths that do without them
+	if (hasFlag(backendFlags, VulkanBackendFlags::DYNAMIC_RENDERING) && !supported13.dynamicRendering)
+	{
+		std::cerr << "Dynamic rendering is not supported, falling back to render passes" << std::endl;
+		backendFlags = clearFlag(backendFlags, VulkanBackendFlags::DYNAMIC_RENDERING);
+	}
+	bool bindlessSupported = supported12.descriptorIndexing && supported12.runtimeDescriptorArray && supported12.descriptorBindingPartiallyBound
+		&& supported12.descriptorBindingUpdateUnusedWhilePending && supported12.descriptorBindingSampledImageUpdateAfterBind && supported12.descriptorBindingStorageBufferUpdateAfterBind
+		&& supported12.shaderSampledImageArrayNonUniformIndexing && supported12.shaderStorageBufferArrayNonUniformIndexing;
+	if (hasFlag(backendFlags, VulkanBackendFlags::BINDLESS_DESCRIPTORS) && !bindlessSupported)
+	{
+		std::cerr << "Descriptor indexing is not supported, falling back to per material descriptor sets" << std::endl;
+		backendFlags = clearFlag(backendFlags, VulkanBackendFlags::BINDLESS_DESCRIPTORS);
+	}
+
 	VkPhysicalDeviceFeatures deviceFeatures{};
-	deviceFeatures.samplerAnisotropy = VK_TRUE;
+	deviceFeatures.samplerAnisotropy = supported.features.samplerAnisotropy;
+	// GPU driven rendering writes one indirect draw per instance, with the instance index as firstInstance
+	deviceFeatures.multiDrawIndirect = VK_TRUE;
+	deviceFeatures.drawIndirectFirstInstance = VK_TRUE;
+
+	// uploads are tracked with a timeline semaphore and submitted with synchronization2
+	VkPhysicalDeviceVulkan13Features vulkan13Features{};
+	vulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+	vulkan13Features.synchronization2 = VK_TRUE;
+	vulkan13Features.dynamicRendering = hasFlag(backendFlags, VulkanBackendFlags::DYNAMIC_RENDERING) ? VK_TRUE : VK_FALSE;
+	// lets the thread pipeline caches skip the driver's locking, they work without it too
+	vulkan13Features.pipelineCreationCacheControl = supported13.pipelineCreationCacheControl;
+	pipelineCacheControl = supported13.pipelineCreationCacheControl == VK_TRUE;
+	VkPhysicalDeviceVulkan12Features vulkan12Features{};
+	vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	vulkan12Features.pNext = &vulkan13Features;
+	vulkan12Features.timelineSemaphore = VK_TRUE;
+	vulkan12Features.drawIndirectCount = VK_TRUE;
+	if (hasFlag(backendFlags, VulkanBackendFlags::BINDLESS_DESCRIPTORS))
+	{
+		// unsized arrays indexed per draw, written while in use
+		vulkan12Features.descriptorIndexing = VK_TRUE;
+		vulkan12Features.runtimeDescriptorArray = VK_TRUE;
+		vulkan12Features.descriptorBindingPartiallyBound = VK_TRUE;
+		vulkan12Features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+		vulkan12Features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+		vulkan12Features.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+		vulkan12Features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+		vulkan12Features.shaderStorageBufferArrayNonUniformIndexing = VK_TRUE;
+	}
 
 	VkDeviceCreateInfo devCreateInfo{};
 	devCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	devCreateInfo.pNext = &vulkan12Features;
 	devCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 	devCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
 
@@ -436,9 +521,9 @@ void VulkanBackend::createLogicalDevice()
 	devCreateInfo.enabledLayerCount = 0;
 
 	VK_CHECK(vkCreateDevice(physDevice, &devCreateInfo, nullptr, &logDevice), "Could not create logical device");
-	// TODO create a transfer queue as well
 	vkGetDeviceQueue(logDevice, indice.graphicsFamily.value(), 0, &graphicsQueue);
 	vkGetDeviceQueue(logDevice, indice.presentFamily.value(), 0, &presentQueue);
+	vkGetDeviceQueue(logDevice, indice.transferFamily.value(), 0, &transferQueue);
 }
 
 void VulkanBackend::createAllocator()
@@ -452,6 +537,40 @@ void VulkanBackend::createAllocator()
 	VK_CHECK(vmaCreateAllocator(&allocatorInfo, &gpuAllocator), "Could not create allocator");
 }
 
+void VulkanBackend::createUploadManager()
+{
+	QueueFamilyIndices indices = findQueueFamilies(this->physDevice, this->surface);
+	UploadQueues queues{};
+	queues.transferQueue = transferQueue;
+	queues.transferFamily = indices.transferFamily.value();
+	queues.graphicsFamily = indices.graphicsFamily.value();
+	// the same family hands out the same queue, which the frame loop submits and presents on as well
+	if (transferQueue == graphicsQueue || transferQueue == presentQueue)
+		queues.queueMutex = &queueMutex;
+	uploadManager.initialize(logDevice, gpuAllocator, queues);
+}
+
+void VulkanBackend::createGeometryBuffers(uint32_t vertexCapacity, uint32_t indexCapacity)
+{
+	geometryBuffers.initialize(gpuAllocator, &uploadManager, vertexCapacity, indexCapacity);
+}
+
+void VulkanBackend::createPipelineCache(const std::string& path)
+{
+	pipelineCache.initialize(physDevice, logDevice, path, pipelineCacheControl);
+}
+
+void VulkanBackend::createBindlessTable()
+{
+	if (hasFlag(backendFlags, VulkanBackendFlags::BINDLESS_DESCRIPTORS))
+		bindlessTable.initialize(physDevice, logDevice, kConcurrentFrames);
+}
+
+void VulkanBackend::createUniformRing()
+{
+	uniformRing.initialize(physDevice, logDevice, gpuAllocator, kConcurrentFrames);
+}
+
 VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats)
 {
 	for (const auto& format : availableFormats)
@@ -547,9 +666,13 @@ void VulkanBackend::createSwapChain()
 	swapInfo.presentMode = mode;
 	swapInfo.clipped = VK_TRUE;
 
-	swapInfo.oldSwapchain = VK_NULL_HANDLE;
+	// when recreating, the old swap chain hands its resources over
+	VkSwapchainKHR oldSwapChain = swapChain;
+	swapInfo.oldSwapchain = oldSwapChain;
 
 	VK_CHECK(vkCreateSwapchainKHR(logDevice, &swapInfo, nullptr, &swapChain), "Failed to create a swapchain");
+	if (oldSwapChain != VK_NULL_HANDLE)
+		vkDestroySwapchainKHR(logDevice, oldSwapChain, nullptr);
 
 	vkGetSwapchainImagesKHR(logDevice, swapChain, &imageCount, nullptr);
 	swapChainImages.resize(imageCount);
@@ -559,6 +682,49 @@ void VulkanBackend::createSwapChain()
 	swapChainExtent = extent;
 }
 
+void VulkanBackend::recreateSwapChain()
+{
+	// a swap chain or depth image of zero extent is invalid, the rebuild waits until the window is shown again
+	if (!hasDrawableExtent())
+	{
+		swapChainOutdated = true;
+		return;
+	}
+	swapChainOutdated = false;
+	// pipelines use dynamic viewport and scissor, so only the size dependent attachments are rebuilt
+	vkDeviceWaitIdle(logDevice);
+	destroySwapChainResources();
+	createSwapChain();
+	createDepthResources();
+	createImageViews();
+	if (!hasFlag(backendFlags, VulkanBackendFlags::DYNAMIC_RENDERING))
+		createFramebuffers();
+}
+
+bool VulkanBackend::hasDrawableExtent() const
+{
+	int width = 0, height = 0;
+	SDL_GetWindowSizeInPixels(window, &width, &height);
+	if (width <= 0 || height <= 0)
+		return false;
+	// some platforms report the minimized size only through the surface
+	VkSurfaceCapabilitiesKHR capabilities;
+	if (vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physDevice, surface, &capabilities) != VK_SUCCESS)
+		return false;
+	return capabilities.currentExtent.width != 0 && capabilities.currentExtent.height != 0;
+}
+
+void VulkanBackend::destroySwapChainResources()
+{
+	for (VkFramebuffer frameBuffer : frameBuffers)
+		vkDestroyFramebuffer(logDevice, frameBuffer, nullptr);
+	frameBuffers.clear();
+	for (VkImageView imageView : swapChainImageViews)
+		vkDestroyImageView(logDevice, imageView, nullptr);
+	swapChainImageViews.clear();
+	destroyImage(gpuAllocator, depthImage);
+}
+
 void VulkanBackend::createImageViews()
 {
 	swapChainImageViews.resize(swapChainImages.size());
@@ -701,30 +867,13 @@ void VulkanBackend::createFramebuffers()
 	}
 }
 
-void VulkanBackend::createCommandPool()
+void VulkanBackend::createCommandRecorder()
 {
 	auto queuefamilyIndices = findQueueFamilies(this->physDevice, this->surface);
-
-	VkCommandPoolCreateInfo poolInfo{};
-	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	poolInfo.queueFamilyIndex = queuefamilyIndices.graphicsFamily.value();
-	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-
-	VK_CHECK(vkCreateCommandPool(logDevice, &poolInfo, nullptr, &commandPool), "Failed to create a command pool");
-}
-
-void VulkanBackend::createCommandBuffers()
-{
-	commandBuffers.resize(frameBuffers.size());
-
-	VkCommandBufferAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.commandPool = commandPool;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
-
-	if (vkAllocateCommandBuffers(logDevice, &allocInfo, commandBuffers.data()) != VK_SUCCESS)
-		throw std::runtime_error("Failed to allocate command buffers");
+	// one recording slot per job system thread, including the one submitting the frame
+	commandRecorder.initialize(logDevice, queuefamilyIndices.graphicsFamily.value(), kConcurrentFrames, JobSystem::getInstance().getWorkerCount() + 1);
+	// descriptor sets of a frame are allocated by the same slots and reset along with its command pools
+	frameDescriptors.initialize(logDevice, kConcurrentFrames, commandRecorder.getSlotCount());
 }
 
 void VulkanBackend::createSynchronization()
@@ -748,8 +897,232 @@ void VulkanBackend::createSynchronization()
 	}
 }
 
+PipelineRenderTarget VulkanBackend::getRenderTarget() const
+{
+	if (!hasFlag(backendFlags, VulkanBackendFlags::DYNAMIC_RENDERING))
+		return { renderPass };
+	return { VK_NULL_HANDLE, swapChainImageFormat, depthFormat };
+}
+
+VkCommandBufferInheritanceInfo VulkanBackend::getInheritanceInfo(uint32_t imageIndex) const
+{
+	VkCommandBufferInheritanceInfo inheritance{};
+	inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	if (hasFlag(backendFlags, VulkanBackendFlags::DYNAMIC_RENDERING))
+	{
+		inheritance.pNext = &inheritanceRenderingInfo;
+	}
+	else
+	{
+		inheritance.renderPass = renderPass;
+		inheritance.subpass = 0;
+		inheritance.framebuffer = frameBuffers[imageIndex];
+	}
+	return inheritance;
+}
+
+void VulkanBackend::beginRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex, VkSubpassContents contents)
+{
+	VkClearValue colorClear{};
+	colorClear.color = { { 0.f, 0.f, 0.f, 1.f } };
+	VkClearValue depthClear{};
+	depthClear.depthStencil = { 1.f, 0 };
+	VkRect2D renderArea = { { 0, 0 }, swapChainExtent };
+
+	if (!hasFlag(backendFlags, VulkanBackendFlags::DYNAMIC_RENDERING))
+	{
+		std::array<VkClearValue, 2> clearValues = { colorClear, depthClear };
+		VkRenderPassBeginInfo passInfo{};
+		passInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		passInfo.renderPass = renderPass;
+		passInfo.framebuffer = frameBuffers[imageIndex];
+		passInfo.renderArea = renderArea;
+		passInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+		passInfo.pClearValues = clearValues.data();
+		vkCmdBeginRenderPass(commandBuffer, &passInfo, contents);
+		return;
+	}
+
+	// the render pass did these transitions through its initial and final layouts
+	std::array<VkImageMemoryBarrier2, 2> barriers{};
+	barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+	barriers[0].srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+	barriers[0].srcAccessMask = VK_ACCESS_2_NONE;
+	barriers[0].dstStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+	barriers[0].dstAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].image = swapChainImages[imageIndex];
+	barriers[0].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+	bool hasStencil = depthFormat == VK_FORMAT_D32_SFLOAT_S8_UINT || depthFormat == VK_FORMAT_D24_UNORM_S8_UINT;
+	barriers[1].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+	barriers[1].srcStageMask = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT;
+	barriers[1].srcAccessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	barriers[1].dstStageMask = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT;
+	barriers[1].dstAccessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barriers[1].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	barriers[1].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[1].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[1].image = depthImage.image;
+	barriers[1].subresourceRange = { static_cast<VkImageAspectFlags>(VK_IMAGE_ASPECT_DEPTH_BIT | (hasStencil ? VK_IMAGE_ASPECT_STENCIL_BIT : 0)), 0, 1, 0, 1 };
+
+	VkDependencyInfo dependency{};
+	dependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	dependency.imageMemoryBarrierCount = static_cast<uint32_t>(barriers.size());
+	dependency.pImageMemoryBarriers = barriers.data();
+	vkCmdPipelineBarrier2(commandBuffer, &dependency);
+
+	VkRenderingAttachmentInfo colorAttachment{};
+	colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+	colorAttachment.imageView = swapChainImageViews[imageIndex];
+	colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	colorAttachment.clearValue = colorClear;
+
+	VkRenderingAttachmentInfo depthAttachment{};
+	depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+	depthAttachment.imageView = depthImage.view;
+	depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.clearValue = depthClear;
+
+	VkRenderingInfo renderingInfo{};
+	renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+	renderingInfo.flags = contents == VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT : 0;
+	renderingInfo.renderArea = renderArea;
+	renderingInfo.layerCount = 1;
+	renderingInfo.colorAttachmentCount = 1;
+	renderingInfo.pColorAttachments = &colorAttachment;
+	renderingInfo.pDepthAttachment = &depthAttachment;
+	vkCmdBeginRendering(commandBuffer, &renderingInfo);
+}
+
+void VulkanBackend::endRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+	if (!hasFlag(backendFlags, VulkanBackendFlags::DYNAMIC_RENDERING))
+	{
+		vkCmdEndRenderPass(commandBuffer);
+		return;
+	}
+
+	vkCmdEndRendering(commandBuffer);
+	VkImageMemoryBarrier2 presentBarrier{};
+	presentBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+	presentBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+	presentBarrier.srcAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+	presentBarrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+	presentBarrier.dstAccessMask = VK_ACCESS_2_NONE;
+	presentBarrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	presentBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	presentBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	presentBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	presentBarrier.image = swapChainImages[imageIndex];
+	presentBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+	VkDependencyInfo dependency{};
+	dependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	dependency.imageMemoryBarrierCount = 1;
+	dependency.pImageMemoryBarriers = &presentBarrier;
+	vkCmdPipelineBarrier2(commandBuffer, &dependency);
+}
+
+void VulkanBackend::drawFrame(const std::function<void(uint32_t imageIndex)>& recordDraws)
+{
+	if (swapChainOutdated)
+	{
+		recreateSwapChain();
+		// still no pixels, skip the frame
+		if (swapChainOutdated)
+			return;
+	}
+	VK_CHECK(vkWaitForFences(logDevice, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX), "Failed to wait for a frame");
+	uint32_t imageIndex = 0;
+	VkResult acquireResult = vkAcquireNextImageKHR(logDevice, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+	if (acquireResult == VK_ERROR_OUT_OF_DATE_KHR)
+	{
+		recreateSwapChain();
+		return;
+	}
+	if (acquireResult != VK_SUCCESS && acquireResult != VK_SUBOPTIMAL_KHR)
+		throw std::runtime_error("Failed to acquire a swap chain image");
+	VK_CHECK(vkResetFences(logDevice, 1, &inFlightFences[currentFrame]), "Failed to reset a frame fence");
+
+	// the fence of the frame has signaled, so everything it used may be reset
+	VkCommandBuffer commandBuffer = commandRecorder.beginFrame(currentFrame);
+	frameDescriptors.beginFrame(currentFrame);
+	uniformRing.beginFrame(currentFrame);
+	if (hasFlag(backendFlags, VulkanBackendFlags::BINDLESS_DESCRIPTORS))
+		bindlessTable.beginFrame(currentFrame);
+
+	// uploads queued since the last frame go out now, the ones that finished are acquired before any draw reads them
+	uploadManager.flush();
+	VkSemaphoreSubmitInfo uploadWait{};
+	uploadManager.recordAcquires(commandBuffer, uploadWait);
+
+	beginRendering(commandBuffer, imageIndex, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+	if (recordDraws)
+		recordDraws(imageIndex);
+	endRendering(commandBuffer, imageIndex);
+	commandRecorder.endFrame();
+
+	std::array<VkSemaphoreSubmitInfo, 2> waits{};
+	waits[0].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+	waits[0].semaphore = imageAvailableSemaphores[currentFrame];
+	waits[0].stageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+	waits[1] = uploadWait;
+	uint32_t waitCount = (uploadWait.semaphore != VK_NULL_HANDLE) ? 2 : 1;
+
+	VkSemaphoreSubmitInfo signal{};
+	signal.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+	signal.semaphore = renderFinishedSemaphores[currentFrame];
+	signal.stageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+
+	VkCommandBufferSubmitInfo commandInfo{};
+	commandInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+	commandInfo.commandBuffer = commandBuffer;
+
+	VkSubmitInfo2 submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+	submitInfo.waitSemaphoreInfoCount = waitCount;
+	submitInfo.pWaitSemaphoreInfos = waits.data();
+	submitInfo.commandBufferInfoCount = 1;
+	submitInfo.pCommandBufferInfos = &commandInfo;
+	submitInfo.signalSemaphoreInfoCount = 1;
+	submitInfo.pSignalSemaphoreInfos = &signal;
+	std::unique_lock<std::mutex> queueLock(queueMutex);
+	VK_CHECK(vkQueueSubmit2(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]), "Failed to submit a frame");
+
+	VkPresentInfoKHR presentInfo{};
+	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+	presentInfo.waitSemaphoreCount = 1;
+	presentInfo.pWaitSemaphores = &renderFinishedSemaphores[currentFrame];
+	presentInfo.swapchainCount = 1;
+	presentInfo.pSwapchains = &swapChain;
+	presentInfo.pImageIndices = &imageIndex;
+	VkResult presentResult = vkQueuePresentKHR(presentQueue, &presentInfo);
+	queueLock.unlock();
+	currentFrame = (currentFrame + 1) % kConcurrentFrames;
+	if (presentResult == VK_ERROR_OUT_OF_DATE_KHR || presentResult == VK_SUBOPTIMAL_KHR)
+		recreateSwapChain();
+	else if (presentResult != VK_SUCCESS)
+		throw std::runtime_error("Failed to present a swap chain image");
+}
+
 void VulkanBackend::cleanup()
 {
+	commandRecorder.cleanup();
+	frameDescriptors.cleanup();
+	uniformRing.cleanup();
+	bindlessTable.cleanup();
+	pipelineCache.cleanup();
+	geometryBuffers.cleanup();
+	uploadManager.cleanup();
 	DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
 	vkDestroyInstance(instance, nullptr);
 	if (window != nullptr)
@@ -763,6 +1136,7 @@ void VulkanBackend::initialize(const GraphicsSettings& graphicsSettings)
 	{
 		throw std::runtime_error("Graphics already initialized");
 	}
+	backendFlags = graphicsSettings.backendFlags;
 
 	if (graphicsSettings.windowCapability)
 	{
@@ -807,15 +1181,29 @@ void VulkanBackend::initialize(const GraphicsSettings& graphicsSettings)
 	createPhysicalDevice();
 	createLogicalDevice();
 	createAllocator();
+	createUploadManager();
+	createGeometryBuffers(graphicsSettings.geometryVertexCapacity, graphicsSettings.geometryIndexCapacity);
+	createPipelineCache(graphicsSettings.pipelineCachePath);
+	createBindlessTable();
+	createUniformRing();
 	createSwapChain();
 	createDepthResources();
 	createImageViews();
-	createRenderPass();
+	// dynamic rendering binds the attachments per pass, so there is no render pass or framebuffer to create
+	if (!hasFlag(backendFlags, VulkanBackendFlags::DYNAMIC_RENDERING))
+	{
+		createRenderPass();
+		createFramebuffers();
+	}
 	createGraphicsPipeline();
-	createFramebuffers();
-	createCommandPool();
-	createCommandBuffers();
+	createCommandRecorder();
 	createSynchronization();
 
+	inheritanceRenderingInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+	inheritanceRenderingInfo.colorAttachmentCount = 1;
+	inheritanceRenderingInfo.pColorAttachmentFormats = &swapChainImageFormat;
+	inheritanceRenderingInfo.depthAttachmentFormat = depthFormat;
+	inheritanceRenderingInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
 	// initializeGuiCapabilities();
 }
\ No newline at end of file
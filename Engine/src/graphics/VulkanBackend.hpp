@@ -1,6 +1,16 @@
 #pragma once
 
+#include "BindlessDescriptorTable.hpp"
+#include "CommandRecorder.hpp"
+#include "DescriptorBuilder.hpp"
 #include "GraphicsResources.hpp"
+#include "PipelineCache.hpp"
+#include "PipelineManager.hpp"
+#include "GeometryBuffers.hpp"
+#include "UniformRing.hpp"
+#include "UploadManager.hpp"
+#include <functional>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -13,21 +23,40 @@ constexpr uint32_t REQUIRED_VULKAN_VERSION = VK_API_VERSION_1_3;
 
 
 // decl
+enum class VulkanBackendFlags : uint16_t
+{
+	NONE,
+	DYNAMIC_RENDERING = 1 << 0, // use dynamic rendering instead of render passes
+	BINDLESS_DESCRIPTORS = 1 << 1, // bind every texture and storage buffer through one BindlessDescriptorTable
+};
+
+inline VulkanBackendFlags operator|(VulkanBackendFlags a, VulkanBackendFlags b)
+{
+	return static_cast<VulkanBackendFlags>(static_cast<uint16_t>(a) | static_cast<uint16_t>(b));
+}
+
+inline bool hasFlag(VulkanBackendFlags flags, VulkanBackendFlags flag)
+{
+	return (static_cast<uint16_t>(flags) & static_cast<uint16_t>(flag)) != 0;
+}
+
+inline VulkanBackendFlags clearFlag(VulkanBackendFlags flags, VulkanBackendFlags flag)
+{
+	return static_cast<VulkanBackendFlags>(static_cast<uint16_t>(flags) & ~static_cast<uint16_t>(flag));
+}
+
 struct GraphicsSettings
 {
 	std::string windowTitle = "Rehti engine";
 	uint32_t concurrentFrames = 2;
 	bool windowCapability = true; // whether graphical output is desired
 	bool dynamicVertexInput = false; // Used when the vertex input should be dynamic and specified at draw time
+	std::string pipelineCachePath = "pipeline_cache.bin"; // compiled pipelines are kept here between runs
+	uint32_t geometryVertexCapacity = DEFAULT_GEOMETRY_VERTEX_CAPACITY; // vertices of each vertex layout's buffer
+	uint32_t geometryIndexCapacity = DEFAULT_GEOMETRY_INDEX_CAPACITY; // indices shared by all vertex layouts
+	VulkanBackendFlags backendFlags = VulkanBackendFlags::NONE;
 };
 
-enum class VulkanBackendFlags : uint16_t
-{
-	NONE,
-	DYNAMIC_RENDERING = 1 << 0, // use dynamic rendering instead of render passes
-};
-
-
 class VulkanBackend
 {
 public:
@@ -49,27 +78,39 @@ private:
 	VkDebugUtilsMessengerEXT debugMessenger = VK_NULL_HANDLE;
 	VkQueue graphicsQueue = VK_NULL_HANDLE;
 	VkQueue presentQueue = VK_NULL_HANDLE;
+	VkQueue transferQueue = VK_NULL_HANDLE;
+	std::mutex queueMutex; // guards the graphics and present queues, which the uploads share when there is no dedicated transfer family
 	VkSwapchainKHR swapChain = VK_NULL_HANDLE;
 	std::vector<VkImage> swapChainImages = std::vector<VkImage>();
 	std::vector<VkImageView> swapChainImageViews = std::vector<VkImageView>();
 	std::vector<VkFramebuffer> frameBuffers = std::vector<VkFramebuffer>();
-	std::vector<VkCommandBuffer> commandBuffers = std::vector<VkCommandBuffer>();
 	std::vector<const char*> instanceExtensions = std::vector<const char*>();
 	std::vector<const char*> deviceExtensions = std::vector<const char*>();
 	VkFormat swapChainImageFormat;
 	VkExtent2D swapChainExtent;
-	VkRenderPass renderPass = VK_NULL_HANDLE;
+	bool swapChainOutdated = false; // the swap chain needs rebuilding but the window had no pixels, e.g. while minimized
+	VkRenderPass renderPass = VK_NULL_HANDLE; // not created with dynamic rendering
 	VkFormat depthFormat;
 	Image depthImage;
-	VkCommandPool commandPool = VK_NULL_HANDLE;
+	VulkanBackendFlags backendFlags = VulkanBackendFlags::NONE;
+	bool pipelineCacheControl = false; // whether pipelineCreationCacheControl is enabled on the device
+	VkCommandBufferInheritanceRenderingInfo inheritanceRenderingInfo{}; // attachment formats for secondaries with dynamic rendering
 
 	std::vector<VkSemaphore> imageAvailableSemaphores;
 	std::vector<VkSemaphore> renderFinishedSemaphores;
 	std::vector<VkFence> inFlightFences;
+	uint32_t currentFrame = 0; // index of the concurrent frame recorded next
 
 	// PipelineManager pipelineManager;
 
 	VmaAllocator gpuAllocator;
+	UploadManager uploadManager;
+	GeometryBuffers geometryBuffers;
+	CommandRecorder commandRecorder;
+	FrameDescriptorAllocator frameDescriptors;
+	FrameUniformRing uniformRing; // per frame constants, bound with dynamic offsets
+	PipelineCache pipelineCache;
+	BindlessDescriptorTable bindlessTable; // bindless mode only
 
 	// private functions
 	void createInstance();
@@ -79,16 +120,65 @@ private:
 	void createPhysicalDevice();
 	void createLogicalDevice();
 	void createAllocator();
+	void createUploadManager();
+	void createGeometryBuffers(uint32_t vertexCapacity, uint32_t indexCapacity);
+	void createPipelineCache(const std::string& path);
+	void createBindlessTable();
+	void createUniformRing();
 	void createSwapChain();
+	/**
+	 * @brief Rebuilds the swap chain and the attachments that depend on its size, e.g. after the window was resized.
+	 * While the window has no pixels the rebuild is put off and swapChainOutdated is set.
+	 */
+	void recreateSwapChain();
+	/**
+	 * @brief Returns whether the window and the surface have a non zero size, which a swap chain needs.
+	 */
+	bool hasDrawableExtent() const;
+	void destroySwapChainResources();
 	void createImageViews();
 	void createDepthResources();
 	void createRenderPass();
 	void createGraphicsPipeline();
 	void createFramebuffers();
-	void createCommandPool();
-	void createCommandBuffers();
+	void createCommandRecorder();
 	void createSynchronization();
 
+	/**
+	 * @brief Returns what pipelines drawing to the swap chain render to: the render pass, or the attachment formats with dynamic rendering.
+	 */
+	PipelineRenderTarget getRenderTarget() const;
+
+	/**
+	 * @brief Returns the inheritance of secondary command buffers drawing between beginRendering and endRendering.
+	 * With dynamic rendering its pNext points to formats owned by the backend.
+	 * @param imageIndex of the swap chain image rendered to.
+	 */
+	VkCommandBufferInheritanceInfo getInheritanceInfo(uint32_t imageIndex) const;
+
+	/**
+	 * @brief Starts drawing to a swap chain image and clears it and the depth buffer.
+	 * With dynamic rendering the attachments are transitioned and bound here, otherwise the render pass is begun on the framebuffer of the image.
+	 * @param commandBuffer to record into.
+	 * @param imageIndex of the acquired swap chain image.
+	 * @param contents is VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS when the draws come from CommandRecorder::recordDrawList.
+	 */
+	void beginRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex, VkSubpassContents contents);
+
+	/**
+	 * @brief Ends drawing to the swap chain image and leaves it ready to present.
+	 */
+	void endRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+
+	/**
+	 * @brief Records, submits and presents one frame.
+	 * Begins the per frame resources, flushes the queued uploads and acquires the finished ones before any draw, so meshes
+	 * uploaded in earlier frames become ready. The submission waits on the acquired uploads as UploadManager requires.
+	 * @param recordDraws records the draws between beginRendering and endRendering, through CommandRecorder::recordDrawList
+	 * with getInheritanceInfo(imageIndex). May be empty.
+	 */
+	void drawFrame(const std::function<void(uint32_t imageIndex)>& recordDraws = nullptr);
+
 	void initialize(const GraphicsSettings& graphicsSettings);
 	void cleanup();
 };
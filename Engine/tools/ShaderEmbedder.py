@@ -1,30 +1,269 @@
 import os
+import re
+import struct
+import subprocess
 import sys
+import tempfile
 
-def embedShaders(shaderDir, outputFile):
-    supportedFileExtensions = [".vert", ".frag", ".comp", ".geom", ".tesc", ".tese", ".spv"]
-    compiledShaders = {}
+# Compiles every shader to SPIR-V with glslc and writes the code and its reflection into a header of constexpr tables,
+# so the engine neither compiles nor reflects GLSL at startup.
+#
+# A shader that is built for several vertex layouts lists them on a line of its own, e.g.
+#   // permutations: POSITION|NORMAL, POSITION|NORMAL|TEXCOORD
+# using the names of VertexAttributeEnum. Each permutation is compiled with HAS_<NAME> defined for its attributes.
+
+SUPPORTED_EXTENSIONS = [".vert", ".frag", ".comp", ".geom", ".tesc", ".tese"]
+VERTEX_ATTRIBUTES = ["POSITION", "NORMAL", "COLOR", "TEXCOORD", "TANGENT", "BITANGENT", "JOINTS", "WEIGHTS"]
+
+# SPIR-V opcodes, decorations and storage classes used by the reflection
+OP_ENTRY_POINT = 15
+OP_TYPE_BOOL, OP_TYPE_INT, OP_TYPE_FLOAT, OP_TYPE_VECTOR, OP_TYPE_MATRIX = 20, 21, 22, 23, 24
+OP_TYPE_IMAGE, OP_TYPE_SAMPLER, OP_TYPE_SAMPLED_IMAGE, OP_TYPE_ARRAY, OP_TYPE_RUNTIME_ARRAY, OP_TYPE_STRUCT = 25, 26, 27, 28, 29, 30
+OP_TYPE_POINTER, OP_CONSTANT, OP_VARIABLE, OP_DECORATE, OP_MEMBER_DECORATE = 32, 43, 59, 71, 72
+DECORATION_BLOCK, DECORATION_BUFFER_BLOCK, DECORATION_ARRAY_STRIDE, DECORATION_MATRIX_STRIDE = 2, 3, 6, 7
+DECORATION_BUILT_IN, DECORATION_LOCATION, DECORATION_BINDING, DECORATION_DESCRIPTOR_SET, DECORATION_OFFSET = 11, 30, 33, 34, 35
+STORAGE_UNIFORM_CONSTANT, STORAGE_INPUT, STORAGE_UNIFORM, STORAGE_OUTPUT, STORAGE_PUSH_CONSTANT, STORAGE_STORAGE_BUFFER = 0, 1, 2, 3, 9, 12
+DIM_BUFFER, DIM_SUBPASS_DATA = 5, 6
+
+STAGES = {
+    0: "VK_SHADER_STAGE_VERTEX_BIT",
+    1: "VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT",
+    2: "VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT",
+    3: "VK_SHADER_STAGE_GEOMETRY_BIT",
+    4: "VK_SHADER_STAGE_FRAGMENT_BIT",
+    5: "VK_SHADER_STAGE_COMPUTE_BIT",
+}
+FORMAT_SUFFIXES = {"float": "SFLOAT", "int": "SINT", "uint": "UINT"}
+
+
+class SpirvModule:
+    """Reflection of the interface of a SPIR-V module, matching what ShaderTools gets from SPIRV-Reflect."""
+
+    def __init__(self, code):
+        words = struct.unpack("<%dI" % (len(code) // 4), code)
+        if words[0] != 0x07230203:
+            raise ValueError("not a SPIR-V module")
+        self.words = words
+        self.types = {}
+        self.constants = {}
+        self.variables = []
+        self.decorations = {}
+        self.memberDecorations = {}
+        self.stage = None
+        i = 5
+        while i < len(words):
+            count = words[i] >> 16
+            opcode = words[i] & 0xffff
+            operands = words[i + 1:i + count]
+            self.parseInstruction(opcode, operands)
+            i += count
+
+    def parseInstruction(self, opcode, operands):
+        if opcode == OP_ENTRY_POINT and self.stage is None:
+            self.stage = operands[0]
+        elif opcode in (OP_TYPE_BOOL, OP_TYPE_INT, OP_TYPE_FLOAT, OP_TYPE_VECTOR, OP_TYPE_MATRIX, OP_TYPE_IMAGE, OP_TYPE_SAMPLER,
+                        OP_TYPE_SAMPLED_IMAGE, OP_TYPE_ARRAY, OP_TYPE_RUNTIME_ARRAY, OP_TYPE_STRUCT, OP_TYPE_POINTER):
+            self.types[operands[0]] = (opcode, operands[1:])
+        elif opcode == OP_CONSTANT:
+            self.constants[operands[1]] = operands[2]
+        elif opcode == OP_VARIABLE:
+            self.variables.append((operands[1], operands[0], operands[2]))
+        elif opcode == OP_DECORATE:
+            self.decorations.setdefault(operands[0], {})[operands[1]] = operands[2:]
+        elif opcode == OP_MEMBER_DECORATE:
+            self.memberDecorations.setdefault((operands[0], operands[1]), {})[operands[2]] = operands[3:]
+
+    def getDecoration(self, target, decoration):
+        values = self.decorations.get(target, {}).get(decoration)
+        return None if values is None else (values[0] if values else True)
+
+    def isBuiltIn(self, typeId, variableId):
+        if self.getDecoration(variableId, DECORATION_BUILT_IN) is not None:
+            return True
+        opcode, operands = self.types[typeId]
+        while opcode == OP_TYPE_ARRAY: # gl_in of tessellation and geometry shaders
+            typeId = operands[0]
+            opcode, operands = self.types[typeId]
+        # gl_PerVertex is a block whose members are built-ins
+        return opcode == OP_TYPE_STRUCT and any(DECORATION_BUILT_IN in self.memberDecorations.get((typeId, m), {}) for m in range(len(operands)))
+
+    def getSize(self, typeId):
+        opcode, operands = self.types[typeId]
+        if opcode in (OP_TYPE_INT, OP_TYPE_FLOAT):
+            return operands[0] // 8
+        if opcode == OP_TYPE_BOOL:
+            return 4
+        if opcode == OP_TYPE_VECTOR:
+            return self.getSize(operands[0]) * operands[1]
+        if opcode == OP_TYPE_MATRIX:
+            return self.getSize(operands[0]) * operands[1]
+        if opcode == OP_TYPE_ARRAY:
+            stride = self.getDecoration(typeId, DECORATION_ARRAY_STRIDE) or self.getSize(operands[0])
+            return stride * self.constants[operands[1]]
+        if opcode == OP_TYPE_RUNTIME_ARRAY:
+            return 0
+        if opcode == OP_TYPE_STRUCT:
+            return max((self.getMemberOffset(typeId, m) + self.getMemberSize(typeId, m, member) for m, member in enumerate(operands)), default=0)
+        raise ValueError("unsized type %d" % opcode)
+
+    def getMemberOffset(self, structId, member):
+        return self.memberDecorations.get((structId, member), {}).get(DECORATION_OFFSET, [0])[0]
+
+    def getMemberSize(self, structId, member, memberType):
+        # matrices in blocks take their column stride, not their packed size
+        opcode, operands = self.types[memberType]
+        matrixStride = self.memberDecorations.get((structId, member), {}).get(DECORATION_MATRIX_STRIDE)
+        if opcode == OP_TYPE_MATRIX and matrixStride:
+            return matrixStride[0] * operands[1]
+        return self.getSize(memberType)
+
+    def getFormat(self, typeId):
+        opcode, operands = self.types[typeId]
+        componentCount = 1
+        if opcode == OP_TYPE_VECTOR:
+            componentCount = operands[1]
+            opcode, operands = self.types[operands[0]]
+        if opcode == OP_TYPE_FLOAT:
+            kind = "float"
+        elif opcode == OP_TYPE_INT:
+            kind = "int" if operands[1] else "uint"
+        else:
+            return "VK_FORMAT_UNDEFINED"
+        width = operands[0]
+        components = "".join("%s%d" % (c, width) for c in "RGBA"[:componentCount])
+        return "VK_FORMAT_%s_%s" % (components, FORMAT_SUFFIXES[kind])
+
+    def getDescriptorType(self, storageClass, typeId):
+        opcode, operands = self.types[typeId]
+        if storageClass == STORAGE_STORAGE_BUFFER:
+            return "VK_DESCRIPTOR_TYPE_STORAGE_BUFFER"
+        if storageClass == STORAGE_UNIFORM:
+            if self.getDecoration(typeId, DECORATION_BUFFER_BLOCK) is not None:
+                return "VK_DESCRIPTOR_TYPE_STORAGE_BUFFER"
+            return "VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER"
+        if opcode == OP_TYPE_SAMPLER:
+            return "VK_DESCRIPTOR_TYPE_SAMPLER"
+        if opcode == OP_TYPE_SAMPLED_IMAGE:
+            imageOperands = self.types[operands[0]][1]
+            return "VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER" if imageOperands[1] == DIM_BUFFER else "VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER"
+        if opcode == OP_TYPE_IMAGE:
+            dim, sampled = operands[1], operands[5]
+            if dim == DIM_SUBPASS_DATA:
+                return "VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT"
+            if dim == DIM_BUFFER:
+                return "VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER" if sampled == 1 else "VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER"
+            return "VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE" if sampled == 1 else "VK_DESCRIPTOR_TYPE_STORAGE_IMAGE"
+        raise ValueError("unknown descriptor type %d" % opcode)
+
+    def reflect(self):
+        bindings = []
+        pushConstants = []
+        inputs = []
+        outputs = []
+        for variableId, pointerId, storageClass in self.variables:
+            typeId = self.types[pointerId][1][1]
+            if storageClass in (STORAGE_INPUT, STORAGE_OUTPUT):
+                if self.isBuiltIn(typeId, variableId):
+                    continue
+                location = self.getDecoration(variableId, DECORATION_LOCATION)
+                (inputs if storageClass == STORAGE_INPUT else outputs).append((location, self.getFormat(typeId)))
+            elif storageClass == STORAGE_PUSH_CONSTANT:
+                members = self.types[typeId][1]
+                offset = min((self.getMemberOffset(typeId, m) for m in range(len(members))), default=0)
+                pushConstants.append((offset, self.getSize(typeId) - offset))
+            elif storageClass in (STORAGE_UNIFORM_CONSTANT, STORAGE_UNIFORM, STORAGE_STORAGE_BUFFER):
+                count = 1
+                opcode, operands = self.types[typeId]
+                if opcode == OP_TYPE_ARRAY:
+                    count = self.constants[operands[1]]
+                    typeId = operands[0]
+                elif opcode == OP_TYPE_RUNTIME_ARRAY:
+                    typeId = operands[0]
+                descriptorType = self.getDescriptorType(storageClass, typeId)
+                binding = self.getDecoration(variableId, DECORATION_BINDING) or 0
+                descriptorSet = self.getDecoration(variableId, DECORATION_DESCRIPTOR_SET) or 0
+                bindings.append((descriptorSet, binding, descriptorType, count))
+        return sorted(bindings), pushConstants, sorted(inputs), sorted(outputs)
+
+
+def findPermutations(source):
+    match = re.search(r"^\s*//\s*permutations:(.*)$", source, re.MULTILINE)
+    if match is None:
+        return [[]]
+    return [[name.strip() for name in permutation.split("|") if name.strip()] for permutation in match.group(1).split(",")]
+
+
+def compileShader(glslc, path, defines):
+    with tempfile.TemporaryDirectory() as directory:
+        output = os.path.join(directory, "shader.spv")
+        command = [glslc, "--target-env=vulkan1.3", "-O", "-I", os.path.dirname(path), "-o", output, path]
+        command[1:1] = ["-D%s=1" % define for define in defines]
+        result = subprocess.run(command, capture_output=True, text=True)
+        if result.returncode != 0:
+            raise RuntimeError("Failed to compile %s:\n%s" % (path, result.stderr))
+        with open(output, "rb") as f:
+            return f.read()
+
+
+def writeArray(f, declaration, rows):
+    if not rows:
+        return False
+    f.write("inline constexpr %s[] = {\n" % declaration)
+    for row in rows:
+        f.write("\t%s,\n" % row)
+    f.write("};\n")
+    return True
+
+
+def embedShaders(glslc, shaderDir, outputFile):
+    variants = []
     for root, _, files in os.walk(shaderDir): # Walk through all files in the directory
-        for file in files:
-            if os.path.splitext(file)[1] in supportedFileExtensions: # Check if file is a shader file
-                with open(os.path.join(root, file), "r") as f:
-                    compiledShaders[os.path.basename(file)] = f.read() # read content of the file and store it in the dictionary
-    
-    with open(outputFile, 'w+') as f:
+        for file in sorted(files):
+            if os.path.splitext(file)[1] not in SUPPORTED_EXTENSIONS: # Check if file is a shader file
+                continue
+            path = os.path.join(root, file)
+            with open(path, "r") as f:
+                source = f.read()
+            for permutation in findPermutations(source):
+                for attribute in permutation:
+                    if attribute not in VERTEX_ATTRIBUTES:
+                        raise ValueError("Unknown vertex attribute %s in %s" % (attribute, file))
+                module = SpirvModule(compileShader(glslc, path, ["HAS_" + attribute for attribute in permutation]))
+                if module.stage not in STAGES:
+                    raise ValueError("Unsupported shader stage in %s" % file)
+                flags = sum(1 << VERTEX_ATTRIBUTES.index(attribute) for attribute in permutation)
+                variants.append((file, flags, module))
+
+    os.makedirs(os.path.dirname(os.path.abspath(outputFile)), exist_ok=True)
+    with open(outputFile, "w+") as f:
+        f.write("// Generated by ShaderEmbedder.py from the shaders in resources/shaders. Do not edit.\n")
         f.write("#pragma once\n")
-        f.write("#include <unordered_map>\n")
-        f.write("#include <string>\n")
+        f.write("#include \"EmbeddedShader.hpp\"\n")
         f.write("namespace ShaderEmbedder {\n")
-        f.write("std::unordered_map<std::string, std::string> shaders = {\n")
-        for shaderName, shaderContent in compiledShaders.items():
-            f.write("\t{\"" + shaderName + "\", R\"(" + shaderContent + ")\"},\n")
-        f.write("};\n")
+        entries = []
+        for file, flags, module in variants:
+            name = "%s_%d" % (re.sub(r"\W", "_", file), flags)
+            bindings, pushConstants, inputs, outputs = module.reflect()
+            words = module.words
+            codeRows = [", ".join("0x%08x" % word for word in words[i:i + 8]) for i in range(0, len(words), 8)]
+            writeArray(f, "uint32_t %s_code" % name, codeRows)
+            hasBindings = writeArray(f, "ShaderBindingReflection %s_bindings" % name, ["{ %d, %d, %s, %d }" % binding for binding in bindings])
+            hasPushConstants = writeArray(f, "VkPushConstantRange %s_pushConstants" % name,
+                ["{ %s, %d, %d }" % (STAGES[module.stage], offset, size) for offset, size in pushConstants])
+            hasInputs = writeArray(f, "ShaderInterfaceReflection %s_inputs" % name, ["{ %d, %s }" % variable for variable in inputs])
+            hasOutputs = writeArray(f, "ShaderInterfaceReflection %s_outputs" % name, ["{ %d, %s }" % variable for variable in outputs])
+            table = lambda present, suffix, count: ("%s_%s, %d" % (name, suffix, count)) if present else "nullptr, 0"
+            entries.append("{ \"%s\", static_cast<VertexAttributeFlags>(%d), %s, %s_code, %d, %s, %s, %s, %s }" % (
+                file, flags, STAGES[module.stage], name, len(words),
+                table(hasBindings, "bindings", len(bindings)), table(hasPushConstants, "pushConstants", len(pushConstants)),
+                table(hasInputs, "inputs", len(inputs)), table(hasOutputs, "outputs", len(outputs))))
+        writeArray(f, "EmbeddedShader shaders", entries)
         f.write("}\n")
 
 
 
 if __name__ == "__main__":
-    if len(sys.argv) != 3:
-        print("Usage: ShaderEmbedder.py <shaderDir> <outputFile>")
+    if len(sys.argv) != 4:
+        print("Usage: ShaderEmbedder.py <glslc> <shaderDir> <outputFile>")
     else:
-        embedShaders(sys.argv[1], sys.argv[2])
\ No newline at end of file
+        embedShaders(sys.argv[1], sys.argv[2], sys.argv[3])
@@ -0,0 +1,341 @@
+#include <AttributeArray.hpp>
+#include <BasicAttributes.hpp>
+#include <CpuFeatures.hpp>
+#include <DynamicBvh.hpp>
+#include <FrustumCulling.hpp>
+#include <RadixSort.hpp>
+#include <TriangleBvh.hpp>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <vector>
+
+/*
+* Microbenchmarks for the hot math of the engine. Run the release build, e.g. `benchmarks`.
+* Each case reports the best of several runs to filter out scheduling noise.
+*/
+
+constexpr int BENCHMARK_RUNS = 7;
+
+/**
+ * @brief Runs the work a few times and prints the best throughput.
+ * @param name of the case.
+ * @param itemCount is the number of items processed by a single run.
+ * @param work to measure.
+ */
+void runBenchmark(const char* name, size_t itemCount, const std::function<void()>& work)
+{
+	work(); // warm up caches
+	double bestSeconds = 1e30;
+	for (int run = 0; run < BENCHMARK_RUNS; run++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		work();
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		bestSeconds = std::min(bestSeconds, elapsed.count());
+	}
+	std::printf("%-44s %10.2f Mitems/s %10.3f ms\n", name, itemCount / bestSeconds / 1e6, bestSeconds * 1e3);
+}
+
+std::vector<Pose> randomPoses(size_t count, uint32_t seed)
+{
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> distribution(-1.f, 1.f);
+	std::vector<Pose> poses(count);
+	for (Pose& pose : poses)
+	{
+		pose.position = glm::vec3(distribution(rng), distribution(rng), distribution(rng));
+		pose.orientation = glm::normalize(glm::quat(distribution(rng), distribution(rng), distribution(rng), distribution(rng)));
+		pose.scale = glm::vec3(1.f) + glm::vec3(distribution(rng)) * 0.1f;
+	}
+	return poses;
+}
+
+/**
+ * @brief Returns poses whose orientations are close to the given ones, as consecutive animation keys usually are.
+ */
+std::vector<Pose> perturbPoses(const std::vector<Pose>& poses, uint32_t seed)
+{
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> distribution(-0.1f, 0.1f);
+	std::vector<Pose> perturbed = poses;
+	for (Pose& pose : perturbed)
+	{
+		glm::quat delta = glm::normalize(glm::quat(1.f, distribution(rng), distribution(rng), distribution(rng)));
+		pose.orientation = glm::normalize(delta * pose.orientation.value);
+		pose.position = pose.position.value + glm::vec3(distribution(rng));
+	}
+	return perturbed;
+}
+
+void benchmarkPoseKernels()
+{
+	constexpr size_t POSE_COUNT = 1 << 16;
+	std::vector<Pose> first = randomPoses(POSE_COUNT, 1);
+	std::vector<Pose> second = perturbPoses(first, 2);
+	std::vector<Pose> interpolated(POSE_COUNT);
+	std::vector<glm::mat4> matrices(POSE_COUNT);
+	std::vector<AffineTransform> transforms(POSE_COUNT);
+
+	runBenchmark("Pose::getTransformationMatrix (loop)", POSE_COUNT, [&]() {
+		for (size_t i = 0; i < POSE_COUNT; i++)
+			matrices[i] = first[i].getTransformationMatrix();
+	});
+	runBenchmark("glm translate * rotate * scale (old)", POSE_COUNT, [&]() {
+		for (size_t i = 0; i < POSE_COUNT; i++)
+		{
+			glm::mat4 scaling = glm::scale(glm::mat4(1.f), first[i].scale.value);
+			glm::mat4 translation = glm::translate(glm::mat4(1.f), first[i].position.value);
+			matrices[i] = translation * first[i].orientation.toMat4() * scaling;
+		}
+	});
+	runBenchmark("Pose::interpolate (slerp loop)", POSE_COUNT, [&]() {
+		for (size_t i = 0; i < POSE_COUNT; i++)
+			interpolated[i] = Pose::interpolate(first[i], second[i], 0.37f);
+	});
+
+	SimdLevel detected = getSimdLevel();
+	for (SimdLevel level : { SimdLevel::SCALAR, SimdLevel::SSE2, SimdLevel::AVX2 })
+	{
+		if (detected < level)
+			break;
+		limitSimdLevel(level);
+		char name[64];
+		std::snprintf(name, sizeof(name), "Pose::composeAffineTransforms (%s)", getSimdLevelName(level));
+		runBenchmark(name, POSE_COUNT, [&]() {
+			Pose::composeAffineTransforms(first.data(), POSE_COUNT, transforms.data());
+		});
+		std::snprintf(name, sizeof(name), "Pose::interpolatePoses (%s)", getSimdLevelName(level));
+		runBenchmark(name, POSE_COUNT, [&]() {
+			Pose::interpolatePoses(first.data(), second.data(), 0.37f, POSE_COUNT, interpolated.data());
+		});
+	}
+	limitSimdLevel(detected);
+}
+
+void benchmarkAttributeArrays()
+{
+	constexpr size_t ENTITY_COUNT = 100000;
+	constexpr float DELTA_TIME = 1.f / 60.f;
+	std::vector<Position> positionList(ENTITY_COUNT, Position(glm::vec3(0.f)));
+	std::vector<Velocity> velocityList(ENTITY_COUNT, Velocity(glm::vec3(1.f, 0.5f, -1.f)));
+	PositionArray positions(ENTITY_COUNT);
+	VelocityArray velocities(ENTITY_COUNT);
+	for (size_t i = 0; i < ENTITY_COUNT; i++)
+		velocities.set(i, velocityList[i]);
+
+	runBenchmark("Position += Velocity * dt (operator loop)", ENTITY_COUNT, [&]() {
+		for (size_t i = 0; i < ENTITY_COUNT; i++)
+			positionList[i] += velocityList[i].value * DELTA_TIME;
+	});
+
+	SimdLevel detected = getSimdLevel();
+	for (SimdLevel level : { SimdLevel::SCALAR, SimdLevel::SSE2, SimdLevel::AVX2 })
+	{
+		if (detected < level)
+			break;
+		limitSimdLevel(level);
+		char name[64];
+		std::snprintf(name, sizeof(name), "PositionArray::addScaled (%s)", getSimdLevelName(level));
+		runBenchmark(name, ENTITY_COUNT, [&]() {
+			positions.addScaled(velocities, DELTA_TIME);
+		});
+	}
+	limitSimdLevel(detected);
+}
+
+void benchmarkFrustumCulling()
+{
+	constexpr size_t OBJECT_COUNT = 1000000;
+	glm::mat4 projection = glm::perspective(glm::quarter_pi<float>(), 16.f / 9.f, 0.1f, 500.f);
+	projection[1][1] *= -1;
+	Frustum frustum = Frustum::fromViewProjection(projection * glm::lookAt(glm::vec3(0.f, 20.f, -100.f), glm::vec3(0.f), glm::vec3(0.f, 1.f, 0.f)));
+
+	std::mt19937 rng(11);
+	std::uniform_real_distribution<float> position(-1000.f, 1000.f);
+	std::uniform_real_distribution<float> size(0.5f, 5.f);
+	BoundingSphereArray spheres;
+	BoundingBoxArray boxes;
+	spheres.reserve(OBJECT_COUNT);
+	boxes.reserve(OBJECT_COUNT);
+	for (size_t i = 0; i < OBJECT_COUNT; i++)
+	{
+		glm::vec3 center(position(rng), position(rng) * 0.05f, position(rng));
+		spheres.push_back(BoundingSphere(glm::vec4(center, size(rng))));
+		boxes.push_back(BoundingBox(BoxBounds{ center, glm::vec3(size(rng)) }));
+	}
+	std::vector<uint32_t> visible(OBJECT_COUNT);
+	size_t visibleCount = 0;
+
+	runBenchmark("Frustum::containsSphere (loop)", OBJECT_COUNT, [&]() {
+		visibleCount = 0;
+		for (size_t i = 0; i < OBJECT_COUNT; i++)
+		{
+			glm::vec4 sphere = spheres.get(i).value;
+			if (frustum.containsSphere(glm::vec3(sphere), sphere.w))
+				visible[visibleCount++] = static_cast<uint32_t>(i);
+		}
+	});
+
+	SimdLevel detected = getSimdLevel();
+	for (SimdLevel level : { SimdLevel::SCALAR, SimdLevel::SSE2, SimdLevel::AVX2 })
+	{
+		if (detected < level)
+			break;
+		limitSimdLevel(level);
+		char name[64];
+		std::snprintf(name, sizeof(name), "cullSpheres (%s)", getSimdLevelName(level));
+		runBenchmark(name, OBJECT_COUNT, [&]() {
+			visibleCount = cullSpheres(frustum, spheres, visible.data());
+		});
+		std::snprintf(name, sizeof(name), "cullBoxes (%s)", getSimdLevelName(level));
+		runBenchmark(name, OBJECT_COUNT, [&]() {
+			visibleCount = cullBoxes(frustum, boxes, visible.data());
+		});
+	}
+	limitSimdLevel(detected);
+}
+
+void benchmarkDynamicBvh()
+{
+	constexpr size_t ENTITY_COUNT = 100000;
+	constexpr size_t MOVING_COUNT = ENTITY_COUNT / 10;
+	std::mt19937 rng(13);
+	std::uniform_real_distribution<float> position(-1000.f, 1000.f);
+	std::uniform_real_distribution<float> step(-0.5f, 0.5f);
+	std::vector<Aabb> boxes(ENTITY_COUNT);
+	std::vector<int32_t> proxies(ENTITY_COUNT);
+	DynamicBvh bvh;
+	for (size_t i = 0; i < ENTITY_COUNT; i++)
+	{
+		glm::vec3 center(position(rng), position(rng) * 0.05f, position(rng));
+		boxes[i] = { center - glm::vec3(1.f), center + glm::vec3(1.f) };
+		proxies[i] = bvh.insert(boxes[i], i);
+	}
+	bvh.rebuild();
+
+	runBenchmark("DynamicBvh::rebuild", ENTITY_COUNT, [&]() {
+		bvh.rebuild();
+	});
+
+	size_t frame = 0;
+	runBenchmark("DynamicBvh move 10% + update", MOVING_COUNT, [&]() {
+		for (size_t i = frame % 10; i < ENTITY_COUNT; i += 10)
+		{
+			glm::vec3 offset(step(rng), 0.f, step(rng));
+			boxes[i] = { boxes[i].min + offset, boxes[i].max + offset };
+			bvh.move(proxies[i], boxes[i]);
+		}
+		bvh.update();
+		frame++;
+	});
+
+	glm::mat4 projection = glm::perspective(glm::quarter_pi<float>(), 16.f / 9.f, 0.1f, 500.f);
+	projection[1][1] *= -1;
+	Frustum frustum = Frustum::fromViewProjection(projection * glm::lookAt(glm::vec3(0.f, 20.f, -100.f), glm::vec3(0.f), glm::vec3(0.f, 1.f, 0.f)));
+	std::vector<int32_t> found;
+	runBenchmark("DynamicBvh::queryFrustum", ENTITY_COUNT, [&]() {
+		found.clear();
+		bvh.queryFrustum(frustum, found);
+	});
+
+	constexpr size_t QUERY_COUNT = 1000;
+	runBenchmark("DynamicBvh::queryNearest (k = 8)", QUERY_COUNT, [&]() {
+		for (size_t q = 0; q < QUERY_COUNT; q++)
+			bvh.queryNearest(boxes[q * 97].getCenter(), 8, found);
+	});
+}
+
+void benchmarkRayPicking()
+{
+	// a terrain sized height field
+	constexpr uint32_t GRID = 512;
+	std::mt19937 rng(17);
+	std::uniform_real_distribution<float> height(-2.f, 2.f);
+	std::vector<glm::vec3> positions;
+	for (uint32_t z = 0; z <= GRID; z++)
+	{
+		for (uint32_t x = 0; x <= GRID; x++)
+			positions.push_back(glm::vec3(static_cast<float>(x), height(rng), static_cast<float>(z)));
+	}
+	std::vector<uint32_t> indices;
+	for (uint32_t z = 0; z < GRID; z++)
+	{
+		for (uint32_t x = 0; x < GRID; x++)
+		{
+			uint32_t corner = z * (GRID + 1) + x;
+			indices.insert(indices.end(), { corner, corner + 1, corner + GRID + 2, corner, corner + GRID + 2, corner + GRID + 1 });
+		}
+	}
+	TriangleBvh bvh;
+	runBenchmark("TriangleBvh::build", indices.size() / 3, [&]() {
+		bvh.build(positions.data(), indices.data(), indices.size());
+	});
+
+	constexpr size_t RAY_COUNT = 10000;
+	std::uniform_real_distribution<float> spread(0.f, static_cast<float>(GRID));
+	std::vector<Ray> rays;
+	for (size_t i = 0; i < RAY_COUNT; i++)
+	{
+		glm::vec3 origin(spread(rng), 50.f, spread(rng));
+		glm::vec3 target(spread(rng), 0.f, spread(rng));
+		rays.push_back({ origin, glm::normalize(target - origin) });
+	}
+	SimdLevel detected = getSimdLevel();
+	for (SimdLevel level : { SimdLevel::SCALAR, SimdLevel::SSE2, SimdLevel::AVX2 })
+	{
+		if (detected < level)
+			break;
+		limitSimdLevel(level);
+		char name[64];
+		std::snprintf(name, sizeof(name), "TriangleBvh::intersect (%s)", getSimdLevelName(level));
+		runBenchmark(name, RAY_COUNT, [&]() {
+			RayHit hit;
+			for (const Ray& ray : rays)
+				bvh.intersect(ray, INFINITY, hit);
+		});
+	}
+	limitSimdLevel(detected);
+}
+
+void benchmarkDrawKeySort()
+{
+	// draw keys of a busy frame: few passes and pipelines, many materials and meshes, random depth
+	constexpr size_t DRAW_COUNT = 1000000;
+	std::mt19937_64 rng(19);
+	std::vector<uint64_t> unsortedKeys(DRAW_COUNT);
+	for (uint64_t& key : unsortedKeys)
+		key = (rng() % 2) << 60 | (rng() % 32) << 48 | (rng() % 1024) << 32 | (rng() % 4096) << 16 | (rng() & 0xffff);
+	std::vector<uint64_t> keys(DRAW_COUNT);
+	std::vector<uint32_t> draws(DRAW_COUNT);
+	std::vector<uint64_t> keyScratch(DRAW_COUNT);
+	std::vector<uint32_t> drawScratch(DRAW_COUNT);
+
+	runBenchmark("std::sort (draw keys)", DRAW_COUNT, [&]() {
+		keys = unsortedKeys;
+		std::sort(keys.begin(), keys.end());
+	});
+	runBenchmark("radixSort (draw keys and indices)", DRAW_COUNT, [&]() {
+		keys = unsortedKeys;
+		for (uint32_t i = 0; i < DRAW_COUNT; i++)
+			draws[i] = i;
+		radixSort(keys.data(), draws.data(), keyScratch.data(), drawScratch.data(), DRAW_COUNT);
+	});
+}
+
+int main(int argc, char** argv)
+{
+	std::printf("Detected instruction set: %s\n", getSimdLevelName(getSimdLevel()));
+	benchmarkPoseKernels();
+	benchmarkAttributeArrays();
+	benchmarkFrustumCulling();
+	benchmarkDynamicBvh();
+	benchmarkRayPicking();
+	benchmarkDrawKeySort();
+	return 0;
+}
@@ -1,5 +1,63 @@
 #include <gtest/gtest.h>
 #include <Rehti.hpp>
+#include <AttributeArray.hpp>
+#include <BakedAnimation.hpp>
+#include <BindlessDescriptorTable.hpp>
+#include <BasicAttributes.hpp>
+#include <CpuFeatures.hpp>
+#include <DescriptorBuilder.hpp>
+#include <DrawList.hpp>
+#include <DynamicBvh.hpp>
+#include <EmbeddedShader.hpp>
+#include <FileWatcher.hpp>
+#include <FrustumCulling.hpp>
+#include <GraphicsAssetCache.hpp>
+#include <HandleCache.hpp>
+#include <JobSystem.hpp>
+#include <OffsetAllocator.hpp>
+#include <PickingService.hpp>
+#include <PipelineCache.hpp>
+#include <PipelineManager.hpp>
+#include <RadixSort.hpp>
+#include <ShaderCache.hpp>
+#include <TransformSystem.hpp>
+#include <TriangleBvh.hpp>
+#include <UniformRing.hpp>
+#include <AssetLoader.hpp>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Fills poses with random normalized orientations and non uniform scales.
+ */
+std::vector<Pose> randomPoses(size_t count, uint32_t seed)
+{
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> distribution(-1.f, 1.f);
+	std::vector<Pose> poses(count);
+	for (Pose& pose : poses)
+	{
+		pose.position = glm::vec3(distribution(rng), distribution(rng), distribution(rng)) * 10.f;
+		pose.orientation = glm::normalize(glm::quat(distribution(rng), distribution(rng), distribution(rng), distribution(rng)));
+		pose.scale = glm::vec3(1.5f) + glm::vec3(distribution(rng), distribution(rng), distribution(rng));
+	}
+	return poses;
+}
+
+void expectMatricesNear(const glm::mat4& expected, const glm::mat4& actual, float tolerance)
+{
+	for (int column = 0; column < 4; column++)
+		for (int row = 0; row < 4; row++)
+			EXPECT_NEAR(expected[column][row], actual[column][row], tolerance);
+}
 
 TEST(SampleTest, BasicAssertions) {
 	// Expect two strings to be equal.
@@ -13,6 +71,1211 @@ TEST(RehtiTest, Initialization) {
 	Rehti::cleanupRehti();
 }
 
+TEST(PoseKernelTest, ComposeMatchesMatrixProduct) {
+	// odd count exercises the scalar tail of the wide kernels
+	std::vector<Pose> poses = randomPoses(37, 1);
+	std::vector<AffineTransform> transforms(poses.size());
+	for (SimdLevel level : { SimdLevel::SCALAR, SimdLevel::SSE2, SimdLevel::AVX2 })
+	{
+		limitSimdLevel(level);
+		Pose::composeAffineTransforms(poses.data(), poses.size(), transforms.data());
+		for (size_t i = 0; i < poses.size(); i++)
+		{
+			glm::mat4 expected = glm::translate(glm::mat4(1.f), poses[i].position.value)
+				* glm::mat4_cast(poses[i].orientation.value)
+				* glm::scale(glm::mat4(1.f), poses[i].scale.value);
+			expectMatricesNear(expected, transforms[i].toMat4(), 1e-4f);
+		}
+	}
+	limitSimdLevel(SimdLevel::AVX2);
+}
+
+TEST(PoseKernelTest, InterpolateMatchesSlerp) {
+	std::vector<Pose> first = randomPoses(37, 2);
+	std::vector<Pose> second = randomPoses(37, 3);
+	std::vector<Pose> interpolated(first.size());
+	for (SimdLevel level : { SimdLevel::SCALAR, SimdLevel::SSE2, SimdLevel::AVX2 })
+	{
+		limitSimdLevel(level);
+		for (float factor : { 0.f, 0.25f, 0.5f, 1.f })
+		{
+			Pose::interpolatePoses(first.data(), second.data(), factor, first.size(), interpolated.data());
+			for (size_t i = 0; i < first.size(); i++)
+			{
+				Pose expected = Pose::interpolate(first[i], second[i], factor);
+				// nlerp is only used for close orientations, so the result stays close to slerp
+				expectMatricesNear(expected.getTransformationMatrix(), interpolated[i].getTransformationMatrix(), 5e-3f);
+			}
+		}
+	}
+	limitSimdLevel(SimdLevel::AVX2);
+}
+
+Pose makePose(const glm::vec3& position)
+{
+	Pose pose{};
+	pose.position = position;
+	pose.orientation = glm::quat(1.f, 0.f, 0.f, 0.f);
+	pose.scale = glm::vec3(1.f);
+	return pose;
+}
+
+/**
+ * @brief A root bone with a child one unit along its x axis.
+ */
+Skeleton twoBoneSkeleton()
+{
+	return Skeleton{ std::vector<glm::mat4>(2, glm::mat4(1.f)), { BoneNode{ glm::mat4(1.f), -1, { 1 } }, BoneNode{ glm::mat4(1.f), 0, {} } } };
+}
+
+/**
+ * @brief A one second clip of 10 ticks. The root moves from the origin to x = 4 and turns 90 degrees about z by tick 5, then loops back.
+ */
+Animation twoKeyAnimation()
+{
+	Pose rest{};
+	rest.position = glm::vec3(0.f);
+	rest.orientation = glm::quat(1.f, 0.f, 0.f, 0.f);
+	rest.scale = glm::vec3(1.f);
+	Pose child = rest;
+	child.position = glm::vec3(1.f, 0.f, 0.f);
+	Pose moved = rest;
+	moved.position = glm::vec3(4.f, 0.f, 0.f);
+	moved.orientation = glm::angleAxis(glm::half_pi<float>(), glm::vec3(0.f, 0.f, 1.f));
+
+	Animation animation{};
+	animation.totalTicks = 10.0;
+	animation.ticksPerSecond = 10.0;
+	animation.duration = 1.f;
+	animation.animationNodes = { AnimationNode{ 0.0, { rest, child } }, AnimationNode{ 5.0, { moved, child } } };
+	return animation;
+}
+
+TEST(AnimationSamplingTest, HitsKeyframesInterpolatesAndLoops) {
+	Skeleton skeleton = twoBoneSkeleton();
+	Animation animation = twoKeyAnimation();
+	glm::mat4 inverseGlobal = glm::translate(glm::mat4(1.f), glm::vec3(0.f, 0.f, -1.f));
+	glm::mat4 bones[2];
+	float diagonal = std::sqrt(0.5f);
+
+	auto expectBonesAt = [&](glm::vec3 root, glm::vec3 child) {
+		EXPECT_NEAR(bones[0][3].x, root.x, 1e-4f);
+		EXPECT_NEAR(bones[0][3].y, root.y, 1e-4f);
+		EXPECT_NEAR(bones[0][3].z, root.z - 1.f, 1e-4f);
+		EXPECT_NEAR(bones[1][3].x, child.x, 1e-4f);
+		EXPECT_NEAR(bones[1][3].y, child.y, 1e-4f);
+		EXPECT_NEAR(bones[1][3].z, child.z - 1.f, 1e-4f);
+	};
+
+	// on the keyframes, the child follows the turn of the root
+	sampleAnimation(animation, skeleton, inverseGlobal, 0.0, bones);
+	expectBonesAt(glm::vec3(0.f), glm::vec3(1.f, 0.f, 0.f));
+	sampleAnimation(animation, skeleton, inverseGlobal, 5.0, bones);
+	expectBonesAt(glm::vec3(4.f, 0.f, 0.f), glm::vec3(4.f, 1.f, 0.f));
+
+	// halfway between them, 45 degrees
+	sampleAnimation(animation, skeleton, inverseGlobal, 2.5, bones);
+	expectBonesAt(glm::vec3(2.f, 0.f, 0.f), glm::vec3(2.f + diagonal, diagonal, 0.f));
+	// from the last keyframe back to the first
+	sampleAnimation(animation, skeleton, inverseGlobal, 7.5, bones);
+	expectBonesAt(glm::vec3(2.f, 0.f, 0.f), glm::vec3(2.f + diagonal, diagonal, 0.f));
+	// past the end the clip starts over
+	sampleAnimation(animation, skeleton, inverseGlobal, 12.5, bones);
+	expectBonesAt(glm::vec3(2.f, 0.f, 0.f), glm::vec3(2.f + diagonal, diagonal, 0.f));
+	sampleAnimation(animation, skeleton, inverseGlobal, 25.0, bones);
+	expectBonesAt(glm::vec3(4.f, 0.f, 0.f), glm::vec3(4.f, 1.f, 0.f));
+}
+
+TEST(AnimationSamplingTest, BakedFramesMatchSampledPoses) {
+	Skeleton skeleton = twoBoneSkeleton();
+	Animation empty{};
+	empty.totalTicks = 0.0;
+	empty.ticksPerSecond = 10.0;
+	std::vector<Animation> clips = { twoKeyAnimation(), empty };
+	BakedAnimationLibrary library = bakeAnimations(clips, skeleton, glm::mat4(1.f), 4.f);
+
+	ASSERT_EQ(library.clips.size(), 2u);
+	EXPECT_EQ(library.boneCount, 2u);
+	EXPECT_EQ(library.clips[0].firstFrame, 0u);
+	EXPECT_EQ(library.clips[0].frameCount, 4u);
+	EXPECT_FLOAT_EQ(library.clips[0].duration, 1.f);
+	// an empty clip keeps its id with one frame of bind pose
+	EXPECT_EQ(library.clips[1].firstFrame, 4u);
+	EXPECT_EQ(library.clips[1].frameCount, 1u);
+	EXPECT_EQ(library.frameCount, 5u);
+	EXPECT_EQ(library.texels.size(), static_cast<size_t>(library.frameCount) * library.getRowLength());
+
+	glm::mat4 bones[2];
+	for (uint32_t frame = 0; frame < library.clips[0].frameCount; frame++)
+	{
+		double ticks = frame / 4.0 * clips[0].ticksPerSecond;
+		sampleAnimation(clips[0], skeleton, glm::mat4(1.f), ticks, bones);
+		for (uint32_t bone = 0; bone < 2; bone++)
+			expectMatricesNear(bones[bone], library.getBoneMatrix(frame, bone), 4e-3f);
+	}
+	for (uint32_t bone = 0; bone < 2; bone++)
+		expectMatricesNear(glm::mat4(1.f), library.getBoneMatrix(library.clips[1].firstFrame, bone), 1e-6f);
+}
+
+TEST(TransformSystemTest, PropagatesOnlyDirtySubtrees) {
+	TransformSystem transforms;
+	TransformHandle root = transforms.createTransform(makePose(glm::vec3(1.f, 0.f, 0.f)));
+	TransformHandle child = transforms.createTransform(makePose(glm::vec3(0.f, 2.f, 0.f)), root);
+	TransformHandle grandChild = transforms.createTransform(makePose(glm::vec3(0.f, 0.f, 3.f)), child);
+	TransformHandle scenery = transforms.createTransform(makePose(glm::vec3(5.f)));
+	transforms.update();
+	EXPECT_EQ(transforms.getLastUpdateCount(), 4u);
+	expectMatricesNear(glm::translate(glm::mat4(1.f), glm::vec3(1.f, 2.f, 3.f)), transforms.getWorldMatrix(grandChild), 1e-5f);
+
+	// nothing moved, nothing is recomputed
+	transforms.update();
+	EXPECT_EQ(transforms.getLastUpdateCount(), 0u);
+
+	// moving the child touches only the child and the grandchild
+	transforms.setPosition(child, glm::vec3(0.f, 4.f, 0.f));
+	transforms.setPosition(grandChild, glm::vec3(0.f, 0.f, 6.f));
+	transforms.update();
+	EXPECT_EQ(transforms.getLastUpdateCount(), 2u);
+	expectMatricesNear(glm::translate(glm::mat4(1.f), glm::vec3(1.f, 4.f, 6.f)), transforms.getWorldMatrix(grandChild), 1e-5f);
+	expectMatricesNear(glm::translate(glm::mat4(1.f), glm::vec3(5.f)), transforms.getWorldMatrix(scenery), 1e-5f);
+
+	// reparenting keeps the local transform
+	transforms.setParent(grandChild, scenery);
+	transforms.update();
+	expectMatricesNear(glm::translate(glm::mat4(1.f), glm::vec3(5.f, 5.f, 11.f)), transforms.getWorldMatrix(grandChild), 1e-5f);
+}
+
+TEST(TransformSystemTest, ParallelUpdateMatchesSerial) {
+	JobSystem jobs(3);
+	TransformSystem serial;
+	TransformSystem parallel;
+	std::vector<TransformHandle> handles;
+	for (uint32_t i = 0; i < 1000; i++)
+	{
+		// chains of ten transforms
+		TransformHandle parent = (i % 10 == 0) ? INVALID_TRANSFORM : handles.back();
+		Pose pose = makePose(glm::vec3(static_cast<float>(i), 1.f, 0.f));
+		pose.orientation = glm::angleAxis(0.1f * static_cast<float>(i % 10), glm::vec3(0.f, 1.f, 0.f));
+		handles.push_back(serial.createTransform(pose, parent));
+		parallel.createTransform(pose, parent);
+	}
+	serial.update();
+	parallel.update(&jobs);
+	EXPECT_EQ(serial.getLastUpdateCount(), parallel.getLastUpdateCount());
+	for (TransformHandle handle : handles)
+		expectMatricesNear(serial.getWorldMatrix(handle), parallel.getWorldMatrix(handle), 1e-3f);
+}
+
+TEST(AttributeArrayTest, VectorizedOperationsMatchScalar) {
+	// odd count exercises the scalar tail
+	constexpr size_t COUNT = 1003;
+	PositionArray positions;
+	VelocityArray velocities;
+	std::vector<Position> expected;
+	for (size_t i = 0; i < COUNT; i++)
+	{
+		float f = static_cast<float>(i);
+		positions.push_back(Position(glm::vec3(f, -f, 0.5f * f)));
+		velocities.push_back(Velocity(glm::vec3(1.f, 2.f, f)));
+		expected.push_back(Position(glm::vec3(f, -f, 0.5f * f)));
+	}
+	EXPECT_EQ(reinterpret_cast<uintptr_t>(positions.component(1)) % ATTRIBUTE_ARRAY_ALIGNMENT, 0u);
+
+	for (SimdLevel level : { SimdLevel::SCALAR, SimdLevel::SSE2, SimdLevel::AVX2 })
+	{
+		limitSimdLevel(level);
+		positions.addScaled(velocities, 0.5f).scale(2.f);
+		for (size_t i = 0; i < COUNT; i++)
+		{
+			expected[i] += velocities.get(i).value * 0.5f;
+			expected[i] *= 2.f;
+			glm::vec3 difference = positions.get(i).value - expected[i].value;
+			EXPECT_NEAR(glm::dot(difference, difference), 0.f, 1e-4f);
+		}
+	}
+	limitSimdLevel(SimdLevel::AVX2);
+
+	PositionArray first(COUNT);
+	PositionArray mixed;
+	mixed.lerp(first, positions, 0.25f);
+	positions.swapRemove(0);
+	EXPECT_EQ(positions.size(), COUNT - 1);
+	EXPECT_NEAR(mixed.get(COUNT - 1).value.x, 0.25f * expected[COUNT - 1].value.x, 1e-3f);
+	EXPECT_NEAR(positions.get(0).value.z, expected[COUNT - 1].value.z, 1e-3f);
+}
+
+TEST(OffsetAllocatorTest, AllocatesDisjointRangesAndCoalesces) {
+	constexpr uint32_t SIZE = 1 << 20;
+	OffsetAllocator allocator(SIZE);
+	EXPECT_EQ(allocator.getFreeStorage(), SIZE);
+
+	// bins never promise more than they hold
+	for (uint32_t size = 1; size < SIZE; size = size * 3 + 1)
+	{
+		EXPECT_GE(OffsetAllocator::binToSize(OffsetAllocator::sizeToBinRoundUp(size)), size);
+		EXPECT_LE(OffsetAllocator::binToSize(OffsetAllocator::sizeToBinRoundDown(size)), size);
+	}
+
+	std::mt19937 generator(7);
+	std::uniform_int_distribution<uint32_t> sizes(1, 5000);
+	std::vector<OffsetAllocation> allocations;
+	std::vector<uint8_t> owners(SIZE, 0);
+	for (int round = 0; round < 4; round++)
+	{
+		for (int i = 0; i < 300; i++)
+		{
+			uint32_t size = sizes(generator);
+			OffsetAllocation allocation = allocator.allocate(size);
+			if (!allocation.isValid())
+				continue;
+			ASSERT_LE(allocation.offset + size, SIZE);
+			for (uint32_t unit = allocation.offset; unit < allocation.offset + size; unit++)
+			{
+				ASSERT_EQ(owners[unit], 0) << "overlapping ranges";
+				owners[unit] = 1;
+			}
+			allocations.push_back(allocation);
+		}
+		// free every other allocation to fragment the space
+		std::vector<OffsetAllocation> kept;
+		for (size_t i = 0; i < allocations.size(); i++)
+		{
+			OffsetAllocation allocation = allocations[i];
+			if (i % 2 == 0)
+			{
+				kept.push_back(allocation);
+				continue;
+			}
+			uint32_t size = allocator.getAllocationSize(allocation);
+			for (uint32_t unit = allocation.offset; unit < allocation.offset + size; unit++)
+				owners[unit] = 0;
+			allocator.free(allocation);
+		}
+		allocations = kept;
+	}
+
+	for (OffsetAllocation allocation : allocations)
+		allocator.free(allocation);
+	EXPECT_EQ(allocator.getFreeStorage(), SIZE);
+	// everything merged back into one range
+	OffsetAllocation whole = allocator.allocate(SIZE);
+	EXPECT_TRUE(whole.isValid());
+	EXPECT_EQ(whole.offset, 0u);
+	EXPECT_FALSE(allocator.allocate(1).isValid());
+}
+
+TEST(FrustumCullingTest, MatchesScalarTestOnEveryLevel) {
+	// enough volumes for several parallel chunks and an odd tail
+	constexpr size_t COUNT = 2 * CULLING_CHUNK_SIZE + 13;
+	constexpr float MARGIN = 1e-3f; // volumes this close to a plane may go either way with fused multiply adds
+	glm::mat4 projection = glm::perspective(glm::quarter_pi<float>(), 16.f / 9.f, 0.1f, 100.f);
+	projection[1][1] *= -1;
+	Frustum frustum = Frustum::fromViewProjection(projection * glm::lookAt(glm::vec3(0.f, 5.f, -20.f), glm::vec3(0.f), glm::vec3(0.f, 1.f, 0.f)));
+
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> position(-120.f, 120.f);
+	std::uniform_real_distribution<float> size(0.f, 4.f);
+	BoundingSphereArray spheres;
+	BoundingBoxArray boxes;
+	for (size_t i = 0; i < COUNT; i++)
+	{
+		glm::vec3 center(position(rng), position(rng), position(rng));
+		spheres.push_back(BoundingSphere(glm::vec4(center, size(rng))));
+		boxes.push_back(BoundingBox(BoxBounds{ center, glm::vec3(size(rng), size(rng), size(rng)) }));
+	}
+
+	std::vector<uint32_t> visible(COUNT);
+	for (SimdLevel level : { SimdLevel::SCALAR, SimdLevel::SSE2, SimdLevel::AVX2 })
+	{
+		limitSimdLevel(level);
+		size_t visibleCount = cullSpheres(frustum, spheres, visible.data());
+		EXPECT_LT(0u, visibleCount);
+		EXPECT_LT(visibleCount, COUNT);
+		std::vector<bool> isVisible(COUNT, false);
+		for (size_t v = 0; v < visibleCount; v++)
+		{
+			EXPECT_TRUE(v == 0 || visible[v - 1] < visible[v]);
+			isVisible[visible[v]] = true;
+		}
+		for (size_t i = 0; i < COUNT; i++)
+		{
+			glm::vec4 sphere = spheres.get(i).value;
+			if (frustum.containsSphere(glm::vec3(sphere), sphere.w - MARGIN))
+			{
+				EXPECT_TRUE(isVisible[i]);
+			}
+			else if (!frustum.containsSphere(glm::vec3(sphere), sphere.w + MARGIN))
+			{
+				EXPECT_FALSE(isVisible[i]);
+			}
+		}
+
+		visibleCount = cullBoxes(frustum, boxes, visible.data());
+		std::fill(isVisible.begin(), isVisible.end(), false);
+		for (size_t v = 0; v < visibleCount; v++)
+			isVisible[visible[v]] = true;
+		for (size_t i = 0; i < COUNT; i++)
+		{
+			BoxBounds box = boxes.get(i).value;
+			if (frustum.containsBox(box.center, box.extents - MARGIN))
+			{
+				EXPECT_TRUE(isVisible[i]);
+			}
+			else if (!frustum.containsBox(box.center, box.extents + MARGIN))
+			{
+				EXPECT_FALSE(isVisible[i]);
+			}
+		}
+	}
+	limitSimdLevel(SimdLevel::AVX2);
+}
+
+TEST(DynamicBvhTest, QueriesMatchBruteForceAfterMovesAndRebuilds) {
+	constexpr size_t COUNT = 2000;
+	std::mt19937 rng(5);
+	std::uniform_real_distribution<float> position(-50.f, 50.f);
+	std::uniform_real_distribution<float> size(0.1f, 2.f);
+	auto randomBox = [&]() {
+		glm::vec3 center(position(rng), position(rng), position(rng));
+		glm::vec3 extents(size(rng), size(rng), size(rng));
+		return Aabb{ center - extents, center + extents };
+	};
+
+	DynamicBvh bvh;
+	std::vector<int32_t> proxies;
+	std::vector<Aabb> boxes;
+	for (size_t i = 0; i < COUNT; i++)
+	{
+		boxes.push_back(randomBox());
+		proxies.push_back(bvh.insert(boxes.back(), i));
+	}
+
+	auto expectOverlapsMatch = [&](const Aabb& query) {
+		std::vector<int32_t> found;
+		bvh.queryOverlaps(query, found);
+		std::vector<uint64_t> foundIds;
+		for (int32_t proxy : found)
+			foundIds.push_back(bvh.getUserData(proxy));
+		std::sort(foundIds.begin(), foundIds.end());
+		std::vector<uint64_t> expectedIds;
+		for (size_t i = 0; i < boxes.size(); i++)
+		{
+			if (proxies[i] != BVH_NULL_NODE && boxes[i].overlaps(query))
+				expectedIds.push_back(i);
+		}
+		EXPECT_EQ(foundIds, expectedIds);
+	};
+
+	for (int frame = 0; frame < 5; frame++)
+	{
+		// move a tenth of the boxes and drop a few
+		for (size_t i = frame; i < COUNT; i += 10)
+		{
+			if (proxies[i] == BVH_NULL_NODE)
+				continue;
+			if (i % 70 == 0)
+			{
+				bvh.remove(proxies[i]);
+				proxies[i] = BVH_NULL_NODE;
+				continue;
+			}
+			boxes[i] = randomBox();
+			bvh.move(proxies[i], boxes[i]);
+		}
+		bvh.update();
+		for (int q = 0; q < 10; q++)
+			expectOverlapsMatch(Aabb{ glm::vec3(position(rng)) - 8.f, glm::vec3(position(rng)) + 8.f });
+	}
+	bvh.rebuild();
+	expectOverlapsMatch(Aabb{ glm::vec3(-20.f), glm::vec3(20.f) });
+	EXPECT_LT(bvh.getHeight(), 40);
+
+	// nearest neighbours come out in order of distance
+	glm::vec3 point(3.f, -7.f, 11.f);
+	std::vector<int32_t> nearest;
+	bvh.queryNearest(point, 5, nearest);
+	ASSERT_EQ(nearest.size(), 5u);
+	std::vector<float> distances;
+	for (size_t i = 0; i < boxes.size(); i++)
+	{
+		if (proxies[i] != BVH_NULL_NODE)
+			distances.push_back(boxes[i].distanceSquared(point));
+	}
+	std::sort(distances.begin(), distances.end());
+	for (size_t i = 0; i < nearest.size(); i++)
+		EXPECT_FLOAT_EQ(bvh.getBounds(nearest[i]).distanceSquared(point), distances[i]);
+}
+
+namespace
+{
+	GraphicsAsset makeQuadAsset(const std::vector<glm::vec3>& corners)
+	{
+		GraphicsAsset asset{};
+		asset.attributes = FLAG_POSITION;
+		for (size_t quad = 0; quad < corners.size() / 4; quad++)
+		{
+			uint32_t first = static_cast<uint32_t>(asset.vertices.size());
+			for (size_t i = 0; i < 4; i++)
+			{
+				FullVertex vertex{};
+				vertex.position = corners[4 * quad + i];
+				asset.vertices.push_back(vertex);
+			}
+			asset.indices.insert(asset.indices.end(), { first, first + 1, first + 2, first, first + 2, first + 3 });
+		}
+		return asset;
+	}
+} // namespace
+
+TEST(TriangleBvhTest, ClosestHitMatchesBruteForceOnEveryLevel) {
+	// a bumpy height field, so rays cross several layers of boxes
+	constexpr uint32_t GRID = 48;
+	std::mt19937 rng(9);
+	std::uniform_real_distribution<float> height(-1.f, 1.f);
+	std::vector<glm::vec3> positions;
+	for (uint32_t z = 0; z <= GRID; z++)
+	{
+		for (uint32_t x = 0; x <= GRID; x++)
+			positions.push_back(glm::vec3(static_cast<float>(x), height(rng), static_cast<float>(z)));
+	}
+	std::vector<uint32_t> indices;
+	for (uint32_t z = 0; z < GRID; z++)
+	{
+		for (uint32_t x = 0; x < GRID; x++)
+		{
+			uint32_t corner = z * (GRID + 1) + x;
+			indices.insert(indices.end(), { corner, corner + 1, corner + GRID + 2, corner, corner + GRID + 2, corner + GRID + 1 });
+		}
+	}
+	TriangleBvh bvh;
+	bvh.build(positions.data(), indices.data(), indices.size());
+	EXPECT_EQ(bvh.getTriangleCount(), indices.size() / 3);
+
+	auto bruteForce = [&](const Ray& ray) {
+		float closest = INFINITY;
+		for (size_t t = 0; t < indices.size(); t += 3)
+		{
+			glm::vec3 a = positions[indices[t]];
+			glm::vec3 edge1 = positions[indices[t + 1]] - a;
+			glm::vec3 edge2 = positions[indices[t + 2]] - a;
+			glm::vec3 p = glm::cross(ray.direction, edge2);
+			float determinant = glm::dot(edge1, p);
+			if (std::abs(determinant) <= 1e-12f)
+				continue;
+			glm::vec3 s = ray.origin - a;
+			float u = glm::dot(s, p) / determinant;
+			glm::vec3 q = glm::cross(s, edge1);
+			float v = glm::dot(ray.direction, q) / determinant;
+			float distance = glm::dot(edge2, q) / determinant;
+			if (0.f <= u && 0.f <= v && u + v <= 1.f && 0.f < distance && distance < closest)
+				closest = distance;
+		}
+		return closest;
+	};
+
+	std::uniform_real_distribution<float> spread(-10.f, GRID + 10.f);
+	std::vector<Ray> rays;
+	for (int i = 0; i < 300; i++)
+	{
+		glm::vec3 origin(spread(rng), 6.f, spread(rng));
+		glm::vec3 target(spread(rng), height(rng), spread(rng));
+		rays.push_back({ origin, glm::normalize(target - origin) });
+	}
+	for (SimdLevel level : { SimdLevel::SCALAR, SimdLevel::SSE2, SimdLevel::AVX2 })
+	{
+		limitSimdLevel(level);
+		for (const Ray& ray : rays)
+		{
+			float expected = bruteForce(ray);
+			RayHit hit{};
+			bool found = bvh.intersect(ray, INFINITY, hit);
+			EXPECT_EQ(found, expected != INFINITY);
+			if (found)
+			{
+				EXPECT_NEAR(hit.distance, expected, 1e-3f);
+				glm::vec3 point = ray.getPoint(hit.distance);
+				glm::vec3 a = positions[indices[3 * hit.triangle]];
+				glm::vec3 expectedPoint = a + hit.u * (positions[indices[3 * hit.triangle + 1]] - a) + hit.v * (positions[indices[3 * hit.triangle + 2]] - a);
+				EXPECT_NEAR(glm::length(point - expectedPoint), 0.f, 1e-3f);
+			}
+			// nothing is closer than a limit below the hit
+			if (found && 0.01f < hit.distance)
+			{
+				EXPECT_FALSE(bvh.intersect(ray, hit.distance - 0.01f, hit));
+			}
+		}
+	}
+	limitSimdLevel(SimdLevel::AVX2);
+}
+
+TEST(PickingServiceTest, PicksClosestRigidAndPosedSkinnedInstances) {
+	PickingService picking;
+	GraphicsAsset quad = makeQuadAsset({ glm::vec3(-1.f, -1.f, 0.f), glm::vec3(1.f, -1.f, 0.f), glm::vec3(1.f, 1.f, 0.f), glm::vec3(-1.f, 1.f, 0.f) });
+	uint32_t quadMesh = picking.registerMesh(quad);
+	int32_t farQuad = picking.addInstance(quadMesh, glm::translate(glm::mat4(1.f), glm::vec3(0.f, 0.f, -10.f)), 10);
+	int32_t nearQuad = picking.addInstance(quadMesh, glm::translate(glm::mat4(1.f), glm::vec3(0.f, 0.f, -5.f)), 5);
+	picking.update();
+
+	Ray ray = { glm::vec3(0.2f, 0.3f, 0.f), glm::vec3(0.f, 0.f, -1.f) };
+	PickResult result = picking.pick(ray);
+	ASSERT_TRUE(result.hit);
+	EXPECT_EQ(result.instance, nearQuad);
+	EXPECT_EQ(result.userData, 5u);
+	EXPECT_NEAR(result.distance, 5.f, 1e-4f);
+	EXPECT_NEAR(result.position.z, -5.f, 1e-4f);
+	EXPECT_FALSE(picking.pick(ray, 4.f).hit);
+
+	// moving the near quad aside uncovers the far one
+	picking.setTransform(nearQuad, glm::translate(glm::mat4(1.f), glm::vec3(5.f, 0.f, -5.f)));
+	picking.update();
+	result = picking.pick(ray);
+	ASSERT_TRUE(result.hit);
+	EXPECT_EQ(result.instance, farQuad);
+	picking.removeInstance(farQuad);
+	picking.update();
+	EXPECT_FALSE(picking.pick(ray).hit);
+
+	// two quads side by side, each following its own bone
+	GraphicsAsset arm = makeQuadAsset({
+		glm::vec3(-3.f, -1.f, 0.f), glm::vec3(-1.f, -1.f, 0.f), glm::vec3(-1.f, 1.f, 0.f), glm::vec3(-3.f, 1.f, 0.f),
+		glm::vec3(1.f, -1.f, 0.f), glm::vec3(3.f, -1.f, 0.f), glm::vec3(3.f, 1.f, 0.f), glm::vec3(1.f, 1.f, 0.f),
+	});
+	arm.attributes = FLAG_POSITION | FLAG_JOINTS | FLAG_WEIGHTS;
+	for (size_t i = 0; i < arm.vertices.size(); i++)
+	{
+		arm.vertices[i].joints = glm::uvec4(i < 4 ? 0 : 1, 0, 0, 0);
+		arm.vertices[i].weights = glm::vec4(1.f, 0.f, 0.f, 0.f);
+	}
+	arm.skeleton.emplace(Skeleton{ {}, { BoneNode{ glm::mat4(1.f), -1, { 1 } }, BoneNode{ glm::mat4(1.f), 0, {} } } });
+	int32_t character = picking.addInstance(picking.registerMesh(arm), glm::translate(glm::mat4(1.f), glm::vec3(0.f, 0.f, -20.f)), 20);
+	picking.update();
+
+	Ray restRay = { glm::vec3(2.f, 0.f, 0.f), glm::vec3(0.f, 0.f, -1.f) };
+	Ray raisedRay = { glm::vec3(2.f, 4.f, 0.f), glm::vec3(0.f, 0.f, -1.f) };
+	result = picking.pick(restRay);
+	ASSERT_TRUE(result.hit);
+	EXPECT_EQ(result.instance, character);
+	EXPECT_GE(result.triangle, 2u);
+	EXPECT_FALSE(picking.pick(raisedRay).hit);
+
+	// raise the second bone
+	glm::mat4 pose[2] = { glm::mat4(1.f), glm::translate(glm::mat4(1.f), glm::vec3(0.f, 4.f, 0.f)) };
+	picking.setBoneTransforms(character, pose);
+	picking.update();
+	EXPECT_FALSE(picking.pick(restRay).hit);
+	result = picking.pick(raisedRay);
+	ASSERT_TRUE(result.hit);
+	EXPECT_EQ(result.userData, 20u);
+	EXPECT_NEAR(result.distance, 20.f, 1e-4f);
+	EXPECT_TRUE(picking.pick({ glm::vec3(-2.f, 0.f, 0.f), glm::vec3(0.f, 0.f, -1.f) }).hit);
+}
+
+TEST(RadixSortTest, MatchesStableSort) {
+	std::mt19937_64 rng(21);
+	for (size_t count : { size_t(0), size_t(1), size_t(100), RADIX_SORT_CHUNK_SIZE * 3 + 17 })
+	{
+		std::vector<uint64_t> keys(count);
+		std::vector<uint32_t> values(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			// constant high bits and many duplicates, as in draw keys
+			keys[i] = (0x3ull << 60) | (rng() & 0xff00000000ffull);
+			values[i] = static_cast<uint32_t>(i);
+		}
+		std::vector<std::pair<uint64_t, uint32_t>> expected;
+		for (size_t i = 0; i < count; i++)
+			expected.push_back({ keys[i], values[i] });
+		std::stable_sort(expected.begin(), expected.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+		std::vector<uint64_t> keyScratch(count);
+		std::vector<uint32_t> valueScratch(count);
+		radixSort(keys.data(), values.data(), keyScratch.data(), valueScratch.data(), count);
+		for (size_t i = 0; i < count; i++)
+		{
+			ASSERT_EQ(keys[i], expected[i].first);
+			ASSERT_EQ(values[i], expected[i].second);
+		}
+	}
+}
+
+/**
+ * @brief A mesh of positions only, its vertices spread along x from start.
+ */
+GraphicsAsset lineMesh(float start, uint32_t vertexCount)
+{
+	GraphicsAsset asset{};
+	asset.attributes = FLAG_POSITION;
+	asset.vertices.resize(vertexCount);
+	for (uint32_t i = 0; i < vertexCount; i++)
+	{
+		asset.vertices[i].position = glm::vec3(start + static_cast<float>(i), 0.f, 0.f);
+		asset.indices.push_back(i);
+	}
+	return asset;
+}
+
+TEST(GraphicsAssetCacheTest, SharesEqualMeshesAndCountsReferences) {
+	// without an allocator only the ranges are tracked, uploads are ready at once
+	GeometryBuffers geometryBuffers;
+	geometryBuffers.initialize(VK_NULL_HANDLE, nullptr, 1024, 4096);
+	GraphicsAssetCache cache;
+	cache.initialize(&geometryBuffers, 2);
+
+	GraphicsAsset mesh = lineMesh(0.f, 8);
+	MeshHandle first = cache.acquireMesh(mesh);
+	MeshHandle second = cache.acquireMesh(lineMesh(0.f, 8));
+	ASSERT_TRUE(first.isValid());
+	EXPECT_EQ(second.entryId, first.entryId);
+	EXPECT_EQ(cache.getStats().hits, 1u);
+	EXPECT_EQ(cache.getStats().misses, 1u);
+	ASSERT_NE(cache.useMesh(first), nullptr);
+	EXPECT_EQ(cache.useMesh(first)->referenceCount, 2u);
+
+	// one changed vertex, or the same data with other attributes, is a different mesh
+	GraphicsAsset moved = mesh;
+	moved.vertices[3].position.y = 1.f;
+	MeshHandle other = cache.acquireMesh(moved);
+	GraphicsAsset withNormals = mesh;
+	withNormals.attributes = FLAG_POSITION | FLAG_NORMAL;
+	MeshHandle otherLayout = cache.acquireMesh(withNormals);
+	EXPECT_NE(other.entryId, first.entryId);
+	EXPECT_NE(otherLayout.entryId, first.entryId);
+	EXPECT_NE(otherLayout.entryId, other.entryId);
+	EXPECT_EQ(cache.getStats().misses, 3u);
+	EXPECT_EQ(cache.getStats().entryCount, 3u);
+
+	cache.addReference(first);
+	EXPECT_EQ(cache.useMesh(first)->referenceCount, 3u);
+	for (int i = 0; i < 3; i++)
+		cache.releaseMesh(first);
+	// a released handle does not drop the count below zero
+	cache.releaseMesh(first);
+	EXPECT_EQ(cache.useMesh(first)->referenceCount, 0u);
+	// unreferenced entries stay within the default budget
+	EXPECT_EQ(cache.getStats().entryCount, 3u);
+	EXPECT_EQ(cache.getStats().evictions, 0u);
+	cache.cleanup();
+	EXPECT_EQ(geometryBuffers.getUsedBytes(), 0u);
+}
+
+TEST(GraphicsAssetCacheTest, EvictsLeastRecentlyReleasedFirst) {
+	GeometryBuffers geometryBuffers;
+	geometryBuffers.initialize(VK_NULL_HANDLE, nullptr, 1024, 4096);
+	GraphicsAssetCache cache;
+	constexpr uint32_t VERTICES = 4;
+	const VkDeviceSize meshBytes = VERTICES * getVertexStride(FLAG_POSITION) + VERTICES * sizeof(uint32_t);
+	cache.initialize(&geometryBuffers, 2, 2 * meshBytes);
+
+	MeshHandle a = cache.acquireMesh(lineMesh(0.f, VERTICES));
+	MeshHandle b = cache.acquireMesh(lineMesh(10.f, VERTICES));
+	MeshHandle c = cache.acquireMesh(lineMesh(20.f, VERTICES));
+	cache.releaseMesh(a);
+	cache.releaseMesh(b);
+	EXPECT_EQ(cache.getStats().evictions, 0u);
+	cache.releaseMesh(c);
+	// three unreferenced meshes exceed the budget of two, the first released goes
+	EXPECT_EQ(cache.getStats().evictions, 1u);
+	EXPECT_EQ(cache.useMesh(a), nullptr);
+	EXPECT_NE(cache.useMesh(b), nullptr);
+
+	// taking b back moves it behind c
+	MeshHandle b2 = cache.acquireMesh(lineMesh(10.f, VERTICES));
+	EXPECT_EQ(b2.entryId, b.entryId);
+	cache.releaseMesh(b2);
+	cache.setBudget(meshBytes);
+	EXPECT_EQ(cache.getStats().evictions, 2u);
+	EXPECT_EQ(cache.useMesh(c), nullptr);
+	EXPECT_NE(cache.useMesh(b), nullptr);
+
+	// referenced meshes are kept whatever the budget
+	MeshHandle d = cache.acquireMesh(lineMesh(30.f, VERTICES));
+	cache.setBudget(0);
+	EXPECT_NE(cache.useMesh(d), nullptr);
+	EXPECT_EQ(cache.useMesh(b), nullptr);
+	EXPECT_EQ(cache.getStats().entryCount, 1u);
+	cache.cleanup();
+}
+
+TEST(GraphicsAssetCacheTest, DestroysEvictedMeshesOnceTheirFramesRetire) {
+	GeometryBuffers geometryBuffers;
+	geometryBuffers.initialize(VK_NULL_HANDLE, nullptr, 1024, 4096);
+	GraphicsAssetCache cache;
+	cache.initialize(&geometryBuffers, 2, 0);
+
+	MeshHandle mesh = cache.acquireMesh(lineMesh(0.f, 6));
+	const VkDeviceSize meshBytes = cache.getStats().residentBytes;
+	EXPECT_EQ(geometryBuffers.getUsedBytes(), meshBytes);
+	cache.beginFrame();
+	ASSERT_NE(cache.useMesh(mesh), nullptr);
+	cache.releaseMesh(mesh);
+	EXPECT_EQ(cache.getStats().evictions, 1u);
+	EXPECT_EQ(cache.getStats().entryCount, 0u);
+
+	// drawn in frame 1, the GPU may read it until frame 3 begins
+	cache.beginFrame();
+	EXPECT_EQ(cache.getStats().residentBytes, meshBytes);
+	EXPECT_EQ(geometryBuffers.getUsedBytes(), meshBytes);
+	cache.beginFrame();
+	EXPECT_EQ(cache.getStats().residentBytes, 0u);
+	EXPECT_EQ(geometryBuffers.getUsedBytes(), 0u);
+
+	// the same content uploads again after eviction
+	MeshHandle again = cache.acquireMesh(lineMesh(0.f, 6));
+	EXPECT_NE(again.entryId, mesh.entryId);
+	EXPECT_EQ(cache.getStats().misses, 2u);
+	cache.cleanup();
+}
+
+TEST(DrawListTest, BatchesDrawsOfEqualStateAndBindsOncePerState) {
+	EXPECT_EQ(getDrawKeyPass(makeDrawKey(3, 4000, 60000, 1234, 77)), 3u);
+	EXPECT_EQ(getDrawKeyPipeline(makeDrawKey(3, 4000, 60000, 1234, 77)), 4000u);
+	EXPECT_EQ(getDrawKeyMaterial(makeDrawKey(3, 4000, 60000, 1234, 77)), 60000u);
+	EXPECT_EQ(getDrawKeyMesh(makeDrawKey(3, 4000, 60000, 1234, 77)), 1234u);
+	EXPECT_EQ(getDrawKeyDepth(makeDrawKey(3, 4000, 60000, 1234, 77)), 77u);
+	EXPECT_LT(quantizeDrawDepth(1.f, 100.f), quantizeDrawDepth(2.f, 100.f));
+	EXPECT_GT(quantizeDrawDepth(1.f, 100.f, true), quantizeDrawDepth(2.f, 100.f, true));
+
+	constexpr uint32_t PIPELINES = 3;
+	constexpr uint32_t MATERIALS = 5;
+	constexpr uint32_t MESHES = 7;
+	std::mt19937 rng(23);
+	DrawList list;
+	std::vector<uint64_t> addedKeys;
+	std::set<uint64_t> states;
+	for (uint32_t draw = 0; draw < 5000; draw++)
+	{
+		uint32_t pass = rng() % 2;
+		uint32_t pipeline = rng() % PIPELINES;
+		uint64_t key = makeDrawKey(pass, pipeline, rng() % MATERIALS, rng() % MESHES, quantizeDrawDepth(static_cast<float>(rng() % 1000), 1000.f, pass == 1));
+		list.add(key, draw);
+		addedKeys.push_back(key);
+		states.insert(key & DRAW_KEY_STATE_MASK);
+	}
+	list.sort();
+
+	const std::vector<uint64_t>& keys = list.getSortedKeys();
+	ASSERT_EQ(keys.size(), addedKeys.size());
+	EXPECT_TRUE(std::is_sorted(keys.begin(), keys.end()));
+	for (size_t i = 0; i < keys.size(); i++)
+		EXPECT_EQ(addedKeys[list.getSortedDraws()[i]], keys[i]);
+	ASSERT_EQ(list.getBatches().size(), states.size());
+	uint32_t covered = 0;
+	for (const DrawBatch& batch : list.getBatches())
+	{
+		EXPECT_EQ(batch.firstDraw, covered);
+		for (uint32_t i = 0; i < batch.drawCount; i++)
+			EXPECT_EQ(keys[batch.firstDraw + i] & DRAW_KEY_STATE_MASK, batch.key & DRAW_KEY_STATE_MASK);
+		covered += batch.drawCount;
+	}
+	EXPECT_EQ(covered, keys.size());
+
+	DrawStateTable table;
+	for (uint32_t i = 0; i < PIPELINES; i++)
+		table.pipelines.push_back({ reinterpret_cast<VkPipeline>(uintptr_t(i + 1)), VK_NULL_HANDLE, i == 2 ? FLAG_POSITION : FLAG_POSITION | FLAG_NORMAL });
+	for (uint32_t i = 0; i < MATERIALS; i++)
+		table.materials.push_back(reinterpret_cast<VkDescriptorSet>(uintptr_t(i + 1)));
+	table.meshes.resize(MESHES);
+	DrawListStats stats = list.countCommands(table);
+	EXPECT_EQ(stats.drawCalls, states.size());
+	// each pass binds every pipeline once and every material once per pipeline
+	EXPECT_EQ(stats.pipelineBinds, 2 * PIPELINES);
+	EXPECT_EQ(stats.materialBinds, 2 * PIPELINES * MATERIALS);
+	EXPECT_LE(stats.geometryBinds, stats.pipelineBinds);
+
+	// slices, as recorded into secondary command buffers, cover every batch once
+	size_t batchCount = list.getBatches().size();
+	uint32_t slicedDraws = 0;
+	for (size_t slice = 0; slice < 4; slice++)
+		slicedDraws += list.countCommands(table, batchCount * slice / 4, batchCount * (slice + 1) / 4 - batchCount * slice / 4).drawCalls;
+	EXPECT_EQ(slicedDraws, stats.drawCalls);
+	EXPECT_EQ(list.countCommands(table, batchCount, 10).drawCalls, 0u);
+
+	// bindless mode binds the sets once per pipeline layout, whatever the number of materials
+	table.bindlessSet = reinterpret_cast<VkDescriptorSet>(uintptr_t(100));
+	table.bindlessMaterials = { 10, 11, 12, 13, 14 };
+	DrawListStats bindlessStats = list.countCommands(table);
+	EXPECT_EQ(bindlessStats.drawCalls, stats.drawCalls);
+	EXPECT_EQ(bindlessStats.descriptorSetBinds, 1u);
+	EXPECT_LE(bindlessStats.materialBinds, stats.materialBinds);
+}
+
+TEST(DescriptorPoolTest, SizesPoolsForTheObservedDescriptorMix) {
+	std::array<uint32_t, TRACKED_DESCRIPTOR_TYPE_COUNT> counts{};
+	std::vector<VkDescriptorPoolSize> defaults = computeDescriptorPoolSizes(counts, 0, 100);
+	EXPECT_EQ(defaults.size(), DEFAULT_POOL_SIZE_RATIOS.size());
+	for (const VkDescriptorPoolSize& size : defaults)
+		EXPECT_NE(size.type, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT);
+
+	counts[VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER] = 10;
+	counts[VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER] = 30;
+	std::vector<VkDescriptorPoolSize> observed = computeDescriptorPoolSizes(counts, 10, 100);
+	ASSERT_EQ(observed.size(), 2u);
+	// ordered by type
+	EXPECT_EQ(observed[0].type, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+	EXPECT_EQ(observed[0].descriptorCount, static_cast<uint32_t>(300 * POOL_SIZE_HEADROOM));
+	EXPECT_EQ(observed[1].type, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+	EXPECT_EQ(observed[1].descriptorCount, static_cast<uint32_t>(100 * POOL_SIZE_HEADROOM));
+	EXPECT_TRUE(descriptorPoolSizesChanged(defaults, observed));
+	EXPECT_FALSE(descriptorPoolSizesChanged(observed, observed));
+	std::vector<VkDescriptorPoolSize> close = observed;
+	close[0].descriptorCount += close[0].descriptorCount / 10;
+	EXPECT_FALSE(descriptorPoolSizesChanged(observed, close));
+	std::vector<VkDescriptorPoolSize> empty = observed;
+	empty[0].descriptorCount = 0;
+	EXPECT_TRUE(descriptorPoolSizesChanged(empty, observed));
+
+	// a frame of uniform buffer sets recreates the pools with uniform buffers only, a like frame keeps them
+	PoolManager pools(VK_NULL_HANDLE, 16);
+	VkDescriptorSetLayoutBinding binding{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr };
+	VkDescriptorSet set;
+	for (int frame = 0; frame < 2; frame++)
+	{
+		for (int i = 0; i < 40; i++)
+			ASSERT_TRUE(pools.allocateDescriptorSet(VK_NULL_HANDLE, &binding, 1, set));
+		EXPECT_EQ(pools.getStats().allocatedSets, 40u);
+		pools.resetPools();
+		EXPECT_EQ(pools.getStats().resizes, 1u);
+		EXPECT_EQ(pools.getStats().allocatedSets, 0u);
+	}
+	EXPECT_EQ(pools.getStats().poolDescriptors, pools.getStats().pools * static_cast<uint64_t>(16 * POOL_SIZE_HEADROOM));
+}
+
+TEST(HandleCacheTest, InternsEqualCreateInfosAcrossThreads) {
+	std::array<VkDescriptorSetLayoutBinding, 2> bindings = { {
+		{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr },
+		{ 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
+	} };
+	std::array<VkDescriptorSetLayoutBinding, 2> reversed = { bindings[1], bindings[0] };
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = 2;
+	layoutInfo.pBindings = bindings.data();
+	HandleCacheKey sorted = makeDescriptorSetLayoutKey(layoutInfo);
+	layoutInfo.pBindings = reversed.data();
+	// bindings are keyed in binding order
+	EXPECT_EQ(sorted, makeDescriptorSetLayoutKey(layoutInfo));
+	reversed[0].stageFlags |= VK_SHADER_STAGE_VERTEX_BIT;
+	EXPECT_NE(sorted, makeDescriptorSetLayoutKey(layoutInfo));
+
+	HandleCacheKey longKey;
+	HandleCacheKey sameLongKey;
+	for (uint32_t i = 0; i < HANDLE_CACHE_KEY_INLINE_WORDS + 8; i++)
+	{
+		longKey.push(i);
+		sameLongKey.push(i);
+	}
+	EXPECT_EQ(longKey, sameLongKey);
+	sameLongKey.push(0);
+	EXPECT_NE(longKey, sameLongKey);
+
+	// threads missing on the same keys at once still agree on one handle per key
+	constexpr uint32_t UNIQUE_KEYS = 50;
+	ShardedHandleCache<uint64_t> cache;
+	std::atomic<uint64_t> nextHandle = 1;
+	std::atomic<uint32_t> destroyed = 0;
+	std::vector<uint64_t> handles(UNIQUE_KEYS * 40);
+	JobSystem jobs(4);
+	jobs.parallelFor(handles.size(), 8, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			HandleCacheKey key;
+			key.push(static_cast<uint32_t>(i % UNIQUE_KEYS));
+			handles[i] = cache.getOrCreate(key, [&]() { return nextHandle.fetch_add(1); }, [&](uint64_t) { destroyed++; });
+		}
+	});
+	EXPECT_EQ(cache.size(), UNIQUE_KEYS);
+	EXPECT_EQ(nextHandle - 1 - destroyed, UNIQUE_KEYS);
+	for (size_t i = UNIQUE_KEYS; i < handles.size(); i++)
+		EXPECT_EQ(handles[i], handles[i % UNIQUE_KEYS]);
+	uint32_t cleared = 0;
+	cache.clear([&](uint64_t) { cleared++; });
+	EXPECT_EQ(cleared, UNIQUE_KEYS);
+	EXPECT_EQ(cache.size(), 0u);
+}
+
+TEST(BindlessSlotAllocatorTest, ReusesRetiredSlotsLowestFirst) {
+	BindlessSlotAllocator allocator;
+	allocator.reset(4, 2);
+	for (uint32_t i = 0; i < 4; i++)
+		EXPECT_EQ(allocator.allocate(), i);
+	EXPECT_EQ(allocator.allocate(), INVALID_BINDLESS_SLOT);
+	EXPECT_EQ(allocator.getAllocatedCount(), 4u);
+
+	allocator.beginFrame(0);
+	allocator.release(3);
+	allocator.release(1);
+	EXPECT_EQ(allocator.getAllocatedCount(), 2u);
+	// frames in flight may still read released slots, they come back when frame 0 begins again
+	EXPECT_EQ(allocator.allocate(), INVALID_BINDLESS_SLOT);
+	allocator.beginFrame(1);
+	EXPECT_EQ(allocator.allocate(), INVALID_BINDLESS_SLOT);
+	allocator.beginFrame(0);
+	EXPECT_EQ(allocator.allocate(), 1u);
+	EXPECT_EQ(allocator.allocate(), 3u);
+	EXPECT_EQ(allocator.allocate(), INVALID_BINDLESS_SLOT);
+
+	allocator.reset(2);
+	EXPECT_EQ(allocator.allocate(), 0u);
+	EXPECT_EQ(allocator.getCapacity(), 2u);
+}
+
+TEST(UniformRingAllocatorTest, AlignsOffsetsAndFillsUpAcrossThreads) {
+	UniformRingAllocator offsets(1024, 256);
+	EXPECT_EQ(offsets.allocate(64), 0u);
+	EXPECT_EQ(offsets.allocate(1), 256u);
+	EXPECT_EQ(offsets.allocate(256), 512u);
+	EXPECT_EQ(offsets.allocate(257), INVALID_UNIFORM_OFFSET);
+	EXPECT_EQ(offsets.allocate(256), INVALID_UNIFORM_OFFSET);
+	EXPECT_EQ(offsets.getUsed(), 1024u);
+	offsets.clear();
+	EXPECT_EQ(offsets.getUsed(), 0u);
+	EXPECT_EQ(offsets.allocate(16), 0u);
+
+	// every thread gets its own aligned range, and allocations past the capacity fail
+	offsets.reset(64 * 1000, 64);
+	std::vector<uint32_t> allocated(1200);
+	JobSystem jobs(4);
+	jobs.parallelFor(allocated.size(), 16, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+			allocated[i] = offsets.allocate(48);
+	});
+	std::set<uint32_t> unique;
+	for (uint32_t offset : allocated)
+	{
+		if (offset == INVALID_UNIFORM_OFFSET)
+			continue;
+		EXPECT_EQ(offset % 64, 0u);
+		EXPECT_LE(offset + 64, 64u * 1000u);
+		unique.insert(offset);
+	}
+	EXPECT_EQ(unique.size(), 1000u);
+	EXPECT_EQ(std::count(allocated.begin(), allocated.end(), INVALID_UNIFORM_OFFSET), 200);
+}
+
+TEST(PipelineCacheTest, RejectsCorruptAndForeignFiles) {
+	VkPhysicalDeviceProperties properties{};
+	properties.vendorID = 0x10de;
+	properties.deviceID = 0x2684;
+	properties.driverVersion = 555;
+	for (uint8_t i = 0; i < VK_UUID_SIZE; i++)
+		properties.pipelineCacheUUID[i] = i;
+
+	// driver data starts with the driver's own header
+	VkPipelineCacheHeaderVersionOne driverHeader{};
+	driverHeader.headerSize = sizeof(driverHeader);
+	driverHeader.headerVersion = VK_PIPELINE_CACHE_HEADER_VERSION_ONE;
+	driverHeader.vendorID = properties.vendorID;
+	driverHeader.deviceID = properties.deviceID;
+	std::memcpy(driverHeader.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+	std::vector<uint8_t> data(sizeof(driverHeader) + 100);
+	std::memcpy(data.data(), &driverHeader, sizeof(driverHeader));
+	for (size_t i = sizeof(driverHeader); i < data.size(); i++)
+		data[i] = static_cast<uint8_t>(i * 7);
+
+	std::vector<uint8_t> file = packPipelineCacheFile(properties, data);
+	std::vector<uint8_t> unpacked;
+	ASSERT_TRUE(unpackPipelineCacheFile(file, properties, unpacked));
+	EXPECT_EQ(unpacked, data);
+
+	std::vector<uint8_t> corrupt = file;
+	corrupt.back() ^= 1;
+	EXPECT_FALSE(unpackPipelineCacheFile(corrupt, properties, unpacked));
+	std::vector<uint8_t> truncated(file.begin(), file.end() - 1);
+	EXPECT_FALSE(unpackPipelineCacheFile(truncated, properties, unpacked));
+	EXPECT_FALSE(unpackPipelineCacheFile({}, properties, unpacked));
+
+	VkPhysicalDeviceProperties updatedDriver = properties;
+	updatedDriver.driverVersion++;
+	EXPECT_FALSE(unpackPipelineCacheFile(file, updatedDriver, unpacked));
+	VkPhysicalDeviceProperties otherDevice = properties;
+	otherDevice.pipelineCacheUUID[3] ^= 0xff;
+	EXPECT_FALSE(unpackPipelineCacheFile(file, otherDevice, unpacked));
+
+	// a file whose checksum matches but whose driver header is from elsewhere
+	std::vector<uint8_t> foreignData = data;
+	foreignData[offsetof(VkPipelineCacheHeaderVersionOne, deviceID)] ^= 1;
+	EXPECT_FALSE(unpackPipelineCacheFile(packPipelineCacheFile(properties, foreignData), properties, unpacked));
+}
+
+TEST(PipelineThreadCachePoolTest, MergesEveryReleasedCacheOnce) {
+	std::vector<VkPipelineCache> created;
+	auto create = [&created]() {
+		created.push_back(reinterpret_cast<VkPipelineCache>(static_cast<uintptr_t>(created.size() + 1)));
+		return created.back();
+	};
+	PipelineThreadCachePool pool;
+
+	// concurrent jobs get caches of their own
+	VkPipelineCache first = pool.acquire(create);
+	VkPipelineCache second = pool.acquire(create);
+	EXPECT_NE(first, second);
+	EXPECT_EQ(created.size(), 2u);
+	// a cache in use is not merged
+	pool.release(first);
+	EXPECT_EQ(pool.takeUnmerged(), std::vector<VkPipelineCache>{ first });
+	EXPECT_TRUE(pool.takeUnmerged().empty());
+
+	// idle caches are reused and merged again after compiling more
+	EXPECT_EQ(pool.acquire(create), first);
+	pool.release(first);
+	pool.release(second);
+	EXPECT_EQ(created.size(), 2u);
+	std::vector<VkPipelineCache> unmerged = pool.takeUnmerged();
+	std::sort(unmerged.begin(), unmerged.end());
+	EXPECT_EQ(unmerged, created);
+	EXPECT_EQ(pool.getAll(), created);
+
+	pool.clear();
+	EXPECT_TRUE(pool.getAll().empty());
+	EXPECT_TRUE(pool.takeUnmerged().empty());
+}
+
+TEST(ShaderCacheTest, KeysEntriesAndFiles) {
+	ShaderCompileSettings settings;
+	uint64_t key = makeShaderCacheKey("void main() {}", 0, settings, 1);
+	EXPECT_EQ(key, makeShaderCacheKey("void main() {}", 0, settings, 1));
+	EXPECT_NE(key, makeShaderCacheKey("void main() { }", 0, settings, 1));
+	EXPECT_NE(key, makeShaderCacheKey("void main() {}", 1, settings, 1));
+	EXPECT_NE(key, makeShaderCacheKey("void main() {}", 0, settings, 2));
+	ShaderCompileSettings defined;
+	defined.defines = { { "SKINNED", "1" } };
+	EXPECT_NE(key, makeShaderCacheKey("void main() {}", 0, defined, 1));
+	ShaderCompileSettings optimized;
+	optimized.optimize = true;
+	EXPECT_NE(key, makeShaderCacheKey("void main() {}", 0, optimized, 1));
+
+	ShaderCacheEntry entry;
+	entry.code = { 0x07230203, 0x00010000, 1, 2, 3 };
+	entry.reflection.stage = VK_SHADER_STAGE_VERTEX_BIT;
+	entry.reflection.bindings = { { 0, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 }, { 1, 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4 } };
+	entry.reflection.pushConstantRanges = { { VK_SHADER_STAGE_VERTEX_BIT, 0, 64 } };
+	entry.reflection.inputs = { { 0, VK_FORMAT_R32G32B32_SFLOAT }, { 2, VK_FORMAT_R32G32_SFLOAT } };
+	entry.reflection.outputs = { { 0, VK_FORMAT_R32G32B32A32_SFLOAT } };
+
+	std::vector<uint8_t> file = packShaderCacheEntry(key, entry);
+	ShaderCacheEntry unpacked;
+	ASSERT_TRUE(unpackShaderCacheEntry(file, key, unpacked));
+	EXPECT_EQ(unpacked.code, entry.code);
+	EXPECT_EQ(unpacked.reflection.stage, VK_SHADER_STAGE_VERTEX_BIT);
+	ASSERT_EQ(unpacked.reflection.bindings.size(), 2u);
+	EXPECT_EQ(unpacked.reflection.bindings[1].set, 1u);
+	EXPECT_EQ(unpacked.reflection.bindings[1].descriptorCount, 4u);
+	ASSERT_EQ(unpacked.reflection.pushConstantRanges.size(), 1u);
+	EXPECT_EQ(unpacked.reflection.pushConstantRanges[0].size, 64u);
+	ASSERT_EQ(unpacked.reflection.inputs.size(), 2u);
+	EXPECT_EQ(unpacked.reflection.inputs[1].location, 2u);
+	EXPECT_EQ(unpacked.reflection.outputs.size(), 1u);
+
+	std::vector<uint8_t> corrupt = file;
+	corrupt.back() ^= 1;
+	EXPECT_FALSE(unpackShaderCacheEntry(corrupt, key, unpacked));
+	std::vector<uint8_t> truncated(file.begin(), file.end() - 1);
+	EXPECT_FALSE(unpackShaderCacheEntry(truncated, key, unpacked));
+	EXPECT_FALSE(unpackShaderCacheEntry(file, key + 1, unpacked));
+
+	// a second cache over the same directory starts from the files
+	std::filesystem::path directory = std::filesystem::temp_directory_path() / "rehti_shader_cache_test";
+	std::filesystem::remove_all(directory);
+	{
+		ShaderCache cache;
+		cache.initialize(directory.string());
+		EXPECT_FALSE(cache.find(key, unpacked));
+		cache.store(key, entry);
+		EXPECT_TRUE(cache.find(key, unpacked));
+		EXPECT_EQ(cache.getStats().memoryHits, 1u);
+	}
+	ShaderCache reopened;
+	reopened.initialize(directory.string());
+	ASSERT_TRUE(reopened.find(key, unpacked));
+	EXPECT_EQ(unpacked.code, entry.code);
+	EXPECT_EQ(reopened.getStats().diskHits, 1u);
+	EXPECT_TRUE(reopened.find(key, unpacked));
+	EXPECT_EQ(reopened.getStats().memoryHits, 1u);
+
+	// racing stores of one key each write their own temporary file, so the file left behind is whole
+	{
+		std::vector<std::thread> writers;
+		for (int t = 0; t < 4; t++)
+			writers.emplace_back([&]() {
+				for (int i = 0; i < 20; i++)
+					reopened.store(key, entry);
+			});
+		for (std::thread& writer : writers)
+			writer.join();
+	}
+	ShaderCache raced;
+	raced.initialize(directory.string());
+	ASSERT_TRUE(raced.find(key, unpacked));
+	EXPECT_EQ(unpacked.code, entry.code);
+	size_t fileCount = std::distance(std::filesystem::directory_iterator(directory), std::filesystem::directory_iterator());
+	EXPECT_EQ(fileCount, 1u);
+	std::filesystem::remove_all(directory);
+}
+
+TEST(ShaderReflectionTest, VertexInputsGiveTheLayoutOfTheMeshShaders) {
+	auto reflectVertexShader = [](const char* name) {
+		PipelineShaderInfo info;
+		const EmbeddedShader* shader = findEmbeddedShader(name);
+		EXPECT_NE(shader, nullptr) << name;
+		if (shader == nullptr)
+			return info;
+		CompiledShaderData vertex{};
+		vertex.inputAttributes = toShaderInterfaceVariables(std::vector<ShaderInterfaceReflection>(shader->inputs, shader->inputs + shader->inputCount), true);
+		info.vertexShaderData = vertex;
+		return info;
+	};
+
+	PipelineShaderInfo mesh = reflectVertexShader("gpu_driven.vert");
+	EXPECT_EQ(mesh.getAttributes(), FLAG_POSITION | FLAG_NORMAL);
+	EXPECT_EQ(mesh.getStride(), 2 * sizeof(glm::vec3));
+
+	// texture coordinates are read at location 2 but packed after the color in enum order, which the mesh lacks
+	PipelineShaderInfo skinned = reflectVertexShader("skinned.vert");
+	VertexAttributeFlags skinnedAttributes = FLAG_POSITION | FLAG_NORMAL | FLAG_TEXCOORD | FLAG_JOINTS | FLAG_WEIGHTS;
+	EXPECT_EQ(skinned.getAttributes(), skinnedAttributes);
+	EXPECT_EQ(skinned.getStride(), sizeof(BasicCharacterVertex));
+	std::vector<VkVertexInputAttributeDescription> descriptions = skinned.getVertexAttributes();
+	ASSERT_EQ(descriptions.size(), 5u);
+	EXPECT_EQ(descriptions[2].location, 2u);
+	EXPECT_EQ(descriptions[2].offset, offsetof(BasicCharacterVertex, texCoord));
+	EXPECT_EQ(descriptions[3].offset, offsetof(BasicCharacterVertex, joints));
+	EXPECT_EQ(descriptions[4].offset, offsetof(BasicCharacterVertex, weights));
+
+	// locations without a variable are no attribute at all
+	std::vector<ShaderInterfaceVariable> sparse = toShaderInterfaceVariables({ { 0, VK_FORMAT_R32G32B32_SFLOAT }, { 2, VK_FORMAT_R32G32_SFLOAT } }, true);
+	ASSERT_EQ(sparse.size(), 3u);
+	EXPECT_EQ(sparse[1].first, VertexAttributeEnum::UNDEFINED);
+	EXPECT_EQ(sparse[2].first, VertexAttributeEnum::TEXCOORD);
+}
+
+TEST(FileWatcherTest, ReportsWrittenFilesOnce) {
+	std::filesystem::path directory = std::filesystem::temp_directory_path() / "rehti_file_watcher_test";
+	std::filesystem::remove_all(directory);
+	std::filesystem::create_directories(directory);
+	std::ofstream(directory / "existing.frag") << "void main() {}";
+
+	FileWatcher watcher;
+	ASSERT_TRUE(watcher.initialize(directory.string(), std::chrono::milliseconds(0)));
+	EXPECT_TRUE(watcher.poll().empty());
+
+	// the polling fallback compares modification times, make sure the rewrite gets a newer one
+	auto earlier = std::filesystem::last_write_time(directory / "existing.frag") - std::chrono::seconds(10);
+	std::filesystem::last_write_time(directory / "existing.frag", earlier);
+	watcher.poll();
+	std::ofstream(directory / "existing.frag") << "void main() { }";
+	std::ofstream(directory / "existing.frag") << "void main() {  }";
+	std::ofstream(directory / "added.vert") << "void main() {}";
+
+	std::vector<std::string> changed = watcher.poll();
+	std::vector<std::string> expected = { (directory / "added.vert").string(), (directory / "existing.frag").string() };
+	EXPECT_EQ(changed, expected);
+	EXPECT_TRUE(watcher.poll().empty());
+
+	watcher.cleanup();
+	EXPECT_FALSE(watcher.isWatching());
+	std::filesystem::remove_all(directory);
+}
+
 int main(int argc, char** argv) {
 	::testing::InitGoogleTest(&argc, argv);
 	return RUN_ALL_TESTS();